@@ -46,6 +46,14 @@
 #include <modelAnim.h>					// Clase para cargar y renderizar modelos animados (ej. .dae de Mixamo)
 #include <model.h>						// Clase para cargar y renderizar modelos estáticos (ej. .obj)
 #include <Skybox.h>						// Clase para renderizar el entorno (cielo/fondo)
+#include <gallery.h>					// Galería de pinturas: arreglo de texturas y una sola llamada instanciada
+#include <crowd.h>						// Multitudes de visitantes: clips horneados en textura, una llamada instanciada por malla
+#include <memoryStats.h>				// Memoria residente del proceso (pico y actual)
+#include <memoryLedger.h>				// Contabilidad de memoria CPU/GPU por dueño y categoría (JSON, fugas al cerrar)
+#include <jobSystem.h>					// Grupo de hilos para la fase de actualización (tareas con dependencias)
+#ifdef MUSEO_BENCHMARKS
+#include <vertexConvert.h>				// Microbenchmark de la conversion de vertices
+#endif
 #include <iostream>						// Para entrada/salida en consola (std::cout)
 #include <mmsystem.h>					// Librería multimedia de Windows (complementa a Windows.h)
 #include <vector>						// Para manejar arreglos dinámicos (usado para el enjambre de mariposas)
@@ -61,7 +69,12 @@ void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);  // Se
 void my_input(GLFWwindow* window, int key, int scancode, int action, int mods); // Se llama al presionar/soltar una tecla
 
 // Funciones de control y utilitarias
-void animate(void);                                                       // Actualiza todas las variables de animación por frame
+float factorVelocidad(void);                                              // Factor que compensa las variaciones de deltaTime
+void animarCaballete(float speedFactor);                                  // Tareas de la fase de actualización, una por sistema
+void animarFoco(float speedFactor);
+void animarSilla(float speedFactor);
+void animarPincel(float speedFactor);
+void animarMariposas(float tiempo);
 void getResolution(void);                                                 // Obtiene la resolución del monitor principal
 void myData(void);                                                        // Configura VAOs/VBOs para geometrías primitivas (piso, lienzo)
 void LoadTextures(void);                                                  // Carga las texturas desde archivos
@@ -142,7 +155,7 @@ float adornoRot = 0.0f;
 float pinturaRotZ = 0.0f; // Rotación Z (eje frontal) de la pintura
 
 // --- Incrementos de Animación: CABALLETE (Calculados por interpolación) ---
-// Estos valores se calculan en `interpolation()` y se aplican en `animate()`
+// Estos valores se calculan en `interpolation()` y se aplican en `animarCaballete()`
 float incX = 0.0f, incY = 0.0f, incZ = 0.0f; // Incrementos de posición general
 
 // Incrementos de posición (offset Y)
@@ -339,6 +352,8 @@ struct Mariposa {
 
 // Vector que almacena todas las mariposas
 std::vector<Mariposa> enjambre;
+// Matriz de modelo de cada mariposa en el cuadro actual (calculada por animarMariposas())
+std::vector<glm::mat4> modelosMariposas;
 
 /**
  * @brief Genera un conjunto de mariposas con parámetros aleatorios
@@ -386,7 +401,7 @@ bool playPincel = false;          // Bandera: ¿Se está animando el pincel?
 bool firstPlayPincel = true;      // Bandera para reiniciar
 int i_max_steps_pincel = 30;      // Pasos de interpolación
 
-// Posición y rotación actual del pincel (actualizadas en animate())
+// Posición y rotación actual del pincel (actualizadas en animarPincel())
 float posPincelX = 2875.0f;
 float posPincelY = 380.0f;
 float posPincelZ = -1000.0f;
@@ -437,6 +452,9 @@ unsigned int generateTextures(const char* filename, bool alfa, bool isPrimitive)
 			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
 
 		glGenerateMipmap(GL_TEXTURE_2D);
+		// 4 bytes por texel (el driver rellena RGB) más un tercio para los mips
+		gpuResources().allocate(GPU_RESOURCE_TEXTURE, textureID, (size_t)width * height * 4 * 4 / 3, filename);
+		stbi_image_free(data); // Libera la memoria de la imagen cargada
 		return textureID;
 	}
 	else
@@ -444,8 +462,6 @@ unsigned int generateTextures(const char* filename, bool alfa, bool isPrimitive)
 		std::cout << "Failed to load texture" << std::endl;
 		return 100;
 	}
-
-	stbi_image_free(data); // Libera la memoria de la imagen cargada
 }
 
 /**
@@ -472,21 +488,28 @@ float focoIntensidad = 20.0f; // Intensidad (se anima)
 bool focoSubiendo = true;   // Dirección de la animación de intensidad
 
 //-------------------------------------------------------------------------------------
-// 11. FUNCIÓN DE ANIMACIÓN PRINCIPAL (animate)
+// 11. FUNCIONES DE ANIMACIÓN (Fase de actualización)
 //-------------------------------------------------------------------------------------
+// Cada sistema es una tarea del grupo de hilos (ver jobSystem.h): el bucle principal las agrega cada
+// fotograma junto con las de los personajes y espera a que terminen antes de dibujar. Cada una escribe
+// solo sus propias variables, así que pueden correr al mismo tiempo.
 
 /**
- * @brief Se llama en cada fotograma desde el bucle principal.
- * Actualiza todas las variables de estado para las animaciones
- * (Caballete, Silla, Pincel, Foco).
+ * @brief Factor de velocidad para compensar variaciones en deltaTime.
+ * Se calcula una vez por fotograma, antes de repartir las tareas.
  */
-void animate(void)
+float factorVelocidad(void)
 {
-	// Factor de velocidad para compensar variaciones en deltaTime
 	float speedFactor = 1.0f;
 	if (deltaTime > 0.0) speedFactor = float(deltaTime * 80.0);
-	speedFactor = glm::clamp(speedFactor, 0.1f, 5.0f); // Limita el factor
+	return glm::clamp(speedFactor, 0.1f, 5.0f); // Limita el factor
+}
 
+/**
+ * @brief Avanza la interpolación de los keyframes del caballete.
+ */
+void animarCaballete(float speedFactor)
+{
 	// ==========================================================
 	// 1. ANIMACIÓN DEL CABALLETE (Interpolación Lineal Simple)
 	// ==========================================================
@@ -545,7 +568,13 @@ void animate(void)
 			i_curr_steps++; // Avanza un paso de interpolación
 		}
 	}
+}
 
+/**
+ * @brief Oscila la intensidad de la luz focal.
+ */
+void animarFoco(float speedFactor)
+{
 	// ==========================================================
 	// 2. ANIMACIÓN DEL FOCO (Oscilación de Intensidad)
 	// ==========================================================
@@ -557,7 +586,13 @@ void animate(void)
 		focoIntensidad -= 0.02f * speedFactor;
 		if (focoIntensidad <= 0.0f) focoSubiendo = true;
 	}
+}
 
+/**
+ * @brief Balancea la silla mecedora entre sus keyframes.
+ */
+void animarSilla(float speedFactor)
+{
 	// ==========================================================
 	// 3. ANIMACIÓN DE LA SILLA MECEDORA (Interpolación LERP Cíclica)
 	// ==========================================================
@@ -593,7 +628,13 @@ void animate(void)
 	else {
 		firstPlaySilla = true; // Prepara para el reinicio
 	}
+}
 
+/**
+ * @brief Mueve el pincel entre sus keyframes y cambia la pintura del lienzo.
+ */
+void animarPincel(float speedFactor)
+{
 	// ==========================================================
 	// 4. ANIMACIÓN DEL PINCEL (LERP Cíclica + Cambio de Textura)
 	// ==========================================================
@@ -644,6 +685,30 @@ void animate(void)
 	}
 }
 
+/**
+ * @brief Calcula la matriz de modelo de cada mariposa del enjambre en el instante tiempo.
+ */
+void animarMariposas(float tiempo)
+{
+	modelosMariposas.resize(enjambre.size());
+	for (size_t i = 0; i < enjambre.size(); i++) {
+		const Mariposa& m = enjambre[i];
+		// Calcula el movimiento oscilante usando seno y coseno
+		float vueloX = sin(tiempo * m.velocidad + m.fase) * 100.0f;
+		float vueloY = sin(tiempo * 2.0f * m.velocidad + m.fase) * 30.0f;
+		float vueloZ = cos(tiempo * m.velocidad + m.fase) * 100.0f;
+
+		glm::vec3 posActual = m.posicionBase + glm::vec3(vueloX, vueloY, vueloZ);
+		float rotY = sin(tiempo * m.velocidad + m.fase) * 45.0f;
+
+		glm::mat4 modelOp = glm::mat4(1.0f);
+		modelOp = glm::translate(modelOp, posActual);
+		modelOp = glm::rotate(modelOp, glm::radians(rotY), glm::vec3(0.0f, 1.0f, 0.0f));
+		modelOp = glm::scale(modelOp, glm::vec3(m.escala));
+		modelosMariposas[i] = modelOp;
+	}
+}
+
 
 //-------------------------------------------------------------------------------------
 // 12. FUNCIONES DE CONFIGURACIÓN INICIAL
@@ -746,6 +811,13 @@ void myData() {
 	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)(3 * sizeof(float)));
 	glEnableVertexAttribArray(1);
 
+	// Se registran en el presupuesto de VRAM (ver gpuResources.h)
+	gpuResources().allocate(GPU_RESOURCE_BUFFER, VBO[0], sizeof(vertices), "cuadro");
+	gpuResources().allocate(GPU_RESOURCE_BUFFER, EBO[0], sizeof(indices), "cuadro");
+	gpuResources().allocate(GPU_RESOURCE_BUFFER, VBO[2], sizeof(verticesPiso), "piso");
+	gpuResources().allocate(GPU_RESOURCE_BUFFER, EBO[2], sizeof(indicesPiso), "piso");
+	gpuResources().allocate(GPU_RESOURCE_BUFFER, VBO[1], sizeof(verticesCubo), "cubo");
+
 	// Desvincula los buffers
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 	glBindVertexArray(0);
@@ -803,6 +875,7 @@ int main() {
 	Shader staticShader("Shaders/shader_Lights.vs", "Shaders/shader_Lights_mod.fs");		// Para modelos 3D estáticos (con luces)
 	Shader skyboxShader("Shaders/skybox.vs", "Shaders/skybox.fs");							// Para el skybox
 	Shader animShader("Shaders/anim.vs", "Shaders/anim.fs");								// Para modelos 3D animados (Mixamo)
+	Shader galleryShader("Shaders/gallery.vs", "Shaders/gallery.fs");						// Para la galería de pinturas (instanciada)
 
 	// =========================================================================
 	// 5. CONFIGURACIÓN DEL SKYBOX
@@ -823,33 +896,40 @@ int main() {
 	// 6. CARGA DE MODELOS 3D
 	// =========================================================================
 
+#ifdef MUSEO_BENCHMARKS
+	// Compara la conversion de vertices original con la version por lotes (SSE2 + hilos) sobre la malla mas grande
+	benchmarkVertexConversion("resources/objects/Plantas/matteucia.obj", 10);
+	// El cargador OBJ debe dar las mismas mallas sin importar en cuantos trozos se divida el archivo
+	benchmarkObjLoader("resources/objects/Museo_Casa_Azul/museo_frida_kahlo.obj", 10);
+#endif
+
+	// Calidad de texturas por categoría (MUSEO_TEXTURE_QUALITY=full|half|quarter): los cuadros se quedan completos,
+	// utilería y plantas se reducen al decodificar en los equipos con poca VRAM (ver textureQuality.h)
+	textureQuality().printSettings();
+
+	// Las texturas de los modelos se decodifican en hilos y se suben por PBO durante el bucle (ver textureStreamer.h)
+	textureStreamer().start();
+	// Hilos de la fase de actualización de cada cuadro (MUSEO_JOB_THREADS=0 la corre en el hilo principal)
+	jobSystem().start();
+	// Los cuadros que se ven de cerca se dibujan con texturas virtuales: solo las páginas visibles de sus
+	// escaneos ocupan VRAM (ver virtualTexture.h). El escaneo se corta en páginas la primera vez.
+	virtualTextures().start();
+	virtualTextures().setupProgram(staticShader);
+	virtualTextures().setupProgram(galleryShader);
+	virtualTextures().addScan("resources/objects/Arte/Pinturas01/dos-fridas.jpg");
+	virtualTextures().addScan("resources/objects/Arte/Pinturas02/viva-la-vida.jpg");
+
+	// Memoria residente antes de importar, para medir el costo real de la carga
+	size_t rssAntesCarga = getCurrentRSS();
+
 	// --- Escenario Principal ---
 	Model museo("resources/objects/Museo_Casa_Azul/museo_frida_kahlo.obj");
 
-	// --- Colección de Pinturas (Agrupadas por carpetas) ---
-	Model pintura_01("resources/objects/Arte/Pinturas01/autorretrato-con-pelo-corto.obj");
-	Model pintura_02("resources/objects/Arte/Pinturas01/autorretrato-con-stalin.obj");
-	Model pintura_03("resources/objects/Arte/Pinturas01/autorretrato-mono-plantas.obj");
-	Model pintura_04("resources/objects/Arte/Pinturas01/autorretrato-pelo-rizado.obj");
-	Model pintura_05("resources/objects/Arte/Pinturas01/columna-rota.obj");
-	Model pintura_06("resources/objects/Arte/Pinturas01/dos-fridas.obj");
-	Model pintura_07("resources/objects/Arte/Pinturas01/yo-y-mi-munieca.obj");
-
-	Model pintura_08("resources/objects/Arte/Pinturas02/viva-la-vida.obj");
-	Model pintura_09("resources/objects/Arte/Pinturas02/pintura-tunas.obj");
-	Model pintura_10("resources/objects/Arte/Pinturas02/pintura-cocos.obj");
-	Model pintura_11("resources/objects/Arte/Pinturas02/abuelos.obj");
-	Model pintura_12("resources/objects/Arte/Pinturas02/mi-nacimiento.obj");
-	Model pintura_13("resources/objects/Arte/Pinturas02/mascara-de-muerte.obj");
-	Model pintura_14("resources/objects/Arte/Pinturas02/frida-y-diego.obj");
-
-	Model pintura_15("resources/objects/Arte/Pinturas03/suicidio-dorothy-hale.obj");
-	Model pintura_16("resources/objects/Arte/Pinturas03/memoria-el-corazon.obj");
-	Model pintura_17("resources/objects/Arte/Pinturas03/yo-y-mis-pericos.obj");
-	Model pintura_18("resources/objects/Arte/Pinturas03/luther-burbank.obj");
-	Model pintura_19("resources/objects/Arte/Pinturas03/la-mascara.obj");
-	Model pintura_20("resources/objects/Arte/Pinturas03/diego-y-yo.obj");
-	Model pintura_21("resources/objects/Arte/Pinturas03/marxismo.obj");
+	// --- Colección de Pinturas ---
+	// Todas las obras salen de galeria.txt (imagen, marco, medidas y posición) y se dibujan con una sola
+	// llamada instanciada: los lienzos son capas de un arreglo de texturas (ver gallery.h)
+	gallery().load("resources/objects/Arte/galeria.txt");
+	gallery().setupProgram(galleryShader);
 
 	// --- Vitrinas ---
 	Model vitrina_01("resources/objects/Vitrinas/Vitrina01.obj");
@@ -863,10 +943,24 @@ int main() {
 	Model pincel("resources/objects/Pincel/pincel.obj");
 
 	// --- Modelos Animados (Mixamo) ---
-	ModelAnim hombre_sentado("resources/objects/Hombre_Sentado_Banca/hombre-sentado.dae");
+	// La escena importada se libera al cargar (queda el clip comprimido); el benchmark la necesita
+#ifdef MUSEO_BENCHMARKS
+	const bool conservarEscena = true;
+#else
+	const bool conservarEscena = false;
+#endif
+	ModelAnim hombre_sentado("resources/objects/Hombre_Sentado_Banca/hombre-sentado.dae", false, RESIDENCY_GPU_ONLY, conservarEscena);
 	hombre_sentado.initShaders(animShader.ID); // Vincula el modelo al shader de animación
 	ModelAnim mujer_sentada("resources/objects/Mujer_Sentada_Banca/mujer-sentada.dae");
 	mujer_sentada.initShaders(animShader.ID);
+	boneBuffer().setupProgram(animShader);			// las poses de todos los personajes se leen del mismo buffer de huesos
+
+	// --- Visitantes (multitudes con los mismos personajes, animadas en la GPU; ver crowd.h) ---
+	Crowd visitantesHombre(hombre_sentado, "hombre_sentado");
+	Crowd visitantesMujer(mujer_sentada, "mujer_sentada");
+	std::map<std::string, Crowd*> multitudes = { { "hombre_sentado", &visitantesHombre }, { "mujer_sentada", &visitantesMujer } };
+	loadCrowds("resources/objects/visitantes.txt", multitudes);
+	visitantesHombre.setupProgram(animShader);	// la unidad de la textura de animación es la misma para todas
 
 	// --- Caballete (Cargado por partes para animación por keyframes) ---
 	Model adorno("resources/objects/Caballete/adorno.obj");
@@ -890,18 +984,61 @@ int main() {
 	Model flor_anemonas("resources/objects/Plantas/flor_anemonas.obj");
 	Model flor_nieve("resources/objects/Plantas/flor_nieve.obj");
 
+	// --- Reporte de memoria por modelo (CPU / GPU) ---
+	// Las copias en CPU de la geometría se liberan al subirla a la GPU; un modelo que las necesite
+	// (picking, colisiones) debe pedirlas con acquireCpuData() y se recargan desde el .meshcache.
+	std::vector<std::pair<const char*, Model*>> modelosCargados = {
+		{ "museo", &museo },
+		{ "vitrina_01", &vitrina_01 }, { "vitrina_02", &vitrina_02 }, { "vitrina_03", &vitrina_03 },
+		{ "banca", &banca }, { "silla_mecedora", &silla_mecedora }, { "lampara", &lampara }, { "pincel", &pincel },
+		{ "adorno", &adorno }, { "base", &base }, { "pataderecha", &pataderecha }, { "pataizquierda", &pataizquierda },
+		{ "patatrasera", &patatrasera }, { "pintura", &pintura }, { "soportetrasero", &soportetrasero },
+		{ "caballete_completo", &caballete_completo }, { "mariposa", &mariposa }, { "matteucia", &matteucia },
+		{ "phormium", &phormium }, { "arbol_generico", &arbol_generico }, { "arbol_basico", &arbol_basico },
+		{ "arbol_primaveral", &arbol_primaveral }, { "maceta", &maceta }, { "rosa", &rosa },
+		{ "flor_narciso", &flor_narciso }, { "flor_anemonas", &flor_anemonas }, { "flor_nieve", &flor_nieve }
+	};
+	size_t totalCPU = 0, totalGPU = 0;
+	for (auto& modelo : modelosCargados) {
+		modelo.second->printMemoryReport(modelo.first);
+		totalCPU += modelo.second->cpuBytes();
+		totalGPU += modelo.second->gpuBytes();
+	}
+	hombre_sentado.printMemoryReport("hombre_sentado");
+#ifdef MUSEO_BENCHMARKS
+	// Poses desde el clip comprimido contra la evaluacion clave por clave de Assimp
+	benchmarkBoneEvaluation(hombre_sentado, "hombre_sentado", 1000);
+	hombre_sentado.releaseScene();
+#endif
+	mujer_sentada.printMemoryReport("mujer_sentada");
+	std::cout << "MEMORY::TOTAL:: modelos estaticos  cpu: " << totalCPU / 1024 << " KB  gpu: " << totalGPU / 1024 << " KB" << std::endl;
+	std::cout << "MEMORY::RSS:: antes de cargar: " << rssAntesCarga / (1024 * 1024) << " MB  despues: " << getCurrentRSS() / (1024 * 1024)
+		<< " MB  pico: " << getPeakRSS() / (1024 * 1024) << " MB" << std::endl;
+	// Texturas compartidas entre modelos (mismo contenido en distintas carpetas se sube una sola vez)
+	textureRegistry().printReport();
+	textureResidency().printReport();
+	virtualTextures().printReport();
+	gallery().printReport();
+	visitantesHombre.printReport();
+	visitantesMujer.printReport();
+	gpuResources().printReport();
+	memoryLedger().printReport();
+
 	// =========================================================================
 	// 7. INICIALIZACIÓN DE AUDIO (MINIAUDIO)
 	// =========================================================================
 	ma_engine engine;
+	ma_sound sonido;	// Vive hasta la limpieza, el motor lo sigue reproduciendo
+	bool audioIniciado = false, sonidoCargado = false;
 	if (ma_engine_init(NULL, &engine) != MA_SUCCESS) {
 		std::cerr << "Error al inicializar el motor de audio." << std::endl;
 	}
 	else {
-		ma_sound sonido;
+		audioIniciado = true;
 		// Carga el archivo de audio
 		if (ma_sound_init_from_file(&engine, "resources/Audio/la_bruja_son_jarocho.mp3",
 			0, NULL, NULL, &sonido) == MA_SUCCESS) {
+			sonidoCargado = true;
 			ma_sound_set_looping(&sonido, MA_TRUE);  // Configura para repetirse
 			ma_sound_start(&sonido); // Inicia la reproducción
 		}
@@ -1056,14 +1193,12 @@ int main() {
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(-2200.0f, 121.5f, -2150.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(60.0f, 39.1f, 60.0f));
-		staticShader.setMat4("model", modelOp);
-		banca.Draw(staticShader);
+		banca.Draw(staticShader, modelOp);
 
 		// --- MUSEO ---
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(-27.0f, 1.5f, 5.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(50.0f));
-		staticShader.setMat4("model", modelOp);
-		museo.Draw(staticShader);
+		museo.Draw(staticShader, modelOp);
 
 		// --- VEGETACIÓN (Bucles para crear múltiples instancias) ---
 		for (int i = 0; i < 9; i++) {
@@ -1074,8 +1209,7 @@ int main() {
 			glm::mat4 modelOp = glm::mat4(1.0f);
 			modelOp = glm::translate(modelOp, glm::vec3(posX, posY, posZ));
 			modelOp = glm::scale(modelOp, glm::vec3(20.0f));
-			staticShader.setMat4("model", modelOp);
-			phormium.Draw(staticShader);
+			phormium.Draw(staticShader, modelOp);
 		}
 
 
@@ -1087,8 +1221,7 @@ int main() {
 			glm::mat4 modelOp = glm::mat4(1.0f);
 			modelOp = glm::translate(modelOp, glm::vec3(posX, posY, posZ));
 			modelOp = glm::scale(modelOp, glm::vec3(20.0f));
-			staticShader.setMat4("model", modelOp);
-			phormium.Draw(staticShader);
+			phormium.Draw(staticShader, modelOp);
 		}
 
 		for (int i = 0; i < 7; i++) {
@@ -1101,8 +1234,7 @@ int main() {
 			modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 			modelOp = glm::scale(modelOp, glm::vec3(60.0f, 150.1f, 60.0f));
 
-			staticShader.setMat4("model", modelOp);
-			arbol_basico.Draw(staticShader);
+			arbol_basico.Draw(staticShader, modelOp);
 		}
 
 		struct LineaMatteucia {
@@ -1135,8 +1267,7 @@ int main() {
 				modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 				modelOp = glm::scale(modelOp, glm::vec3(20.0f));
 
-				staticShader.setMat4("model", modelOp);
-				matteucia.Draw(staticShader);
+				matteucia.Draw(staticShader, modelOp);
 			}
 		}
 
@@ -1171,8 +1302,7 @@ int main() {
 				modelOp = glm::translate(modelOp, glm::vec3(posX, posY, posZ));
 				modelOp = glm::scale(modelOp, glm::vec3(50.0f));
 
-				staticShader.setMat4("model", modelOp);
-				arbol_generico.Draw(staticShader);
+				arbol_generico.Draw(staticShader, modelOp);
 			}
 		}
 
@@ -1207,8 +1337,7 @@ int main() {
 				modelOp = glm::rotate(modelOp, glm::radians(80.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 				modelOp = glm::scale(modelOp, glm::vec3(2.0f));
 
-				staticShader.setMat4("model", modelOp);
-				rosa.Draw(staticShader);
+				rosa.Draw(staticShader, modelOp);
 			}
 		}
 
@@ -1244,8 +1373,7 @@ int main() {
 				modelOp = glm::rotate(modelOp, glm::radians(180.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 				modelOp = glm::scale(modelOp, glm::vec3(35.0f));
 
-				staticShader.setMat4("model", modelOp);
-				flor_nieve.Draw(staticShader);
+				flor_nieve.Draw(staticShader, modelOp);
 			}
 		}
 
@@ -1258,8 +1386,7 @@ int main() {
 			modelOp = glm::translate(modelOp, glm::vec3(posX, posY, posZ));
 			modelOp = glm::scale(modelOp, glm::vec3(40.0f, 60.0f, 40.0f));
 
-			staticShader.setMat4("model", modelOp);
-			arbol_primaveral.Draw(staticShader);
+			arbol_primaveral.Draw(staticShader, modelOp);
 		}
 
 
@@ -1271,8 +1398,7 @@ int main() {
 			glm::mat4 modelOp = glm::mat4(1.0f);
 			modelOp = glm::translate(modelOp, glm::vec3(posX, posY, posZ));
 			modelOp = glm::scale(modelOp, glm::vec3(20.0f));
-			staticShader.setMat4("model", modelOp);
-			phormium.Draw(staticShader);
+			phormium.Draw(staticShader, modelOp);
 		}
 
 		for (int i = 0; i < 10; i++) {
@@ -1283,8 +1409,7 @@ int main() {
 			glm::mat4 modelOp = glm::mat4(1.0f);
 			modelOp = glm::translate(modelOp, glm::vec3(posX, posY, posZ));
 			modelOp = glm::scale(modelOp, glm::vec3(20.0f));
-			staticShader.setMat4("model", modelOp);
-			phormium.Draw(staticShader);
+			phormium.Draw(staticShader, modelOp);
 		}
 
 		for (int i = 0; i < 10; i++) {
@@ -1295,8 +1420,7 @@ int main() {
 			glm::mat4 modelOp = glm::mat4(1.0f);
 			modelOp = glm::translate(modelOp, glm::vec3(posX, posY, posZ));
 			modelOp = glm::scale(modelOp, glm::vec3(20.0f));
-			staticShader.setMat4("model", modelOp);
-			phormium.Draw(staticShader);
+			phormium.Draw(staticShader, modelOp);
 		}
 
 		for (int i = 0; i < 6; i++) {
@@ -1308,8 +1432,7 @@ int main() {
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 			modelOp = glm::scale(modelOp, glm::vec3(5.0f, 5.0f, 8.0f));
-			staticShader.setMat4("model", modelOp);
-			flor_anemonas.Draw(staticShader);
+			flor_anemonas.Draw(staticShader, modelOp);
 		}
 
 		for (int i = 0; i < 6; i++) {
@@ -1321,8 +1444,7 @@ int main() {
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 			modelOp = glm::scale(modelOp, glm::vec3(5.0f, 5.0f, 8.0f));
-			staticShader.setMat4("model", modelOp);
-			flor_anemonas.Draw(staticShader);
+			flor_anemonas.Draw(staticShader, modelOp);
 		}
 
 		for (int i = 0; i < 6; i++) {
@@ -1334,8 +1456,7 @@ int main() {
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 			modelOp = glm::scale(modelOp, glm::vec3(5.0f, 5.0f, 8.0f));
-			staticShader.setMat4("model", modelOp);
-			flor_anemonas.Draw(staticShader);
+			flor_anemonas.Draw(staticShader, modelOp);
 		}
 
 		for (int i = 0; i < 5; i++) {
@@ -1347,8 +1468,7 @@ int main() {
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 			modelOp = glm::scale(modelOp, glm::vec3(28.0f));
-			staticShader.setMat4("model", modelOp);
-			flor_narciso.Draw(staticShader);
+			flor_narciso.Draw(staticShader, modelOp);
 
 		}
 
@@ -1361,191 +1481,107 @@ int main() {
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(1.0f, 0.0f, 0.0f));
 			modelOp = glm::rotate(modelOp, glm::radians(-90.0f), glm::vec3(0.0f, 0.0f, 1.0f));
 			modelOp = glm::scale(modelOp, glm::vec3(28.0f));
-			staticShader.setMat4("model", modelOp);
-			flor_narciso.Draw(staticShader);
+			flor_narciso.Draw(staticShader, modelOp);
 
 		}
 
 		// --- MACETAS ---
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(880.0f, 140.0f, -3550.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(180.0f));
-		staticShader.setMat4("model", modelOp);
-		maceta.Draw(staticShader);
+		maceta.Draw(staticShader, modelOp);
 
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2210.0f, 140.0f, -3550.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(180.0f));
-		staticShader.setMat4("model", modelOp);
-		maceta.Draw(staticShader);
+		maceta.Draw(staticShader, modelOp);
 
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2520.0f, 140.0f, -2070.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(180.0f));
-		staticShader.setMat4("model", modelOp);
-		maceta.Draw(staticShader);
+		maceta.Draw(staticShader, modelOp);
 
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2530.0f, 140.0f, -800.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(180.0f));
-		staticShader.setMat4("model", modelOp);
-		maceta.Draw(staticShader);
+		maceta.Draw(staticShader, modelOp);
 
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(1370.0f, 140.0f, -1250.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(180.0f));
-		staticShader.setMat4("model", modelOp);
-		maceta.Draw(staticShader);
+		maceta.Draw(staticShader, modelOp);
 
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(400.0f, 140.0f, -800.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(180.0f));
-		staticShader.setMat4("model", modelOp);
-		maceta.Draw(staticShader); 
+		maceta.Draw(staticShader, modelOp);
 		
-		// --- PINTURAS (Posicionadas una por una) ---
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(1095.0f, 580.0f, -3625.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_01.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(1280.0f, 380.0f, -3070.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_02.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2235.0f, 580.0f, -3625.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_03.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(1280.0f, 580.0f, -3070.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(70.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_04.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2970.0f, 580.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(80.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_05.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2770.0f, 580.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_06.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2580.0f, 580.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_07.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2240.0f, 420.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_08.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(1460.0f, 370.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_09.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2200.0f, 390.0f, -3070.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(113.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_10.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(1460.0f, 540.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_11.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2200.0f, 580.0f, -3070.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_12.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2240.0f, 580.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_13.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(610.0f, 580.0f, -3370.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_14.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(1640.0f, 580.0f, -3625.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_15.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(-630.0f, 580.0f, -930.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_16.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(190.0f, 580.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_17.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(-10.0f, 580.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_18.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(-210.0f, 580.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_19.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(-410.0f, 580.0f, -780.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_20.Draw(staticShader);
-
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(-630.0f, 580.0f, -1130.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(85.0f));
-		staticShader.setMat4("model", modelOp);
-		pintura_21.Draw(staticShader);
-
 		// --- VITRINAS ---
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(1750.0f, 365.0f, -3070.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(45.0f));
-		staticShader.setMat4("model", modelOp);
-		vitrina_01.Draw(staticShader);
+		vitrina_01.Draw(staticShader, modelOp);
 
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(1840.0f, 365.0f, -780.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(45.0f));
-		staticShader.setMat4("model", modelOp);
-		vitrina_02.Draw(staticShader);
+		vitrina_02.Draw(staticShader, modelOp);
 
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(880.0f, 365.0f, -780.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(45.0f));
-		staticShader.setMat4("model", modelOp);
-		vitrina_03.Draw(staticShader);
+		vitrina_03.Draw(staticShader, modelOp);
 
 		// --- CABALLETE ESTÁTICO (de referencia) ---
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2960.0f, 230.0f, -1000.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		caballete_completo.Draw(staticShader);
+		caballete_completo.Draw(staticShader, modelOp);
+		};
+
+	// =========================================================================
+	// 9.1. LAMBDA PARA LAS LUCES
+	// =========================================================================
+	// Pasa los datos de iluminación a un shader con la iluminación de shader_Lights_mod.fs
+	// (modelos estáticos y galería de pinturas) y lo deja activo.
+
+	auto setLights = [&](Shader& shader) {
+		shader.use();
+
+		// Luces (Pasa los datos de iluminación al shader)
+		shader.setVec3("viewPos", camera.Position);
+		shader.setVec3("dirLight.direction", lightDirection);
+		shader.setVec3("dirLight.ambient", ambientColor);
+		shader.setVec3("dirLight.diffuse", diffuseColor);
+		shader.setVec3("dirLight.specular", glm::vec3(0.6f));
+
+		// Luces puntuales (configuradas pero deshabilitadas/débiles)
+		shader.setVec3("pointLight[0].position", lightPosition);
+		shader.setVec3("pointLight[0].ambient", glm::vec3(0.0f, 0.0f, 0.0f));
+		shader.setVec3("pointLight[0].diffuse", glm::vec3(0.0f, 0.0f, 0.0f));
+		shader.setVec3("pointLight[0].specular", glm::vec3(0.0f, 0.0f, 0.0f));
+		shader.setFloat("pointLight[0].constant", 0.08f);
+		shader.setFloat("pointLight[0].linear", 0.009f);
+		shader.setFloat("pointLight[0].quadratic", 0.032f);
+
+		shader.setVec3("pointLight[1].position", glm::vec3(-80.0, 0.0f, 0.0f));
+		shader.setVec3("pointLight[1].ambient", glm::vec3(0.0f, 0.0f, 0.0f));
+		shader.setVec3("pointLight[1].diffuse", glm::vec3(0.0f, 0.0f, 0.0f));
+		shader.setVec3("pointLight[1].specular", glm::vec3(0.0f, 0.0f, 0.0f));
+		shader.setFloat("pointLight[1].constant", 1.0f);
+		shader.setFloat("pointLight[1].linear", 0.009f);
+		shader.setFloat("pointLight[1].quadratic", 0.032f);
+
+		// Luz Focal (Spotlight) - Animada por 'animarFoco()'
+		shader.setVec3("viewPos", camera.Position);
+		shader.setVec3("spotLight[0].position", focoPos);
+		shader.setVec3("spotLight[0].direction", focoDir);
+		shader.setFloat("spotLight[0].cutOff", glm::cos(glm::radians(30.0f)));
+		shader.setFloat("spotLight[0].outerCutOff", glm::cos(glm::radians(45.0f)));
+		glm::vec3 lightBaseColor = glm::vec3(1.0f, 0.6f, 0.2f);
+		// La intensidad (focoIntensidad) se multiplica para crear el pulso
+		shader.setVec3("spotLight[0].ambient", lightBaseColor * 0.3f * focoIntensidad);
+		shader.setVec3("spotLight[0].diffuse", lightBaseColor * 1.5f * focoIntensidad);
+		shader.setVec3("spotLight[0].specular", lightBaseColor * 2.0f * focoIntensidad);
+		shader.setFloat("spotLight[0].constant", 1.0f);
+		shader.setFloat("spotLight[0].linear", 0.001f);
+		shader.setFloat("spotLight[0].quadratic", 0.00005f);
+
+		shader.setFloat("material_shininess", 32.0f);
 		};
 
 	// =========================================================================
@@ -1555,6 +1591,14 @@ int main() {
 	glm::mat4 viewOp = glm::mat4(1.0f);			// Matriz de Vista (Cámara)
 	glm::mat4 projectionOp = glm::mat4(1.0f);	// Matriz de Proyección (Perspectiva)
 
+	// Matrices de modelo de los personajes animados (fijos en la sala)
+	glm::mat4 modeloHombre = glm::translate(glm::mat4(1.0f), glm::vec3(-2100.0f, -2.0f, -2240.0f));
+	modeloHombre = glm::rotate(modeloHombre, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	modeloHombre = glm::scale(modeloHombre, glm::vec3(3.5f));
+	glm::mat4 modeloMujer = glm::translate(glm::mat4(1.0f), glm::vec3(-2100.0f, -2.0f, -2040.0f));
+	modeloMujer = glm::rotate(modeloMujer, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+	modeloMujer = glm::scale(modeloMujer, glm::vec3(3.5f));
+
 	// =========================================================================
 	// 11. BUCLE DE RENDERIZADO (Game Loop)
 	// =========================================================================
@@ -1570,7 +1614,37 @@ int main() {
 		// ------------------------------------
 		// 11.2. Actualizar Animaciones
 		// ------------------------------------
-		animate(); // Actualiza todas las variables de animación (posX, rotSilla, etc.)
+		// Matrices de Vista y Proyección(Perspectiva): la cámara del cuadro, con ella se elige el nivel de detalle
+		projectionOp = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
+		viewOp = camera.GetViewMatrix();
+
+		// Cada sistema (caballete, foco, silla, pincel, mariposas) y el esqueleto de cada personaje es una tarea
+		// del grupo de hilos (ver jobSystem.h). Los personajes esperan a la cámara del nivel de detalle de su
+		// animación; run() vuelve cuando todas terminaron, antes de subir las poses y dibujar
+		float speedFactor = factorVelocidad();
+		double segundos = (double)SDL_GetTicks() / 1000.0;
+		float tiempo = (float)glfwGetTime();
+		unsigned int camaraLod = jobSystem().add([&]() { animationLod().beginFrame(projectionOp, viewOp, (float)SCR_HEIGHT); });
+		jobSystem().add([&]() { hombre_sentado.animate(segundos, modeloHombre); }, { camaraLod });
+		jobSystem().add([&]() { mujer_sentada.animate(segundos, modeloMujer); }, { camaraLod });
+		jobSystem().add([speedFactor]() { animarCaballete(speedFactor); });
+		jobSystem().add([speedFactor]() { animarFoco(speedFactor); });
+		jobSystem().add([speedFactor]() { animarSilla(speedFactor); });
+		jobSystem().add([speedFactor]() { animarPincel(speedFactor); });
+		jobSystem().add([tiempo]() { animarMariposas(tiempo); });
+		jobSystem().run();
+
+		// Presupuesto global de VRAM: reparte lo que queda para texturas y, si ni así alcanza, libera la
+		// geometría de los modelos que llevan tiempo fuera de vista (se recarga del .meshcache al volver)
+		gpuResources().update();
+		// Pide los mips que el cuadro anterior necesitó (o libera los que sobran, según el presupuesto de VRAM)
+		// y sube las texturas ya decodificadas, con un límite de bytes por cuadro para no provocar tirones
+		textureResidency().update();
+		textureStreamer().update();
+		// Páginas de los cuadros que pidió la pasada de feedback (usa la cámara del cuadro anterior)
+		virtualTextures().update();
+		// Vuelca la contabilidad de memoria a memory_report.json cada tantos segundos
+		memoryLedger().update(glfwGetTime());
 
 		// ------------------------------------
 		// 11.3. Limpieza de Pantalla
@@ -1582,56 +1656,16 @@ int main() {
 		// 11.4. Configuración de Shaders y Luces
 		// ------------------------------------
 
-		// --- Shader Estático (staticShader) ---
-		staticShader.use();
-
-		// Luces (Pasa los datos de iluminación al shader)
-		staticShader.setVec3("viewPos", camera.Position);
-		staticShader.setVec3("dirLight.direction", lightDirection);
-		staticShader.setVec3("dirLight.ambient", ambientColor);
-		staticShader.setVec3("dirLight.diffuse", diffuseColor);
-		staticShader.setVec3("dirLight.specular", glm::vec3(0.6f));
-
-		// Luces puntuales (configuradas pero deshabilitadas/débiles)
-		staticShader.setVec3("pointLight[0].position", lightPosition);
-		staticShader.setVec3("pointLight[0].ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-		staticShader.setVec3("pointLight[0].diffuse", glm::vec3(0.0f, 0.0f, 0.0f));
-		staticShader.setVec3("pointLight[0].specular", glm::vec3(0.0f, 0.0f, 0.0f));
-		staticShader.setFloat("pointLight[0].constant", 0.08f);
-		staticShader.setFloat("pointLight[0].linear", 0.009f);
-		staticShader.setFloat("pointLight[0].quadratic", 0.032f);
-
-		staticShader.setVec3("pointLight[1].position", glm::vec3(-80.0, 0.0f, 0.0f));
-		staticShader.setVec3("pointLight[1].ambient", glm::vec3(0.0f, 0.0f, 0.0f));
-		staticShader.setVec3("pointLight[1].diffuse", glm::vec3(0.0f, 0.0f, 0.0f));
-		staticShader.setVec3("pointLight[1].specular", glm::vec3(0.0f, 0.0f, 0.0f));
-		staticShader.setFloat("pointLight[1].constant", 1.0f);
-		staticShader.setFloat("pointLight[1].linear", 0.009f);
-		staticShader.setFloat("pointLight[1].quadratic", 0.032f);
-
-		// Luz Focal (Spotlight) - Animada por 'animate()'
-		staticShader.setVec3("viewPos", camera.Position);
-		staticShader.setVec3("spotLight[0].position", focoPos);
-		staticShader.setVec3("spotLight[0].direction", focoDir);
-		staticShader.setFloat("spotLight[0].cutOff", glm::cos(glm::radians(30.0f)));
-		staticShader.setFloat("spotLight[0].outerCutOff", glm::cos(glm::radians(45.0f)));
-		glm::vec3 lightBaseColor = glm::vec3(1.0f, 0.6f, 0.2f);
-		// La intensidad (focoIntensidad) se multiplica para crear el pulso
-		staticShader.setVec3("spotLight[0].ambient", lightBaseColor * 0.3f * focoIntensidad);
-		staticShader.setVec3("spotLight[0].diffuse", lightBaseColor * 1.5f * focoIntensidad);
-		staticShader.setVec3("spotLight[0].specular", lightBaseColor * 2.0f * focoIntensidad);
-		staticShader.setFloat("spotLight[0].constant", 1.0f);
-		staticShader.setFloat("spotLight[0].linear", 0.001f);
-		staticShader.setFloat("spotLight[0].quadratic", 0.00005f);
-
-		staticShader.setFloat("material_shininess", 32.0f);
+		// --- Luces: las mismas para los modelos estáticos y la galería (staticShader queda activo) ---
+		setLights(galleryShader);
+		setLights(staticShader);
 
 		glm::mat4 tmp = glm::mat4(1.0f);
-		// Matrices de Vista y Proyección(Perspectiva)
-		projectionOp = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 0.1f, 10000.0f);
-		viewOp = camera.GetViewMatrix();
 		staticShader.setMat4("projection", projectionOp);
 		staticShader.setMat4("view", viewOp);
+		// Cámara con la que los modelos estiman su tamaño en pantalla (nivel de mip que necesitan sus texturas)
+		textureResidency().beginFrame(projectionOp, viewOp, (float)SCR_HEIGHT);
+		virtualTextures().beginFrame(projectionOp, viewOp, SCR_WIDTH, SCR_HEIGHT);
 
 		// --- Shader de Primitivas (myShader) ---
 		myShader.use();
@@ -1640,6 +1674,17 @@ int main() {
 		myShader.setMat4("projection", projectionOp);
 
 		// --- Shader Animado (animShader) ---
+		// Poses de todos los personajes, subidas al buffer de huesos con una sola llamada. Los lejanos se
+		// actualizan cada 2 o 4 cuadros con menos huesos y los que no se ven se congelan (ver animationLod.h).
+		// Los personajes del mismo archivo en el mismo instante comparten la pose evaluada (ver poseCache.h).
+		// Las poses se escribieron en la fase de actualización (11.2); el contexto de GL es del hilo principal
+		boneBuffer().upload();
+		boneBuffer().bind();
+		// Con MUSEO_PRESKINNING=1 los vertices se deforman una vez por cuadro y cada pasada los dibuja ya
+		// deformados (ver preSkinning.h); conviene cuando hay mas de una pasada sobre los personajes
+		hombre_sentado.preSkin();
+		mujer_sentada.preSkin();
+
 		animShader.use();
 		animShader.setMat4("projection", projectionOp);
 		animShader.setMat4("view", viewOp);
@@ -1658,19 +1703,17 @@ int main() {
 
 		// --- RENDERIZADO: Modelos Animados (Mixamo) ---
 		// Hombre sentado
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(-2100.0f, -2.0f, -2240.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(3.5f));
-		animShader.setMat4("model", modelOp);
+		animShader.setMat4("model", modeloHombre);
 		hombre_sentado.Draw(animShader);
 
 		// Mujer sentada
-		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(-2100.0f, -2.0f, -2040.0f));
-		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-		modelOp = glm::scale(modelOp, glm::vec3(3.5f));
-		animShader.setMat4("model", modelOp);
+		animShader.setMat4("model", modeloMujer);
 		mujer_sentada.Draw(animShader);
 
+		// Visitantes: una llamada instanciada por malla de cada personaje
+		visitantesHombre.draw(animShader, (double)SDL_GetTicks() / 1000.0);
+		visitantesMujer.draw(animShader, (double)SDL_GetTicks() / 1000.0);
+
 		// --- RENDERIZADO: Primitivas (Piso) ---
 		myShader.use();
 		glBindVertexArray(VAO[2]); // Activa el VAO del piso
@@ -1696,6 +1739,13 @@ int main() {
 
 		drawStaticObjects(staticShader);
 
+		// --- RENDERIZADO: Galería de Pinturas (una sola llamada instanciada) ---
+		galleryShader.use();
+		galleryShader.setMat4("projection", projectionOp);
+		galleryShader.setMat4("view", viewOp);
+		gallery().draw(galleryShader);
+		staticShader.use();
+
 		// --- RENDERIZADO: Caballete Animado (por piezas) ---
 		// Se usa 'playIndex' para obtener el estado actual desde KeyFrame[]
 		glm::mat4 tmpPintura;   // Matriz padre (la pintura)
@@ -1707,46 +1757,39 @@ int main() {
 		tmpPintura = glm::rotate(tmpPintura, glm::radians(KeyFrame[playIndex].pinturaRot), glm::vec3(0.0f, 0.0f, 1.0f));
 		tmpPintura = glm::rotate(tmpPintura, glm::radians(pinturaRotZ), glm::vec3(0.0f, 0.0f, 1.0f));
 		tmpPintura = glm::scale(tmpPintura, glm::vec3(escala));
-		staticShader.setMat4("model", tmpPintura);
-		pintura.Draw(staticShader);
+		pintura.Draw(staticShader, tmpPintura);
 
 		// PIEZAS HIJAS: Se dibujan relativas a la matriz 'tmpPintura' (la pintura)
 		// Se aplica el offset Y animado (ej. KeyFrame[playIndex].soporteTrasPosY)
 		// ----- SOPORTE TRASERO -----
 		modelOp = tmpPintura * glm::translate(glm::mat4(1.0f), glm::vec3((0.34f - 0.15f), (2.0f - 1.3f) + KeyFrame[playIndex].soporteTrasPosY, 0.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(KeyFrame[playIndex].soporteTrasRot), glm::vec3(0.0f, 0.0f, 1.0f));
-		staticShader.setMat4("model", modelOp);
-		soportetrasero.Draw(staticShader);
+		soportetrasero.Draw(staticShader, modelOp);
 
 		// ----- ADORNO -----
 		modelOp = tmpPintura * glm::translate(glm::mat4(1.0f), glm::vec3((0.52f - 0.15f), (3.0f - 1.3f) + KeyFrame[playIndex].adornoPosY, 0.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(KeyFrame[playIndex].adornoRot), glm::vec3(1.0f, 0.0f, 0.0f));
-		staticShader.setMat4("model", modelOp);
-		adorno.Draw(staticShader);
+		adorno.Draw(staticShader, modelOp);
 
 		// ----- BASE -----
 		modelOp = tmpPintura * glm::translate(glm::mat4(1.0f), glm::vec3((0.0f - 0.15f), (0.66f - 1.3f) + KeyFrame[playIndex].basePosY, 0.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(KeyFrame[playIndex].baseRot), glm::vec3(1.0f, 0.0f, 0.0f));
-		staticShader.setMat4("model", modelOp);
-		base.Draw(staticShader);
+		base.Draw(staticShader, modelOp);
 
 		// ----- PATA DERECHA -----
 		modelOp = tmpPintura * glm::translate(glm::mat4(1.0f), glm::vec3((0.0f - 0.15f), (-0.5f - 1.3f) + KeyFrame[playIndex].pataDerPosY, 0.4f));
 		modelOp = glm::rotate(modelOp, glm::radians(KeyFrame[playIndex].pataDerRot), glm::vec3(0.0f, 0.0f, 1.0f));
-		staticShader.setMat4("model", modelOp);
-		pataderecha.Draw(staticShader);
+		pataderecha.Draw(staticShader, modelOp);
 
 		// ----- PATA IZQUIERDA -----
 		modelOp = tmpPintura * glm::translate(glm::mat4(1.0f), glm::vec3((0.0f - 0.15f), (-0.5f - 1.3f) + KeyFrame[playIndex].pataIzqPosY, -0.4f));
 		modelOp = glm::rotate(modelOp, glm::radians(KeyFrame[playIndex].pataIzqRot), glm::vec3(0.0f, 0.0f, 1.0f));
-		staticShader.setMat4("model", modelOp);
-		pataizquierda.Draw(staticShader);
+		pataizquierda.Draw(staticShader, modelOp);
 
 		// ----- PATA TRASERA -----
 		modelOp = tmpPintura * glm::translate(glm::mat4(1.0f), glm::vec3((0.81f - 0.15f), (0.0f - 1.3f) + KeyFrame[playIndex].pataTrasPosY, 0.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(KeyFrame[playIndex].pataTrasRot), glm::vec3(0.0f, 0.0f, 1.0f));
-		staticShader.setMat4("model", modelOp);
-		patatrasera.Draw(staticShader);
+		patatrasera.Draw(staticShader, modelOp);
 
 		// --- RENDERIZADO: Silla Mecedora (Animación independiente) ---
 		glm::mat4 modelOp = glm::mat4(1.0f);
@@ -1757,52 +1800,33 @@ int main() {
 		modelOp = glm::rotate(modelOp, glm::radians(rotSilla), glm::vec3(0.0f, 0.0f, 1.0f));
 		modelOp = glm::translate(modelOp, glm::vec3(0.0f, 100.0f, 0.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(90.0f));
-		staticShader.setMat4("model", modelOp);
-		silla_mecedora.Draw(staticShader);
+		silla_mecedora.Draw(staticShader, modelOp);
 
 
 		// --- RENDERIZADO: Lámpara (Estática) y Foco ---
 		modelOp = glm::translate(glm::mat4(1.0f), glm::vec3(2960.0f, 300.0f, -1500.0f));
 		modelOp = glm::rotate(modelOp, glm::radians(90.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		modelOp = glm::scale(modelOp, glm::vec3(20.0f, 30.0f, 20.0f));
-		staticShader.setMat4("model", modelOp);
-		lampara.Draw(staticShader);
+		lampara.Draw(staticShader, modelOp);
 
 		// Actualiza la posición y dirección del foco (luz)
 		glm::vec3 offsetFoco(0.0f, 150.0f, 0.0f);
 		glm::vec3 focoPos = glm::vec3(2960.0f, 300.0f, -1500.0f) + offsetFoco;
 		glm::vec3 focoDir = glm::normalize(glm::vec3(0.0f, -0.8f, -0.3f));
 
-		// --- RENDERIZADO: Enjambre de Mariposas ---
-		float tiempo = glfwGetTime(); 
-		for (Mariposa& m : enjambre) {
-			// Calcula el movimiento oscilante usando seno y coseno
-			float vueloX = sin(tiempo * m.velocidad + m.fase) * 100.0f;
-			float vueloY = sin(tiempo * 2.0f * m.velocidad + m.fase) * 30.0f;
-			float vueloZ = cos(tiempo * m.velocidad + m.fase) * 100.0f;
-
-			glm::vec3 posActual = m.posicionBase + glm::vec3(vueloX, vueloY, vueloZ);
-			float rotY = sin(tiempo * m.velocidad + m.fase) * 45.0f;
+		// --- RENDERIZADO: Enjambre de Mariposas (matrices de animarMariposas()) ---
+		for (const glm::mat4& modeloMariposa : modelosMariposas)
+			mariposa.Draw(staticShader, modeloMariposa);
 
-			glm::mat4 modelOp = glm::mat4(1.0f);
-			modelOp = glm::translate(modelOp, posActual);
-			modelOp = glm::rotate(modelOp, glm::radians(rotY), glm::vec3(0.0f, 1.0f, 0.0f));
-			modelOp = glm::scale(modelOp, glm::vec3(m.escala));
-
-			staticShader.setMat4("model", modelOp);
-			mariposa.Draw(staticShader);
-		}
-
-		// --- RENDERIZADO: Pincel (Animado por 'animate()') ---
+		// --- RENDERIZADO: Pincel (Animado por 'animarPincel()') ---
 		glm::mat4 modelPincel = glm::mat4(1.0f);
-		// Aplica la posición y rotación Z calculadas en 'animate()'
+		// Aplica la posición y rotación Z calculadas en 'animarPincel()'
 		modelPincel = glm::translate(modelPincel, glm::vec3(posPincelX, posPincelY, posPincelZ));
 		modelPincel = glm::rotate(modelPincel, glm::radians(180.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 		modelPincel = glm::rotate(modelPincel, glm::radians(rotPincelZ), glm::vec3(0.0f, 0.0f, 1.0f));
 		modelPincel = glm::scale(modelPincel, glm::vec3(50.0f));
 		staticShader.use();
-		staticShader.setMat4("model", modelPincel);
-		pincel.Draw(staticShader);
+		pincel.Draw(staticShader, modelPincel);
 
 		// --- RENDERIZADO: Lienzo (Primitiva VAO[0] con textura cambiante) ---
 		myShader.use();
@@ -1843,9 +1867,51 @@ int main() {
 	// =========================================================================
 	// 12. LIMPIEZA
 	// =========================================================================
-	glDeleteVertexArrays(2, VAO);
-	glDeleteBuffers(2, VBO);
-	ma_engine_init(NULL, &engine);
+	glDeleteVertexArrays(3, VAO);
+	for (int i = 0; i < 3; i++)
+	{
+		gpuResources().release(GPU_RESOURCE_BUFFER, VBO[i]);
+		gpuResources().release(GPU_RESOURCE_BUFFER, EBO[i]);
+	}
+	glDeleteBuffers(3, VBO);
+	glDeleteBuffers(3, EBO);
+	unsigned int texturas[] = { t_piedra, t_rosa, t_rojo, t_verde, t_naranja, t_azul };
+	for (unsigned int textura : texturas)
+		gpuResources().release(GPU_RESOURCE_TEXTURE, textura);
+	glDeleteTextures(6, texturas);
+	skybox.Terminate();
+	gallery().release();
+	virtualTextures().stop();
+	textureStreamer().stop();
+	// Tiempo de la fase de actualización por cuadro
+	jobSystem().printReport();
+	jobSystem().stop();
+	for (auto& modelo : modelosCargados)
+	{
+		modelo.second->releaseTextures();
+		modelo.second->releaseGpuData();
+	}
+	visitantesHombre.release();
+	visitantesMujer.release();
+	hombre_sentado.releaseTextures();
+	hombre_sentado.releaseGpuData();
+	hombre_sentado.releaseScene();
+	mujer_sentada.releaseTextures();
+	mujer_sentada.releaseGpuData();
+	mujer_sentada.releaseScene();
+	boneBuffer().release();
+	// Cuadros que cada personaje pasó en cada nivel de detalle de la animación
+	animationLod().printReport();
+	preSkinning().printReport();
+	preSkinning().release();
+	poseCache().printReport();
+	poseCache().clear();
+	// Lo que siga contabilizado a estas alturas es una fuga
+	memoryLedger().checkShutdown();
+	if (sonidoCargado)
+		ma_sound_uninit(&sonido);
+	if (audioIniciado)
+		ma_engine_uninit(&engine);
 
 }
 
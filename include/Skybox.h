@@ -8,6 +8,7 @@
 
 #include <shader_m.h>
 #include <camera.h>
+#include <gpuResources.h>
 
 #include <string>
 #include <fstream>
@@ -48,12 +49,16 @@ public:
 	// ------------------------------------------------------------------
 	void Terminate() {
 		glDeleteVertexArrays(1, &VAO);
-		glDeleteBuffers(1, &VAO);
+		glDeleteBuffers(1, &VBO);
+		glDeleteTextures(1, &cubemapTexture);
+		gpuResources().release(GPU_RESOURCE_BUFFER, VBO);
+		gpuResources().release(GPU_RESOURCE_TEXTURE, cubemapTexture);
+		VAO = VBO = cubemapTexture = 0;
 	}
 
 private:
 	unsigned int VAO, VBO;
-	unsigned int cubemapTexture = loadCubemap(faces);
+	unsigned int cubemapTexture = 0;	// loaded by setupSkybox
 	float skyboxVertices[108] = {
 		// positions          
 		-1.0f,  1.0f, -1.0f,
@@ -106,6 +111,7 @@ private:
 		glBindVertexArray(VAO);
 		glBindBuffer(GL_ARRAY_BUFFER, VBO);
 		glBufferData(GL_ARRAY_BUFFER, sizeof(skyboxVertices), &skyboxVertices, GL_STATIC_DRAW);
+		gpuResources().allocate(GPU_RESOURCE_BUFFER, VBO, sizeof(skyboxVertices), "skybox");
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
 
@@ -169,12 +175,15 @@ private:
 		glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
 		int width, height, nrChannels;
+		size_t bytes = 0;
 		for (unsigned int i = 0; i < faces.size(); i++)
 		{
 			unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
 			if (data)
 			{
 				glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
+				// drivers pad RGB8 to 4 bytes per texel
+				bytes += (size_t)width * height * 4;
 				stbi_image_free(data);
 			}
 			else
@@ -188,6 +197,7 @@ private:
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+		gpuResources().allocate(GPU_RESOURCE_TEXTURE, textureID, bytes, "skybox");
 
 		return textureID;
 	}
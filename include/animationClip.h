@@ -0,0 +1,402 @@
+#ifndef ANIMATION_CLIP_H
+#define ANIMATION_CLIP_H
+
+#include <glm/glm.hpp>
+
+#include <animationTracks.h>
+#include <meshCache.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+// A baked clip (animationTracks.h) compressed for as long as the app runs, and the binary file that keeps it
+// next to the asset ("<asset>.clip"): the next start reads it and doesn't bake the animation again.
+// Every track has three curves (translation, rotation and scale) and each one only keeps the frames that
+// linear interpolation between its neighbours can't rebuild within the tolerance; walking forward from the
+// first frame, a key spans at most ANIMATION_CLIP_MAX_SPAN frames. A key is its frame (16 bits) and 48 bits:
+//  - translation and scale: 16 bits per axis over the range the curve covers
+//  - rotation: "smallest three", the largest component is left out (the quaternion is flipped so it is
+//    positive, and it comes back from the unit length) and the other three take 15 bits in [-1/sqrt(2),
+//    1/sqrt(2)]; the top bits of the first two say which one was left out
+// The tolerances are checked against the baked frames after quantization, so they bound the whole error:
+// ANIMATION_CLIP_TRANSLATION_ERROR of the longest bone, ANIMATION_CLIP_ROTATION_ERROR radians and
+// ANIMATION_CLIP_SCALE_ERROR.
+// Sampling decodes the two keys around the time of every curve into one frame of SoA rows, and the matrices
+// are built from it as from the baked tracks. Each curve remembers the key it used last, so playback going
+// forward finds the next one in a step or two.
+// Like the mesh cache, the file is only trusted while the size and modification time of the asset match.
+
+#define ANIMATION_CLIP_MAGIC                0x50494C43u // "CLIP"
+#define ANIMATION_CLIP_VERSION              1u
+#define ANIMATION_CLIP_TRANSLATION_ERROR    0.0005f
+#define ANIMATION_CLIP_ROTATION_ERROR       0.001f
+#define ANIMATION_CLIP_SCALE_ERROR          0.0005f
+#define ANIMATION_CLIP_MAX_SPAN             255
+#define ANIMATION_CLIP_MAX_FRAMES           65535u      // longer clips are cut, frames are 16 bits
+#define ANIMATION_CLIP_CURSOR_STEPS         4           // keys a cursor walks before it searches
+
+struct AnimationClipHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    uint32_t tracks;
+    uint32_t frames;
+    float    rate;
+    uint32_t keys;
+};
+
+inline string animationClipPath(const string &sourcePath)
+{
+    return sourcePath + ".clip";
+}
+
+class AnimationClip {
+public:
+    AnimationClip() : trackCount(0), stride(0), frameCount(0), rate(0.0f) {}
+
+    // compresses the frames of baked, whose track t holds the channel channels[t] (stored to check the file
+    // against the skeleton that reads it)
+    void compress(const AnimationTracks &baked, const vector<int> &channels)
+    {
+        trackCount = baked.tracks();
+        stride = (trackCount + 3) & ~3u;
+        frameCount = (std::min)(baked.frames(), ANIMATION_CLIP_MAX_FRAMES);
+        rate = baked.frameRate();
+        trackChannels.assign(channels.begin(), channels.end());
+        curves.assign((size_t)trackCount * 3, Curve());
+        keyFrames.clear();
+        keyValues.clear();
+
+        float longest = 0.0f;
+        for (unsigned int f = 0; f < frameCount; f++)
+            for (unsigned int t = 0; t < trackCount; t++)
+                longest = (std::max)(longest, glm::length(glm::vec3(baked.value(f, t, 0), baked.value(f, t, 1), baked.value(f, t, 2))));
+        float tolerances[3] = { (std::max)(longest * ANIMATION_CLIP_TRANSLATION_ERROR, 1e-6f), ANIMATION_CLIP_ROTATION_ERROR,
+                                ANIMATION_CLIP_SCALE_ERROR };
+
+        // every frame of one curve, 4 floats and 3 codes each
+        vector<float> original((size_t)frameCount * 4), decoded((size_t)frameCount * 4);
+        vector<uint16_t> codes((size_t)frameCount * 3), kept;
+        for (unsigned int t = 0; t < trackCount; t++)
+        {
+            for (int kind = 0; kind < 3; kind++)
+            {
+                Curve &curve = curves[(size_t)t * 3 + kind];
+                unsigned int components = kind == 1 ? 4 : 3, first = firstComponent(kind);
+                for (unsigned int f = 0; f < frameCount; f++)
+                    for (unsigned int c = 0; c < components; c++)
+                        original[(size_t)f * 4 + c] = baked.value(f, t, first + c);
+                if (kind != 1)
+                    setRange(curve, original);
+                for (unsigned int f = 0; f < frameCount; f++)
+                {
+                    encode(curve, kind, &original[(size_t)f * 4], &codes[(size_t)f * 3]);
+                    decode(curve, kind, &codes[(size_t)f * 3], &decoded[(size_t)f * 4]);
+                }
+                reduce(original, decoded, kind, tolerances[kind], kept);
+                curve.firstKey = (uint32_t)keyFrames.size();
+                curve.keyCount = (uint32_t)kept.size();
+                for (size_t k = 0; k < kept.size(); k++)
+                {
+                    keyFrames.push_back(kept[k]);
+                    keyValues.insert(keyValues.end(), &codes[(size_t)kept[k] * 3], &codes[(size_t)kept[k] * 3] + 3);
+                }
+            }
+        }
+        prepare();
+    }
+
+    bool empty() const { return frameCount == 0; }
+    unsigned int tracks() const { return trackCount; }
+    unsigned int frames() const { return frameCount; }
+    float frameRate() const { return rate; }
+    size_t keys() const { return keyFrames.size(); }
+
+    size_t bytes() const
+    {
+        return curves.size() * sizeof(Curve) + keyFrames.size() * sizeof(uint16_t) + keyValues.size() * sizeof(uint16_t) +
+               trackChannels.size() * sizeof(int32_t) + cursors.size() * sizeof(uint32_t) + frame.size() * sizeof(float);
+    }
+
+    // local transform of the first count tracks at seconds into the clip (held at both ends), locals has
+    // tracks() entries; as with AnimationTracks::sample a few tracks past count may be written too
+    void sample(float seconds, glm::mat4 *locals, unsigned int count)
+    {
+        if (frameCount == 0)
+            return;
+        float position = (std::min)((std::max)(seconds * rate, 0.0f), (float)(frameCount - 1));
+        count = (std::min)(count, trackCount);
+        for (unsigned int t = 0; t < count; t++)
+            for (int kind = 0; kind < 3; kind++)
+                sampleCurve(t, kind, position);
+        AnimationTracks::interpolate(frame.data(), frame.data(), stride, trackCount, 0.0f, locals, count);
+    }
+
+    // writes the clip next to sourcePath. Returns false (and leaves no file behind) on failure
+    bool save(const string &sourcePath) const
+    {
+        AnimationClipHeader header = {};
+        header.magic = ANIMATION_CLIP_MAGIC;
+        header.version = ANIMATION_CLIP_VERSION;
+        header.tracks = trackCount;
+        header.frames = frameCount;
+        header.rate = rate;
+        header.keys = (uint32_t)keyFrames.size();
+        if (!meshCacheSourceStamp(sourcePath, header.sourceSize, header.sourceTime))
+            return false;
+
+        string clipPath = animationClipPath(sourcePath);
+        FILE *file = fopen(clipPath.c_str(), "wb");
+        if (!file)
+            return false;
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  meshCacheWriteArray(file, trackChannels) &&
+                  meshCacheWriteArray(file, curves) &&
+                  meshCacheWriteArray(file, keyFrames) &&
+                  meshCacheWriteArray(file, keyValues);
+        ok = (fclose(file) == 0) && ok;
+        if (!ok)
+            remove(clipPath.c_str());
+        return ok;
+    }
+
+    // reads the clip of sourcePath. Fails if the file is missing, corrupt, older than its source or was
+    // written for other tracks than channels
+    bool load(const string &sourcePath, const vector<int> &channels)
+    {
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        if (!meshCacheSourceStamp(sourcePath, sourceSize, sourceTime))
+            return false;
+        FILE *file = fopen(animationClipPath(sourcePath).c_str(), "rb");
+        if (!file)
+            return false;
+
+        AnimationClipHeader header;
+        bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+                  header.magic == ANIMATION_CLIP_MAGIC && header.version == ANIMATION_CLIP_VERSION &&
+                  header.sourceSize == sourceSize && header.sourceTime == sourceTime &&
+                  header.tracks == channels.size() && header.frames <= ANIMATION_CLIP_MAX_FRAMES &&
+                  meshCacheReadArray(file, trackChannels, header.tracks) &&
+                  meshCacheReadArray(file, curves, header.tracks * 3) &&
+                  meshCacheReadArray(file, keyFrames, header.keys) &&
+                  meshCacheReadArray(file, keyValues, header.keys * 3);
+        fclose(file);
+        for (size_t t = 0; ok && t < channels.size(); t++)
+            ok = trackChannels[t] == channels[t];
+        for (size_t c = 0; ok && c < curves.size(); c++)
+            ok = curves[c].keyCount > 0 && curves[c].firstKey + curves[c].keyCount <= header.keys;
+        if (!ok)
+        {
+            *this = AnimationClip();
+            return false;
+        }
+        trackCount = header.tracks;
+        stride = (trackCount + 3) & ~3u;
+        frameCount = header.frames;
+        rate = header.rate;
+        prepare();
+        return true;
+    }
+
+private:
+    struct Curve {
+        uint32_t firstKey;
+        uint32_t keyCount;
+        float low[3];           // translation and scale: the range the codes cover
+        float extent[3];
+    };
+
+    unsigned int trackCount;
+    unsigned int stride;
+    unsigned int frameCount;
+    float rate;
+    vector<int32_t> trackChannels;
+    vector<Curve> curves;           // translation, rotation and scale of every track
+    vector<uint16_t> keyFrames;
+    vector<uint16_t> keyValues;     // 3 codes per key
+    vector<uint32_t> cursors;       // key of every curve sampled last
+    vector<float> frame;            // ANIMATION_TRACK_COMPONENTS rows of stride floats, rebuilt by sample
+
+    static unsigned int firstComponent(int kind)
+    {
+        return kind == 0 ? 0 : kind == 1 ? 3 : 7;
+    }
+
+    void prepare()
+    {
+        cursors.assign(curves.size(), 0);
+        // the padding lanes hold an identity transform
+        frame.assign((size_t)ANIMATION_TRACK_COMPONENTS * stride, 0.0f);
+        for (unsigned int c = 6; c < ANIMATION_TRACK_COMPONENTS; c++)
+            for (unsigned int t = 0; t < stride; t++)
+                frame[(size_t)c * stride + t] = 1.0f;
+    }
+
+    // the box of a translation or scale curve, frames 4 floats apart
+    void setRange(Curve &curve, const vector<float> &values) const
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            float low = values[c], high = values[c];
+            for (unsigned int f = 1; f < frameCount; f++)
+            {
+                low = (std::min)(low, values[(size_t)f * 4 + c]);
+                high = (std::max)(high, values[(size_t)f * 4 + c]);
+            }
+            curve.low[c] = low;
+            curve.extent[c] = high - low;
+        }
+    }
+
+    static void encode(const Curve &curve, int kind, const float *value, uint16_t *codes)
+    {
+        if (kind == 1)
+        {
+            int largest = 0;
+            for (int c = 1; c < 4; c++)
+                if (std::fabs(value[c]) > std::fabs(value[largest]))
+                    largest = c;
+            float sign = value[largest] < 0.0f ? -1.0f : 1.0f;
+            for (int c = 0, slot = 0; c < 4; c++)
+                if (c != largest)
+                    codes[slot++] = (uint16_t)(std::min)((std::max)((value[c] * sign * 0.70710678f + 0.5f) * 32767.0f + 0.5f, 0.0f), 32767.0f);
+            codes[0] |= (uint16_t)((largest & 1) << 15);
+            codes[1] |= (uint16_t)((largest >> 1) << 15);
+            return;
+        }
+        for (int c = 0; c < 3; c++)
+            codes[c] = curve.extent[c] > 0.0f ?
+                (uint16_t)(std::min)((std::max)((value[c] - curve.low[c]) / curve.extent[c] * 65535.0f + 0.5f, 0.0f), 65535.0f) : 0;
+    }
+
+    static void decode(const Curve &curve, int kind, const uint16_t *codes, float *value)
+    {
+        if (kind == 1)
+        {
+            int largest = (codes[0] >> 15) | ((codes[1] >> 15) << 1);
+            float sum = 0.0f;
+            for (int c = 0, slot = 0; c < 4; c++)
+                if (c != largest)
+                {
+                    value[c] = ((codes[slot++] & 0x7FFF) / 32767.0f - 0.5f) * 1.41421356f;
+                    sum += value[c] * value[c];
+                }
+            value[largest] = std::sqrt((std::max)(1.0f - sum, 0.0f));
+            return;
+        }
+        for (int c = 0; c < 3; c++)
+            value[c] = curve.low[c] + codes[c] * (curve.extent[c] / 65535.0f);
+    }
+
+    // a to b by weight; rotations are normalized, and taken the short way (keys are only positive in their
+    // largest component)
+    static void blend(const float *a, const float *b, float weight, int kind, float *out)
+    {
+        unsigned int components = kind == 1 ? 4 : 3;
+        float sign = 1.0f;
+        if (kind == 1 && a[0] * b[0] + a[1] * b[1] + a[2] * b[2] + a[3] * b[3] < 0.0f)
+            sign = -1.0f;
+        for (unsigned int c = 0; c < components; c++)
+            out[c] = a[c] + (b[c] * sign - a[c]) * weight;
+        if (kind == 1)
+        {
+            float length = std::sqrt(out[0] * out[0] + out[1] * out[1] + out[2] * out[2] + out[3] * out[3]);
+            for (unsigned int c = 0; c < 4; c++)
+                out[c] /= length;
+        }
+    }
+
+    static bool close(const float *value, const float *original, int kind, float tolerance)
+    {
+        if (kind == 1)
+        {
+            float dot = std::fabs(value[0] * original[0] + value[1] * original[1] + value[2] * original[2] + value[3] * original[3]);
+            return 2.0f * std::acos((std::min)(dot, 1.0f)) <= tolerance;
+        }
+        for (int c = 0; c < 3; c++)
+            if (std::fabs(value[c] - original[c]) > tolerance)
+                return false;
+        return true;
+    }
+
+    // frames of one curve that become keys: the first, then each time as far as interpolating from the last
+    // key still rebuilds every frame in between
+    void reduce(const vector<float> &original, const vector<float> &decoded, int kind, float tolerance, vector<uint16_t> &kept) const
+    {
+        kept.assign(1, 0);
+        bool constant = true;
+        for (unsigned int f = 0; f < frameCount && constant; f++)
+            constant = close(&decoded[0], &original[(size_t)f * 4], kind, tolerance);
+        if (constant)
+            return;
+        float value[4];
+        unsigned int start = 0;
+        while (start + 1 < frameCount)
+        {
+            unsigned int end = start + 1;
+            for (bool fits = true; fits && end + 1 < frameCount && end + 1 - start <= ANIMATION_CLIP_MAX_SPAN;)
+            {
+                unsigned int next = end + 1;
+                for (unsigned int f = start; f <= next && fits; f++)
+                {
+                    blend(&decoded[(size_t)start * 4], &decoded[(size_t)next * 4], (float)(f - start) / (float)(next - start), kind, value);
+                    fits = close(value, &original[(size_t)f * 4], kind, tolerance);
+                }
+                if (fits)
+                    end = next;
+            }
+            kept.push_back((uint16_t)end);
+            start = end;
+        }
+    }
+
+    // interval of keys holding position, from the cursor of the curve
+    static uint32_t findKey(const uint16_t *frames, uint32_t count, float position, uint32_t &cursor)
+    {
+        uint32_t last = count - 2;
+        uint32_t k = (std::min)(cursor, last);
+        if (position < (float)frames[k])
+            k = 0;
+        for (unsigned int step = 0; k < last && position >= (float)frames[k + 1]; step++)
+        {
+            if (step == ANIMATION_CLIP_CURSOR_STEPS)
+            {
+                k = (uint32_t)(std::upper_bound(frames + k + 1, frames + last + 1, position) - frames) - 1;
+                break;
+            }
+            k++;
+        }
+        cursor = k;
+        return k;
+    }
+
+    void sampleCurve(unsigned int track, int kind, float position)
+    {
+        size_t index = (size_t)track * 3 + kind;
+        const Curve &curve = curves[index];
+        float value[4];
+        if (curve.keyCount == 1)
+            decode(curve, kind, &keyValues[(size_t)curve.firstKey * 3], value);
+        else
+        {
+            const uint16_t *frames = &keyFrames[curve.firstKey];
+            uint32_t k = findKey(frames, curve.keyCount, position, cursors[index]);
+            float weight = (std::min)((std::max)((position - frames[k]) / (float)(frames[k + 1] - frames[k]), 0.0f), 1.0f);
+            float a[4], b[4];
+            decode(curve, kind, &keyValues[((size_t)curve.firstKey + k) * 3], a);
+            decode(curve, kind, &keyValues[((size_t)curve.firstKey + k + 1) * 3], b);
+            blend(a, b, weight, kind, value);
+        }
+        unsigned int components = kind == 1 ? 4 : 3, first = firstComponent(kind);
+        for (unsigned int c = 0; c < components; c++)
+            frame[(size_t)(first + c) * stride + track] = value[c];
+    }
+};
+#endif
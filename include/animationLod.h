@@ -0,0 +1,150 @@
+#ifndef ANIMATION_LOD_H
+#define ANIMATION_LOD_H
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+using namespace std;
+
+// Level of detail of the skinned characters' animation, from how large they are on screen.
+// Every frame each character projects the bounding sphere of its bind pose (grown by
+// ANIMATION_LOD_BOUNDS_MARGIN, the animation moves the limbs out of it) with the camera given to beginFrame:
+//  - outside the frustum its pose is frozen: the bone buffer keeps the last one it wrote
+//  - above ANIMATION_LOD_FULL_PIXELS the pose is evaluated every frame, above ANIMATION_LOD_HALF_PIXELS every
+//    2nd frame and below it every 4th, each character on its own phase so the updates don't pile up
+//  - below ANIMATION_LOD_HALF_PIXELS it also uses the reduced skeleton: fingers, toes and face bones
+//    (detailBone) move with the nearest bone above them and aren't evaluated, and the shader skins with
+//    the two heaviest influences of each vertex instead of four
+// MUSEO_ANIMATION_LOD=0 in the environment keeps every character at the full level, to compare.
+// level and due are called by the characters' jobs of the update phase (jobSystem.h), after beginFrame.
+
+#define ANIMATION_LOD_FULL_PIXELS   250.0f
+#define ANIMATION_LOD_HALF_PIXELS   100.0f
+#define ANIMATION_LOD_BOUNDS_MARGIN 1.5f
+
+enum AnimationLodLevel {
+    ANIMATION_LOD_FULL,
+    ANIMATION_LOD_HALF,             // every 2nd frame
+    ANIMATION_LOD_QUARTER,          // every 4th frame, reduced skeleton
+    ANIMATION_LOD_FROZEN,           // off screen
+    ANIMATION_LOD_LEVELS
+};
+
+class AnimationLod {
+public:
+    AnimationLod() : frame(0), pixelScale(0.0f), enabled(true)
+    {
+        const char *lod = getenv("MUSEO_ANIMATION_LOD");
+        if (lod && strcmp(lod, "0") == 0)
+            enabled = false;
+        resetCounts();
+    }
+
+    // camera of the frame about to be drawn; viewportHeight in pixels
+    void beginFrame(const glm::mat4 &projection, const glm::mat4 &view, float viewportHeight)
+    {
+        this->view = view;
+        pixelScale = 0.5f * viewportHeight * projection[1][1];
+        // the planes of the frustum, from the rows of the clip matrix
+        glm::mat4 clip = projection * view;
+        for (int p = 0; p < 6; p++)
+        {
+            int axis = p / 2;
+            float sign = p % 2 ? -1.0f : 1.0f;
+            glm::vec4 plane(clip[0][3] + sign * clip[0][axis], clip[1][3] + sign * clip[1][axis],
+                            clip[2][3] + sign * clip[2][axis], clip[3][3] + sign * clip[3][axis]);
+            planes[p] = plane / glm::length(glm::vec3(plane));
+        }
+        frame++;
+    }
+
+    // level of a character whose bounding sphere (world space) is center, radius
+    AnimationLodLevel level(const glm::vec3 &center, float radius)
+    {
+        AnimationLodLevel chosen = ANIMATION_LOD_FULL;
+        if (enabled && pixelScale > 0.0f)
+        {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++)
+                inside = glm::dot(glm::vec3(planes[p]), center) + planes[p].w > -radius;
+            if (!inside)
+                chosen = ANIMATION_LOD_FROZEN;
+            else
+            {
+                float distance = (std::max)(glm::length(glm::vec3(view * glm::vec4(center, 1.0f))) - radius, 0.1f);
+                float pixels = 2.0f * radius * pixelScale / distance;
+                chosen = pixels >= ANIMATION_LOD_FULL_PIXELS ? ANIMATION_LOD_FULL
+                       : pixels >= ANIMATION_LOD_HALF_PIXELS ? ANIMATION_LOD_HALF : ANIMATION_LOD_QUARTER;
+            }
+        }
+        counts[chosen]++;
+        return chosen;
+    }
+
+    // whether a character at level, on its own phase, evaluates its pose this frame
+    bool due(AnimationLodLevel level, unsigned int phase)
+    {
+        if (level == ANIMATION_LOD_FROZEN)
+            return false;
+        unsigned int interval = level == ANIMATION_LOD_FULL ? 1 : level == ANIMATION_LOD_HALF ? 2 : 4;
+        bool evaluate = (frame + phase) % interval == 0;
+        if (evaluate)
+            evaluated++;
+        return evaluate;
+    }
+
+    static bool reduced(AnimationLodLevel level)
+    {
+        return level >= ANIMATION_LOD_QUARTER;
+    }
+
+    // bones the reduced skeleton collapses into their parent (Mixamo and Blender rig names)
+    static bool detailBone(const string &name)
+    {
+        static const char *parts[] = { "Thumb", "Index", "Middle", "Ring", "Pinky", "Toe", "Eye", "Jaw", "HeadTop", "thumb",
+                                       "index", "middle", "ring", "pinky", "toe", "eye", "jaw" };
+        for (size_t p = 0; p < sizeof(parts) / sizeof(parts[0]); p++)
+            if (name.find(parts[p]) != string::npos)
+                return true;
+        return false;
+    }
+
+    // characters at each level and poses evaluated since the last report
+    void printReport()
+    {
+        static const char *names[ANIMATION_LOD_LEVELS] = { "full", "half", "quarter", "frozen" };
+        cout << "ANIMATION::LOD::";
+        for (int l = 0; l < ANIMATION_LOD_LEVELS; l++)
+            cout << " " << names[l] << ": " << counts[l];
+        cout << "  poses evaluated: " << evaluated << (enabled ? "" : "  (off)") << endl;
+        resetCounts();
+    }
+
+private:
+    unsigned int frame;
+    glm::mat4 view;
+    float pixelScale;
+    glm::vec4 planes[6];            // inside when dot(normal, point) + w > 0
+    bool enabled;
+    atomic<unsigned int> counts[ANIMATION_LOD_LEVELS];
+    atomic<unsigned int> evaluated;
+
+    void resetCounts()
+    {
+        for (int l = 0; l < ANIMATION_LOD_LEVELS; l++)
+            counts[l] = 0;
+        evaluated = 0;
+    }
+};
+
+inline AnimationLod& animationLod()
+{
+    static AnimationLod lod;
+    return lod;
+}
+#endif
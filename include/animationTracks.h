@@ -0,0 +1,195 @@
+#ifndef ANIMATION_TRACKS_H
+#define ANIMATION_TRACKS_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ANIMATION_TRACKS_SSE2
+#endif
+
+// An animation clip resampled at import to a fixed rate and stored as structure-of-arrays tracks, one
+// track per animated node. Every frame holds ANIMATION_TRACK_COMPONENTS rows of `stride` floats (the
+// track count padded to a multiple of 4): translation x, y, z, rotation x, y, z, w and scale x, y, z.
+// Sampling a pose interpolates two consecutive frames of every track at once, four tracks per SSE2
+// register: lerp, renormalize the quaternions (the bake keeps each one in the hemisphere of the frame
+// before, so there is no sign test) and build the local T * R * S matrices in glm's column-major order.
+// AVX isn't used: the builds don't enable it, and once the tracks are sampled the pose is bound by the
+// hierarchy walk, one parent after another.
+// The rate follows the densest channel of the clip, within ANIMATION_TRACKS_MIN_RATE..MAX_RATE, so keys
+// exported at a regular rate (Mixamo's 30 per second) are reproduced exactly.
+
+#define ANIMATION_TRACKS_MIN_RATE   30.0f
+#define ANIMATION_TRACKS_MAX_RATE   120.0f
+#define ANIMATION_TRACK_COMPONENTS  10
+
+class AnimationTracks {
+public:
+    AnimationTracks() : trackCount(0), stride(0), frameCount(0), rate(0.0f) {}
+
+    // room for frames frames of tracks tracks, sampled rate times a second
+    void resize(unsigned int tracks, unsigned int frames, float framesPerSecond)
+    {
+        trackCount = tracks;
+        stride = (tracks + 3) & ~3u;
+        frameCount = frames;
+        rate = framesPerSecond;
+        // padding lanes hold an identity transform, they are computed and never stored
+        data.assign((size_t)frames * ANIMATION_TRACK_COMPONENTS * stride, 0.0f);
+        for (unsigned int f = 0; f < frames; f++)
+            for (unsigned int t = 0; t < stride; t++)
+                row(f, 6)[t] = row(f, 7)[t] = row(f, 8)[t] = row(f, 9)[t] = 1.0f;    // rotation w and scale
+    }
+
+    // frames are expected in increasing order: the rotation is flipped into the hemisphere of the frame before
+    void setFrame(unsigned int frame, unsigned int track, const glm::vec3 &translation, glm::quat rotation, const glm::vec3 &scaling)
+    {
+        if (frame > 0)
+        {
+            glm::quat previous(row(frame - 1, 6)[track], row(frame - 1, 3)[track], row(frame - 1, 4)[track], row(frame - 1, 5)[track]);
+            if (glm::dot(previous, rotation) < 0.0f)
+                rotation = -rotation;
+        }
+        float values[ANIMATION_TRACK_COMPONENTS] = { translation.x, translation.y, translation.z, rotation.x, rotation.y, rotation.z,
+                                                     rotation.w, scaling.x, scaling.y, scaling.z };
+        for (unsigned int c = 0; c < ANIMATION_TRACK_COMPONENTS; c++)
+            row(frame, c)[track] = values[c];
+    }
+
+    bool empty() const { return frameCount == 0; }
+    unsigned int tracks() const { return trackCount; }
+    unsigned int frames() const { return frameCount; }
+    float frameRate() const { return rate; }
+    size_t bytes() const { return data.size() * sizeof(float); }
+
+    // local transform of the first count tracks at seconds into the clip (held at both ends), locals has
+    // tracks() entries; whole groups of four are computed, so a few tracks past count may be written too
+    void sample(float seconds, glm::mat4 *locals, unsigned int count) const
+    {
+        if (frameCount == 0)
+            return;
+        float position = (std::min)((std::max)(seconds * rate, 0.0f), (float)(frameCount - 1));
+        unsigned int first = (std::min)((unsigned int)position, frameCount > 1 ? frameCount - 2 : 0);
+        unsigned int second = (std::min)(first + 1, frameCount - 1);
+        float weight = (std::min)(position - (float)first, 1.0f);
+        interpolate(&data[(size_t)first * ANIMATION_TRACK_COMPONENTS * stride], &data[(size_t)second * ANIMATION_TRACK_COMPONENTS * stride],
+                    stride, trackCount, weight, locals, count);
+    }
+
+    // component of a track in a frame
+    float value(unsigned int frame, unsigned int track, unsigned int component) const
+    {
+        return data[((size_t)frame * ANIMATION_TRACK_COMPONENTS + component) * stride + track];
+    }
+
+    // local transforms of the first count of tracks tracks between two frames laid out as the baked ones,
+    // ANIMATION_TRACK_COMPONENTS rows of stride floats; also builds the poses of compressed clips
+    static void interpolate(const float *a, const float *b, unsigned int stride, unsigned int tracks, float weight,
+                            glm::mat4 *locals, unsigned int count)
+    {
+#ifdef ANIMATION_TRACKS_SSE2
+        for (unsigned int t = 0; t < count; t += 4)
+            sampleFour(a + t, b + t, stride, weight, locals + t, (std::min)(tracks - t, 4u));
+#else
+        for (unsigned int t = 0; t < count; t++)
+            sampleOne(a + t, b + t, stride, weight, locals[t]);
+#endif
+    }
+
+private:
+    unsigned int trackCount;
+    unsigned int stride;
+    unsigned int frameCount;
+    float rate;
+    vector<float> data;
+
+    float *row(unsigned int frame, unsigned int component)
+    {
+        return &data[((size_t)frame * ANIMATION_TRACK_COMPONENTS + component) * stride];
+    }
+
+    // a and b point at the track in the first row of their frame
+    static void sampleOne(const float *a, const float *b, unsigned int stride, float weight, glm::mat4 &local)
+    {
+        float v[ANIMATION_TRACK_COMPONENTS];
+        for (unsigned int c = 0; c < ANIMATION_TRACK_COMPONENTS; c++)
+            v[c] = a[c * stride] + (b[c * stride] - a[c * stride]) * weight;
+        float length = std::sqrt(v[3] * v[3] + v[4] * v[4] + v[5] * v[5] + v[6] * v[6]);
+        float x = v[3] / length, y = v[4] / length, z = v[5] / length, w = v[6] / length;
+        local[0] = glm::vec4(1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + w * z), 2.0f * (x * z - w * y), 0.0f) * v[7];
+        local[1] = glm::vec4(2.0f * (x * y - w * z), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + w * x), 0.0f) * v[8];
+        local[2] = glm::vec4(2.0f * (x * z + w * y), 2.0f * (y * z - w * x), 1.0f - 2.0f * (x * x + y * y), 0.0f) * v[9];
+        local[3] = glm::vec4(v[0], v[1], v[2], 1.0f);
+    }
+
+#ifdef ANIMATION_TRACKS_SSE2
+    // four tracks at once, the first count of them are stored
+    static void sampleFour(const float *a, const float *b, unsigned int stride, float weight, glm::mat4 *locals, unsigned int count)
+    {
+        __m128 w = _mm_set1_ps(weight);
+        __m128 v[ANIMATION_TRACK_COMPONENTS];
+        for (unsigned int c = 0; c < ANIMATION_TRACK_COMPONENTS; c++)
+        {
+            __m128 from = _mm_loadu_ps(a + c * stride), to = _mm_loadu_ps(b + c * stride);
+            v[c] = _mm_add_ps(from, _mm_mul_ps(_mm_sub_ps(to, from), w));
+        }
+        __m128 length = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(v[3], v[3]), _mm_mul_ps(v[4], v[4])),
+                                               _mm_add_ps(_mm_mul_ps(v[5], v[5]), _mm_mul_ps(v[6], v[6]))));
+        __m128 x = _mm_div_ps(v[3], length), y = _mm_div_ps(v[4], length), z = _mm_div_ps(v[5], length), qw = _mm_div_ps(v[6], length);
+        __m128 one = _mm_set1_ps(1.0f), two = _mm_set1_ps(2.0f), zero = _mm_setzero_ps();
+        __m128 xx = _mm_mul_ps(x, x), yy = _mm_mul_ps(y, y), zz = _mm_mul_ps(z, z);
+        __m128 xy = _mm_mul_ps(x, y), xz = _mm_mul_ps(x, z), yz = _mm_mul_ps(y, z);
+        __m128 wx = _mm_mul_ps(qw, x), wy = _mm_mul_ps(qw, y), wz = _mm_mul_ps(qw, z);
+
+        // columns of the four matrices, one element per register
+        __m128 m[4][4];
+        m[0][0] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(yy, zz))), v[7]);
+        m[0][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xy, wz)), v[7]);
+        m[0][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xz, wy)), v[7]);
+        m[1][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(xy, wz)), v[8]);
+        m[1][1] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, zz))), v[8]);
+        m[1][2] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(yz, wx)), v[8]);
+        m[2][0] = _mm_mul_ps(_mm_mul_ps(two, _mm_add_ps(xz, wy)), v[9]);
+        m[2][1] = _mm_mul_ps(_mm_mul_ps(two, _mm_sub_ps(yz, wx)), v[9]);
+        m[2][2] = _mm_mul_ps(_mm_sub_ps(one, _mm_mul_ps(two, _mm_add_ps(xx, yy))), v[9]);
+        m[3][0] = v[0];
+        m[3][1] = v[1];
+        m[3][2] = v[2];
+        for (int c = 0; c < 3; c++)
+            m[c][3] = zero;
+        m[3][3] = one;
+
+        // transposing each column turns "element of four tracks" into "column of one track"
+        for (int c = 0; c < 4; c++)
+        {
+            _MM_TRANSPOSE4_PS(m[c][0], m[c][1], m[c][2], m[c][3]);
+            for (unsigned int t = 0; t < count; t++)
+                _mm_storeu_ps(&locals[t][c][0], m[c][t]);
+        }
+    }
+#endif
+};
+
+// out = a * b for column-major matrices (out may not alias a or b)
+inline void multiplyTransforms(const glm::mat4 &a, const glm::mat4 &b, glm::mat4 &out)
+{
+#ifdef ANIMATION_TRACKS_SSE2
+    __m128 a0 = _mm_loadu_ps(&a[0][0]), a1 = _mm_loadu_ps(&a[1][0]), a2 = _mm_loadu_ps(&a[2][0]), a3 = _mm_loadu_ps(&a[3][0]);
+    for (int c = 0; c < 4; c++)
+    {
+        __m128 column = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a0, _mm_set1_ps(b[c][0])), _mm_mul_ps(a1, _mm_set1_ps(b[c][1]))),
+                                   _mm_add_ps(_mm_mul_ps(a2, _mm_set1_ps(b[c][2])), _mm_mul_ps(a3, _mm_set1_ps(b[c][3]))));
+        _mm_storeu_ps(&out[c][0], column);
+    }
+#else
+    out = a * b;
+#endif
+}
+#endif
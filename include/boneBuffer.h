@@ -0,0 +1,129 @@
+#ifndef BONE_BUFFER_H
+#define BONE_BUFFER_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <gpuResources.h>
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+using namespace std;
+
+// Bone matrices of every skinned character in one texture buffer, read by anim.vs with texelFetch.
+// A character reserves a range of bones once at load and writes its palette into it every frame; upload()
+// sends the whole buffer with one call before the characters are drawn, and each draw only sets the first
+// bone of its range (bone_base). A bone is BONE_BUFFER_ROWS RGBA32F texels, the first three rows of its
+// matrix: the last one is always 0 0 0 1. The texture buffer isn't bound by a uniform array size, so the
+// number of bones per character is only limited by GL_MAX_TEXTURE_BUFFER_SIZE.
+// Characters animated in parallel (jobSystem.h) write their own ranges; reserve and upload are main thread only.
+
+#define BONE_BUFFER_UNIT    11      // texture unit of the palette in the animation shader
+#define BONE_BUFFER_ROWS    3
+
+class BoneBuffer {
+public:
+    BoneBuffer() : buffer(0), texture(0), capacity(0), dirty(false) {}
+
+    // a range of bones bones for one character, returns its first bone
+    unsigned int reserve(unsigned int bones)
+    {
+        unsigned int base = (unsigned int)(rows.size() / (BONE_BUFFER_ROWS * 4));
+        rows.resize(rows.size() + (size_t)bones * BONE_BUFFER_ROWS * 4, 0.0f);
+        for (unsigned int b = base; b < base + bones; b++)
+            for (int r = 0; r < BONE_BUFFER_ROWS; r++)
+                rows[((size_t)b * BONE_BUFFER_ROWS + r) * 4 + r] = 1.0f;
+        dirty = true;
+        return base;
+    }
+
+    // the column-major palette of a character, transposed to rows at base
+    void write(unsigned int base, const vector<glm::mat4> &palette)
+    {
+        float *out = &rows[(size_t)base * BONE_BUFFER_ROWS * 4];
+        for (size_t b = 0; b < palette.size(); b++, out += BONE_BUFFER_ROWS * 4)
+            for (int r = 0; r < BONE_BUFFER_ROWS; r++)
+                for (int c = 0; c < 4; c++)
+                    out[r * 4 + c] = palette[b][c][r];
+        dirty = true;
+    }
+
+    // once a frame, after every character wrote its palette
+    void upload()
+    {
+        if (!dirty || rows.empty())
+            return;
+        dirty = false;
+        size_t bytes = rows.size() * sizeof(float);
+        if (buffer == 0)
+        {
+            glGenBuffers(1, &buffer);
+            glGenTextures(1, &texture);
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        if (bytes > capacity)
+        {
+            // a character was loaded after the last upload
+            capacity = bytes;
+            glBufferData(GL_TEXTURE_BUFFER, capacity, rows.data(), GL_STREAM_DRAW);
+            gpuResources().allocate(GPU_RESOURCE_BUFFER, buffer, capacity, "bone palette");
+            glBindTexture(GL_TEXTURE_BUFFER, texture);
+            glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+            glBindTexture(GL_TEXTURE_BUFFER, 0);
+        }
+        else
+        {
+            // orphaned, so the draws of the last frame still reading it don't stall the upload
+            glBufferData(GL_TEXTURE_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+            glBufferSubData(GL_TEXTURE_BUFFER, 0, bytes, rows.data());
+        }
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // points the palette sampler of a shader that draws characters at its texture unit (leaves it in use)
+    void setupProgram(Shader &shader)
+    {
+        shader.use();
+        shader.setInt("bone_palette", BONE_BUFFER_UNIT);
+    }
+
+    // before the characters are drawn
+    void bind()
+    {
+        glActiveTexture(GL_TEXTURE0 + BONE_BUFFER_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    size_t bones() const
+    {
+        return rows.size() / (BONE_BUFFER_ROWS * 4);
+    }
+
+    void release()
+    {
+        gpuResources().release(GPU_RESOURCE_BUFFER, buffer);
+        glDeleteTextures(1, &texture);
+        glDeleteBuffers(1, &buffer);
+        buffer = texture = 0;
+        capacity = 0;
+        dirty = !rows.empty();
+    }
+
+private:
+    GLuint buffer;
+    GLuint texture;
+    size_t capacity;            // bytes of the buffer
+    atomic<bool> dirty;         // written since the last upload
+    vector<float> rows;         // BONE_BUFFER_ROWS texels of 4 floats per bone
+};
+
+inline BoneBuffer& boneBuffer()
+{
+    static BoneBuffer bones;
+    return bones;
+}
+#endif
@@ -0,0 +1,350 @@
+#ifndef CROWD_H
+#define CROWD_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <modelAnim.h>
+#include <shader.h>
+#include <gpuResources.h>
+
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Crowd of visitors sharing one skinned character: every copy is drawn with one instanced call per mesh and
+// animated entirely on the GPU.
+//  - the clips are baked at load to an animation texture (GL_RGBA32F): one row per frame, BONE_BUFFER_ROWS
+//    texels per bone in the layout of the bone buffer (boneBuffer.h), the clips one after another. The
+//    first clip is the character's own animation; more can be taken from other files of the same rig
+//    (a Mixamo export per animation), matched to the character's bones by name.
+//  - every instance holds its model matrix, the rows of its clip and a time offset, in a buffer added to
+//    the VAOs of the character's meshes (locations CROWD_INSTANCE_LOCATION..+4). anim.vs finds the two
+//    frames around crowd_time and blends them, so a visitor costs the CPU nothing per frame.
+// Visitors are listed in a text file (see resources/objects/visitantes.txt), read by loadCrowds:
+//   clip <character> <file>
+//   visitante <character> <clip> <x> <y> <z> <rotation Y> <scale> <offset in seconds>
+//   fila <character> <clip> <count> <x> <y> <z> <dx> <dz> <rotation Y> <scale>
+// fila places count visitors from x, y, z every dx, dz, their offsets spread over the clip.
+
+#define CROWD_FRAME_RATE            30.0f   // frames per second of the baked clips
+#define CROWD_ANIMATION_UNIT        10      // texture unit of the animation texture in the animation shader
+#define CROWD_INSTANCE_LOCATION     7       // model matrix, the clip takes the location after it
+
+struct CrowdInstance {
+    glm::mat4 model;
+    glm::vec4 clip;     // first row in the animation texture, frames, time offset in seconds, frames per second
+};
+
+class Crowd {
+public:
+    Crowd(ModelAnim &character, const string &name)
+        : character(character), name(name), texture(0), instanceBuffer(0), instanceCapacity(0), textureRows(0),
+          instancesDirty(false), attached(false)
+    {
+        addClip(character);
+    }
+
+    Crowd(const Crowd &) = delete;
+    Crowd &operator=(const Crowd &) = delete;
+
+    // bakes the first animation of source, a model with the rig of the character; returns the clip or -1
+    int addClip(ModelAnim &source)
+    {
+        unsigned int bones = character.m_num_bones;
+        double seconds = source.ticks_per_second > 0.0f ? source.animationDuration / source.ticks_per_second : 0.0;
+        if (bones == 0 || source.clip.empty())
+        {
+            cout << "WARNING::CROWD:: " << source.path << " has no animation for " << name << endl;
+            return -1;
+        }
+        // the character's bones in the palette of source
+        vector<int> sourceBone(bones, -1);
+        unsigned int matched = 0;
+        for (map<string, uint>::const_iterator it = character.m_bone_mapping.begin(); it != character.m_bone_mapping.end(); ++it)
+        {
+            map<string, uint>::const_iterator bone = source.m_bone_mapping.find(it->first);
+            if (bone != source.m_bone_mapping.end())
+            {
+                sourceBone[it->second] = (int)bone->second;
+                matched++;
+            }
+        }
+        if (matched == 0)
+        {
+            cout << "WARNING::CROWD:: " << source.path << " doesn't share a bone with " << name << endl;
+            return -1;
+        }
+
+        // whole frames, so the clip loops from the last one back to the first
+        Clip clip;
+        clip.row = textureRows;
+        clip.frames = (unsigned int)(std::max)(1.0, std::floor(seconds * CROWD_FRAME_RATE + 0.5));
+        clip.rate = seconds > 0.0 ? (float)(clip.frames / seconds) : 0.0f;
+        size_t rowFloats = (size_t)bones * BONE_BUFFER_ROWS * 4;
+        rows.resize(rows.size() + clip.frames * rowFloats, 0.0f);
+        for (unsigned int f = 0; f < clip.frames; f++)
+        {
+            const vector<glm::mat4> &palette = source.boneTransform(clip.rate > 0.0f ? f / clip.rate : 0.0);
+            float *out = &rows[(clip.row + f) * rowFloats];
+            for (unsigned int b = 0; b < bones; b++, out += BONE_BUFFER_ROWS * 4)
+            {
+                glm::mat4 bone = sourceBone[b] >= 0 ? palette[sourceBone[b]] : glm::mat4(1.0f);
+                for (int r = 0; r < BONE_BUFFER_ROWS; r++)
+                    for (int c = 0; c < 4; c++)
+                        out[r * 4 + c] = bone[c][r];
+            }
+        }
+        textureRows += clip.frames;
+        clips.push_back(clip);
+        releaseTexture();
+        return (int)clips.size() - 1;
+    }
+
+    // loads the first animation of path just to bake it
+    int addClip(const string &path)
+    {
+        ModelAnim source(path);
+        int clip = addClip(source);
+        source.releaseTextures();
+        source.releaseGpuData();
+        source.releaseScene();
+        return clip;
+    }
+
+    size_t clipCount() const
+    {
+        return clips.size();
+    }
+
+    float clipSeconds(int clip) const
+    {
+        return clips[clip].rate > 0.0f ? clips[clip].frames / clips[clip].rate : 0.0f;
+    }
+
+    // a visitor playing clip from offset seconds, returns its index
+    unsigned int add(int clip, const glm::mat4 &model, float offset)
+    {
+        const Clip &baked = clips[clip];
+        CrowdInstance instance = { model, glm::vec4((float)baked.row, (float)baked.frames, offset, baked.rate) };
+        instances.push_back(instance);
+        instancesDirty = true;
+        return (unsigned int)instances.size() - 1;
+    }
+
+    void setTransform(unsigned int instance, const glm::mat4 &model)
+    {
+        instances[instance].model = model;
+        instancesDirty = true;
+    }
+
+    size_t size() const
+    {
+        return instances.size();
+    }
+
+    // points the animation sampler of a shader that draws the crowd at its texture unit (leaves it in use)
+    void setupProgram(Shader &shader)
+    {
+        shader.use();
+        shader.setInt("crowd_animation", CROWD_ANIMATION_UNIT);
+    }
+
+    // every visitor at seconds; shader has its camera and lights set
+    void draw(Shader &shader, double seconds)
+    {
+        if (instances.empty() || clips.empty())
+            return;
+        upload();
+        glActiveTexture(GL_TEXTURE0 + CROWD_ANIMATION_UNIT);
+        glBindTexture(GL_TEXTURE_2D, texture);
+        glActiveTexture(GL_TEXTURE0);
+        shader.setBool("crowd", true);
+        // wrapped to an hour so the float keeps its precision
+        shader.setFloat("crowd_time", (float)fmod(seconds, 3600.0));
+        for (size_t m = 0; m < character.meshes.size(); m++)
+            character.meshes[m].DrawInstanced(shader, (GLsizei)instances.size());
+        shader.setBool("crowd", false);
+    }
+
+    void printReport() const
+    {
+        cout << "MEMORY::CROWD:: " << name << "  visitors: " << instances.size() << "  clips: " << clips.size() << "  frames: "
+             << textureRows << "  animation: " << rows.size() * sizeof(float) / 1024 << " KB  draws: "
+             << (instances.empty() ? 0 : character.meshes.size()) << endl;
+    }
+
+    // deletes the texture and the instance buffer; before the character releases its meshes
+    void release()
+    {
+        releaseTexture();
+        if (attached)
+        {
+            for (size_t m = 0; m < character.meshes.size(); m++)
+            {
+                if (character.meshes[m].VAO == 0)
+                    continue;
+                glBindVertexArray(character.meshes[m].VAO);
+                for (int l = 0; l < 5; l++)
+                    glDisableVertexAttribArray(CROWD_INSTANCE_LOCATION + l);
+            }
+            glBindVertexArray(0);
+            attached = false;
+        }
+        gpuResources().release(GPU_RESOURCE_BUFFER, instanceBuffer);
+        glDeleteBuffers(1, &instanceBuffer);
+        instanceBuffer = 0;
+        instanceCapacity = 0;
+        instancesDirty = !instances.empty();
+    }
+
+private:
+    struct Clip {
+        size_t row;             // first row in the animation texture
+        unsigned int frames;
+        float rate;             // frames per second, so that frames make the whole clip
+    };
+
+    ModelAnim &character;
+    string name;
+    vector<Clip> clips;
+    vector<float> rows;         // the animation texture, frame after frame
+    vector<CrowdInstance> instances;
+    GLuint texture;
+    GLuint instanceBuffer;
+    size_t instanceCapacity;    // instances the buffer holds
+    size_t textureRows;
+    bool instancesDirty;
+    bool attached;              // the instance attributes are in the meshes' VAOs
+
+    void upload()
+    {
+        if (texture == 0)
+        {
+            GLint maxSize = 0;
+            glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxSize);
+            GLsizei width = (GLsizei)(character.m_num_bones * BONE_BUFFER_ROWS);
+            if ((GLint)textureRows > maxSize || width > maxSize)
+                cout << "WARNING::CROWD:: " << name << " animation of " << width << "x" << textureRows << " is over " << maxSize << endl;
+            glGenTextures(1, &texture);
+            glBindTexture(GL_TEXTURE_2D, texture);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, width, (GLsizei)textureRows, 0, GL_RGBA, GL_FLOAT, rows.data());
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            gpuResources().allocate(GPU_RESOURCE_TEXTURE, texture, rows.size() * sizeof(float), "crowd " + name + " animation");
+        }
+        if (!instancesDirty)
+            return;
+        instancesDirty = false;
+        if (instanceBuffer == 0)
+            glGenBuffers(1, &instanceBuffer);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        if (instances.size() > instanceCapacity)
+        {
+            instanceCapacity = instances.size();
+            glBufferData(GL_ARRAY_BUFFER, instanceCapacity * sizeof(CrowdInstance), instances.data(), GL_DYNAMIC_DRAW);
+            gpuResources().allocate(GPU_RESOURCE_BUFFER, instanceBuffer, instanceCapacity * sizeof(CrowdInstance), "crowd " + name + " instances");
+        }
+        else
+            glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(CrowdInstance), instances.data());
+        if (!attached)
+        {
+            for (size_t m = 0; m < character.meshes.size(); m++)
+            {
+                glBindVertexArray(character.meshes[m].VAO);
+                for (int c = 0; c < 4; c++)
+                {
+                    glEnableVertexAttribArray(CROWD_INSTANCE_LOCATION + c);
+                    glVertexAttribPointer(CROWD_INSTANCE_LOCATION + c, 4, GL_FLOAT, GL_FALSE, sizeof(CrowdInstance),
+                                          (void*)(offsetof(CrowdInstance, model) + c * sizeof(glm::vec4)));
+                    glVertexAttribDivisor(CROWD_INSTANCE_LOCATION + c, 1);
+                }
+                glEnableVertexAttribArray(CROWD_INSTANCE_LOCATION + 4);
+                glVertexAttribPointer(CROWD_INSTANCE_LOCATION + 4, 4, GL_FLOAT, GL_FALSE, sizeof(CrowdInstance), (void*)offsetof(CrowdInstance, clip));
+                glVertexAttribDivisor(CROWD_INSTANCE_LOCATION + 4, 1);
+            }
+            glBindVertexArray(0);
+            attached = true;
+        }
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    // the texture is rebuilt with the next draw once a clip is added
+    void releaseTexture()
+    {
+        gpuResources().release(GPU_RESOURCE_TEXTURE, texture);
+        glDeleteTextures(1, &texture);
+        texture = 0;
+    }
+};
+
+// reads the visitors of path into the crowds, keyed by the character name the file uses
+inline bool loadCrowds(const string &path, const map<string, Crowd*> &crowds)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        cout << "WARNING::CROWD:: could not read " << path << endl;
+        return false;
+    }
+    string directory = path.substr(0, path.find_last_of("/\\") + 1);
+    string line;
+    int number = 0;
+    while (getline(file, line))
+    {
+        number++;
+        istringstream words(line);
+        string command, character;
+        if (!(words >> command) || command[0] == '#')
+            continue;
+        words >> character;
+        map<string, Crowd*>::const_iterator crowd = crowds.find(character);
+        if (crowd == crowds.end())
+        {
+            cout << "WARNING::CROWD:: " << path << ":" << number << " unknown character " << character << endl;
+            continue;
+        }
+        if (command == "clip")
+        {
+            string clipPath;
+            if (words >> clipPath)
+                crowd->second->addClip(directory + clipPath);
+            continue;
+        }
+        int clip = 0, count = 1;
+        glm::vec3 position, step(0.0f);
+        float rotation = 0.0f, scale = 1.0f, offset = 0.0f;
+        bool read = false;
+        if (command == "visitante")
+            read = (bool)(words >> clip >> position.x >> position.y >> position.z >> rotation >> scale >> offset);
+        else if (command == "fila")
+            read = (bool)(words >> clip >> count >> position.x >> position.y >> position.z >> step.x >> step.z >> rotation >> scale);
+        if (!read || clip < 0 || clip >= (int)crowd->second->clipCount())
+        {
+            cout << "WARNING::CROWD:: " << path << ":" << number << " can't read " << line << endl;
+            continue;
+        }
+        for (int i = 0; i < count; i++)
+        {
+            glm::mat4 model = glm::translate(glm::mat4(1.0f), position + step * (float)i);
+            model = glm::rotate(model, glm::radians(rotation), glm::vec3(0.0f, 1.0f, 0.0f));
+            model = glm::scale(model, glm::vec3(scale));
+            // the golden ratio keeps the visitors of a row out of step
+            float start = command == "fila" ? (float)fmod(i * 0.618034, 1.0) * crowd->second->clipSeconds(clip) : offset;
+            crowd->second->add(clip, model, start);
+        }
+    }
+    return true;
+}
+#endif
@@ -0,0 +1,638 @@
+#ifndef GALLERY_H
+#define GALLERY_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <shader.h>
+#include <mappedFile.h>
+#include <textureCooker.h>
+#include <textureQuality.h>
+#include <textureRegistry.h>
+#include <virtualTexture.h>
+#include <gpuResources.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Painting gallery: every framed canvas of the museum drawn with one instanced call.
+// The works are listed in a text file (see resources/objects/Arte/galeria.txt) instead of being a model each:
+//   marco <name> <image>
+//   obra <image> <turn> <frame> <canvas width> <height> <frame width> <height> <x> <y> <z> <rotation Y> <scale>
+// Sizes are in model units before the scale, images relative to the file. turn is how many degrees (0, 90,
+// 180 or 270) the image is stored turned clockwise; the canvas turns it back.
+//  - the canvas images are the layers of one GL_TEXTURE_2D_ARRAY, each in the top left corner of a layer as
+//    large as the largest of them (at most GALLERY_LAYER_MAX, halved for the painting quality tier), with its
+//    last row and column repeated to the edge so the mips don't bleed. The part of the layer it covers (its
+//    UV scale) goes with the instance. Frame finishes are a second, smaller array, stretched to fill a layer.
+//  - one shared mesh: a canvas of half size 1 and four frame bars whose outer vertices move out by the frame
+//    size of the instance, so any aspect ratio is the same geometry
+//  - one buffer of per work attributes (model matrix, sizes, layer, finish) drawn with glDrawElementsInstanced
+// Works whose image has a virtual texture scan (virtualTexture.h) are kept at the end of the buffer and drawn
+// one by one after the others, each with its page table. Layers are cooked (BC1, or BC7 without S3TC and RGBA8
+// without BPTC either) once and stored in TEXTURE_COOK_DIRECTORY.
+// Decoding uses stb_image, whose implementation is compiled by the main translation unit.
+
+#define GALLERY_LAYER_MAX       1024
+#define GALLERY_FINISH_SIZE     1024
+#define GALLERY_FRAME_DEPTH     0.1f        // half depth of the frame bars, in model units
+#define GALLERY_CANVAS_DEPTH    0.005f
+#define GALLERY_CANVAS_UNIT     12          // texture units of the canvas and finish arrays
+#define GALLERY_FINISH_UNIT     13
+
+struct GalleryVertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 texCoords;    // canvas: 0,0 at the top left of the painting as the viewer sees it
+    glm::vec3 frame;        // x, y: how far the vertex moves out to the frame edge along the height and width; z: 1 on the frame
+};
+
+// attributes of a work, one per instance
+struct GalleryInstance {
+    glm::mat4 model;
+    glm::vec4 size;         // canvas half width, half height, frame half width, half height
+    glm::vec4 canvas;       // UV scale of the image in its layer, layer, quarter turns
+    float finish;           // layer of the frame finish
+};
+
+class Gallery {
+public:
+    Gallery() : VAO(0), VBO(0), EBO(0), instanceVBO(0), canvases(0), finishes(0), format(COOKED_BC1),
+        layerWidth(0), layerHeight(0), canvasLevels(0), finishLevels(0), batchCount(0), frameIndexCount(0), indexCount(0),
+        canvasBytes(0), finishBytes(0), cooked(0), cached(0)
+    {
+    }
+
+    // reads the works at path and builds the texture arrays, the mesh and the instance buffer. Main thread.
+    // Scans have to be registered (virtualTextures().addScan) before
+    bool load(const string &path)
+    {
+        ifstream file(path.c_str());
+        if (!file)
+        {
+            cout << "ERROR::GALLERY:: could not read " << path << endl;
+            return false;
+        }
+        string directory = path.substr(0, path.find_last_of("/\\"));
+        map<string, unsigned int> finishLayers;
+        string line;
+        for (unsigned int number = 1; getline(file, line); number++)
+        {
+            istringstream fields(line);
+            string kind;
+            if (!(fields >> kind) || kind[0] == '#')
+                continue;
+            if (kind == "marco")
+            {
+                string name, image;
+                if (!(fields >> name >> image))
+                {
+                    cout << "WARNING::GALLERY:: " << path << ":" << number << ": expected marco <name> <image>" << endl;
+                    continue;
+                }
+                finishLayers[name] = (unsigned int)finishImages.size();
+                finishImages.push_back(directory + '/' + image);
+                continue;
+            }
+            Work work;
+            string finish;
+            float rotation = 0.0f, scale = 1.0f;
+            if (kind != "obra" || !(fields >> work.image >> work.turn >> finish >> work.canvasSize.x >> work.canvasSize.y
+                                           >> work.frameSize.x >> work.frameSize.y >> work.position.x >> work.position.y
+                                           >> work.position.z >> rotation >> scale))
+            {
+                cout << "WARNING::GALLERY:: " << path << ":" << number << ": expected obra <image> <turn> <frame> <canvas width> "
+                     << "<height> <frame width> <height> <x> <y> <z> <rotation> <scale>" << endl;
+                continue;
+            }
+            map<string, unsigned int>::const_iterator layer = finishLayers.find(finish);
+            if (layer == finishLayers.end())
+            {
+                cout << "WARNING::GALLERY:: " << path << ":" << number << ": unknown frame " << finish << endl;
+                continue;
+            }
+            work.image = directory + '/' + work.image;
+            work.turn = ((work.turn % 360 + 360) % 360) / 90;
+            work.finish = layer->second;
+            work.frameSize = glm::max(work.frameSize, work.canvasSize);
+            work.model = glm::translate(glm::mat4(1.0f), work.position);
+            work.model = glm::rotate(work.model, glm::radians(rotation), glm::vec3(0.0f, 1.0f, 0.0f));
+            work.model = glm::scale(work.model, glm::vec3(scale));
+            works.push_back(work);
+        }
+
+        GLint maxLayers = 0;
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+        if (works.size() > (size_t)maxLayers)
+        {
+            cout << "WARNING::GALLERY:: " << works.size() << " works, the GPU takes " << maxLayers << " layers" << endl;
+            works.resize(maxLayers);
+        }
+        format = s3tcSupported() ? COOKED_BC1 : bptcSupported() ? COOKED_BC7 : COOKED_RGBA8;
+        if (!buildCanvases() || !buildFinishes())
+        {
+            release();
+            return false;
+        }
+        // works with a scan go last, drawn on their own
+        for (size_t w = 0; w < works.size(); w++)
+            works[w].scan = virtualTextures().acquire(works[w].image);
+        stable_partition(works.begin(), works.end(), [](const Work &work) { return work.scan == 0; });
+        batchCount = 0;
+        while (batchCount < works.size() && works[batchCount].scan == 0)
+            batchCount++;
+        buildMesh();
+        return true;
+    }
+
+    // points the array samplers of a shader that draws the gallery at their texture units (leaves it in use)
+    void setupProgram(Shader &shader)
+    {
+        shader.use();
+        shader.setInt("gallery_canvases", GALLERY_CANVAS_UNIT);
+        shader.setInt("gallery_finishes", GALLERY_FINISH_UNIT);
+    }
+
+    // every work; shader has its camera and lights set
+    void draw(Shader &shader)
+    {
+        if (VAO == 0)
+            return;
+        shader.use();
+        glActiveTexture(GL_TEXTURE0 + GALLERY_CANVAS_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, canvases);
+        glActiveTexture(GL_TEXTURE0 + GALLERY_FINISH_UNIT);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, finishes);
+        glActiveTexture(GL_TEXTURE0);
+        glBindVertexArray(VAO);
+        virtualTextures().unbind(shader.ID);
+        if (batchCount > 0)
+            glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)0, (GLsizei)batchCount);
+        for (size_t w = batchCount; w < works.size(); w++)
+        {
+            // the feedback pass draws the canvas alone, with the UVs of the scan
+            const Work &work = works[w];
+            glm::mat4 canvas = glm::scale(work.model, glm::vec3(1.0f, work.canvasSize.y * 0.5f, work.canvasSize.x * 0.5f));
+            virtualTextures().record(work.scan, VAO, 12, GL_UNSIGNED_SHORT, canvasOffsets[work.turn], canvas);
+            // the layer shows until the coarsest page of the scan is in
+            if (!virtualTextures().bind(shader.ID, work.scan))
+                virtualTextures().unbind(shader.ID);
+            // base instances are GL 4.2: the instance attributes start at the work instead
+            pointInstances(w);
+            glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, (void*)0, 1);
+        }
+        if (batchCount < works.size())
+            pointInstances(0);
+        virtualTextures().unbind(shader.ID);
+        glBindVertexArray(0);
+    }
+
+    size_t size() const
+    {
+        return works.size();
+    }
+
+    void printReport() const
+    {
+        cout << "MEMORY::GALLERY:: works: " << works.size() << " (" << works.size() - batchCount << " with scans)  draws: "
+             << (batchCount > 0 ? 1 : 0) + works.size() - batchCount << "  canvases: " << layerWidth << "x" << layerHeight << " "
+             << cookedFormatName(format) << " " << canvasBytes / 1024 << " KB  frames: " << finishImages.size() << " finishes "
+             << finishBytes / 1024 << " KB  layers cooked: " << cooked << " cached: " << cached << endl;
+    }
+
+    // deletes the arrays and the buffers
+    void release()
+    {
+        gpuResources().release(GPU_RESOURCE_TEXTURE, canvases);
+        gpuResources().release(GPU_RESOURCE_TEXTURE, finishes);
+        gpuResources().release(GPU_RESOURCE_BUFFER, VBO);
+        gpuResources().release(GPU_RESOURCE_BUFFER, EBO);
+        gpuResources().release(GPU_RESOURCE_BUFFER, instanceVBO);
+        glDeleteTextures(1, &canvases);
+        glDeleteTextures(1, &finishes);
+        glDeleteVertexArrays(1, &VAO);
+        glDeleteBuffers(1, &VBO);
+        glDeleteBuffers(1, &EBO);
+        glDeleteBuffers(1, &instanceVBO);
+        VAO = VBO = EBO = instanceVBO = canvases = finishes = 0;
+    }
+
+private:
+    struct Work {
+        string image;
+        int turn;
+        unsigned int finish;
+        glm::vec2 canvasSize;   // width, height
+        glm::vec2 frameSize;
+        glm::vec3 position;
+        glm::mat4 model;
+        unsigned int layer;
+        glm::vec2 uvScale;
+        unsigned int scan;      // virtual texture handle, 0 for none
+        Work() : turn(0), finish(0), layer(0), uvScale(1.0f), scan(0) {}
+    };
+
+    vector<Work> works;
+    vector<string> finishImages;
+    unsigned int VAO, VBO, EBO, instanceVBO;
+    unsigned int canvases, finishes;
+    CookedFormat format;
+    unsigned int layerWidth, layerHeight;
+    unsigned int canvasLevels, finishLevels;
+    size_t batchCount;                  // works drawn together, the ones with a scan follow
+    unsigned int frameIndexCount;
+    unsigned int indexCount;            // frame and canvas
+    size_t canvasOffsets[4];            // byte offset of the canvas indices for every quarter turn of its UVs
+    size_t canvasBytes, finishBytes;
+    unsigned int cooked, cached;
+
+    // halvings that bring an image to the quality tier and into a layer
+    static unsigned int layerHalvings(unsigned int width, unsigned int height, unsigned int maxSize)
+    {
+        unsigned int halvings = 0, tier = textureQuality().tier(TEXTURE_CATEGORY_PAINTING);
+        for (; halvings < tier && (std::max)(width, height) / 2 >= TEXTURE_QUALITY_MIN_SIZE; halvings++)
+        {
+            width = (std::max)(1u, width / 2);
+            height = (std::max)(1u, height / 2);
+        }
+        for (; (std::max)(width, height) > maxSize; halvings++)
+        {
+            width = (std::max)(1u, width / 2);
+            height = (std::max)(1u, height / 2);
+        }
+        return halvings;
+    }
+
+    static unsigned int levelCount(unsigned int width, unsigned int height)
+    {
+        unsigned int levels = 1;
+        for (; width > 1 || height > 1; levels++)
+        {
+            width = (std::max)(1u, width / 2);
+            height = (std::max)(1u, height / 2);
+        }
+        return levels;
+    }
+
+    // cooked layer of an image: named after its contents and everything that shapes the layer
+    string layerPath(const MappedFile &source, unsigned int halvings, unsigned int width, unsigned int height, bool stretch) const
+    {
+        char name[96];
+        snprintf(name, sizeof(name), "%016llx_%llx_%s%ux%u_d%u_%s.ktx2",
+                 (unsigned long long)textureContentHash((const unsigned char*)source.data(), source.size()),
+                 (unsigned long long)source.size(), stretch ? "s" : "g", width, height, halvings, cookedFormatName(format));
+        return string(TEXTURE_COOK_DIRECTORY) + '/' + name;
+    }
+
+    // decodes source into a width x height layer, halved first; the image is stretched over the layer, or put in its
+    // top left corner with the last row and column repeated. False if it can't be decoded
+    static bool fillLayer(const MappedFile &source, unsigned int halvings, unsigned int width, unsigned int height, bool stretch,
+                          vector<unsigned char> &layer)
+    {
+        stbi_set_flip_vertically_on_load(false);
+        int w, h, components;
+        unsigned char *pixels = stbi_load_from_memory((const unsigned char*)source.data(), (int)source.size(), &w, &h, &components, 4);
+        if (!pixels)
+            return false;
+        unsigned int imageWidth = (unsigned int)w, imageHeight = (unsigned int)h;
+        vector<unsigned char> scaled;
+        const unsigned char *image = pixels;
+        if (cookDownscale(pixels, imageWidth, imageHeight, halvings, 1, scaled))
+            image = scaled.data();
+        layer.resize((size_t)width * height * 4);
+        for (unsigned int y = 0; y < height; y++)
+            for (unsigned int x = 0; x < width; x++)
+            {
+                unsigned int sx = stretch ? x * imageWidth / width : (std::min)(x, imageWidth - 1);
+                unsigned int sy = stretch ? y * imageHeight / height : (std::min)(y, imageHeight - 1);
+                memcpy(&layer[((size_t)y * width + x) * 4], image + ((size_t)sy * imageWidth + sx) * 4, 4);
+            }
+        stbi_image_free(pixels);
+        return true;
+    }
+
+    // cooked copy of a layer, read from the cache or cooked and stored there
+    bool cookLayer(const MappedFile &source, unsigned int halvings, unsigned int width, unsigned int height, bool stretch, CookedTexture &texture)
+    {
+        string path = layerPath(source, halvings, width, height, stretch);
+        if (readKtx2(path, texture) && texture.format == format && texture.width == width && texture.height == height
+            && texture.levels() == levelCount(width, height))
+        {
+            cached++;
+            return true;
+        }
+        vector<unsigned char> layer;
+        if (!fillLayer(source, halvings, width, height, stretch, layer))
+            return false;
+        cookTexture(layer.data(), width, height, format, TEXTURE_USAGE_COLOR, texture);
+        cooked++;
+        if (makeDirectories(TEXTURE_COOK_DIRECTORY))
+            writeKtx2(path, texture);
+        return true;
+    }
+
+    void grayLayer(unsigned int width, unsigned int height, CookedTexture &texture) const
+    {
+        vector<unsigned char> gray((size_t)width * height * 4, 128);
+        cookTexture(gray.data(), width, height, format, TEXTURE_USAGE_COLOR, texture);
+    }
+
+    static void uploadLayer(const CookedTexture &texture, unsigned int layer)
+    {
+        unsigned int w = texture.width, h = texture.height;
+        for (size_t l = 0; l < texture.levels(); l++)
+        {
+            const unsigned char *level = &texture.data[texture.levelOffsets[l]];
+            if (texture.format == COOKED_RGBA8)
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, 0, 0, layer, w, h, 1, GL_RGBA, GL_UNSIGNED_BYTE, level);
+            else
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, 0, 0, layer, w, h, 1, cookedGLFormat(texture.format),
+                                          (GLsizei)texture.levelSizes[l], level);
+            w = (std::max)(1u, w / 2);
+            h = (std::max)(1u, h / 2);
+        }
+    }
+
+    // allocates every level of the bound array without data (glTexStorage3D would need GL 4.2)
+    static void allocateArray(CookedFormat format, unsigned int levels, unsigned int width, unsigned int height, unsigned int layers)
+    {
+        unsigned int w = width, h = height;
+        for (unsigned int l = 0; l < levels; l++)
+        {
+            if (format == COOKED_RGBA8)
+                glTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, GL_RGBA8, w, h, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+            else
+                glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, (GLint)l, cookedGLFormat(format), w, h, layers, 0,
+                                       (GLsizei)(cookedLevelSize(format, w, h) * layers), nullptr);
+            w = (std::max)(1u, w / 2);
+            h = (std::max)(1u, h / 2);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, (GLint)levels - 1);
+    }
+
+    static size_t arrayBytes(CookedFormat format, unsigned int width, unsigned int height, unsigned int layers)
+    {
+        size_t bytes = 0;
+        for (unsigned int w = width, h = height;; w = (std::max)(1u, w / 2), h = (std::max)(1u, h / 2))
+        {
+            bytes += cookedLevelSize(format, w, h);
+            if (w == 1 && h == 1)
+                break;
+        }
+        return bytes * layers;
+    }
+
+    // one layer per work, as large as the largest image
+    bool buildCanvases()
+    {
+        vector<unsigned int> halvings(works.size(), 0);
+        vector<glm::uvec2> sizes(works.size());
+        layerWidth = layerHeight = 4;
+        for (size_t w = 0; w < works.size(); w++)
+        {
+            MappedFile source;
+            int width = 0, height = 0, components;
+            if (!source.open(works[w].image)
+                || !stbi_info_from_memory((const unsigned char*)source.data(), (int)source.size(), &width, &height, &components))
+            {
+                cout << "WARNING::GALLERY:: could not read " << works[w].image << ", the work is left out" << endl;
+                works.erase(works.begin() + w);
+                halvings.erase(halvings.begin() + w);
+                sizes.erase(sizes.begin() + w);
+                w--;
+                continue;
+            }
+            halvings[w] = layerHalvings(width, height, GALLERY_LAYER_MAX);
+            sizes[w] = glm::uvec2(width, height);
+            for (unsigned int h = 0; h < halvings[w]; h++)
+                sizes[w] = glm::max(sizes[w] / 2u, glm::uvec2(1u));
+            // whole blocks, so every layer is encoded the same way
+            layerWidth = (std::max)(layerWidth, (sizes[w].x + 3) & ~3u);
+            layerHeight = (std::max)(layerHeight, (sizes[w].y + 3) & ~3u);
+        }
+        if (works.empty())
+            return false;
+
+        canvasLevels = levelCount(layerWidth, layerHeight);
+        glGenTextures(1, &canvases);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, canvases);
+        allocateArray(format, canvasLevels, layerWidth, layerHeight, (unsigned int)works.size());
+        for (size_t w = 0; w < works.size(); w++)
+        {
+            MappedFile source;
+            CookedTexture texture;
+            if (!source.open(works[w].image) || !cookLayer(source, halvings[w], layerWidth, layerHeight, false, texture))
+            {
+                cout << "WARNING::GALLERY:: could not decode " << works[w].image << ", it is drawn gray" << endl;
+                grayLayer(layerWidth, layerHeight, texture);
+            }
+            uploadLayer(texture, (unsigned int)w);
+            works[w].layer = (unsigned int)w;
+            works[w].uvScale = glm::vec2(sizes[w]) / glm::vec2((float)layerWidth, (float)layerHeight);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (glGetError() != GL_NO_ERROR)
+        {
+            cout << "ERROR::GALLERY:: could not create the canvas array" << endl;
+            return false;
+        }
+        canvasBytes = arrayBytes(format, layerWidth, layerHeight, (unsigned int)works.size());
+        gpuResources().allocate(GPU_RESOURCE_TEXTURE, canvases, canvasBytes, "gallery canvases");
+        return true;
+    }
+
+    // one layer per frame finish; a finish that can't be read stays gray
+    bool buildFinishes()
+    {
+        if (finishImages.empty())
+            finishImages.push_back(string());
+        unsigned int size = (std::max)(GALLERY_FINISH_SIZE >> textureQuality().tier(TEXTURE_CATEGORY_PAINTING), 4);
+        finishLevels = levelCount(size, size);
+        glGenTextures(1, &finishes);
+        glBindTexture(GL_TEXTURE_2D_ARRAY, finishes);
+        allocateArray(format, finishLevels, size, size, (unsigned int)finishImages.size());
+        for (size_t f = 0; f < finishImages.size(); f++)
+        {
+            MappedFile source;
+            CookedTexture texture;
+            int width = 0, height = 0, components;
+            bool ok = source.open(finishImages[f])
+                && stbi_info_from_memory((const unsigned char*)source.data(), (int)source.size(), &width, &height, &components)
+                && cookLayer(source, layerHalvings(width, height, size), size, size, true, texture);
+            if (!ok)
+            {
+                cout << "WARNING::GALLERY:: could not read frame finish " << finishImages[f] << ", it is drawn gray" << endl;
+                grayLayer(size, size, texture);
+            }
+            uploadLayer(texture, (unsigned int)f);
+        }
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        if (glGetError() != GL_NO_ERROR)
+        {
+            cout << "ERROR::GALLERY:: could not create the frame finish array" << endl;
+            return false;
+        }
+        finishBytes = arrayBytes(format, size, size, (unsigned int)finishImages.size());
+        gpuResources().allocate(GPU_RESOURCE_TEXTURE, finishes, finishBytes, "gallery frame finishes");
+        return true;
+    }
+
+    // box of the frame: corners at low and high. A corner coordinate of 0 stays on the canvas edge, of 1
+    // moves out to the frame edge (frame.y along the height, frame.z along the width)
+    static void addBox(vector<GalleryVertex> &vertices, vector<uint16_t> &indices, const glm::vec3 &low, const glm::vec3 &high,
+                       const glm::vec2 &frameLow, const glm::vec2 &frameHigh)
+    {
+        for (int axis = 0; axis < 3; axis++)
+            for (int side = 0; side < 2; side++)
+            {
+                glm::vec3 normal(0.0f);
+                normal[axis] = side ? 1.0f : -1.0f;
+                int u = (axis + 1) % 3, v = (axis + 2) % 3;
+                uint16_t first = (uint16_t)vertices.size();
+                for (int corner = 0; corner < 4; corner++)
+                {
+                    // counterclockwise seen from outside
+                    int cu = (corner == 1 || corner == 2) ? 1 : 0, cv = corner >= 2 ? 1 : 0;
+                    if (!side)
+                        cu = 1 - cu;
+                    glm::bvec3 high3(false);
+                    high3[axis] = side != 0;
+                    high3[u] = cu != 0;
+                    high3[v] = cv != 0;
+                    GalleryVertex vertex;
+                    vertex.position = glm::vec3(high3.x ? high.x : low.x, high3.y ? high.y : low.y, high3.z ? high.z : low.z);
+                    vertex.normal = normal;
+                    vertex.texCoords = glm::vec2(0.0f);
+                    vertex.frame = glm::vec3(high3.y ? frameHigh.x : frameLow.x, high3.z ? frameHigh.y : frameLow.y, 1.0f);
+                    vertices.push_back(vertex);
+                }
+                const uint16_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+                for (int i = 0; i < 6; i++)
+                    indices.push_back(first + quad[i]);
+            }
+    }
+
+    // front and back of the canvas, their UVs turned turn quarters clockwise
+    static void addCanvas(vector<GalleryVertex> &vertices, vector<uint16_t> &indices, int turn)
+    {
+        for (int side = 0; side < 2; side++)
+        {
+            float x = side ? GALLERY_CANVAS_DEPTH : -GALLERY_CANVAS_DEPTH, facing = side ? 1.0f : -1.0f;
+            uint16_t first = (uint16_t)vertices.size();
+            for (int corner = 0; corner < 4; corner++)
+            {
+                // left to right and top to bottom as seen from the side it faces; its right is -z from the front
+                float s = (corner == 1 || corner == 2) ? 1.0f : 0.0f, t = corner >= 2 ? 0.0f : 1.0f;
+                GalleryVertex vertex;
+                vertex.position = glm::vec3(x, 1.0f - 2.0f * t, facing * (1.0f - 2.0f * s));
+                vertex.normal = glm::vec3(facing, 0.0f, 0.0f);
+                glm::vec2 turned[4] = { glm::vec2(s, t), glm::vec2(1.0f - t, s), glm::vec2(1.0f - s, 1.0f - t), glm::vec2(t, 1.0f - s) };
+                vertex.texCoords = turned[turn];
+                vertex.frame = glm::vec3(0.0f);
+                vertices.push_back(vertex);
+            }
+            const uint16_t quad[6] = { 0, 1, 2, 0, 2, 3 };
+            for (int i = 0; i < 6; i++)
+                indices.push_back(first + quad[i]);
+        }
+    }
+
+    void buildMesh()
+    {
+        vector<GalleryVertex> vertices;
+        vector<uint16_t> indices;
+        const float depth = GALLERY_FRAME_DEPTH;
+        // top and bottom bars span the whole frame width, the sides fill in between
+        addBox(vertices, indices, glm::vec3(-depth, 1.0f, -1.0f), glm::vec3(depth, 1.0f, 1.0f), glm::vec2(0.0f, -1.0f), glm::vec2(1.0f, 1.0f));
+        addBox(vertices, indices, glm::vec3(-depth, -1.0f, -1.0f), glm::vec3(depth, -1.0f, 1.0f), glm::vec2(-1.0f, -1.0f), glm::vec2(0.0f, 1.0f));
+        addBox(vertices, indices, glm::vec3(-depth, -1.0f, 1.0f), glm::vec3(depth, 1.0f, 1.0f), glm::vec2(0.0f, 0.0f), glm::vec2(0.0f, 1.0f));
+        addBox(vertices, indices, glm::vec3(-depth, -1.0f, -1.0f), glm::vec3(depth, 1.0f, -1.0f), glm::vec2(0.0f, -1.0f), glm::vec2(0.0f, 0.0f));
+        frameIndexCount = (unsigned int)indices.size();
+        for (int turn = 0; turn < 4; turn++)
+        {
+            canvasOffsets[turn] = indices.size() * sizeof(uint16_t);
+            addCanvas(vertices, indices, turn);
+            if (turn == 0)
+                indexCount = (unsigned int)indices.size();
+        }
+
+        vector<GalleryInstance> instances(works.size());
+        for (size_t w = 0; w < works.size(); w++)
+        {
+            const Work &work = works[w];
+            instances[w].model = work.model;
+            instances[w].size = glm::vec4(work.canvasSize * 0.5f, work.frameSize * 0.5f);
+            instances[w].canvas = glm::vec4(work.uvScale, (float)work.layer, (float)work.turn);
+            instances[w].finish = (float)work.finish;
+        }
+
+        glGenVertexArrays(1, &VAO);
+        glGenBuffers(1, &VBO);
+        glGenBuffers(1, &EBO);
+        glGenBuffers(1, &instanceVBO);
+        glBindVertexArray(VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO);
+        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GalleryVertex), vertices.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(GalleryVertex), (void*)offsetof(GalleryVertex, position));
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(GalleryVertex), (void*)offsetof(GalleryVertex, normal));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(GalleryVertex), (void*)offsetof(GalleryVertex, texCoords));
+        glEnableVertexAttribArray(3);
+        glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, sizeof(GalleryVertex), (void*)offsetof(GalleryVertex, frame));
+
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        glBufferData(GL_ARRAY_BUFFER, instances.size() * sizeof(GalleryInstance), instances.data(), GL_STATIC_DRAW);
+        for (unsigned int location = 4; location <= 10; location++)
+        {
+            glEnableVertexAttribArray(location);
+            glVertexAttribDivisor(location, 1);
+        }
+        pointInstances(0);
+        glBindVertexArray(0);
+
+        gpuResources().allocate(GPU_RESOURCE_BUFFER, VBO, vertices.size() * sizeof(GalleryVertex), "gallery mesh");
+        gpuResources().allocate(GPU_RESOURCE_BUFFER, EBO, indices.size() * sizeof(uint16_t), "gallery mesh");
+        gpuResources().allocate(GPU_RESOURCE_BUFFER, instanceVBO, instances.size() * sizeof(GalleryInstance), "gallery instances");
+    }
+
+    // the instance attributes of the bound VAO, read from the work first on
+    void pointInstances(size_t first)
+    {
+        size_t base = first * sizeof(GalleryInstance);
+        glBindBuffer(GL_ARRAY_BUFFER, instanceVBO);
+        for (int column = 0; column < 4; column++)
+            glVertexAttribPointer(4 + column, 4, GL_FLOAT, GL_FALSE, sizeof(GalleryInstance),
+                                  (void*)(base + offsetof(GalleryInstance, model) + column * sizeof(glm::vec4)));
+        glVertexAttribPointer(8, 4, GL_FLOAT, GL_FALSE, sizeof(GalleryInstance), (void*)(base + offsetof(GalleryInstance, size)));
+        glVertexAttribPointer(9, 4, GL_FLOAT, GL_FALSE, sizeof(GalleryInstance), (void*)(base + offsetof(GalleryInstance, canvas)));
+        glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(GalleryInstance), (void*)(base + offsetof(GalleryInstance, finish)));
+    }
+};
+
+inline Gallery& gallery()
+{
+    static Gallery gallery;
+    return gallery;
+}
+#endif
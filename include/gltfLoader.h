@@ -0,0 +1,1131 @@
+#ifndef GLTF_LOADER_H
+#define GLTF_LOADER_H
+
+#include <glad/glad.h> // holds all OpenGL type declarations
+
+#include <glm/glm.hpp>
+
+#include <assimp/scene.h>
+
+#include <mesh.h>
+#include <meshAnim.h>
+#include <meshCache.h>
+#include <mappedFile.h>
+#include <vertexConvert.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// glTF 2.0 loader used by Model and ModelAnim for .glb files (and .gltf files with one external .bin).
+// The binary chunk is memory mapped and its buffer views are uploaded to GL buffers as they are: each
+// primitive gets a VAO whose attribute pointers use the offsets and strides of its accessors, so the
+// common case (float positions/normals/UVs, 16 or 32 bit indices, 8/16 bit joints) costs one
+// glBufferData per buffer view. Only the bitangents, which glTF doesn't store, are computed; any
+// primitive whose layout GL can't read directly is converted into our Vertex layout instead.
+// Skins and animations are turned into the aiNode / aiAnimation structures ModelAnim animates with.
+// Things this loader doesn't support (sparse accessors, embedded base64 buffers, several buffers)
+// make it fail, and the models fall back to Assimp.
+
+#define GLTF_MAGIC       0x46546C67u   // "glTF"
+#define GLTF_CHUNK_JSON  0x4E4F534Au   // "JSON"
+#define GLTF_CHUNK_BIN   0x004E4942u   // "BIN\0"
+
+#define GLTF_BYTE            5120
+#define GLTF_UNSIGNED_BYTE   5121
+#define GLTF_SHORT           5122
+#define GLTF_UNSIGNED_SHORT  5123
+#define GLTF_UNSIGNED_INT    5125
+#define GLTF_FLOAT           5126
+#define GLTF_TRIANGLES       4
+
+// Minimal JSON document, just what the glTF header needs
+struct JsonValue {
+    enum Type { JSON_NULL, JSON_BOOL, JSON_NUMBER, JSON_STRING, JSON_ARRAY, JSON_OBJECT };
+
+    Type type;
+    bool boolean;
+    double number;
+    string text;
+    vector<JsonValue> items;    // array elements, or object values
+    vector<string> keys;        // object keys, parallel to items
+
+    JsonValue() : type(JSON_NULL), boolean(false), number(0.0) {}
+
+    static const JsonValue &null()
+    {
+        static const JsonValue value;
+        return value;
+    }
+
+    size_t size() const { return items.size(); }
+    bool isNull() const { return type == JSON_NULL; }
+
+    // out of range (or negative) indices give null, so a missing glTF reference reads as null
+    const JsonValue &operator[](int i) const
+    {
+        return type == JSON_ARRAY && i >= 0 && (size_t)i < items.size() ? items[i] : null();
+    }
+
+    const JsonValue &operator[](const char *key) const
+    {
+        if (type == JSON_OBJECT)
+            for (size_t i = 0; i < keys.size(); i++)
+                if (keys[i] == key)
+                    return items[i];
+        return null();
+    }
+
+    bool has(const char *key) const { return !(*this)[key].isNull(); }
+    double asNumber(double fallback = 0.0) const { return type == JSON_NUMBER ? number : fallback; }
+    int asInt(int fallback = -1) const { return type == JSON_NUMBER ? (int)number : fallback; }
+    size_t asSize(size_t fallback = 0) const { return type == JSON_NUMBER && number >= 0.0 ? (size_t)number : fallback; }
+    bool asBool(bool fallback = false) const { return type == JSON_BOOL ? boolean : fallback; }
+    const string &asString() const { return text; }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char *begin, const char *end) : p(begin), end(end), depth(0) {}
+
+    bool parse(JsonValue &value)
+    {
+        skipSpaces();
+        if (!parseValue(value))
+            return false;
+        skipSpaces();
+        // the GLB JSON chunk is padded with spaces, anything else after the document is an error
+        while (p < end && *p == '\0')
+            p++;
+        return p == end;
+    }
+
+private:
+    const char *p;
+    const char *end;
+    int depth;
+
+    void skipSpaces()
+    {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+            p++;
+    }
+
+    bool literal(const char *word)
+    {
+        size_t length = strlen(word);
+        if ((size_t)(end - p) < length || memcmp(p, word, length) != 0)
+            return false;
+        p += length;
+        return true;
+    }
+
+    bool parseValue(JsonValue &value)
+    {
+        if (p >= end || depth > 256)
+            return false;
+        switch (*p)
+        {
+        case '{': return parseObject(value);
+        case '[': return parseArray(value);
+        case '"': value.type = JsonValue::JSON_STRING; return parseString(value.text);
+        case 't': value.type = JsonValue::JSON_BOOL; value.boolean = true; return literal("true");
+        case 'f': value.type = JsonValue::JSON_BOOL; value.boolean = false; return literal("false");
+        case 'n': value.type = JsonValue::JSON_NULL; return literal("null");
+        default: return parseNumber(value);
+        }
+    }
+
+    bool parseNumber(JsonValue &value)
+    {
+        char buffer[64];
+        size_t length = 0;
+        while (p < end && length < sizeof(buffer) - 1 &&
+               (isdigit((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E'))
+            buffer[length++] = *p++;
+        if (length == 0)
+            return false;
+        buffer[length] = '\0';
+        char *parsed = nullptr;
+        value.type = JsonValue::JSON_NUMBER;
+        value.number = strtod(buffer, &parsed);
+        return parsed == buffer + length;
+    }
+
+    static void appendUtf8(string &out, unsigned int code)
+    {
+        if (code < 0x80)
+            out += (char)code;
+        else if (code < 0x800)
+        {
+            out += (char)(0xC0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else if (code < 0x10000)
+        {
+            out += (char)(0xE0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+        else
+        {
+            out += (char)(0xF0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3F));
+            out += (char)(0x80 | ((code >> 6) & 0x3F));
+            out += (char)(0x80 | (code & 0x3F));
+        }
+    }
+
+    bool parseHex4(unsigned int &code)
+    {
+        if (end - p < 4)
+            return false;
+        code = 0;
+        for (int i = 0; i < 4; i++, p++)
+        {
+            char c = *p;
+            code <<= 4;
+            if (c >= '0' && c <= '9') code |= c - '0';
+            else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+            else return false;
+        }
+        return true;
+    }
+
+    bool parseString(string &out)
+    {
+        p++; // opening quote
+        out.clear();
+        while (p < end && *p != '"')
+        {
+            if (*p != '\\')
+            {
+                out += *p++;
+                continue;
+            }
+            if (++p >= end)
+                return false;
+            char escaped = *p++;
+            switch (escaped)
+            {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+                unsigned int code;
+                if (!parseHex4(code))
+                    return false;
+                // surrogate pair
+                if (code >= 0xD800 && code <= 0xDBFF && end - p >= 6 && p[0] == '\\' && p[1] == 'u')
+                {
+                    p += 2;
+                    unsigned int low;
+                    if (!parseHex4(low))
+                        return false;
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                }
+                appendUtf8(out, code);
+                break;
+            }
+            default:
+                return false;
+            }
+        }
+        if (p >= end)
+            return false;
+        p++; // closing quote
+        return true;
+    }
+
+    bool parseArray(JsonValue &value)
+    {
+        value.type = JsonValue::JSON_ARRAY;
+        p++;
+        depth++;
+        skipSpaces();
+        if (p < end && *p == ']')
+        {
+            p++;
+            depth--;
+            return true;
+        }
+        for (;;)
+        {
+            value.items.push_back(JsonValue());
+            skipSpaces();
+            if (!parseValue(value.items.back()))
+                return false;
+            skipSpaces();
+            if (p < end && *p == ',')
+            {
+                p++;
+                continue;
+            }
+            if (p < end && *p == ']')
+            {
+                p++;
+                depth--;
+                return true;
+            }
+            return false;
+        }
+    }
+
+    bool parseObject(JsonValue &value)
+    {
+        value.type = JsonValue::JSON_OBJECT;
+        p++;
+        depth++;
+        skipSpaces();
+        if (p < end && *p == '}')
+        {
+            p++;
+            depth--;
+            return true;
+        }
+        for (;;)
+        {
+            skipSpaces();
+            if (p >= end || *p != '"')
+                return false;
+            value.keys.push_back(string());
+            if (!parseString(value.keys.back()))
+                return false;
+            skipSpaces();
+            if (p >= end || *p != ':')
+                return false;
+            p++;
+            skipSpaces();
+            value.items.push_back(JsonValue());
+            if (!parseValue(value.items.back()))
+                return false;
+            skipSpaces();
+            if (p < end && *p == ',')
+            {
+                p++;
+                continue;
+            }
+            if (p < end && *p == '}')
+            {
+                p++;
+                depth--;
+                return true;
+            }
+            return false;
+        }
+    }
+};
+
+inline bool isGltfFile(const string &path)
+{
+    size_t dot = path.find_last_of('.');
+    if (dot == string::npos)
+        return false;
+    string extension = path.substr(dot + 1);
+    for (size_t i = 0; i < extension.size(); i++)
+        extension[i] = (char)tolower((unsigned char)extension[i]);
+    return extension == "glb" || extension == "gltf";
+}
+
+// an accessor resolved against its buffer view: element i starts at data + i * stride
+struct GltfAccessor {
+    int bufferView;
+    size_t byteOffset;          // offset inside the buffer view
+    int componentType;
+    int components;
+    size_t count;
+    size_t stride;
+    bool normalized;
+    const unsigned char *data;
+};
+
+inline size_t gltfComponentSize(int componentType)
+{
+    switch (componentType)
+    {
+    case GLTF_BYTE: case GLTF_UNSIGNED_BYTE: return 1;
+    case GLTF_SHORT: case GLTF_UNSIGNED_SHORT: return 2;
+    case GLTF_UNSIGNED_INT: case GLTF_FLOAT: return 4;
+    default: return 0;
+    }
+}
+
+inline int gltfComponentCount(const string &type)
+{
+    if (type == "SCALAR") return 1;
+    if (type == "VEC2") return 2;
+    if (type == "VEC3") return 3;
+    if (type == "VEC4") return 4;
+    if (type == "MAT4") return 16;
+    return 0;
+}
+
+class GltfFile {
+public:
+    JsonValue json;
+    const unsigned char *bin;
+    size_t binSize;
+    string directory;
+
+    GltfFile() : bin(nullptr), binSize(0) {}
+
+    bool open(const string &path)
+    {
+        directory = path.substr(0, path.find_last_of('/'));
+        if (!file.open(path) || file.size() < 12)
+            return false;
+        const unsigned char *data = (const unsigned char*)file.data();
+        uint32_t header[3];
+        memcpy(header, data, sizeof(header));
+        if (header[0] != GLTF_MAGIC)
+        {
+            // plain .gltf: the JSON is the whole file, the binary data lives in an external .bin
+            JsonParser parser(file.data(), file.data() + file.size());
+            if (!parser.parse(json))
+                return false;
+            return openExternalBuffer();
+        }
+        if (header[1] != 2 || header[2] > file.size())
+            return false;
+
+        size_t offset = 12, length = header[2];
+        bool hasJson = false;
+        while (offset + 8 <= length)
+        {
+            uint32_t chunk[2];
+            memcpy(chunk, data + offset, sizeof(chunk));
+            offset += 8;
+            if (chunk[0] > length - offset)
+                return false;
+            if (chunk[1] == GLTF_CHUNK_JSON && !hasJson)
+            {
+                JsonParser parser((const char*)data + offset, (const char*)data + offset + chunk[0]);
+                if (!parser.parse(json))
+                    return false;
+                hasJson = true;
+            }
+            else if (chunk[1] == GLTF_CHUNK_BIN && !bin)
+            {
+                bin = data + offset;
+                binSize = chunk[0];
+            }
+            offset += (chunk[0] + 3) & ~3u;
+        }
+        if (!hasJson || json["buffers"].size() > 1)
+            return false;
+        return bin || json["buffers"].size() == 0 || openExternalBuffer();
+    }
+
+    // resolves an accessor, checking that every element lies inside the binary data
+    bool accessor(int index, GltfAccessor &out) const
+    {
+        const JsonValue &a = json["accessors"][index];
+        if (index < 0 || a.isNull() || a.has("sparse"))
+            return false;
+        out.bufferView = a["bufferView"].asInt(-1);
+        out.byteOffset = a["byteOffset"].asSize(0);
+        out.componentType = a["componentType"].asInt(0);
+        out.components = gltfComponentCount(a["type"].asString());
+        out.count = a["count"].asSize(0);
+        out.normalized = a["normalized"].asBool(false);
+        size_t componentSize = gltfComponentSize(out.componentType);
+        const JsonValue &view = json["bufferViews"][out.bufferView];
+        if (out.bufferView < 0 || view.isNull() || view["buffer"].asInt(0) != 0 || componentSize == 0 || out.components == 0 || !bin)
+            return false;
+        size_t viewOffset = view["byteOffset"].asSize(0);
+        size_t viewLength = view["byteLength"].asSize(0);
+        size_t elementSize = componentSize * out.components;
+        out.stride = view["byteStride"].asSize(0);
+        if (out.stride == 0)
+            out.stride = elementSize;
+        if (viewOffset + viewLength > binSize || out.count == 0 ||
+            out.byteOffset + out.stride * (out.count - 1) + elementSize > viewLength)
+            return false;
+        out.data = bin + viewOffset + out.byteOffset;
+        return true;
+    }
+
+    const unsigned char *bufferView(int index, size_t &length) const
+    {
+        const JsonValue &view = json["bufferViews"][index];
+        size_t offset = view["byteOffset"].asSize(0);
+        length = view["byteLength"].asSize(0);
+        if (index < 0 || view.isNull() || !bin || offset + length > binSize)
+            return nullptr;
+        return bin + offset;
+    }
+
+private:
+    MappedFile file;
+    MappedFile external;
+
+    bool openExternalBuffer()
+    {
+        const JsonValue &buffers = json["buffers"];
+        if (buffers.size() == 0)
+            return true;
+        const string &uri = buffers[0]["uri"].asString();
+        if (buffers.size() > 1 || uri.empty() || uri.compare(0, 5, "data:") == 0 || !external.open(directory + '/' + gltfDecodeUri(uri)))
+            return false;
+        bin = (const unsigned char*)external.data();
+        binSize = external.size();
+        return true;
+    }
+
+public:
+    // uris are percent-encoded ("my%20texture.png")
+    static string gltfDecodeUri(const string &uri)
+    {
+        string decoded;
+        for (size_t i = 0; i < uri.size(); i++)
+        {
+            if (uri[i] == '%' && i + 2 < uri.size() && isxdigit((unsigned char)uri[i + 1]) && isxdigit((unsigned char)uri[i + 2]))
+            {
+                decoded += (char)strtol(uri.substr(i + 1, 2).c_str(), nullptr, 16);
+                i += 2;
+            }
+            else
+                decoded += uri[i];
+        }
+        return decoded;
+    }
+};
+
+inline float gltfReadComponent(const unsigned char *p, int componentType, bool normalized)
+{
+    switch (componentType)
+    {
+    case GLTF_FLOAT: { float value; memcpy(&value, p, 4); return value; }
+    case GLTF_UNSIGNED_BYTE: return normalized ? *p / 255.0f : (float)*p;
+    case GLTF_BYTE: { float value = (float)(int8_t)*p; return normalized ? (value / 127.0f < -1.0f ? -1.0f : value / 127.0f) : value; }
+    case GLTF_UNSIGNED_SHORT: { uint16_t value; memcpy(&value, p, 2); return normalized ? value / 65535.0f : (float)value; }
+    case GLTF_SHORT: { int16_t value; memcpy(&value, p, 2); return normalized ? (value / 32767.0f < -1.0f ? -1.0f : value / 32767.0f) : (float)value; }
+    case GLTF_UNSIGNED_INT: { uint32_t value; memcpy(&value, p, 4); return (float)value; }
+    default: return 0.0f;
+    }
+}
+
+inline unsigned int gltfReadIndex(const unsigned char *p, int componentType)
+{
+    switch (componentType)
+    {
+    case GLTF_UNSIGNED_BYTE: return *p;
+    case GLTF_UNSIGNED_SHORT: { uint16_t value; memcpy(&value, p, 2); return value; }
+    case GLTF_UNSIGNED_INT: { uint32_t value; memcpy(&value, p, 4); return value; }
+    default: return 0;
+    }
+}
+
+// reads an accessor as floats, components values per element (the accessor must have that many)
+inline bool gltfReadFloats(const GltfFile &file, int index, int components, vector<float> &out)
+{
+    GltfAccessor a;
+    if (!file.accessor(index, a) || a.components != components)
+        return false;
+    size_t componentSize = gltfComponentSize(a.componentType);
+    out.resize(a.count * components);
+    for (size_t i = 0; i < a.count; i++)
+    {
+        const unsigned char *element = a.data + i * a.stride;
+        for (int c = 0; c < components; c++)
+            out[i * components + c] = gltfReadComponent(element + c * componentSize, a.componentType, a.normalized);
+    }
+    return true;
+}
+
+inline bool gltfReadUints(const GltfFile &file, int index, int components, vector<unsigned int> &out)
+{
+    GltfAccessor a;
+    if (!file.accessor(index, a) || a.components != components ||
+        (a.componentType != GLTF_UNSIGNED_BYTE && a.componentType != GLTF_UNSIGNED_SHORT && a.componentType != GLTF_UNSIGNED_INT))
+        return false;
+    size_t componentSize = gltfComponentSize(a.componentType);
+    out.resize(a.count * components);
+    for (size_t i = 0; i < a.count; i++)
+        for (int c = 0; c < components; c++)
+            out[i * components + c] = gltfReadIndex(a.data + i * a.stride + c * componentSize, a.componentType);
+    return true;
+}
+
+// one triangle primitive of a glTF mesh; accessor indices are -1 when the attribute is missing
+struct GltfPrimitive {
+    int mesh;
+    int position, normal, texCoord, tangent, joints, weights, indices;
+    int material;
+    int skin;       // skin of the first node that instantiates the mesh, -1 for static meshes
+};
+
+inline bool gltfCollectPrimitives(const GltfFile &file, vector<GltfPrimitive> &out)
+{
+    const JsonValue &meshes = file.json["meshes"];
+    const JsonValue &nodes = file.json["nodes"];
+    vector<int> meshSkins(meshes.size(), -1);
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        int mesh = nodes[n]["mesh"].asInt(-1);
+        if (mesh >= 0 && mesh < (int)meshes.size() && meshSkins[mesh] < 0)
+            meshSkins[mesh] = nodes[n]["skin"].asInt(-1);
+    }
+
+    out.clear();
+    for (size_t m = 0; m < meshes.size(); m++)
+    {
+        const JsonValue &primitives = meshes[m]["primitives"];
+        for (size_t p = 0; p < primitives.size(); p++)
+        {
+            const JsonValue &primitive = primitives[p];
+            if (primitive["mode"].asInt(GLTF_TRIANGLES) != GLTF_TRIANGLES)
+            {
+                cout << "WARNING::GLTF:: skipping a primitive that is not made of triangles" << endl;
+                continue;
+            }
+            const JsonValue &attributes = primitive["attributes"];
+            GltfPrimitive description;
+            description.mesh = (int)m;
+            description.position = attributes["POSITION"].asInt(-1);
+            description.normal = attributes["NORMAL"].asInt(-1);
+            description.texCoord = attributes["TEXCOORD_0"].asInt(-1);
+            description.tangent = attributes["TANGENT"].asInt(-1);
+            description.joints = attributes["JOINTS_0"].asInt(-1);
+            description.weights = attributes["WEIGHTS_0"].asInt(-1);
+            description.indices = primitive["indices"].asInt(-1);
+            description.material = primitive["material"].asInt(-1);
+            description.skin = meshSkins[m];
+            if (description.position < 0)
+                return false;
+            out.push_back(description);
+        }
+    }
+    return true;
+}
+
+// converts a primitive into our Vertex layout (and bone weights when bones is given). jointToBone maps the
+// joints of the primitive's skin to bone indices; without it joint indices are used as they are.
+inline bool gltfConvertPrimitive(const GltfFile &file, const GltfPrimitive &primitive, vector<Vertex> &vertices, vector<unsigned int> &indices,
+                                 vector<VertexBoneData> *bones = nullptr, const vector<unsigned int> *jointToBone = nullptr)
+{
+    vector<float> data;
+    if (!gltfReadFloats(file, primitive.position, 3, data))
+        return false;
+    size_t count = data.size() / 3;
+    Vertex zero;
+    memset(&zero, 0, sizeof(zero));
+    vertices.assign(count, zero);
+    for (size_t v = 0; v < count; v++)
+        vertices[v].Position = glm::vec3(data[v * 3], data[v * 3 + 1], data[v * 3 + 2]);
+
+    if (primitive.indices >= 0)
+    {
+        if (!gltfReadUints(file, primitive.indices, 1, indices))
+            return false;
+        for (size_t i = 0; i < indices.size(); i++)
+            if (indices[i] >= count)
+                return false;
+    }
+    else
+    {
+        indices.resize(count);
+        for (size_t i = 0; i < count; i++)
+            indices[i] = (unsigned int)i;
+    }
+    indices.resize(indices.size() / 3 * 3);
+
+    if (primitive.normal >= 0)
+    {
+        if (!gltfReadFloats(file, primitive.normal, 3, data) || data.size() != count * 3)
+            return false;
+        for (size_t v = 0; v < count; v++)
+            vertices[v].Normal = glm::vec3(data[v * 3], data[v * 3 + 1], data[v * 3 + 2]);
+    }
+    else
+        computeVertexNormals(vertices, indices);
+
+    // glTF already has its UV origin at the top left, which is what aiProcess_FlipUVs gives us
+    if (primitive.texCoord >= 0)
+    {
+        if (!gltfReadFloats(file, primitive.texCoord, 2, data) || data.size() != count * 2)
+            return false;
+        for (size_t v = 0; v < count; v++)
+            vertices[v].TexCoords = glm::vec2(data[v * 2], data[v * 2 + 1]);
+    }
+
+    if (primitive.tangent >= 0)
+    {
+        if (!gltfReadFloats(file, primitive.tangent, 4, data) || data.size() != count * 4)
+            return false;
+        for (size_t v = 0; v < count; v++)
+        {
+            glm::vec3 tangent(data[v * 4], data[v * 4 + 1], data[v * 4 + 2]);
+            vertices[v].Tangent = tangent;
+            vertices[v].Bitangent = glm::cross(vertices[v].Normal, tangent) * data[v * 4 + 3];
+        }
+    }
+    else
+        computeTangentSpace(vertices, indices);
+
+    if (bones)
+    {
+        bones->assign(count, VertexBoneData());
+        if (primitive.joints >= 0 && primitive.weights >= 0)
+        {
+            vector<unsigned int> joints;
+            if (!gltfReadUints(file, primitive.joints, 4, joints) || !gltfReadFloats(file, primitive.weights, 4, data) ||
+                joints.size() != count * 4 || data.size() != count * 4)
+                return false;
+            for (size_t v = 0; v < count; v++)
+                for (int k = 0; k < 4; k++)
+                {
+                    if (data[v * 4 + k] <= 0.0f)
+                        continue;
+                    unsigned int joint = joints[v * 4 + k];
+                    if (jointToBone && joint >= jointToBone->size())
+                        return false;
+                    (*bones)[v].addBoneData(jointToBone ? (*jointToBone)[joint] : joint, data[v * 4 + k]);
+                }
+        }
+    }
+    return true;
+}
+
+// GL buffers holding whole buffer views, shared by every primitive that reads from them
+struct GltfGpuBuffers {
+    map<int, unsigned int> views;
+    size_t bytes;
+
+    GltfGpuBuffers() : bytes(0) {}
+
+    unsigned int buffer(const GltfFile &file, int view)
+    {
+        map<int, unsigned int>::iterator it = views.find(view);
+        if (it != views.end())
+            return it->second;
+        size_t length = 0;
+        const unsigned char *data = file.bufferView(view, length);
+        unsigned int id = 0;
+        glGenBuffers(1, &id);
+        glBindBuffer(GL_ARRAY_BUFFER, id);
+        glBufferData(GL_ARRAY_BUFFER, length, data, GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        bytes += length;
+        views[view] = id;
+        return id;
+    }
+};
+
+// whether GL can read the accessor in place as a vertex attribute of that many components
+inline bool gltfDirectAttribute(const GltfFile &file, int index, int components, bool allowNormalized, bool integer, GltfAccessor &a)
+{
+    if (index < 0 || !file.accessor(index, a) || a.components != components || a.stride % 4 != 0 || a.byteOffset % 4 != 0)
+        return false;
+    if (integer)
+        return !a.normalized && (a.componentType == GLTF_UNSIGNED_BYTE || a.componentType == GLTF_UNSIGNED_SHORT);
+    if (a.componentType == GLTF_FLOAT)
+        return true;
+    return allowNormalized && a.normalized && (a.componentType == GLTF_UNSIGNED_BYTE || a.componentType == GLTF_UNSIGNED_SHORT);
+}
+
+inline void gltfBindAttribute(GltfGpuBuffers &buffers, const GltfFile &file, unsigned int location, const GltfAccessor &a, int size, bool integer)
+{
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.buffer(file, a.bufferView));
+    glEnableVertexAttribArray(location);
+    if (integer)
+        glVertexAttribIPointer(location, size, (GLenum)a.componentType, (GLsizei)a.stride, (void*)a.byteOffset);
+    else
+        glVertexAttribPointer(location, size, (GLenum)a.componentType, a.normalized ? GL_TRUE : GL_FALSE, (GLsizei)a.stride, (void*)a.byteOffset);
+}
+
+// builds a VAO that reads the primitive straight from the uploaded buffer views, using the attribute
+// locations of Mesh/MeshAnim. Returns false (and creates nothing) if the layout needs converting.
+inline bool gltfUploadPrimitive(const GltfFile &file, const GltfPrimitive &primitive, GltfGpuBuffers &buffers, bool skinned, GpuGeometry &geometry)
+{
+    GltfAccessor position, normal, texCoord, indices, joints, weights;
+    if (!gltfDirectAttribute(file, primitive.position, 3, false, false, position) ||
+        !gltfDirectAttribute(file, primitive.normal, 3, false, false, normal) ||
+        !gltfDirectAttribute(file, primitive.texCoord, 2, true, false, texCoord) ||
+        normal.count != position.count || texCoord.count != position.count)
+        return false;
+    if (primitive.indices < 0 || !file.accessor(primitive.indices, indices) || indices.components != 1 ||
+        (indices.componentType != GLTF_UNSIGNED_SHORT && indices.componentType != GLTF_UNSIGNED_INT) ||
+        indices.byteOffset % gltfComponentSize(indices.componentType) != 0 || indices.count % 3 != 0)
+        return false;
+    if (skinned && (!gltfDirectAttribute(file, primitive.joints, 4, false, true, joints) ||
+                    !gltfDirectAttribute(file, primitive.weights, 4, true, false, weights) ||
+                    joints.count != position.count || weights.count != position.count))
+        return false;
+
+    // the tangent frame is the only thing that doesn't come from the file as it is: glTF has no bitangents,
+    // and when the tangents are missing too they are generated like the other loaders do
+    size_t count = position.count;
+    vector<glm::vec3> frames(count * 2);
+    vector<float> normals, tangents;
+    if (primitive.tangent >= 0 && gltfReadFloats(file, primitive.tangent, 4, tangents) && tangents.size() == count * 4 &&
+        gltfReadFloats(file, primitive.normal, 3, normals))
+    {
+        for (size_t v = 0; v < count; v++)
+        {
+            glm::vec3 n(normals[v * 3], normals[v * 3 + 1], normals[v * 3 + 2]);
+            glm::vec3 t(tangents[v * 4], tangents[v * 4 + 1], tangents[v * 4 + 2]);
+            frames[v * 2] = t;
+            frames[v * 2 + 1] = glm::cross(n, t) * tangents[v * 4 + 3];
+        }
+    }
+    else
+    {
+        vector<Vertex> vertices;
+        vector<unsigned int> converted;
+        if (!gltfConvertPrimitive(file, primitive, vertices, converted) || vertices.size() != count)
+            return false;
+        for (size_t v = 0; v < count; v++)
+        {
+            frames[v * 2] = vertices[v].Tangent;
+            frames[v * 2 + 1] = vertices[v].Bitangent;
+        }
+    }
+
+    unsigned int VAO, frameBuffer;
+    glGenVertexArrays(1, &VAO);
+    glBindVertexArray(VAO);
+    gltfBindAttribute(buffers, file, 0, position, 3, false);
+    gltfBindAttribute(buffers, file, 1, normal, 3, false);
+    gltfBindAttribute(buffers, file, 2, texCoord, 2, false);
+
+    glGenBuffers(1, &frameBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, frameBuffer);
+    glBufferData(GL_ARRAY_BUFFER, frames.size() * sizeof(glm::vec3), &frames[0], GL_STATIC_DRAW);
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)0);
+    glEnableVertexAttribArray(4);
+    glVertexAttribPointer(4, 3, GL_FLOAT, GL_FALSE, 2 * sizeof(glm::vec3), (void*)sizeof(glm::vec3));
+
+    if (skinned)
+    {
+        gltfBindAttribute(buffers, file, 5, joints, 4, true);
+        gltfBindAttribute(buffers, file, 6, weights, 4, false);
+    }
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.buffer(file, indices.bufferView));
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    geometry.VAO = VAO;
+    geometry.VBO = frameBuffer;
+    geometry.vertexCount = (unsigned int)count;
+    geometry.indexCount = (unsigned int)indices.count;
+    geometry.indexType = indices.componentType == GLTF_UNSIGNED_SHORT ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    geometry.indexOffset = indices.byteOffset;
+    geometry.gpuBytes = frames.size() * sizeof(glm::vec3);
+    // POSITION accessors are required to carry min and max
+    const JsonValue &description = file.json["accessors"][primitive.position];
+    glm::vec3 low, high;
+    for (int c = 0; c < 3; c++)
+    {
+        low[c] = (float)description["min"][c].asNumber();
+        high[c] = (float)description["max"][c].asNumber();
+    }
+    geometry.boundsCenter = (low + high) * 0.5f;
+    geometry.boundsRadius = glm::length(high - low) * 0.5f;
+    return true;
+}
+
+// converts every primitive, in the same order the models create their meshes. Used to bring back the
+// CPU copy of the geometry (acquireCpuData). skinBones gives the joint -> bone table of each skin.
+inline bool readGltfGeometry(const string &path, vector<MeshCacheEntry> &entries, const vector<vector<unsigned int> > *skinBones = nullptr)
+{
+    GltfFile file;
+    vector<GltfPrimitive> primitives;
+    if (!file.open(path) || !gltfCollectPrimitives(file, primitives))
+        return false;
+    entries.assign(primitives.size(), MeshCacheEntry());
+    for (size_t i = 0; i < primitives.size(); i++)
+    {
+        const GltfPrimitive &primitive = primitives[i];
+        const vector<unsigned int> *jointToBone = skinBones && primitive.skin >= 0 && primitive.skin < (int)skinBones->size() ?
+            &(*skinBones)[primitive.skin] : nullptr;
+        if (!gltfConvertPrimitive(file, primitive, entries[i].vertices, entries[i].indices, skinBones ? &entries[i].bones : nullptr, jointToBone))
+            return false;
+    }
+    return true;
+}
+
+// a texture of a material: a file next to the model, or an image embedded in the binary chunk
+struct GltfTexture {
+    string type;        // sampler name prefix, as in processMesh
+    string uri;         // empty when embedded
+    int image;
+};
+
+// textures of a material the shaders sample. Only the base color is: normal, occlusion and metallic-roughness
+// maps are left on disk (see materialPacker.h)
+inline void gltfMaterialTextures(const GltfFile &file, int material, vector<GltfTexture> &out)
+{
+    const JsonValue &m = file.json["materials"][material];
+    if (material < 0 || m.isNull())
+        return;
+    int texture = m["pbrMetallicRoughness"]["baseColorTexture"]["index"].asInt(-1);
+    int image = file.json["textures"][texture]["source"].asInt(-1);
+    const JsonValue &description = file.json["images"][image];
+    if (texture < 0 || image < 0 || description.isNull())
+        return;
+    GltfTexture reference;
+    reference.type = "texture_diffuse";
+    reference.image = image;
+    if (description.has("uri"))
+    {
+        reference.uri = GltfFile::gltfDecodeUri(description["uri"].asString());
+        if (reference.uri.compare(0, 5, "data:") == 0)
+            return;
+    }
+    else if (description["bufferView"].asInt(-1) < 0)
+        return;
+    out.push_back(reference);
+}
+
+inline const unsigned char *gltfImageData(const GltfFile &file, int image, size_t &length)
+{
+    return file.bufferView(file.json["images"][image]["bufferView"].asInt(-1), length);
+}
+
+// unique node names (channels and bones are matched by name), generated for unnamed nodes
+inline vector<string> gltfNodeNames(const GltfFile &file)
+{
+    const JsonValue &nodes = file.json["nodes"];
+    vector<string> names(nodes.size());
+    map<string, int> used;
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        string name = nodes[n]["name"].asString();
+        if (name.empty())
+            name = "node_" + to_string(n);
+        if (used[name]++ > 0)
+            name += "_" + to_string(n);
+        names[n] = name;
+    }
+    return names;
+}
+
+inline aiMatrix4x4 gltfNodeTransform(const JsonValue &node)
+{
+    const JsonValue &matrix = node["matrix"];
+    if (matrix.size() == 16)
+    {
+        // glTF matrices are column major, aiMatrix4x4 is row major
+        float m[16];
+        for (int i = 0; i < 16; i++)
+            m[i] = (float)matrix[i].asNumber();
+        return aiMatrix4x4(m[0], m[4], m[8], m[12],
+                           m[1], m[5], m[9], m[13],
+                           m[2], m[6], m[10], m[14],
+                           m[3], m[7], m[11], m[15]);
+    }
+    const JsonValue &t = node["translation"], &r = node["rotation"], &s = node["scale"];
+    aiVector3D translation(0.0f), scaling(1.0f);
+    aiQuaternion rotation;
+    if (t.size() == 3)
+        translation = aiVector3D((float)t[0].asNumber(), (float)t[1].asNumber(), (float)t[2].asNumber());
+    if (s.size() == 3)
+        scaling = aiVector3D((float)s[0].asNumber(1.0), (float)s[1].asNumber(1.0), (float)s[2].asNumber(1.0));
+    if (r.size() == 4)
+        rotation = aiQuaternion((float)r[3].asNumber(1.0), (float)r[0].asNumber(), (float)r[1].asNumber(), (float)r[2].asNumber());
+    return aiMatrix4x4(scaling, rotation, translation);
+}
+
+inline aiNode *gltfBuildNode(const GltfFile &file, int index, const vector<string> &names, int depth)
+{
+    const JsonValue &node = file.json["nodes"][index];
+    aiNode *result = new aiNode(names[index]);
+    result->mTransformation = gltfNodeTransform(node);
+    const JsonValue &children = node["children"];
+    if (children.size() > 0 && depth < 256)
+    {
+        result->mChildren = new aiNode*[children.size()];
+        for (size_t c = 0; c < children.size(); c++)
+        {
+            int child = children[c].asInt(-1);
+            if (child < 0 || child >= (int)names.size())
+                continue;
+            aiNode *built = gltfBuildNode(file, child, names, depth + 1);
+            built->mParent = result;
+            result->mChildren[result->mNumChildren++] = built;
+        }
+    }
+    return result;
+}
+
+// the node tree of the default scene under one root, like Assimp gives it
+inline aiNode *gltfBuildSceneRoot(const GltfFile &file, const vector<string> &names)
+{
+    const JsonValue &scenes = file.json["scenes"];
+    const JsonValue &roots = scenes[file.json["scene"].asInt(0)]["nodes"];
+    aiNode *root = new aiNode("gltf_root");
+    if (roots.size() > 0)
+    {
+        root->mChildren = new aiNode*[roots.size()];
+        for (size_t r = 0; r < roots.size(); r++)
+        {
+            int index = roots[r].asInt(-1);
+            if (index < 0 || index >= (int)names.size())
+                continue;
+            aiNode *built = gltfBuildNode(file, index, names, 1);
+            built->mParent = root;
+            root->mChildren[root->mNumChildren++] = built;
+        }
+    }
+    return root;
+}
+
+// inverse bind matrices of a skin as aiMatrix4x4 (row major), identity when the skin has none
+inline bool gltfInverseBindMatrices(const GltfFile &file, int skin, vector<aiMatrix4x4> &out)
+{
+    const JsonValue &description = file.json["skins"][skin];
+    size_t joints = description["joints"].size();
+    out.assign(joints, aiMatrix4x4());
+    if (!description.has("inverseBindMatrices"))
+        return true;
+    vector<float> m;
+    if (!gltfReadFloats(file, description["inverseBindMatrices"].asInt(-1), 16, m) || m.size() < joints * 16)
+        return false;
+    for (size_t j = 0; j < joints; j++)
+    {
+        const float *c = &m[j * 16];
+        out[j] = aiMatrix4x4(c[0], c[4], c[8], c[12],
+                             c[1], c[5], c[9], c[13],
+                             c[2], c[6], c[10], c[14],
+                             c[3], c[7], c[11], c[15]);
+    }
+    return true;
+}
+
+// ModelAnim looks for the pair of keys around the current time, so every track with more than one key
+// has to cover the whole [0, duration] range: the first and last values are held up to the ends
+template <typename Key>
+inline void gltfPadKeys(vector<Key> &keys, double duration)
+{
+    if (keys.size() < 2)
+        return;
+    if (keys.front().mTime > 0.0)
+    {
+        Key first = keys.front();
+        first.mTime = 0.0;
+        keys.insert(keys.begin(), first);
+    }
+    if (keys.back().mTime < duration)
+    {
+        Key last = keys.back();
+        last.mTime = duration;
+        keys.push_back(last);
+    }
+}
+
+// one aiNodeAnim per animated node. Times stay in seconds (mTicksPerSecond = 1). Tracks a node doesn't
+// animate get one key with its rest pose, since ModelAnim replaces the whole node transform when a
+// channel exists. CUBICSPLINE keys keep only their value, STEP keys are held until just before the next one.
+inline aiAnimation *gltfBuildAnimation(const GltfFile &file, int index, const vector<string> &names)
+{
+    const JsonValue &description = file.json["animations"][index];
+    const JsonValue &channels = description["channels"];
+    const JsonValue &samplers = description["samplers"];
+
+    aiAnimation *animation = new aiAnimation();
+    animation->mName = aiString(description["name"].asString());
+    animation->mTicksPerSecond = 1.0;
+    animation->mDuration = 0.0;
+
+    map<int, vector<aiVectorKey> > translations, scalings;
+    map<int, vector<aiQuatKey> > rotations;
+    vector<int> animatedNodes;
+    for (size_t c = 0; c < channels.size(); c++)
+    {
+        int node = channels[c]["target"]["node"].asInt(-1);
+        const string &targetPath = channels[c]["target"]["path"].asString();
+        const JsonValue &sampler = samplers[channels[c]["sampler"].asInt(-1)];
+        int components = targetPath == "rotation" ? 4 : 3;
+        if (node < 0 || node >= (int)names.size() || sampler.isNull() ||
+            (targetPath != "translation" && targetPath != "rotation" && targetPath != "scale"))
+            continue;
+        vector<float> times, values;
+        if (!gltfReadFloats(file, sampler["input"].asInt(-1), 1, times) ||
+            !gltfReadFloats(file, sampler["output"].asInt(-1), components, values))
+            continue;
+        const string &interpolation = sampler["interpolation"].asString();
+        bool cubic = interpolation == "CUBICSPLINE";
+        bool step = interpolation == "STEP";
+        size_t stride = cubic ? 3 : 1;
+        if (values.size() < times.size() * stride * components)
+            continue;
+        if (std::find(animatedNodes.begin(), animatedNodes.end(), node) == animatedNodes.end())
+            animatedNodes.push_back(node);
+
+        for (size_t k = 0; k < times.size(); k++)
+        {
+            const float *value = &values[(k * stride + (cubic ? 1 : 0)) * components];
+            const float *held = k > 0 ? &values[((k - 1) * stride + (cubic ? 1 : 0)) * components] : nullptr;
+            double time = times[k];
+            double heldTime = k > 0 ? time - (time - times[k - 1]) * 0.001 : 0.0;
+            if (time > animation->mDuration)
+                animation->mDuration = time;
+            if (components == 4)
+            {
+                vector<aiQuatKey> &keys = rotations[node];
+                if (step && held)
+                    keys.push_back(aiQuatKey(heldTime, aiQuaternion(held[3], held[0], held[1], held[2])));
+                keys.push_back(aiQuatKey(time, aiQuaternion(value[3], value[0], value[1], value[2])));
+            }
+            else
+            {
+                vector<aiVectorKey> &keys = targetPath == "translation" ? translations[node] : scalings[node];
+                if (step && held)
+                    keys.push_back(aiVectorKey(heldTime, aiVector3D(held[0], held[1], held[2])));
+                keys.push_back(aiVectorKey(time, aiVector3D(value[0], value[1], value[2])));
+            }
+        }
+    }
+    if (animation->mDuration <= 0.0)
+        animation->mDuration = 1.0;
+
+    animation->mNumChannels = (unsigned int)animatedNodes.size();
+    animation->mChannels = animation->mNumChannels ? new aiNodeAnim*[animation->mNumChannels] : nullptr;
+    for (size_t a = 0; a < animatedNodes.size(); a++)
+    {
+        int node = animatedNodes[a];
+        aiVector3D restScaling, restTranslation;
+        aiQuaternion restRotation;
+        gltfNodeTransform(file.json["nodes"][node]).Decompose(restScaling, restRotation, restTranslation);
+
+        aiNodeAnim *channel = new aiNodeAnim();
+        channel->mNodeName = aiString(names[node]);
+        vector<aiVectorKey> &t = translations[node], &s = scalings[node];
+        vector<aiQuatKey> &r = rotations[node];
+        if (t.empty()) t.push_back(aiVectorKey(0.0, restTranslation));
+        if (s.empty()) s.push_back(aiVectorKey(0.0, restScaling));
+        if (r.empty()) r.push_back(aiQuatKey(0.0, restRotation));
+        gltfPadKeys(t, animation->mDuration);
+        gltfPadKeys(s, animation->mDuration);
+        gltfPadKeys(r, animation->mDuration);
+        channel->mNumPositionKeys = (unsigned int)t.size();
+        channel->mPositionKeys = new aiVectorKey[t.size()];
+        std::copy(t.begin(), t.end(), channel->mPositionKeys);
+        channel->mNumScalingKeys = (unsigned int)s.size();
+        channel->mScalingKeys = new aiVectorKey[s.size()];
+        std::copy(s.begin(), s.end(), channel->mScalingKeys);
+        channel->mNumRotationKeys = (unsigned int)r.size();
+        channel->mRotationKeys = new aiQuatKey[r.size()];
+        std::copy(r.begin(), r.end(), channel->mRotationKeys);
+        animation->mChannels[a] = channel;
+    }
+    return animation;
+}
+#endif
@@ -0,0 +1,222 @@
+#ifndef GPU_RESOURCES_H
+#define GPU_RESOURCES_H
+
+#include <glad/glad.h>
+
+#include <textureCooker.h>
+
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <string>
+#include <utility>
+using namespace std;
+
+// Ledger of the video memory used by the app, checked against one budget.
+// Three kinds of entries add up to the total:
+//   - model textures, whose sizes the loaders and the streamer already keep in textureGpuBytes()
+//   - single allocations (skybox, primitives, virtual texture atlas, upload and readback buffers...) recorded
+//     with allocate/release by whoever creates them
+//   - owners: a model's geometry, which registers its bytes and, when it can rebuild it from the mesh cache,
+//     a function that drops its buffers
+// Once a frame update() works out how much is left for the streamed textures after everything else; the
+// texture residency (textureResidency.h) keeps their mip levels within it, least recently used first. When
+// even textures at GPU_RESOURCES_MIN_TEXTURE_MB wouldn't fit, the geometry not drawn on screen for
+// GPU_RESOURCES_KEEP_FRAMES is dropped, least recently used first, and the model reloads it the next time
+// it is in view. The budget is GPU_RESOURCES_BUDGET_MB, or MUSEO_VRAM_BUDGET_MB from the environment.
+
+#define GPU_RESOURCES_BUDGET_MB        512
+#define GPU_RESOURCES_MIN_TEXTURE_MB   32
+#define GPU_RESOURCES_KEEP_FRAMES      600
+
+enum GpuResourceKind {
+    GPU_RESOURCE_TEXTURE,
+    GPU_RESOURCE_BUFFER,
+    GPU_RESOURCE_RENDERBUFFER,
+    GPU_RESOURCE_KINDS
+};
+
+class GpuResources {
+public:
+    GpuResources() : frame(0), nextOwner(1), budget((size_t)GPU_RESOURCES_BUDGET_MB * 1024 * 1024),
+        evictions(0), evictedBytes(0), reloads(0), reloadedBytes(0)
+    {
+        const char *megabytes = getenv("MUSEO_VRAM_BUDGET_MB");
+        if (megabytes && atoi(megabytes) > 0)
+            budget = (size_t)atoi(megabytes) * 1024 * 1024;
+    }
+
+    // a texture, buffer or renderbuffer created (or resized) with bytes of storage
+    void allocate(GpuResourceKind kind, unsigned int name, size_t bytes, const string &label)
+    {
+        Allocation &allocation = allocations[make_pair((int)kind, name)];
+        allocation.bytes = bytes;
+        allocation.label = label;
+    }
+
+    void release(GpuResourceKind kind, unsigned int name)
+    {
+        allocations.erase(make_pair((int)kind, name));
+    }
+
+    // geometry of a model. evict drops its GL objects and returns the bytes freed; empty when the owner can't
+    // rebuild them, it is only accounted then
+    unsigned int addOwner(const string &label, size_t bytes, const function<size_t()> &evict)
+    {
+        Owner owner;
+        owner.label = label;
+        owner.bytes = bytes;
+        owner.lastUse = frame;
+        owner.evict = evict;
+        owners[nextOwner] = owner;
+        return nextOwner++;
+    }
+
+    void removeOwner(unsigned int handle)
+    {
+        owners.erase(handle);
+    }
+
+    // drawn on screen this frame
+    void touch(unsigned int handle)
+    {
+        map<unsigned int, Owner>::iterator owner = owners.find(handle);
+        if (owner != owners.end())
+            owner->second.lastUse = frame;
+    }
+
+    // the owner rebuilt what it had evicted
+    void reloaded(unsigned int handle, size_t bytes)
+    {
+        map<unsigned int, Owner>::iterator owner = owners.find(handle);
+        if (owner == owners.end())
+            return;
+        owner->second.bytes = bytes;
+        owner->second.lastUse = frame;
+        reloads++;
+        reloadedBytes += bytes;
+    }
+
+    // what the streamed textures may use, the rest of the budget goes to everything else
+    size_t textureBudget() const
+    {
+        size_t others = otherBytes(), floor = (size_t)GPU_RESOURCES_MIN_TEXTURE_MB * 1024 * 1024;
+        return others + floor < budget ? budget - others : floor;
+    }
+
+    // drops geometry while the rest doesn't leave the textures their minimum; main thread, once per frame
+    void update()
+    {
+        frame++;
+        size_t floor = (std::min)(modelTextureBytes(), (size_t)GPU_RESOURCES_MIN_TEXTURE_MB * 1024 * 1024);
+        size_t others = otherBytes();
+        while (others + floor > budget)
+        {
+            Owner *victim = nullptr;
+            for (map<unsigned int, Owner>::iterator it = owners.begin(); it != owners.end(); ++it)
+            {
+                Owner &candidate = it->second;
+                if (!candidate.evict || candidate.bytes == 0 || frame - candidate.lastUse < GPU_RESOURCES_KEEP_FRAMES)
+                    continue;
+                if (!victim || candidate.lastUse < victim->lastUse)
+                    victim = &candidate;
+            }
+            if (!victim)
+                break;
+            size_t freed = victim->evict();
+            others -= (std::min)(others, victim->bytes);
+            victim->bytes = 0;
+            evictions++;
+            evictedBytes += freed;
+        }
+    }
+
+    size_t totalBytes() const
+    {
+        return otherBytes() + modelTextureBytes();
+    }
+
+    // every single allocation with its label, for the memory ledger (memoryLedger.h)
+    void forEachAllocation(const function<void(GpuResourceKind, const string &, size_t)> &visit) const
+    {
+        for (map<pair<int, unsigned int>, Allocation>::const_iterator it = allocations.begin(); it != allocations.end(); ++it)
+            visit((GpuResourceKind)it->first.first, it->second.label, it->second.bytes);
+    }
+
+    // geometry owners that hold their buffers right now
+    void forEachOwner(const function<void(const string &, size_t)> &visit) const
+    {
+        for (map<unsigned int, Owner>::const_iterator it = owners.begin(); it != owners.end(); ++it)
+            if (it->second.bytes > 0)
+                visit(it->second.label, it->second.bytes);
+    }
+
+    void printReport() const
+    {
+        size_t kinds[GPU_RESOURCE_KINDS] = {}, geometry = 0;
+        unsigned int resident = 0;
+        for (map<pair<int, unsigned int>, Allocation>::const_iterator it = allocations.begin(); it != allocations.end(); ++it)
+            kinds[it->first.first] += it->second.bytes;
+        for (map<unsigned int, Owner>::const_iterator it = owners.begin(); it != owners.end(); ++it)
+        {
+            geometry += it->second.bytes;
+            resident += it->second.bytes > 0 ? 1 : 0;
+        }
+        cout << "MEMORY::VRAM:: total: " << totalBytes() / (1024 * 1024) << " MB  budget: " << budget / (1024 * 1024)
+             << " MB  model textures: " << modelTextureBytes() / (1024 * 1024) << " MB (limit " << textureBudget() / (1024 * 1024)
+             << " MB)  geometry: " << geometry / (1024 * 1024) << " MB (" << resident << "/" << owners.size() << " models)"
+             << "  other textures: " << (kinds[GPU_RESOURCE_TEXTURE] + kinds[GPU_RESOURCE_RENDERBUFFER]) / (1024 * 1024)
+             << " MB  buffers: " << kinds[GPU_RESOURCE_BUFFER] / (1024 * 1024) << " MB" << endl;
+        cout << "MEMORY::VRAM:: geometry evicted: " << evictions << " (" << evictedBytes / 1024 << " KB)  reloaded: " << reloads
+             << " (" << reloadedBytes / 1024 << " KB)" << endl;
+    }
+
+private:
+    struct Allocation {
+        size_t bytes;
+        string label;
+    };
+
+    struct Owner {
+        string label;
+        size_t bytes;               // 0 while evicted
+        unsigned int lastUse;       // frame
+        function<size_t()> evict;
+    };
+
+    map<pair<int, unsigned int>, Allocation> allocations;
+    map<unsigned int, Owner> owners;
+    unsigned int frame;
+    unsigned int nextOwner;
+    size_t budget;
+    unsigned int evictions;
+    size_t evictedBytes;
+    unsigned int reloads;
+    size_t reloadedBytes;
+
+    size_t otherBytes() const
+    {
+        size_t bytes = 0;
+        for (map<pair<int, unsigned int>, Allocation>::const_iterator it = allocations.begin(); it != allocations.end(); ++it)
+            bytes += it->second.bytes;
+        for (map<unsigned int, Owner>::const_iterator it = owners.begin(); it != owners.end(); ++it)
+            bytes += it->second.bytes;
+        return bytes;
+    }
+
+    static size_t modelTextureBytes()
+    {
+        size_t bytes = 0;
+        for (map<unsigned int, size_t>::const_iterator it = textureGpuBytes().begin(); it != textureGpuBytes().end(); ++it)
+            bytes += it->second;
+        return bytes;
+    }
+};
+
+inline GpuResources& gpuResources()
+{
+    static GpuResources resources;
+    return resources;
+}
+#endif
@@ -0,0 +1,183 @@
+#ifndef JOB_SYSTEM_H
+#define JOB_SYSTEM_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdlib>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Worker pool for the update phase of a frame. Every system that animates something (a character's skeleton,
+// the keyframes of a prop, the butterflies...) adds a job, naming the jobs whose results it reads; run() gives
+// each job to a worker as soon as its dependencies are done (the calling thread works too) and returns once
+// the whole graph has run, so nothing is drawn before the phase is over. Jobs don't touch GL: the context
+// belongs to the main thread, uploads and draws come after run().
+// The pool has one thread less than the cores, up to JOB_SYSTEM_MAX_THREADS; MUSEO_JOB_THREADS in the
+// environment overrides it, 0 runs every job on the calling thread to compare.
+
+#define JOB_SYSTEM_MAX_THREADS  8
+
+class JobSystem {
+public:
+    typedef function<void()> Task;
+
+    JobSystem() : stopping(false), remaining(0), phases(0), jobsRun(0), seconds(0.0) {}
+
+    ~JobSystem()
+    {
+        stop();
+    }
+
+    // creates the workers; threads 0 picks them from the cores
+    void start(unsigned int threads = 0)
+    {
+        if (!workers.empty())
+            return;
+        const char *count = getenv("MUSEO_JOB_THREADS");
+        if (count)
+            threads = (unsigned int)(std::max)(atoi(count), 0);
+        else if (threads == 0)
+        {
+            unsigned int cores = std::thread::hardware_concurrency();
+            threads = (std::min)((std::max)(cores, 1u) - 1, (unsigned int)JOB_SYSTEM_MAX_THREADS);
+        }
+        stopping = false;
+        for (unsigned int i = 0; i < threads; i++)
+            workers.emplace_back(&JobSystem::work, this);
+    }
+
+    void stop()
+    {
+        {
+            lock_guard<mutex> lock(guard);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+    }
+
+    unsigned int threads() const
+    {
+        return (unsigned int)workers.size();
+    }
+
+    // a job of the next run, started once every job in dependencies has finished; returns its id.
+    // Main thread, between runs
+    unsigned int add(const Task &task, initializer_list<unsigned int> dependencies = {})
+    {
+        unsigned int id = (unsigned int)jobs.size();
+        Job job;
+        job.task = task;
+        job.waiting = (unsigned int)dependencies.size();
+        jobs.push_back(job);
+        for (initializer_list<unsigned int>::const_iterator it = dependencies.begin(); it != dependencies.end(); ++it)
+            jobs[*it].dependents.push_back(id);
+        return id;
+    }
+
+    // runs every job added since the last run and returns when all of them are done
+    void run()
+    {
+        typedef std::chrono::high_resolution_clock Clock;
+        Clock::time_point start = Clock::now();
+        {
+            lock_guard<mutex> lock(guard);
+            remaining = jobs.size();
+            for (size_t i = 0; i < jobs.size(); i++)
+                if (jobs[i].waiting == 0)
+                    ready.push_back((unsigned int)i);
+        }
+        changed.notify_all();
+        for (;;)
+        {
+            unsigned int id;
+            {
+                unique_lock<mutex> lock(guard);
+                changed.wait(lock, [this]() { return remaining == 0 || !ready.empty(); });
+                if (remaining == 0)
+                    break;
+                id = ready.front();
+                ready.pop_front();
+            }
+            execute(id);
+        }
+        jobsRun += jobs.size();
+        jobs.clear();
+        phases++;
+        seconds += std::chrono::duration<double>(Clock::now() - start).count();
+    }
+
+    // phases and jobs run since the last report, and the time the update phase took
+    void printReport()
+    {
+        cout << "JOBS::POOL:: threads: " << workers.size() + 1 << "  phases: " << phases << "  jobs: " << jobsRun << "  update: "
+             << (phases ? seconds * 1000.0 / phases : 0.0) << " ms/phase" << endl;
+        phases = 0;
+        jobsRun = 0;
+        seconds = 0.0;
+    }
+
+private:
+    struct Job {
+        Task task;
+        unsigned int waiting;               // dependencies not finished yet
+        vector<unsigned int> dependents;
+    };
+
+    mutex guard;
+    condition_variable changed;             // a job became ready, or the last one finished
+    vector<thread> workers;
+    bool stopping;
+    vector<Job> jobs;                       // of the current run, only added to between runs
+    deque<unsigned int> ready;
+    size_t remaining;
+    size_t phases;
+    size_t jobsRun;
+    double seconds;
+
+    void work()
+    {
+        for (;;)
+        {
+            unsigned int id;
+            {
+                unique_lock<mutex> lock(guard);
+                changed.wait(lock, [this]() { return stopping || !ready.empty(); });
+                if (stopping)
+                    return;
+                id = ready.front();
+                ready.pop_front();
+            }
+            execute(id);
+        }
+    }
+
+    void execute(unsigned int id)
+    {
+        jobs[id].task();
+        {
+            lock_guard<mutex> lock(guard);
+            for (size_t d = 0; d < jobs[id].dependents.size(); d++)
+                if (--jobs[jobs[id].dependents[d]].waiting == 0)
+                    ready.push_back(jobs[id].dependents[d]);
+            remaining--;
+        }
+        changed.notify_all();
+    }
+};
+
+inline JobSystem& jobSystem()
+{
+    static JobSystem pool;
+    return pool;
+}
+#endif
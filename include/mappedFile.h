@@ -0,0 +1,120 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <string>
+using namespace std;
+
+// Read-only view of a whole file mapped into memory. The pages are brought in by the OS as
+// they are touched, so parsers can walk (or split among threads) the file without first
+// copying it into a buffer. The view stays valid until close() or destruction.
+class MappedFile {
+public:
+    MappedFile() : view(nullptr), length(0)
+#ifdef _WIN32
+        , file(INVALID_HANDLE_VALUE), mapping(NULL)
+#else
+        , fd(-1)
+#endif
+    {
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const string &path)
+    {
+        close();
+#ifdef _WIN32
+        file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        length = (size_t)fileSize.QuadPart;
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping == NULL)
+        {
+            close();
+            return false;
+        }
+        view = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+#else
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close();
+            return false;
+        }
+        length = (size_t)st.st_size;
+        void *address = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+        view = address == MAP_FAILED ? nullptr : (const char*)address;
+        if (view)
+            madvise(address, length, MADV_SEQUENTIAL);
+#endif
+        if (!view)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (view)
+            UnmapViewOfFile(view);
+        if (mapping != NULL)
+            CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE)
+            CloseHandle(file);
+        mapping = NULL;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (view)
+            munmap((void*)view, length);
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+#endif
+        view = nullptr;
+        length = 0;
+    }
+
+    const char *data() const { return view; }
+    size_t size() const { return length; }
+
+private:
+    const char *view;
+    size_t length;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+
+    // the mapping is owned, copying it would unmap it twice
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+#endif
@@ -0,0 +1,179 @@
+#ifndef MATERIAL_PACKER_H
+#define MATERIAL_PACKER_H
+
+#include <glad/glad.h>
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+using namespace std;
+
+// The lighting shaders read every scalar material property from a single RGBA texture, bound as
+// texture_material1, instead of one texture (and one fetch) per map:
+//   R  ambient occlusion     1 when the material has no AO map
+//   G  roughness             0, the shininess then comes from material_shininess alone
+//   B  metalness             0, dielectric
+//   A  specular intensity    0.5
+// The pack is built at import time out of the separate grayscale maps. It is named by a virtual path,
+// "#pack|<ao>|<roughness>|<gloss>|<metalness>|<specular>" (files relative to the model directory, empty
+// when missing), so it can be stored in the mesh cache and memoized like any other texture path.
+// Maps no shader samples (normal, height, opacity) are not loaded at all.
+
+#define MATERIAL_PACK_PREFIX "#pack|"
+
+struct MaterialPack {
+    string occlusion;
+    string roughness;
+    string gloss;       // used (inverted) as roughness when there is no roughness map
+    string metalness;
+    string specular;
+
+    bool empty() const
+    {
+        return occlusion.empty() && roughness.empty() && gloss.empty() && metalness.empty() && specular.empty();
+    }
+};
+
+// only these sampler types are read by the shaders; anything else is skipped by the loaders
+inline bool textureTypeSampled(const string &type)
+{
+    return type == "texture_diffuse" || type == "texture_material";
+}
+
+inline bool isMaterialPackPath(const string &path)
+{
+    return path.compare(0, strlen(MATERIAL_PACK_PREFIX), MATERIAL_PACK_PREFIX) == 0;
+}
+
+inline string materialPackPath(const MaterialPack &pack)
+{
+    return MATERIAL_PACK_PREFIX + pack.occlusion + '|' + pack.roughness + '|' + pack.gloss + '|' + pack.metalness + '|' + pack.specular;
+}
+
+inline bool parseMaterialPackPath(const string &path, MaterialPack &pack)
+{
+    if (!isMaterialPackPath(path))
+        return false;
+    string *fields[5] = { &pack.occlusion, &pack.roughness, &pack.gloss, &pack.metalness, &pack.specular };
+    size_t start = strlen(MATERIAL_PACK_PREFIX);
+    for (int f = 0; f < 5; f++)
+    {
+        size_t end = f < 4 ? path.find('|', start) : path.size();
+        if (end == string::npos)
+            return false;
+        *fields[f] = path.substr(start, end - start);
+        start = end + 1;
+    }
+    return true;
+}
+
+inline bool materialFileExists(const string &path)
+{
+    struct stat info;
+    return stat(path.c_str(), &info) == 0 && (info.st_mode & S_IFREG) != 0;
+}
+
+// Most of the museum materials are texture sets named "<Name>_2K_<Kind>.jpg" whose MTL only lists the
+// color and specular maps. Given any map of such a set, the missing kinds are looked up next to it.
+inline void completeMaterialPack(MaterialPack &pack, const string &reference, const string &directory)
+{
+    static const char *knownKinds[] = { "BaseColor", "Color", "COL", "Albedo", "Diffuse", "AO", "Roughness", "Gloss",
+                                        "Metalness", "Specular", "Bump", "Normal", "Displacement", "Cavity" };
+    size_t dot = reference.find_last_of('.');
+    size_t underscore = reference.find_last_of('_', dot);
+    if (dot == string::npos || underscore == string::npos || underscore > dot)
+        return;
+    string kind = reference.substr(underscore + 1, dot - underscore - 1);
+    bool known = false;
+    for (size_t k = 0; k < sizeof(knownKinds) / sizeof(knownKinds[0]) && !known; k++)
+        known = kind == knownKinds[k];
+    if (!known)
+        return;
+
+    string stem = reference.substr(0, underscore + 1), extension = reference.substr(dot);
+    string *fields[5] = { &pack.occlusion, &pack.roughness, &pack.gloss, &pack.metalness, &pack.specular };
+    const char *kinds[5] = { "AO", "Roughness", "Gloss", "Metalness", "Specular" };
+    for (int f = 0; f < 5; f++)
+    {
+        if (!fields[f]->empty())
+            continue;
+        string sibling = stem + kinds[f] + extension;
+        if (materialFileExists(directory + '/' + sibling))
+            *fields[f] = sibling;
+    }
+    if (!pack.roughness.empty())
+        pack.gloss.clear();
+}
+
+// decodes the maps of a pack and interleaves them into one RGBA8 image as large as the biggest map (smaller
+// ones are resampled nearest). Channels without a map get their default. False if no map could be decoded.
+// Uses stb_image, whose implementation is compiled by the main translation unit.
+inline bool packMaterialImage(const MaterialPack &pack, const string &directory, vector<unsigned char> &rgba, int &width, int &height)
+{
+    const string *fields[4] = { &pack.occlusion, pack.roughness.empty() ? &pack.gloss : &pack.roughness, &pack.metalness, &pack.specular };
+    const unsigned char defaults[4] = { 255, 0, 0, 128 };
+    bool invert[4] = { false, pack.roughness.empty(), false, false };
+    unsigned char *maps[4] = { nullptr, nullptr, nullptr, nullptr };
+    int sizes[4][2] = { { 0, 0 } };
+    width = height = 0;
+    for (int c = 0; c < 4; c++)
+    {
+        if (fields[c]->empty())
+            continue;
+        int components;
+        maps[c] = stbi_load((directory + '/' + *fields[c]).c_str(), &sizes[c][0], &sizes[c][1], &components, 1);
+        if (!maps[c])
+        {
+            cout << "WARNING::MATERIAL:: could not decode " << *fields[c] << endl;
+            continue;
+        }
+        width = (std::max)(width, sizes[c][0]);
+        height = (std::max)(height, sizes[c][1]);
+    }
+    if (width == 0 || height == 0)
+        return false;
+
+    rgba.resize((size_t)width * height * 4);
+    for (int c = 0; c < 4; c++)
+    {
+        for (int y = 0; y < height; y++)
+        {
+            unsigned char *row = &rgba[(size_t)y * width * 4 + c];
+            if (!maps[c])
+            {
+                for (int x = 0; x < width; x++)
+                    row[x * 4] = defaults[c];
+                continue;
+            }
+            const unsigned char *source = maps[c] + (size_t)(y * sizes[c][1] / height) * sizes[c][0];
+            for (int x = 0; x < width; x++)
+            {
+                unsigned char value = source[x * sizes[c][0] / width];
+                row[x * 4] = invert[c] ? 255 - value : value;
+            }
+        }
+        stbi_image_free(maps[c]);
+    }
+    return true;
+}
+
+// 1x1 pack with the defaults, bound for meshes that have no material maps of their own
+inline unsigned int defaultMaterialTexture()
+{
+    static unsigned int textureID = 0;
+    if (textureID == 0)
+    {
+        const unsigned char texel[4] = { 255, 0, 0, 128 };
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, texel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    }
+    return textureID;
+}
+#endif
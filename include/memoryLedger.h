@@ -0,0 +1,270 @@
+#ifndef MEMORY_LEDGER_H
+#define MEMORY_LEDGER_H
+
+#include <gpuResources.h>
+#include <textureCooker.h>
+#include <textureRegistry.h>
+#include <memoryStats.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Accounting of the memory the app holds, CPU and GPU, by owner and category.
+// Most of it is already counted where it is allocated, the ledger only collects it:
+//   - single GPU allocations and model geometry from the VRAM ledger (gpuResources.h), owned by their label
+//   - model textures from textureGpuBytes(), owned by the image the texture registry loaded them from
+//   - CPU memory through sources: an owner registers a function that tells how many bytes it holds right
+//     now (geometry copies, the animation data of a skinned model...), so it doesn't report every change
+// update() writes the whole ledger as JSON every MEMORY_LEDGER_DUMP_SECONDS to MEMORY_LEDGER_REPORT, or to
+// MUSEO_MEMORY_REPORT from the environment (empty turns the dump off).
+// The same owner holding a category twice (an image uploaded by two loaders, a file loaded by two models) is
+// a duplicate; checkShutdown(), once everything was released, reports them along with whatever is still
+// accounted, which would leak.
+
+#define MEMORY_LEDGER_DUMP_SECONDS  10.0
+#define MEMORY_LEDGER_REPORT        "memory_report.json"
+
+enum MemoryCategory {
+    MEMORY_CPU_GEOMETRY,        // vertex, index and bone arrays kept in memory
+    MEMORY_CPU_ANIMATION,       // imported scene retained for the animation and its baked tracks
+    MEMORY_GPU_GEOMETRY,        // vertex and index buffers of the models
+    MEMORY_GPU_MODEL_TEXTURE,   // textures of the registry, streamed level by level
+    MEMORY_GPU_TEXTURE,         // every other texture
+    MEMORY_GPU_BUFFER,
+    MEMORY_GPU_RENDERBUFFER,
+    MEMORY_CATEGORIES
+};
+
+inline const char *memoryCategoryName(MemoryCategory category)
+{
+    static const char *names[MEMORY_CATEGORIES] = {
+        "cpu geometry", "cpu animation", "gpu geometry", "gpu model textures", "gpu textures", "gpu buffers", "gpu renderbuffers"
+    };
+    return names[category];
+}
+
+inline bool memoryCategoryOnGpu(MemoryCategory category)
+{
+    return category >= MEMORY_GPU_GEOMETRY;
+}
+
+struct MemoryEntry {
+    string owner;
+    MemoryCategory category;
+    size_t bytes;
+};
+
+class MemoryLedger {
+public:
+    MemoryLedger() : nextSource(1), reportPath(MEMORY_LEDGER_REPORT), lastDump(-MEMORY_LEDGER_DUMP_SECONDS)
+    {
+        const char *path = getenv("MUSEO_MEMORY_REPORT");
+        if (path)
+            reportPath = path;
+    }
+
+    // CPU memory of owner, bytes is asked every time the ledger is read
+    unsigned int addSource(const string &owner, MemoryCategory category, const function<size_t()> &bytes)
+    {
+        Source source;
+        source.owner = owner;
+        source.category = category;
+        source.bytes = bytes;
+        sources[nextSource] = source;
+        return nextSource++;
+    }
+
+    void removeSource(unsigned int handle)
+    {
+        sources.erase(handle);
+    }
+
+    // everything accounted right now, empty entries left out
+    vector<MemoryEntry> entries() const
+    {
+        vector<MemoryEntry> all;
+        for (map<unsigned int, Source>::const_iterator it = sources.begin(); it != sources.end(); ++it)
+            add(all, it->second.owner, it->second.category, it->second.bytes());
+        gpuResources().forEachOwner([&](const string &owner, size_t bytes) {
+            add(all, owner, MEMORY_GPU_GEOMETRY, bytes);
+        });
+        gpuResources().forEachAllocation([&](GpuResourceKind kind, const string &owner, size_t bytes) {
+            add(all, owner, kind == GPU_RESOURCE_TEXTURE ? MEMORY_GPU_TEXTURE : kind == GPU_RESOURCE_BUFFER ? MEMORY_GPU_BUFFER : MEMORY_GPU_RENDERBUFFER, bytes);
+        });
+        for (map<unsigned int, size_t>::const_iterator it = textureGpuBytes().begin(); it != textureGpuBytes().end(); ++it)
+        {
+            string name = textureRegistry().nameOf(it->first);
+            add(all, name.empty() ? "texture " + to_string(it->first) : name, MEMORY_GPU_MODEL_TEXTURE, it->second);
+        }
+        return all;
+    }
+
+    // bytes of every category, indexed by MemoryCategory
+    vector<size_t> totals() const
+    {
+        return totals(entries());
+    }
+
+    size_t totalBytes(bool gpu) const
+    {
+        vector<size_t> sums = totals();
+        size_t bytes = 0;
+        for (int c = 0; c < MEMORY_CATEGORIES; c++)
+            if (memoryCategoryOnGpu((MemoryCategory)c) == gpu)
+                bytes += sums[c];
+        return bytes;
+    }
+
+    // main thread, once a frame; seconds since the start
+    void update(double seconds)
+    {
+        if (reportPath.empty() || seconds - lastDump < MEMORY_LEDGER_DUMP_SECONDS)
+            return;
+        lastDump = seconds;
+        writeReport(reportPath, seconds);
+    }
+
+    bool writeReport(const string &path, double seconds)
+    {
+        vector<MemoryEntry> all = entries();
+        vector<size_t> sums = totals(all);
+        findDuplicates(all);
+
+        FILE *file = fopen(path.c_str(), "w");
+        if (!file)
+        {
+            cout << "WARNING::MEMORY_LEDGER:: could not write " << path << endl;
+            reportPath.clear();
+            return false;
+        }
+        fprintf(file, "{\n  \"seconds\": %.1f,\n  \"rss\": %zu,\n  \"peakRss\": %zu,\n  \"totals\": {", seconds, getCurrentRSS(), getPeakRSS());
+        for (int c = 0; c < MEMORY_CATEGORIES; c++)
+            fprintf(file, "%s\n    \"%s\": %zu", c ? "," : "", memoryCategoryName((MemoryCategory)c), sums[c]);
+        fprintf(file, "\n  },\n  \"entries\": [");
+        for (size_t i = 0; i < all.size(); i++)
+            fprintf(file, "%s\n    { \"owner\": \"%s\", \"category\": \"%s\", \"bytes\": %zu }", i ? "," : "",
+                    escape(all[i].owner).c_str(), memoryCategoryName(all[i].category), all[i].bytes);
+        fprintf(file, "\n  ],\n  \"duplicates\": [");
+        bool first = true;
+        for (set<string>::const_iterator it = duplicates.begin(); it != duplicates.end(); ++it, first = false)
+            fprintf(file, "%s\n    \"%s\"", first ? "" : ",", escape(*it).c_str());
+        fprintf(file, "\n  ]\n}\n");
+        fclose(file);
+        return true;
+    }
+
+    void printReport()
+    {
+        vector<MemoryEntry> all = entries();
+        vector<size_t> sums = totals(all);
+        cout << "MEMORY::LEDGER::";
+        for (int c = 0; c < MEMORY_CATEGORIES; c++)
+            cout << (c ? "  " : " ") << memoryCategoryName((MemoryCategory)c) << ": " << sums[c] / 1024 << " KB";
+        cout << endl;
+        size_t known = duplicates.size();
+        findDuplicates(all);
+        if (duplicates.size() > known)
+            cout << "WARNING::MEMORY_LEDGER:: " << duplicates.size() << " owners hold the same memory twice, see checkShutdown" << endl;
+    }
+
+    // after the cleanup: the duplicates seen while running and whatever is still held, which leaks
+    void checkShutdown() const
+    {
+        for (set<string>::const_iterator it = duplicates.begin(); it != duplicates.end(); ++it)
+            cout << "WARNING::MEMORY_LEDGER:: duplicate " << *it << endl;
+        vector<MemoryEntry> all = entries();
+        size_t leaked = 0;
+        for (size_t i = 0; i < all.size(); i++)
+        {
+            cout << "WARNING::MEMORY_LEDGER:: leak " << memoryCategoryName(all[i].category) << " of " << all[i].owner
+                 << ": " << all[i].bytes / 1024 << " KB" << endl;
+            leaked += all[i].bytes;
+        }
+        cout << "MEMORY::LEDGER:: shutdown  duplicates: " << duplicates.size() << "  leaks: " << all.size()
+             << " (" << leaked / 1024 << " KB)" << endl;
+    }
+
+private:
+    struct Source {
+        string owner;
+        MemoryCategory category;
+        function<size_t()> bytes;
+    };
+
+    map<unsigned int, Source> sources;
+    unsigned int nextSource;
+    string reportPath;
+    double lastDump;
+    set<string> duplicates;     // "category of owner", kept once seen
+
+    static void add(vector<MemoryEntry> &all, const string &owner, MemoryCategory category, size_t bytes)
+    {
+        if (bytes == 0)
+            return;
+        MemoryEntry entry = { owner, category, bytes };
+        all.push_back(entry);
+    }
+
+    static vector<size_t> totals(const vector<MemoryEntry> &all)
+    {
+        vector<size_t> sums(MEMORY_CATEGORIES, 0);
+        for (size_t i = 0; i < all.size(); i++)
+            sums[all[i].category] += all[i].bytes;
+        return sums;
+    }
+
+    // buffers and renderbuffers come in sets under one label (vertices and indices...), the rest
+    // should appear once per owner. Textures are compared across both texture categories
+    void findDuplicates(const vector<MemoryEntry> &all)
+    {
+        map<string, int> seen;
+        for (size_t i = 0; i < all.size(); i++)
+        {
+            MemoryCategory category = all[i].category;
+            if (category == MEMORY_GPU_BUFFER || category == MEMORY_GPU_RENDERBUFFER)
+                continue;
+            string owner = all[i].owner;
+            for (size_t c = 0; c < owner.size(); c++)
+                if (owner[c] == '\\')
+                    owner[c] = '/';
+            bool texture = category == MEMORY_GPU_TEXTURE || category == MEMORY_GPU_MODEL_TEXTURE;
+            string key = string(texture ? "texture" : memoryCategoryName(category)) + " of " + owner;
+            if (++seen[key] == 2)
+                duplicates.insert(key);
+        }
+    }
+
+    static string escape(const string &text)
+    {
+        string escaped;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            unsigned char c = (unsigned char)text[i];
+            if (c == '"' || c == '\\')
+                escaped += '\\';
+            if (c < 0x20)
+            {
+                char code[8];
+                snprintf(code, sizeof(code), "\\u%04x", c);
+                escaped += code;
+            }
+            else
+                escaped += (char)c;
+        }
+        return escaped;
+    }
+};
+
+inline MemoryLedger& memoryLedger()
+{
+    static MemoryLedger ledger;
+    return ledger;
+}
+#endif
@@ -0,0 +1,55 @@
+#ifndef MEMORY_STATS_H
+#define MEMORY_STATS_H
+
+#include <cstddef>
+#include <cstdio>
+
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#pragma comment(lib, "psapi.lib")
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+// Resident set size of the process, used to check how much memory the asset import really costs.
+// Peak is the high-water mark since the process started; current is what is resident right now.
+
+inline size_t getPeakRSS()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return (size_t)counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return (size_t)usage.ru_maxrss;         // bytes on macOS
+#else
+    return (size_t)usage.ru_maxrss * 1024;  // kilobytes on Linux
+#endif
+#endif
+}
+
+inline size_t getCurrentRSS()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return (size_t)counters.WorkingSetSize;
+    return 0;
+#else
+    FILE *file = fopen("/proc/self/statm", "r");
+    if (!file)
+        return 0;
+    long pages = 0, resident = 0;
+    int read = fscanf(file, "%ld %ld", &pages, &resident);
+    fclose(file);
+    return read == 2 ? (size_t)resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+#endif
+}
+#endif
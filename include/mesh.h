@@ -7,11 +7,15 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include <shader.h>
+#include <materialPacker.h>
+#include <textureResidency.h>
+#include <virtualTexture.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -34,6 +38,26 @@ struct Texture {
     string path;
 };
 
+// what happens to the CPU copy of the geometry once it has been uploaded to the GPU
+enum ResidencyPolicy {
+    RESIDENCY_GPU_ONLY,     // drop vertices/indices after setupMesh (default)
+    RESIDENCY_KEEP_CPU      // keep them for consumers such as picking, collision or a software renderer
+};
+
+// geometry whose GL buffers were created elsewhere, e.g. uploaded straight from the buffer views of a glTF file.
+// The VAO already has every attribute (and the element buffer) bound.
+struct GpuGeometry {
+    unsigned int VAO;
+    unsigned int VBO;           // buffer only this mesh reads from (0 if every attribute lives in shared buffers)
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    GLenum indexType;           // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    size_t indexOffset;         // byte offset of the first index in the element buffer
+    size_t gpuBytes;            // bytes of the buffers only this mesh uses (shared buffer views are counted by the model)
+    glm::vec3 boundsCenter;     // bounding sphere, radius 0 when unknown
+    float boundsRadius;
+};
+
 class Mesh {
 public:
     /*  Mesh Data  */
@@ -41,65 +65,152 @@ public:
     vector<unsigned int> indices;
     vector<Texture> textures;
     unsigned int VAO;
+    unsigned int vertexCount;
+    unsigned int indexCount;
+    GLenum indexType;
+    size_t indexOffset;
+    size_t gpuBytes;            // bytes held by the vertex and index buffers
+    glm::vec3 boundsCenter;     // bounding sphere in model space, radius 0 when unknown
+    float boundsRadius;
+    unsigned int virtualTexture;    // painting scan drawn instead of the diffuse map (virtualTexture.h), 0 for none
 
     /*  Functions  */
-    // constructor
+    // constructor, takes ownership of the buffers (pass them with std::move to avoid copying the geometry)
     Mesh(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+        : vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)), virtualTexture(0)
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-
+        computeBounds();
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
-    // render the mesh
-    void Draw(Shader shader) 
+    // constructor for geometry that is already on the GPU. There is no CPU copy (see hasCpuData).
+    Mesh(const GpuGeometry &geometry, vector<Texture> textures)
+        : textures(std::move(textures)), VAO(geometry.VAO), vertexCount(geometry.vertexCount), indexCount(geometry.indexCount),
+          indexType(geometry.indexType), indexOffset(geometry.indexOffset), gpuBytes(geometry.gpuBytes),
+          boundsCenter(geometry.boundsCenter), boundsRadius(geometry.boundsRadius), virtualTexture(0), VBO(geometry.VBO), EBO(0)
+    {
+    }
+
+    // render the mesh. screenPixels is roughly how many pixels it covers, it decides which mip levels of its
+    // textures stay resident (0: all of them, see textureResidency.h)
+    void Draw(Shader shader, float screenPixels = 0.0f) 
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
-        unsigned int specularNr = 1;
-        unsigned int normalNr   = 1;
-        unsigned int heightNr   = 1;
+        unsigned int materialNr = 1;
         for(unsigned int i = 0; i < textures.size(); i++)
         {
             glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
-            string name = textures[i].type;
+            const string &name = textures[i].type;
             if(name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
-            else if(name == "texture_specular")
-                number = std::to_string(specularNr++); // transfer unsigned int to stream
-            else if(name == "texture_normal")
-                number = std::to_string(normalNr++); // transfer unsigned int to stream
-             else if(name == "texture_height")
-                number = std::to_string(heightNr++); // transfer unsigned int to stream
+            else if(name == "texture_material")
+                number = std::to_string(materialNr++); // transfer unsigned int to stream
 
             // now set the sampler to the correct texture unit
             glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);    // AQUI ES DONDE SE ASIGNAN LOS UNIFORM A LOS SHADERS AHHHHHHHHHHHH
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            textureResidency().use(textures[i].id, screenPixels);
         }
+        // meshes without material maps still need something behind texture_material1
+        if(materialNr == 1)
+        {
+            unsigned int unit = (unsigned int)textures.size();
+            glActiveTexture(GL_TEXTURE0 + unit);
+            glUniform1i(glGetUniformLocation(shader.ID, "texture_material1"), unit);
+            glBindTexture(GL_TEXTURE_2D, defaultMaterialTexture());
+        }
+        // the diffuse map stays bound: it is what shows until the scan's coarsest page is in
+        if(virtualTexture == 0 || !virtualTextures().bind(shader.ID, virtualTexture))
+            virtualTextures().unbind(shader.ID);
         
         // draw mesh
         glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
+        glDrawElements(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset);
         glBindVertexArray(0);
 
         // always good practice to set everything back to defaults once configured.
         glActiveTexture(GL_TEXTURE0);
     }
 
+    bool hasCpuData() const
+    {
+        return vertices.size() == vertexCount && indices.size() == indexCount;
+    }
+
+    // frees the CPU copy of the geometry; the GPU buffers keep drawing as before
+    void releaseCpuData()
+    {
+        vector<Vertex>().swap(vertices);
+        vector<unsigned int>().swap(indices);
+    }
+
+    size_t cpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int);
+    }
+
+    bool hasGpuData() const
+    {
+        return VAO != 0;
+    }
+
+    // deletes the VAO and the buffers only this mesh uses, returns the bytes freed
+    size_t releaseGpuData()
+    {
+        size_t bytes = gpuBytes;
+        glDeleteVertexArrays(1, &VAO);
+        if (VBO)
+            glDeleteBuffers(1, &VBO);
+        if (EBO)
+            glDeleteBuffers(1, &EBO);
+        VAO = VBO = EBO = 0;
+        gpuBytes = 0;
+        return bytes;
+    }
+
+    // uploads the CPU copy of the geometry again after releaseGpuData (not for meshes built from a GpuGeometry)
+    void restoreGpuData()
+    {
+        if (!hasGpuData() && !vertices.empty())
+            setupMesh();
+    }
+
 private:
     /*  Render data  */
     unsigned int VBO, EBO;
 
     /*  Functions    */
+    // sphere around the box of the vertices
+    void computeBounds()
+    {
+        boundsCenter = glm::vec3(0.0f);
+        boundsRadius = 0.0f;
+        if (vertices.empty())
+            return;
+        glm::vec3 low = vertices[0].Position, high = vertices[0].Position;
+        for (size_t i = 1; i < vertices.size(); i++)
+        {
+            low = glm::min(low, vertices[i].Position);
+            high = glm::max(high, vertices[i].Position);
+        }
+        boundsCenter = (low + high) * 0.5f;
+        boundsRadius = glm::length(high - low) * 0.5f;
+    }
+
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+        vertexCount = (unsigned int)vertices.size();
+        indexCount = (unsigned int)indices.size();
+        indexType = GL_UNSIGNED_INT;
+        indexOffset = 0;
+        gpuBytes = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int);
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
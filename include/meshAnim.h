@@ -8,11 +8,13 @@
 
 #include <shader.h>
 #include <mesh.h>
+#include <preSkinning.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <utility>
 #include <vector>
 using namespace std;
 
@@ -58,32 +60,112 @@ public:
     vector<Texture> textures;
 	vector<VertexBoneData> bones_id_weights_for_each_vertex;
     unsigned int VAO;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	GLenum indexType;
+	size_t indexOffset;
+	size_t gpuBytes;            // bytes held by the vertex, bone and index buffers
+	glm::vec3 boundsCenter;     // bounding sphere of the bind pose, radius 0 when unknown
+	float boundsRadius;
+	unsigned int skinnedVAO = 0;    // vertices written by the pre-skinning pass (preSkinning.h), 0 until it runs
+	unsigned int skinnedVBO = 0;
 
     /*  Functions  */
-    // constructor
+    // constructors, take ownership of the buffers (pass them with std::move to avoid copying the geometry)
 	MeshAnim(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures)
+		: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures))
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
-
 		// now that we have all the required data, set the vertex buffers and its attribute pointers.
 		setupMesh();
 	}
 
     MeshAnim(vector<Vertex> vertices, vector<unsigned int> indices, vector<Texture> textures, vector<VertexBoneData> bone_id_weights)
+		: vertices(std::move(vertices)), indices(std::move(indices)), textures(std::move(textures)),
+		  bones_id_weights_for_each_vertex(std::move(bone_id_weights))
     {
-        this->vertices = vertices;
-        this->indices = indices;
-        this->textures = textures;
-		bones_id_weights_for_each_vertex = bone_id_weights;
-
         // now that we have all the required data, set the vertex buffers and its attribute pointers.
         setupMesh();
     }
 
+    // constructor for geometry that is already on the GPU. There is no CPU copy (see hasCpuData).
+    MeshAnim(const GpuGeometry &geometry, vector<Texture> textures)
+        : textures(std::move(textures)), VAO(geometry.VAO), vertexCount(geometry.vertexCount), indexCount(geometry.indexCount),
+          indexType(geometry.indexType), indexOffset(geometry.indexOffset), gpuBytes(geometry.gpuBytes), boundsCenter(geometry.boundsCenter),
+          boundsRadius(geometry.boundsRadius), VBO(geometry.VBO), EBO(0), VBO_bones(0)
+    {
+    }
+
     // render the mesh
     void Draw(Shader shader) 
+    {
+        bindTextures(shader);
+
+        // draw mesh
+        glBindVertexArray(VAO);
+        glDrawElements(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset);
+        glBindVertexArray(0);
+
+        // always good practice to set everything back to defaults once configured.
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // instances copies of the mesh, with the per instance attributes a crowd (crowd.h) added to the VAO
+    void DrawInstanced(Shader shader, GLsizei instances)
+    {
+        bindTextures(shader);
+        glBindVertexArray(VAO);
+        glDrawElementsInstanced(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset, instances);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // the vertices the pre-skinning pass wrote, with the indices of the mesh
+    void DrawSkinned(Shader shader)
+    {
+        bindTextures(shader);
+        glBindVertexArray(skinnedVAO);
+        glDrawElements(GL_TRIANGLES, indexCount, indexType, (void*)indexOffset);
+        glBindVertexArray(0);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    // the buffer the pre-skinning pass writes to and a VAO that draws it with the element buffer of the mesh;
+    // returns its bytes
+    size_t setupSkinned()
+    {
+        GLint elements = 0;
+        glBindVertexArray(VAO);
+        glGetIntegerv(GL_ELEMENT_ARRAY_BUFFER_BINDING, &elements);
+        size_t bytes = (size_t)vertexCount * PRE_SKINNING_STRIDE * sizeof(float);
+        glGenBuffers(1, &skinnedVBO);
+        glBindBuffer(GL_ARRAY_BUFFER, skinnedVBO);
+        glBufferData(GL_ARRAY_BUFFER, bytes, nullptr, GL_DYNAMIC_COPY);
+        glGenVertexArrays(1, &skinnedVAO);
+        glBindVertexArray(skinnedVAO);
+        GLsizei stride = PRE_SKINNING_STRIDE * sizeof(float);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+        glEnableVertexAttribArray(1);
+        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(3 * sizeof(float)));
+        glEnableVertexAttribArray(2);
+        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(6 * sizeof(float)));
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, (GLuint)elements);
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        return bytes;
+    }
+
+    // every vertex through the pre-skinning program, between PreSkinning::begin and end
+    void Skin()
+    {
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, skinnedVBO);
+        glBindVertexArray(VAO);
+        glBeginTransformFeedback(GL_POINTS);
+        glDrawArrays(GL_POINTS, 0, vertexCount);
+        glEndTransformFeedback();
+    }
+
+    void bindTextures(Shader shader)
     {
         // bind appropriate textures
         unsigned int diffuseNr  = 1;
@@ -95,7 +177,7 @@ public:
             glActiveTexture(GL_TEXTURE0 + i); // active proper texture unit before binding
             // retrieve texture number (the N in diffuse_textureN)
             string number;
-            string name = textures[i].type;
+            const string &name = textures[i].type;
             if(name == "texture_diffuse")
                 number = std::to_string(diffuseNr++);
             else if(name == "texture_specular")
@@ -109,25 +191,82 @@ public:
             glUniform1i(glGetUniformLocation(shader.ID, (name + number).c_str()), i);    // AQUI ES DONDE SE ASIGNAN LOS UNIFORM A LOS SHADERS AHHHHHHHHHHHH
             // and finally bind the texture
             glBindTexture(GL_TEXTURE_2D, textures[i].id);
+            textureResidency().use(textures[i].id, 0.0f);   // animated characters keep every level
         }
-        
-        // draw mesh
-        glBindVertexArray(VAO);
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
-
-        // always good practice to set everything back to defaults once configured.
-        glActiveTexture(GL_TEXTURE0);
     }
 
+	bool hasCpuData() const
+	{
+		return vertices.size() == vertexCount && indices.size() == indexCount;
+	}
+
+	// frees the CPU copy of the geometry and skinning data; the GPU buffers keep drawing as before
+	void releaseCpuData()
+	{
+		vector<Vertex>().swap(vertices);
+		vector<unsigned int>().swap(indices);
+		vector<VertexBoneData>().swap(bones_id_weights_for_each_vertex);
+	}
+
+	size_t cpuBytes() const
+	{
+		return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(unsigned int) +
+			bones_id_weights_for_each_vertex.capacity() * sizeof(VertexBoneData);
+	}
+
+	// deletes the VAO and the buffers only this mesh uses, returns the bytes freed
+	size_t releaseGpuData()
+	{
+		size_t bytes = gpuBytes;
+		glDeleteVertexArrays(1, &VAO);
+		if (VBO)
+			glDeleteBuffers(1, &VBO);
+		if (EBO)
+			glDeleteBuffers(1, &EBO);
+		if (VBO_bones)
+			glDeleteBuffers(1, &VBO_bones);
+		if (skinnedVAO)
+			glDeleteVertexArrays(1, &skinnedVAO);
+		if (skinnedVBO)
+			glDeleteBuffers(1, &skinnedVBO);
+		VAO = VBO = EBO = VBO_bones = skinnedVAO = skinnedVBO = 0;
+		gpuBytes = 0;
+		return bytes;
+	}
+
 private:
     /*  Render data  */
     unsigned int VBO, EBO, VBO_bones;
 
     /*  Functions    */
+    // sphere around the box of the vertices
+    void computeBounds()
+    {
+        boundsCenter = glm::vec3(0.0f);
+        boundsRadius = 0.0f;
+        if (vertices.empty())
+            return;
+        glm::vec3 low = vertices[0].Position, high = vertices[0].Position;
+        for (size_t i = 1; i < vertices.size(); i++)
+        {
+            low = glm::min(low, vertices[i].Position);
+            high = glm::max(high, vertices[i].Position);
+        }
+        boundsCenter = (low + high) * 0.5f;
+        boundsRadius = glm::length(high - low) * 0.5f;
+    }
+
     // initializes all the buffer objects/arrays
     void setupMesh()
     {
+		computeBounds();
+		vertexCount = (unsigned int)vertices.size();
+		indexCount = (unsigned int)indices.size();
+		indexType = GL_UNSIGNED_INT;
+		indexOffset = 0;
+		gpuBytes = vertices.size() * sizeof(Vertex) + indices.size() * sizeof(unsigned int) +
+			bones_id_weights_for_each_vertex.size() * sizeof(VertexBoneData);
+
         // create buffers/arrays
         glGenVertexArrays(1, &VAO);
         glGenBuffers(1, &VBO);
@@ -0,0 +1,163 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <assimp/matrix4x4.h>
+
+#include <mesh.h>
+#include <meshAnim.h>
+
+#include <sys/stat.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Binary geometry cache written next to every imported asset ("<asset>.meshcache").
+// It holds the final vertex/index (and bone) arrays of each mesh plus the textures it
+// references, so a model can be rebuilt -- or its CPU copies reloaded on demand --
+// without going through the importer again.
+// The cache is only trusted when the size and modification time of the source file
+// still match the ones recorded in its header.
+
+#define MESH_CACHE_MAGIC   0x4348534Du // "MSHC"
+#define MESH_CACHE_VERSION 2u  // 2: scalar material maps are stored as one packed texture_material
+
+struct MeshCacheTexture {
+    string type;
+    string path;
+};
+
+struct MeshCacheEntry {
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<VertexBoneData> bones;       // empty for static meshes
+    vector<MeshCacheTexture> textures;
+};
+
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t sourceSize;
+    int64_t  sourceTime;
+    uint32_t meshCount;
+    uint32_t reserved;
+};
+
+inline string meshCachePath(const string &sourcePath)
+{
+    return sourcePath + ".meshcache";
+}
+
+// size and modification time of the source asset, used to detect stale caches
+inline bool meshCacheSourceStamp(const string &sourcePath, uint64_t &size, int64_t &time)
+{
+    struct stat st;
+    if (stat(sourcePath.c_str(), &st) != 0)
+        return false;
+    size = (uint64_t)st.st_size;
+    time = (int64_t)st.st_mtime;
+    return true;
+}
+
+inline bool meshCacheWriteString(FILE *file, const string &str)
+{
+    uint32_t length = (uint32_t)str.size();
+    return fwrite(&length, sizeof(length), 1, file) == 1 &&
+           (length == 0 || fwrite(str.data(), 1, length, file) == length);
+}
+
+inline bool meshCacheReadString(FILE *file, string &str)
+{
+    uint32_t length = 0;
+    if (fread(&length, sizeof(length), 1, file) != 1 || length > (1u << 16))
+        return false;
+    str.resize(length);
+    return length == 0 || fread(&str[0], 1, length, file) == length;
+}
+
+template <typename T>
+inline bool meshCacheWriteArray(FILE *file, const vector<T> &data)
+{
+    return data.empty() || fwrite(data.data(), sizeof(T), data.size(), file) == data.size();
+}
+
+template <typename T>
+inline bool meshCacheReadArray(FILE *file, vector<T> &data, uint32_t count)
+{
+    data.resize(count);
+    return count == 0 || fread(data.data(), sizeof(T), count, file) == count;
+}
+
+// writes every mesh of a model to its cache file. Returns false (and leaves no cache behind) on failure.
+inline bool writeMeshCache(const string &sourcePath, const vector<MeshCacheEntry> &entries)
+{
+    MeshCacheHeader header = {};
+    header.magic = MESH_CACHE_MAGIC;
+    header.version = MESH_CACHE_VERSION;
+    header.meshCount = (uint32_t)entries.size();
+    if (!meshCacheSourceStamp(sourcePath, header.sourceSize, header.sourceTime))
+        return false;
+
+    string cachePath = meshCachePath(sourcePath);
+    FILE *file = fopen(cachePath.c_str(), "wb");
+    if (!file)
+        return false;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    for (size_t i = 0; ok && i < entries.size(); i++)
+    {
+        const MeshCacheEntry &entry = entries[i];
+        uint32_t counts[4] = { (uint32_t)entry.vertices.size(), (uint32_t)entry.indices.size(),
+                               (uint32_t)entry.bones.size(), (uint32_t)entry.textures.size() };
+        ok = fwrite(counts, sizeof(counts), 1, file) == 1 &&
+             meshCacheWriteArray(file, entry.vertices) &&
+             meshCacheWriteArray(file, entry.indices) &&
+             meshCacheWriteArray(file, entry.bones);
+        for (size_t t = 0; ok && t < entry.textures.size(); t++)
+            ok = meshCacheWriteString(file, entry.textures[t].type) && meshCacheWriteString(file, entry.textures[t].path);
+    }
+    ok = (fclose(file) == 0) && ok;
+    if (!ok)
+        remove(cachePath.c_str());
+    return ok;
+}
+
+// reads the cache of a model. Fails if the cache is missing, corrupt or older than its source.
+inline bool readMeshCache(const string &sourcePath, vector<MeshCacheEntry> &entries)
+{
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!meshCacheSourceStamp(sourcePath, sourceSize, sourceTime))
+        return false;
+
+    FILE *file = fopen(meshCachePath(sourcePath).c_str(), "rb");
+    if (!file)
+        return false;
+
+    MeshCacheHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+              header.magic == MESH_CACHE_MAGIC && header.version == MESH_CACHE_VERSION &&
+              header.sourceSize == sourceSize && header.sourceTime == sourceTime;
+    if (ok)
+        entries.resize(header.meshCount);
+    for (uint32_t i = 0; ok && i < header.meshCount; i++)
+    {
+        MeshCacheEntry &entry = entries[i];
+        uint32_t counts[4];
+        ok = fread(counts, sizeof(counts), 1, file) == 1 &&
+             meshCacheReadArray(file, entry.vertices, counts[0]) &&
+             meshCacheReadArray(file, entry.indices, counts[1]) &&
+             meshCacheReadArray(file, entry.bones, counts[2]);
+        if (ok)
+            entry.textures.resize(counts[3]);
+        for (uint32_t t = 0; ok && t < counts[3]; t++)
+            ok = meshCacheReadString(file, entry.textures[t].type) && meshCacheReadString(file, entry.textures[t].path);
+    }
+    fclose(file);
+    if (!ok)
+        entries.clear();
+    return ok;
+}
+#endif
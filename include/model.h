@@ -11,17 +11,65 @@
 #include <assimp/postprocess.h>
 
 #include <mesh.h>
+#include <meshCache.h>
+#include <gltfLoader.h>
+#include <textureRegistry.h>
+#include <materialPacker.h>
+#include <textureStreamer.h>
+#include <textureResidency.h>
+#include <textureQuality.h>
+#include <virtualTexture.h>
+#include <gpuResources.h>
+#include <memoryLedger.h>
+#include <objLoader.h>
+#include <vertexConvert.h>
 #include <shader.h>
 
 #include <string>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <functional>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false);
+// halvings is the quality tier of the texture (see textureQuality.h)
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma = false, TextureUsage usage = TEXTURE_USAGE_COLOR, unsigned int halvings = 0);
+unsigned int TextureFromMemory(const unsigned char *data, size_t length, const char *name, TextureUsage usage = TEXTURE_USAGE_COLOR, unsigned int halvings = 0);
+unsigned int TextureFromMaterialPack(const string &packPath, const string &directory, unsigned int halvings = 0);
+
+// returns the texture a glTF material points to (a file next to the model or an image embedded in the GLB),
+// loading it only the first time it is requested. Embedded images are keyed as "#image<N>".
+inline Texture loadGltfTexture(vector<Texture> &textures_loaded, const GltfFile &file, const GltfTexture &reference, const string &directory,
+                               unsigned int halvings = 0)
+{
+    string key = reference.uri.empty() ? "#image" + to_string(reference.image) : reference.uri;
+    for (unsigned int j = 0; j < textures_loaded.size(); j++)
+    {
+        if (textures_loaded[j].path == key)
+        {
+            Texture texture = textures_loaded[j];
+            texture.type = reference.type;
+            return texture;
+        }
+    }
+    TextureUsage usage = reference.type == "texture_normal" ? TEXTURE_USAGE_NORMAL : TEXTURE_USAGE_COLOR;
+    Texture texture;
+    if (reference.uri.empty())
+    {
+        size_t length = 0;
+        const unsigned char *data = gltfImageData(file, reference.image, length);
+        texture.id = TextureFromMemory(data, length, key.c_str(), usage, halvings);
+    }
+    else
+        texture.id = TextureFromFile(key.c_str(), directory, false, usage, halvings);
+    texture.type = reference.type;
+    texture.path = key;
+    textures_loaded.push_back(texture);
+    return texture;
+}
 
 class Model 
 {
@@ -30,27 +78,285 @@ public:
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<Mesh> meshes;
     string directory;
+    string path;
     bool gammaCorrection;
+    ResidencyPolicy residency;
+    TextureCategory textureCategory;    // picks the quality tier of its textures, from the folder of the model
+    GltfGpuBuffers gltfBuffers;         // buffer views uploaded as they are by the glTF loader
 
     /*  Functions   */
     // constructor, expects a filepath to a 3D model.
-    Model(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // by default the CPU copy of the geometry is dropped once it is on the GPU, see acquireCpuData.
+    Model(string const &path, bool gamma = false, ResidencyPolicy residency = RESIDENCY_GPU_ONLY)
+        : path(path), gammaCorrection(gamma), residency(residency), textureCategory(textureCategoryOf(path)), cpuDataUsers(0), gpuEvicted(false)
     {
         loadModel(path);
+        attachVirtualTextures();
+        // the VRAM ledger may drop the geometry of a model out of view for a while; glTF geometry is uploaded
+        // straight from the file and is only accounted
+        function<size_t()> evict;
+        if (!isGltfFile(path))
+            evict = [this]() { return dropGpuData(); };
+        gpuHandle = gpuResources().addOwner(path, geometryBytes(), evict);
+        cpuHandle = memoryLedger().addSource(path, MEMORY_CPU_GEOMETRY, [this]() { return cpuBytes(); });
+    }
+
+    ~Model()
+    {
+        gpuResources().removeOwner(gpuHandle);
+        memoryLedger().removeSource(cpuHandle);
     }
 
+    // the ledgers keep a pointer to the model to evict and account its geometry
+    Model(const Model &) = delete;
+    Model &operator=(const Model &) = delete;
+
     // draws the model, and thus all its meshes
     void Draw(Shader shader)
     {
+        if (gpuEvicted && !restoreGpuData())
+            return;
+        gpuResources().touch(gpuHandle);
         for(unsigned int i = 0; i < meshes.size(); i++)
             meshes[i].Draw(shader);
     }
+
+    // sets the "model" uniform and draws. Knowing where the model is lets every mesh tell the texture
+    // residency how large it is on screen, so its textures only keep the mip levels it can show.
+    // Geometry dropped by the VRAM ledger is reloaded from the mesh cache once the model is in view again.
+    void Draw(Shader &shader, const glm::mat4 &model)
+    {
+        float scale = (std::max)(glm::length(glm::vec3(model[0])), (std::max)(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+        if (gpuEvicted && (!inView(model, scale) || !restoreGpuData()))
+            return;
+        shader.setMat4("model", model);
+        bool onScreen = false;
+        for(unsigned int i = 0; i < meshes.size(); i++)
+        {
+            float pixels = 0.0f;
+            if (meshes[i].boundsRadius > 0.0f)
+            {
+                glm::vec3 center = glm::vec3(model * glm::vec4(meshes[i].boundsCenter, 1.0f));
+                float size = textureResidency().screenSize(center, meshes[i].boundsRadius * scale);
+                onScreen = onScreen || size > 0.0f;
+                // (at least a pixel, 0 would ask for every level)
+                pixels = (std::max)(size, 1.0f);
+            }
+            else
+                onScreen = true;
+            // painting scans find out which of their pages are needed from a feedback pass over these meshes
+            if (meshes[i].virtualTexture != 0)
+                virtualTextures().record(meshes[i].virtualTexture, meshes[i].VAO, meshes[i].indexCount, meshes[i].indexType, meshes[i].indexOffset, model);
+            meshes[i].Draw(shader, pixels);
+        }
+        if (onScreen)
+            gpuResources().touch(gpuHandle);
+    }
+
+    // makes sure every mesh has its vertices/indices in memory, reloading them from the binary cache if
+    // they were released. Consumers (picking, collision...) pair it with releaseCpuData when done.
+    bool acquireCpuData()
+    {
+        cpuDataUsers++;
+        bool resident = true;
+        for (unsigned int i = 0; i < meshes.size() && resident; i++)
+            resident = meshes[i].hasCpuData();
+        if (resident)
+            return true;
+
+        vector<MeshCacheEntry> entries;
+        if (!reloadCpuData(entries) || entries.size() != meshes.size())
+        {
+            cout << "ERROR::MODEL:: could not reload geometry of " << path << endl;
+            cpuDataUsers--;
+            return false;
+        }
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            meshes[i].vertices.swap(entries[i].vertices);
+            meshes[i].indices.swap(entries[i].indices);
+        }
+        return true;
+    }
+
+    void releaseCpuData()
+    {
+        if (cpuDataUsers > 0)
+            cpuDataUsers--;
+        applyResidency();
+    }
+
+    size_t cpuBytes() const
+    {
+        size_t bytes = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].cpuBytes();
+        return bytes;
+    }
+
+    // vertex and index buffers
+    size_t geometryBytes() const
+    {
+        size_t bytes = gltfBuffers.bytes;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].gpuBytes;
+        return bytes;
+    }
+
+    size_t gpuBytes() const
+    {
+        size_t bytes = geometryBytes();
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+        {
+            map<unsigned int, size_t>::const_iterator it = textureGpuBytes().find(textures_loaded[i].id);
+            if (it != textureGpuBytes().end())
+                bytes += it->second;
+        }
+        return bytes;
+    }
+
+    // gives the model's references back to the texture registry, which deletes textures no other model uses
+    void releaseTextures()
+    {
+        for (unsigned int i = 0; i < textures_loaded.size(); i++)
+            textureRegistry().release(textures_loaded[i].id);
+        textures_loaded.clear();
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].textures.clear();
+    }
+
+    // deletes the VAOs and buffers of every mesh for good (drawing the model again doesn't bring them back)
+    void releaseGpuData()
+    {
+        dropGpuData();
+        for (map<int, unsigned int>::iterator it = gltfBuffers.views.begin(); it != gltfBuffers.views.end(); ++it)
+            glDeleteBuffers(1, &it->second);
+        gltfBuffers.views.clear();
+        gltfBuffers.bytes = 0;
+        gpuResources().removeOwner(gpuHandle);
+        gpuHandle = 0;
+    }
+
+    void printMemoryReport(const string &name) const
+    {
+        cout << "MEMORY::MODEL:: " << name << "  meshes: " << meshes.size()
+             << "  cpu: " << cpuBytes() / 1024 << " KB  gpu: " << gpuBytes() / 1024 << " KB" << endl;
+    }
     
 private:
+    int cpuDataUsers;           // consumers that asked for the CPU copy of the geometry
+    unsigned int gpuHandle;     // entry of the geometry in the VRAM ledger
+    unsigned int cpuHandle;     // source of its CPU copy in the memory ledger
+    bool gpuEvicted;            // its buffers were dropped, restoreGpuData brings them back
+
+    // the ledger's eviction: frees the mesh buffers, which restoreGpuData can rebuild
+    size_t dropGpuData()
+    {
+        size_t bytes = 0;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            bytes += meshes[i].releaseGpuData();
+        gpuEvicted = true;
+        return bytes;
+    }
+
+    // uploads the geometry again from the CPU copy, reloading it from the mesh cache if it was released
+    bool restoreGpuData()
+    {
+        if (gpuHandle == 0 || !acquireCpuData())
+            return false;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].restoreGpuData();
+        releaseCpuData();
+        gpuEvicted = false;
+        gpuResources().reloaded(gpuHandle, geometryBytes());
+        return true;
+    }
+
+    // whether any mesh may be on screen (not entirely behind the camera)
+    bool inView(const glm::mat4 &model, float scale) const
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            if (meshes[i].boundsRadius <= 0.0f)
+                return true;
+            glm::vec3 center = glm::vec3(model * glm::vec4(meshes[i].boundsCenter, 1.0f));
+            if (textureResidency().screenSize(center, meshes[i].boundsRadius * scale) > 0.0f)
+                return true;
+        }
+        return false;
+    }
+
     /*  Functions   */
-    // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
+    // meshes whose diffuse map has a painting scan registered with the virtual textures are drawn from it.
+    // Resolved on every load (the mesh cache only knows the diffuse map)
+    void attachVirtualTextures()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            for (unsigned int t = 0; t < meshes[i].textures.size() && meshes[i].virtualTexture == 0; t++)
+                if (meshes[i].textures[t].type == "texture_diffuse")
+                    meshes[i].virtualTexture = virtualTextures().acquire(directory + '/' + meshes[i].textures[t].path);
+    }
+
+    // drops the CPU copy of the geometry unless the policy or a consumer still needs it
+    void applyResidency()
+    {
+        if (residency == RESIDENCY_KEEP_CPU || cpuDataUsers > 0)
+            return;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].releaseCpuData();
+    }
+
+    // glTF geometry is read again from the source file, everything else from the binary cache
+    bool reloadCpuData(vector<MeshCacheEntry> &entries)
+    {
+        if (isGltfFile(path))
+            return readGltfGeometry(path, entries);
+        return readMeshCache(path, entries);
+    }
+
+    // loads a model from file (glTF and OBJ natively, any other ASSIMP supported format through ASSIMP) and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+        // retrieve the directory path of the filepath
+        directory = path.substr(0, path.find_last_of('/'));
+
+        // glTF buffers are already laid out for the GPU, there is nothing a cache would save
+        if (isGltfFile(path))
+        {
+            if (loadGltf(path))
+            {
+                // meshes uploaded straight from the file have no CPU copy to keep, read it once
+                if (residency == RESIDENCY_KEEP_CPU && acquireCpuData())
+                    cpuDataUsers--;
+                applyResidency();
+                return;
+            }
+            cout << "WARNING::GLTF:: native loader failed for " << path << ", falling back to ASSIMP" << endl;
+            discardGltf();
+        }
+
+        // reuse the binary cache if it is still up to date with the source file
+        vector<MeshCacheEntry> entries;
+        if (readMeshCache(path, entries))
+        {
+            buildMeshes(entries);
+            applyResidency();
+            return;
+        }
+
+        // OBJ files go through the native loader, ASSIMP stays as the fallback for everything else
+        if (isObjFile(path))
+        {
+            if (loadObj(path, entries))
+            {
+                buildMeshes(entries);
+                writeCache();
+                applyResidency();
+                return;
+            }
+            cout << "WARNING::OBJ:: native loader failed for " << path << ", falling back to ASSIMP" << endl;
+        }
+
         // read file via ASSIMP
         Assimp::Importer importer;
         const aiScene* scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
@@ -60,11 +366,105 @@ private:
             cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
             return;
         }
-        // retrieve the directory path of the filepath
-        directory = path.substr(0, path.find_last_of('/'));
 
         // process ASSIMP's root node recursively
+        meshes.reserve(scene->mNumMeshes);
         processNode(scene->mRootNode, scene);
+
+        writeCache();
+        applyResidency();
+    }
+
+    // creates the meshes (and loads their textures) from geometry read by the cache or the OBJ loader
+    void buildMeshes(vector<MeshCacheEntry> &entries)
+    {
+        meshes.reserve(entries.size());
+        for (unsigned int i = 0; i < entries.size(); i++)
+        {
+            vector<Texture> textures;
+            textures.reserve(entries[i].textures.size());
+            for (unsigned int t = 0; t < entries[i].textures.size(); t++)
+                textures.push_back(loadTexture(entries[i].textures[t].path.c_str(), entries[i].textures[t].type));
+            meshes.emplace_back(std::move(entries[i].vertices), std::move(entries[i].indices), std::move(textures));
+        }
+    }
+
+    // creates one mesh per glTF primitive. Primitives GL can read in place get a VAO over the uploaded
+    // buffer views; the rest are converted into our vertex layout.
+    bool loadGltf(const string &path)
+    {
+        GltfFile file;
+        vector<GltfPrimitive> primitives;
+        if (!file.open(path) || !gltfCollectPrimitives(file, primitives))
+            return false;
+        meshes.reserve(primitives.size());
+        for (unsigned int i = 0; i < primitives.size(); i++)
+        {
+            vector<GltfTexture> references;
+            vector<Texture> textures;
+            gltfMaterialTextures(file, primitives[i].material, references);
+            for (unsigned int t = 0; t < references.size(); t++)
+                textures.push_back(loadGltfTexture(textures_loaded, file, references[t], directory, textureQuality().tier(textureCategory)));
+
+            GpuGeometry geometry;
+            if (gltfUploadPrimitive(file, primitives[i], gltfBuffers, false, geometry))
+            {
+                meshes.emplace_back(geometry, std::move(textures));
+                continue;
+            }
+            vector<Vertex> vertices;
+            vector<unsigned int> indices;
+            if (!gltfConvertPrimitive(file, primitives[i], vertices, indices))
+                return false;
+            meshes.emplace_back(std::move(vertices), std::move(indices), std::move(textures));
+        }
+        return true;
+    }
+
+    // undoes a glTF load that failed partway: the meshes, textures and buffer views it already created are
+    // released so the fallback loaders start from an empty model
+    void discardGltf()
+    {
+        for (unsigned int i = 0; i < meshes.size(); i++)
+            meshes[i].releaseGpuData();
+        meshes.clear();
+        releaseTextures();
+        for (map<int, unsigned int>::iterator it = gltfBuffers.views.begin(); it != gltfBuffers.views.end(); ++it)
+            glDeleteBuffers(1, &it->second);
+        gltfBuffers.views.clear();
+        gltfBuffers.bytes = 0;
+    }
+
+    static bool isObjFile(const string &path)
+    {
+        size_t dot = path.find_last_of('.');
+        return dot != string::npos && path.size() - dot == 4 && tolower((unsigned char)path[dot + 1]) == 'o' &&
+               tolower((unsigned char)path[dot + 2]) == 'b' && tolower((unsigned char)path[dot + 3]) == 'j';
+    }
+
+    // stores the imported geometry so the next run (and acquireCpuData) can skip the importer.
+    // the buffers are lent to the cache entries and handed back afterwards, nothing is copied.
+    void writeCache()
+    {
+        vector<MeshCacheEntry> entries(meshes.size());
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            entries[i].vertices.swap(meshes[i].vertices);
+            entries[i].indices.swap(meshes[i].indices);
+            entries[i].textures.reserve(meshes[i].textures.size());
+            for (unsigned int t = 0; t < meshes[i].textures.size(); t++)
+            {
+                MeshCacheTexture texture = { meshes[i].textures[t].type, meshes[i].textures[t].path };
+                entries[i].textures.push_back(std::move(texture));
+            }
+        }
+        if (!writeMeshCache(path, entries))
+            cout << "WARNING::MODEL:: could not write mesh cache for " << path << endl;
+        for (unsigned int i = 0; i < meshes.size(); i++)
+        {
+            meshes[i].vertices.swap(entries[i].vertices);
+            meshes[i].indices.swap(entries[i].indices);
+        }
     }
 
     // processes a node in a recursive fashion. Processes each individual mesh located at the node and repeats this process on its children nodes (if any).
@@ -76,7 +476,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            processMesh(mesh, scene);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -86,69 +486,21 @@ private:
 
     }
 
-    Mesh processMesh(aiMesh *mesh, const aiScene *scene)
+    // converts an aiMesh and constructs the resulting Mesh in place at the end of the meshes vector.
+    void processMesh(aiMesh *mesh, const aiScene *scene)
     {
         // data to fill
         vector<Vertex> vertices;
         vector<unsigned int> indices;
         vector<Texture> textures;
+        indices.reserve((size_t)mesh->mNumFaces * 3);
 
-        // Walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-            {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-            }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            
-            if (mesh->HasTangentsAndBitangents())
-            {
-                // Tangent
-                vector.x = mesh->mTangents[i].x;
-                vector.y = mesh->mTangents[i].y;
-                vector.z = mesh->mTangents[i].z;
-                vertex.Tangent = vector;
-
-                // Bitangent
-                vector.x = mesh->mBitangents[i].x;
-                vector.y = mesh->mBitangents[i].y;
-                vector.z = mesh->mBitangents[i].z;
-                vertex.Bitangent = vector;
-            }
-            else
-            {
-                vertex.Tangent = glm::vec3(0.0f);
-                vertex.Bitangent = glm::vec3(0.0f);
-            }
-
-            vertices.push_back(vertex);
-
-
-        }
+        // convert the mesh's attribute streams into our interleaved vertices (batched, and threaded for big meshes)
+        convertVertices(mesh, vertices);
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace &face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
@@ -159,97 +511,269 @@ private:
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
         // Same applies to other texture as the following list summarizes:
         // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
+        // packed scalar maps (AO, roughness, metalness, specular): texture_materialN, see materialPacker.h
+        // normal and height maps are not sampled by any shader and are not loaded.
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
+        // 2. scalar maps, packed into one texture
+        MaterialPack pack;
+        pack.specular = materialTexturePath(material, aiTextureType_SPECULAR);
+        pack.roughness = materialTexturePath(material, aiTextureType_DIFFUSE_ROUGHNESS);
+        if (pack.roughness.empty())
+            pack.roughness = materialTexturePath(material, aiTextureType_SHININESS);    // map_Ns in the OBJs here
+        pack.metalness = materialTexturePath(material, aiTextureType_METALNESS);
+        if (pack.metalness.empty())
+            pack.metalness = materialTexturePath(material, aiTextureType_REFLECTION);
+        pack.occlusion = materialTexturePath(material, aiTextureType_AMBIENT_OCCLUSION);
+        string diffuse = materialTexturePath(material, aiTextureType_DIFFUSE);
+        completeMaterialPack(pack, diffuse.empty() ? pack.specular : diffuse, directory);
+        if (!pack.empty())
+            textures.push_back(loadTexture(materialPackPath(pack).c_str(), "texture_material"));
         
-        // return a mesh object created from the extracted mesh data
-        return Mesh(vertices, indices, textures);
+        // create the mesh in place from the extracted mesh data, handing over the buffers
+        meshes.emplace_back(std::move(vertices), std::move(indices), std::move(textures));
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // the required info is appended to textures as Texture structs.
+    void loadMaterialTextures(aiMaterial *mat, aiTextureType type, const string &typeName, vector<Texture> &textures)
     {
-        vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
             mat->GetTexture(type, i, &str);
-            // check if texture was loaded before and if so, continue to next iteration: skip loading a new texture
-            bool skip = false;
-            for(unsigned int j = 0; j < textures_loaded.size(); j++)
+            textures.push_back(loadTexture(str.C_Str(), typeName));
+        }
+    }
+
+    // first texture of the given type, empty if the material has none
+    static string materialTexturePath(aiMaterial *mat, aiTextureType type)
+    {
+        aiString str;
+        if (mat->GetTextureCount(type) == 0 || mat->GetTexture(type, 0, &str) != AI_SUCCESS)
+            return string();
+        return string(str.C_Str());
+    }
+
+    // returns the texture at path (relative to the model directory), loading it only the first time it is requested.
+    // Material packs ("#pack|...") are built from their maps, see materialPacker.h
+    Texture loadTexture(const char *path, const string &typeName)
+    {
+        // check if texture was loaded before and if so, skip loading a new texture
+        for(unsigned int j = 0; j < textures_loaded.size(); j++)
+        {
+            if(std::strcmp(textures_loaded[j].path.data(), path) == 0)
             {
-                if(std::strcmp(textures_loaded[j].path.data(), str.C_Str()) == 0)
-                {
-                    textures.push_back(textures_loaded[j]);
-                    skip = true; // a texture with the same filepath has already been loaded, continue to next one. (optimization)
-                    break;
-                }
-            }
-            if(!skip)
-            {   // if texture hasn't been loaded already, load it
-                Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
+                Texture texture = textures_loaded[j];
                 texture.type = typeName;
-                texture.path = str.C_Str();
-                textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                return texture; // a texture with the same filepath has already been loaded. (optimization)
             }
         }
-        return textures;
+        Texture texture;
+        unsigned int halvings = textureQuality().tier(textureCategory);
+        if (isMaterialPackPath(path))
+            texture.id = TextureFromMaterialPack(path, this->directory, halvings);
+        else
+            texture.id = TextureFromFile(path, this->directory, gammaCorrection, typeName == "texture_normal" ? TEXTURE_USAGE_NORMAL : TEXTURE_USAGE_COLOR, halvings);
+        texture.type = typeName;
+        texture.path = path;
+        textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+        return texture;
     }
 };
 
 
-unsigned int TextureFromFile(const char *path, const string &directory, bool gamma)
+// wrap and filtering shared by every model texture
+static void setModelTextureSampling()
 {
-	string filename = string(path);
-	filename = directory + '/' + filename;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
 
-	unsigned int textureID;
-	glGenTextures(1, &textureID);
+// cooks an RGBA8 image, halved first for the quality tier, and stores it at cookedPath for the next run. CPU only,
+// like the two below
+static void cookAndStoreTexture(const unsigned char *pixels, int width, int height, TextureUsage usage, unsigned int halvings, bool s3tc,
+	bool bptc, const string &cookedPath, const char *name, CookedTexture &cooked)
+{
+	unsigned int w = (unsigned int)width, h = (unsigned int)height;
+	vector<unsigned char> scaled;
+	if (cookDownscale(pixels, w, h, halvings, TEXTURE_QUALITY_MIN_SIZE, scaled))
+		pixels = scaled.data();
+	CookedFormat format = chooseCookedFormat(pixels, (size_t)w * h, usage, s3tc, bptc);
+	cookTexture(pixels, w, h, format, usage, cooked);
+	if (!makeDirectories(TEXTURE_COOK_DIRECTORY) || !writeKtx2(cookedPath, cooked))
+		std::cout << "WARNING::TEXTURE:: could not write cooked texture for " << name << std::endl;
+}
+
+// the cooked copy of an image left by an earlier run or, when there is none (or its format needs S3TC or BPTC
+// and s3tc or bptc is false), the image decoded and cooked now (format and mip chain, see textureCooker.h).
+// Touches no GL state, so it can run on the decode threads of the texture streamer. False if the image can't
+// be decoded.
+bool cookEncodedTexture(const unsigned char *data, size_t length, uint64_t contentHash, TextureUsage usage, unsigned int halvings, bool s3tc,
+	bool bptc, const char *name, CookedTexture &cooked)
+{
+	string cookedPath = cookedTexturePath(contentHash, length, usage, halvings);
+	if (readKtx2(cookedPath, cooked) && cookedFormatUsable(cooked.format, s3tc, bptc))
+		return true;
 
 	int width, height, nrComponents;
-	unsigned char *data = stbi_load(filename.c_str(), &width, &height, &nrComponents, 0);
-	if (data)
+	unsigned char *pixels = stbi_load_from_memory(data, (int)length, &width, &height, &nrComponents, 4);
+	if (!pixels)
+		return false;
+
+	if (usage == TEXTURE_USAGE_NORMAL && !cookIsNormalMap(pixels, (size_t)width * height))
+		usage = TEXTURE_USAGE_COLOR;
+	cookAndStoreTexture(pixels, width, height, usage, halvings, s3tc, bptc, cookedPath, name, cooked);
+
+	stbi_image_free(pixels);
+	return true;
+}
+
+// same for a material pack: its maps are only decoded and interleaved when there is no cooked copy yet
+bool cookMaterialPack(const MaterialPack &pack, const string &directory, uint64_t contentHash, unsigned int halvings, bool s3tc,
+	bool bptc, const char *name, CookedTexture &cooked)
+{
+	string cookedPath = cookedTexturePath(contentHash, 0, TEXTURE_USAGE_COLOR, halvings);
+	if (readKtx2(cookedPath, cooked) && cookedFormatUsable(cooked.format, s3tc, bptc))
+		return true;
+
+	vector<unsigned char> pixels;
+	int width, height;
+	if (!packMaterialImage(pack, directory, pixels, width, height))
+		return false;
+	cookAndStoreTexture(pixels.data(), width, height, TEXTURE_USAGE_COLOR, halvings, s3tc, bptc, cookedPath, name, cooked);
+	return true;
+}
+
+static unsigned int uploadModelTexture(const CookedTexture &cooked)
+{
+	size_t bytes = 0;
+	unsigned int textureID = uploadCookedTexture(cooked, &bytes);
+	if (textureID == 0)
+		return 0;
+	setModelTextureSampling();
+	textureGpuBytes()[textureID] = bytes;
+	return textureID;
+}
+
+// when GL rejects a cooked texture: the decoded image uploaded as RGBA8 with its mip chain, not stored
+static unsigned int uploadUncompressedTexture(const unsigned char *pixels, int width, int height, TextureUsage usage, unsigned int halvings)
+{
+	unsigned int w = (unsigned int)width, h = (unsigned int)height;
+	vector<unsigned char> scaled;
+	if (cookDownscale(pixels, w, h, halvings, TEXTURE_QUALITY_MIN_SIZE, scaled))
+		pixels = scaled.data();
+	CookedTexture cooked;
+	cookTexture(pixels, w, h, COOKED_RGBA8, usage, cooked);
+	return uploadModelTexture(cooked);
+}
+
+// new texture with an encoded image (PNG, JPEG...), 0 if it can't be decoded. While the texture streamer runs
+// the texture comes back at once and is filled in by it (see textureStreamer.h); otherwise it is cooked and
+// uploaded here.
+unsigned int uploadEncodedTexture(const unsigned char *data, size_t length, uint64_t contentHash, TextureUsage usage, unsigned int halvings, const char *name)
+{
+	if (textureStreamer().running())
 	{
-		GLenum format;
-		if (nrComponents == 1)
-			format = GL_RED;
-		else if (nrComponents == 3)
-			format = GL_RGB;
-		else if (nrComponents == 4)
-			format = GL_RGBA;
-
-		glBindTexture(GL_TEXTURE_2D, textureID);
-		glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		stbi_image_free(data);
+		static const unsigned char gray[4] = { 128, 128, 128, 255 }, flat[4] = { 128, 128, 255, 255 };
+		// the decode thread outlives the caller's buffer (a mapped file, a GLB)
+		shared_ptr<vector<unsigned char> > copy = make_shared<vector<unsigned char> >(data, data + length);
+		string label = name;
+		unsigned int textureID = textureStreamer().request(usage == TEXTURE_USAGE_NORMAL ? flat : gray,
+			[copy, contentHash, usage, halvings, label](bool s3tc, bool bptc, CookedTexture &cooked) {
+				return cookEncodedTexture(copy->data(), copy->size(), contentHash, usage, halvings, s3tc, bptc, label.c_str(), cooked);
+			}, label, TEXTURE_RESIDENCY_START_SIZE);
+		setModelTextureSampling();
+		// the finer levels come later from the cooked file, when something is drawn close enough to need them
+		textureResidency().track(textureID, cookedTexturePath(contentHash, length, usage, halvings));
+		return textureID;
 	}
-	else
+
+	CookedTexture cooked;
+	if (!cookEncodedTexture(data, length, contentHash, usage, halvings, s3tcSupported(), bptcSupported(), name, cooked))
+		return 0;
+	unsigned int textureID = uploadModelTexture(cooked);
+	if (textureID == 0 && cooked.format != COOKED_RGBA8)
 	{
-		std::cout << "Texture failed to load at path: " << path << std::endl;
-		stbi_image_free(data);
+		int width, height, nrComponents;
+		unsigned char *pixels = stbi_load_from_memory(data, (int)length, &width, &height, &nrComponents, 4);
+		if (pixels)
+		{
+			if (usage == TEXTURE_USAGE_NORMAL && !cookIsNormalMap(pixels, (size_t)width * height))
+				usage = TEXTURE_USAGE_COLOR;
+			textureID = uploadUncompressedTexture(pixels, width, height, usage, halvings);
+			stbi_image_free(pixels);
+		}
+	}
+	return textureID;
+}
+
+// same for the packed scalar maps of a material
+unsigned int uploadMaterialPack(const MaterialPack &pack, const string &directory, uint64_t contentHash, unsigned int halvings, const char *name)
+{
+	if (textureStreamer().running())
+	{
+		static const unsigned char defaults[4] = { 255, 0, 0, 128 };
+		string label = name;
+		unsigned int textureID = textureStreamer().request(defaults,
+			[pack, directory, contentHash, halvings, label](bool s3tc, bool bptc, CookedTexture &cooked) {
+				return cookMaterialPack(pack, directory, contentHash, halvings, s3tc, bptc, label.c_str(), cooked);
+			}, label, TEXTURE_RESIDENCY_START_SIZE);
+		setModelTextureSampling();
+		textureResidency().track(textureID, cookedTexturePath(contentHash, 0, TEXTURE_USAGE_COLOR, halvings));
+		return textureID;
+	}
+
+	CookedTexture cooked;
+	if (!cookMaterialPack(pack, directory, contentHash, halvings, s3tcSupported(), bptcSupported(), name, cooked))
+		return 0;
+	unsigned int textureID = uploadModelTexture(cooked);
+	if (textureID == 0 && cooked.format != COOKED_RGBA8)
+	{
+		vector<unsigned char> pixels;
+		int width, height;
+		if (packMaterialImage(pack, directory, pixels, width, height))
+			textureID = uploadUncompressedTexture(pixels.data(), width, height, TEXTURE_USAGE_COLOR, halvings);
 	}
+	return textureID;
+}
+
+// textures go through the process-wide registry: an image already loaded by any model (from this path or
+// from an identical copy elsewhere) is shared instead of being decoded and uploaded again
+unsigned int TextureFromFile(const char *path, const string &directory, bool gamma, TextureUsage usage, unsigned int halvings)
+{
+	string filename = string(path);
+	filename = directory + '/' + filename;
+
+	unsigned int textureID = textureRegistry().acquireFile(filename, usage, halvings);
+	if (textureID == 0)
+		std::cout << "Texture failed to load at path: " << path << std::endl;
+
+	return textureID;
+}
+
+// packed scalar maps of a material (see materialPacker.h), shared through the registry like any other texture
+unsigned int TextureFromMaterialPack(const string &packPath, const string &directory, unsigned int halvings)
+{
+	MaterialPack pack;
+	unsigned int textureID = 0;
+	if (parseMaterialPackPath(packPath, pack))
+		textureID = textureRegistry().acquireMaterialPack(pack, directory, halvings);
+	if (textureID == 0)
+		std::cout << "Material pack failed to load: " << packPath << std::endl;
+
+	return textureID;
+}
+
+// same as TextureFromFile for an encoded image (PNG, JPEG...) that is already in memory, e.g. inside a GLB
+unsigned int TextureFromMemory(const unsigned char *data, size_t length, const char *name, TextureUsage usage, unsigned int halvings)
+{
+	unsigned int textureID = textureRegistry().acquireMemory(data, length, name, usage, halvings);
+	if (textureID == 0)
+		std::cout << "Texture failed to load from memory: " << name << std::endl;
 
 	return textureID;
 }
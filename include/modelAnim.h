@@ -11,6 +11,15 @@
 #include <assimp/postprocess.h>
 
 #include <meshAnim.h>
+#include <meshCache.h>
+#include <gltfLoader.h>
+#include <vertexConvert.h>
+#include <animationTracks.h>
+#include <animationClip.h>
+#include <boneBuffer.h>
+#include <animationLod.h>
+#include <poseCache.h>
+#include <preSkinning.h>
 #include <model.h>
 #include <shader.h>
 
@@ -18,7 +27,9 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <chrono>
 #include <map>
+#include <memory>
 #include <vector>
 using namespace std;
 
@@ -29,64 +40,464 @@ public:
     vector<Texture> textures_loaded;	// stores all the textures loaded so far, optimization to make sure textures aren't loaded more than once.
     vector<MeshAnim> meshes;
     string directory;
+    string path;
     bool gammaCorrection;
+	ResidencyPolicy residency;
+	TextureCategory textureCategory;    // picks the quality tier of its textures, from the folder of the model
+	GltfGpuBuffers gltfBuffers;         // buffer views uploaded as they are by the glTF loader
 
 	/* Importacion base */
 	Assimp::Importer importer;
 	const aiScene* scene;
+	std::unique_ptr<aiScene> gltfScene;                 // node tree and animation built by the glTF loader
+	bool gltfSource = false;                            // read natively: its geometry is reloaded from the file
+	vector<vector<unsigned int> > gltfSkinBones;        // joint -> bone index of every glTF skin
 
 	/* Huesos */
-	static const uint MAX_BONES = 100;
-
 	map<string, uint> m_bone_mapping; // maps a bone name and their index
 	uint m_num_bones = 0;
 	vector<BoneMatrix> m_bone_matrices;
 	aiMatrix4x4 m_global_inverse_transform;
 
-	GLuint m_bone_location[MAX_BONES];
+	unsigned int paletteBase;           // first bone of the model in the shared bone buffer
+	GLint m_bone_base_location;
+
+	/* Esqueleto aplanado */
+	// the node tree in depth-first order, with the channel and bone of each node resolved at load so
+	// evaluating a pose needs no names, maps or recursion
+	struct SkeletonNode {
+		int parent;                     // index in skeleton, -1 for the root; always before the node
+		int channel;                    // channel of the first animation, -1 when the node isn't animated
+		int track;                      // its baked track (the tracks of the reduced skeleton come first)
+		int bone;                       // -1 when no vertex follows the node
+		aiMatrix4x4 transformation;     // rest transform, used when there is no channel
+		glm::mat4 rest;                 // the same, column-major for the baked tracks
+	};
+	vector<SkeletonNode> skeleton;
+	vector<aiMatrix4x4> skeletonGlobals;    // global transform of every node, rewritten by each pose from keys
+
+	/* Pistas horneadas */
+	// the first animation resampled at load (animationTracks.h), one track per channel, and kept compressed
+	// (animationClip.h); poses are built from the clip in glm, the keys are only read again by
+	// boneTransformFromKeys while the scene is kept
+	AnimationClip clip;
+	double animationDuration = 0.0;         // in ticks
+	vector<glm::mat4> trackLocals;          // local transform of every track
+	vector<int> trackChannels;              // channel baked in each track
+	vector<glm::mat4> poseGlobals;          // of every node, already multiplied by the inverse of the scene root
+	vector<glm::mat4> boneOffsets;
+	vector<glm::mat4> bonePalette;          // what the shader gets, one matrix per bone
+	glm::mat4 globalInverse;
+
+	/* Nivel de detalle (animationLod.h) */
+	// the reduced skeleton leaves out fingers, toes and face: their bones take the palette of the nearest
+	// bone above them
+	vector<int> reducedNodes;               // nodes still evaluated, in skeleton order
+	vector<pair<int, int> > collapsedBones; // bone -> bone it moves with
+	unsigned int reducedTracks = 0;         // tracks of the reduced nodes
+	glm::vec3 boundsCenter;                 // bounding sphere of the bind pose, model space
+	float boundsRadius = 0.0f;
+	AnimationLodLevel lodLevel = ANIMATION_LOD_FULL;
+	unsigned int poseSkeleton = 0;          // shared by the models of the same file in the pose cache
+	GLint m_bone_influences_location = -1;
+	GLint m_preskinned_location = -1;
+	bool skinPending = false;               // the pose changed since the pre-skinning pass (preSkinning.h) ran
+
+	// key each channel sampled last, where the next search starts
+	struct KeyCursors {
+		uint position;
+		uint rotation;
+		uint scaling;
+	};
+	vector<KeyCursors> keyCursors;
+	static const uint KEY_CURSOR_STEPS = 4;     // keys a cursor walks before it gives up and searches
 	float ticks_per_second = 0.0f;
 
     /*  Functions   */
     // constructor, expects a filepath to a 3D model.
-    ModelAnim(string const &path, bool gamma = false) : gammaCorrection(gamma)
+    // by default the CPU copy of the geometry is dropped once it is on the GPU, see acquireCpuData, and the
+    // imported scene once the clip is ready: keepScene holds it for boneTransformFromKeys.
+    ModelAnim(string const &path, bool gamma = false, ResidencyPolicy residency = RESIDENCY_GPU_ONLY, bool keepScene = false)
+		: path(path), gammaCorrection(gamma), residency(residency), textureCategory(textureCategoryOf(path)), scene(nullptr),
+		  m_bone_base_location(-1), cpuDataUsers(0)
     {
         loadModel(path);
+		buildSkeleton();
+		paletteBase = boneBuffer().reserve(m_num_bones);
+		poseSkeleton = poseCache().skeletonId(path);
+		computeBounds();
+		// skinned geometry is only accounted by the VRAM ledger, it is never evicted
+		gpuHandle = gpuResources().addOwner(path, geometryBytes(), function<size_t()>());
+		cpuHandles[0] = memoryLedger().addSource(path, MEMORY_CPU_GEOMETRY, [this]() { return cpuBytes() - sceneBytes(); });
+		cpuHandles[1] = memoryLedger().addSource(path, MEMORY_CPU_ANIMATION, [this]() { return sceneBytes() + clip.bytes(); });
+		if (!keepScene)
+			releaseScene();
     }
 
+	~ModelAnim()
+	{
+		gpuResources().removeOwner(gpuHandle);
+		memoryLedger().removeSource(cpuHandles[0]);
+		memoryLedger().removeSource(cpuHandles[1]);
+	}
+
+	// the ledgers keep a pointer to the model to account its memory
+	ModelAnim(const ModelAnim &) = delete;
+	ModelAnim &operator=(const ModelAnim &) = delete;
+
 	void initShaders(GLuint shader_program)
 	{
-		for (uint i = 0; i < MAX_BONES; i++) // get location all matrices of bones
-		{
-			string name = "bones[" + to_string(i) + "]";// name like in shader
-			m_bone_location[i] = glGetUniformLocation(shader_program, name.c_str());
-		}
+		// the matrices are read from the bone buffer, the model only tells where its range starts
+		m_bone_base_location = glGetUniformLocation(shader_program, "bone_base");
+		m_bone_influences_location = glGetUniformLocation(shader_program, "bone_influences");
+		m_preskinned_location = glGetUniformLocation(shader_program, "preskinned");
 
 		// rotate head AND AXIS(y_z) about x !!!!!  Not be gimbal lock
 		//rotate_head_xz *= glm::quat(cos(glm::radians(-45.0f / 2)), sin(glm::radians(-45.0f / 2)) * glm::vec3(1.0f, 0.0f, 0.0f));
 	}
 
-    // draws the model, and thus all its meshes
+	// Calculo de las animaciones: the update phase, separate from drawing. Writes the pose at time_in_sec to the
+	// bone buffer, before boneBuffer().upload(); every pass that draws the model afterwards reads it from there.
+	// How often, and with how many bones, depends on how large the model is on screen (animationLod.h); the
+	// camera of the frame has been given to animationLod().beginFrame. Models can be animated at the same time
+	// on different threads (jobSystem.h), it doesn't touch GL
+	void animate(double time_in_sec, const glm::mat4 &model)
+	{
+		lodLevel = ANIMATION_LOD_FULL;
+		if (boundsRadius > 0.0f)
+		{
+			float scale = (std::max)(glm::length(glm::vec3(model[0])), (std::max)(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+			glm::vec3 center = glm::vec3(model * glm::vec4(boundsCenter, 1.0f));
+			lodLevel = animationLod().level(center, boundsRadius * scale * ANIMATION_LOD_BOUNDS_MARGIN);
+		}
+		// the phase spreads the characters updated every few frames over those frames
+		if (animationLod().due(lodLevel, paletteBase))
+		{
+			boneBuffer().write(paletteBase, cachedTransform(time_in_sec, AnimationLod::reduced(lodLevel)));
+			skinPending = true;
+		}
+	}
+
+	// with pre-skinning on, writes the vertices of every mesh skinned by the pose animate wrote, once for every
+	// pass that draws the model this frame. After boneBuffer().upload() and bind()
+	void preSkin()
+	{
+		if (!preSkinning().ready())
+			return;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			if (!meshes[i].skinnedVAO)
+			{
+				size_t bytes = meshes[i].setupSkinned();
+				gpuResources().allocate(GPU_RESOURCE_BUFFER, meshes[i].skinnedVBO, bytes, path + " pre-skinned");
+				skinPending = true;
+			}
+		if (!skinPending)
+		{
+			preSkinning().reused();
+			return;
+		}
+		skinPending = false;
+		unsigned int vertices = 0;
+		preSkinning().begin(paletteBase, AnimationLod::reduced(lodLevel) ? 2 : NUM_BONES_PER_VEREX);
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			meshes[i].Skin();
+			vertices += meshes[i].vertexCount;
+		}
+		preSkinning().end(vertices);
+	}
+
+	// whether Draw uses the vertices of the pre-skinning pass
+	bool preSkinned()
+	{
+		return preSkinning().ready() && !meshes.empty() && meshes[0].skinnedVAO != 0;
+	}
+
+	// boneTransform at time_in_sec rounded to a step of the pose cache, evaluated only if no model of the same
+	// file asked for that step lately
+	const vector<glm::mat4>& cachedTransform(double time_in_sec, bool reduced = false)
+	{
+		double length = ticks_per_second > 0.0f ? animationDuration / ticks_per_second : 0.0;
+		int64_t step = PoseCache::step(length > 0.0 ? fmod(time_in_sec, length) : 0.0);
+		uint64_t key = PoseCache::key(poseSkeleton, 0, reduced, step);
+		if (!poseCache().find(key, bonePalette))
+			poseCache().store(key, boneTransform(PoseCache::stepSeconds(step), reduced));
+		return bonePalette;
+	}
+
+    // draws the model, and thus all its meshes; the bone buffer is uploaded and bound
     void Draw(Shader shader)
     {
-		// Calculo de las animaciones
-		vector<aiMatrix4x4> transforms;
-		boneTransform((double)SDL_GetTicks() / 1000.0f, transforms);
+		glUniform1i(m_bone_base_location, (GLint)paletteBase);
+		glUniform1i(m_bone_influences_location, AnimationLod::reduced(lodLevel) ? 2 : NUM_BONES_PER_VEREX);
+		bool skinned = preSkinned();
+		glUniform1i(m_preskinned_location, skinned);
 
-		for (uint i = 0; i < transforms.size(); i++) // move all matrices for actual model position to shader
+		for (unsigned int i = 0; i < meshes.size(); i++)
 		{
-			glUniformMatrix4fv(m_bone_location[i], 1, GL_TRUE, (const GLfloat*)&transforms[i]);
+			if (skinned)
+				meshes[i].DrawSkinned(shader);
+			else
+				meshes[i].Draw(shader);
 		}
-
-        for(unsigned int i = 0; i < meshes.size(); i++)
-            meshes[i].Draw(shader);
+		glUniform1i(m_preskinned_location, 0);
     }
+
+	// makes sure every mesh has its vertices, indices and bone weights in memory, reloading them from the
+	// binary cache if they were released. Consumers pair it with releaseCpuData when done.
+	bool acquireCpuData()
+	{
+		cpuDataUsers++;
+		bool resident = true;
+		for (unsigned int i = 0; i < meshes.size() && resident; i++)
+			resident = meshes[i].hasCpuData();
+		if (resident)
+			return true;
+
+		vector<MeshCacheEntry> entries;
+		if (!reloadCpuData(entries) || entries.size() != meshes.size())
+		{
+			cout << "ERROR::MODEL_ANIM:: could not reload geometry of " << path << endl;
+			cpuDataUsers--;
+			return false;
+		}
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			meshes[i].vertices.swap(entries[i].vertices);
+			meshes[i].indices.swap(entries[i].indices);
+			meshes[i].bones_id_weights_for_each_vertex.swap(entries[i].bones);
+		}
+		return true;
+	}
+
+	void releaseCpuData()
+	{
+		if (cpuDataUsers > 0)
+			cpuDataUsers--;
+		applyResidency();
+	}
+
+	// geometry copies plus what is still retained of the imported scene (node tree and animation keys)
+	size_t cpuBytes() const
+	{
+		size_t bytes = sceneBytes();
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			bytes += meshes[i].cpuBytes();
+		return bytes;
+	}
+
+	// vertex, bone and index buffers
+	size_t geometryBytes() const
+	{
+		size_t bytes = gltfBuffers.bytes;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			bytes += meshes[i].gpuBytes;
+		return bytes;
+	}
+
+	size_t gpuBytes() const
+	{
+		size_t bytes = geometryBytes();
+		for (unsigned int i = 0; i < textures_loaded.size(); i++)
+		{
+			map<unsigned int, size_t>::const_iterator it = textureGpuBytes().find(textures_loaded[i].id);
+			if (it != textureGpuBytes().end())
+				bytes += it->second;
+		}
+		return bytes;
+	}
+
+	// gives the model's references back to the texture registry, which deletes textures no other model uses
+	void releaseTextures()
+	{
+		for (unsigned int i = 0; i < textures_loaded.size(); i++)
+			textureRegistry().release(textures_loaded[i].id);
+		textures_loaded.clear();
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].textures.clear();
+	}
+
+	// deletes the VAOs and buffers of every mesh for good
+	void releaseGpuData()
+	{
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			gpuResources().release(GPU_RESOURCE_BUFFER, meshes[i].skinnedVBO);
+			meshes[i].releaseGpuData();
+		}
+		for (map<int, unsigned int>::iterator it = gltfBuffers.views.begin(); it != gltfBuffers.views.end(); ++it)
+			glDeleteBuffers(1, &it->second);
+		gltfBuffers.views.clear();
+		gltfBuffers.bytes = 0;
+		gpuResources().removeOwner(gpuHandle);
+		gpuHandle = 0;
+	}
+
+	// frees the imported scene, its copy of the geometry included: the importer allocated it, so only the
+	// importer frees it. The clip keeps the model animated, only boneTransformFromKeys needs the scene
+	void releaseScene()
+	{
+		importer.FreeScene();
+		gltfScene.reset();
+		scene = nullptr;
+	}
+
+	// pose at time_in_sec into the looping animation, one column-major matrix per bone
+	const vector<glm::mat4>& boneTransform(double time_in_sec, bool reduced = false)
+	{
+		double time_in_ticks = time_in_sec * ticks_per_second;
+		evaluatePose(animationDuration > 0.0 ? (float)fmod(time_in_ticks, animationDuration) : 0.0f, reduced);
+		return bonePalette;
+	}
+
+	// the same pose evaluated key by key with Assimp types, as before the tracks were baked (the baseline of
+	// benchmarkBoneEvaluation)
+	void boneTransformFromKeys(double time_in_sec, vector<aiMatrix4x4>& transforms)
+	{
+		if (!scene)
+			return;
+		double time_in_ticks = time_in_sec * ticks_per_second;
+		float animation_time = fmod(time_in_ticks, scene->mAnimations[0]->mDuration); //������� �� ����� (������� �� ������)
+		// animation_time - ���� ������� ������ � ���� ������ �� ������ �������� (�� ������� �������� ����� � �������� )
+
+		evaluatePoseFromKeys(animation_time);
+
+		transforms.resize(m_num_bones);
+
+		for (uint i = 0; i < m_num_bones; i++)
+		{
+			transforms[i] = m_bone_matrices[i].final_world_transform;
+		}
+	}
+
+	// keys of every animation of the scene
+	size_t animationKeyBytes() const
+	{
+		if (!scene)
+			return 0;
+		size_t bytes = 0;
+		for (uint a = 0; a < scene->mNumAnimations; a++)
+		{
+			const aiAnimation* animation = scene->mAnimations[a];
+			for (uint c = 0; c < animation->mNumChannels; c++)
+			{
+				const aiNodeAnim* channel = animation->mChannels[c];
+				bytes += sizeof(aiNodeAnim) + channel->mNumPositionKeys * sizeof(aiVectorKey) +
+					channel->mNumRotationKeys * sizeof(aiQuatKey) + channel->mNumScalingKeys * sizeof(aiVectorKey);
+			}
+		}
+		return bytes;
+	}
+
+	void printMemoryReport(const string &name) const
+	{
+		cout << "MEMORY::MODEL_ANIM:: " << name << "  meshes: " << meshes.size() << "  bones: " << m_num_bones
+			<< "  cpu: " << cpuBytes() / 1024 << " KB (scene " << sceneBytes() / 1024 << " KB, clip " << clip.bytes() / 1024 << " KB)"
+			<< "  gpu: " << gpuBytes() / 1024 << " KB" << endl;
+	}
     
 private:
+	int cpuDataUsers;           // consumers that asked for the CPU copy of the geometry
+	unsigned int gpuHandle;     // entry of the geometry in the VRAM ledger
+	unsigned int cpuHandles[2]; // sources of the geometry copy and the animation in the memory ledger
+
+	// drops the CPU copy of the geometry unless the policy or a consumer still needs it
+	void applyResidency()
+	{
+		if (residency == RESIDENCY_KEEP_CPU || cpuDataUsers > 0)
+			return;
+		for (unsigned int i = 0; i < meshes.size(); i++)
+			meshes[i].releaseCpuData();
+	}
+
+	// glTF geometry is read again from the source file, everything else from the binary cache
+	bool reloadCpuData(vector<MeshCacheEntry> &entries)
+	{
+		if (gltfSource)
+			return readGltfGeometry(path, entries, &gltfSkinBones);
+		return readMeshCache(path, entries);
+	}
+
+	// stores the imported geometry so acquireCpuData can bring it back without the importer.
+	// the buffers are lent to the cache entries, nothing is copied.
+	void writeCache()
+	{
+		vector<MeshCacheEntry> entries(meshes.size());
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			entries[i].vertices.swap(meshes[i].vertices);
+			entries[i].indices.swap(meshes[i].indices);
+			entries[i].bones.swap(meshes[i].bones_id_weights_for_each_vertex);
+			entries[i].textures.reserve(meshes[i].textures.size());
+			for (unsigned int t = 0; t < meshes[i].textures.size(); t++)
+			{
+				MeshCacheTexture texture = { meshes[i].textures[t].type, meshes[i].textures[t].path };
+				entries[i].textures.push_back(std::move(texture));
+			}
+		}
+		if (!writeMeshCache(path, entries))
+			cout << "WARNING::MODEL_ANIM:: could not write mesh cache for " << path << endl;
+		// hand the buffers back, the cache only borrowed them
+		for (unsigned int i = 0; i < meshes.size(); i++)
+		{
+			meshes[i].vertices.swap(entries[i].vertices);
+			meshes[i].indices.swap(entries[i].indices);
+			meshes[i].bones_id_weights_for_each_vertex.swap(entries[i].bones);
+		}
+	}
+
+	size_t sceneBytes() const
+	{
+		if (!scene)
+			return 0;
+		size_t bytes = nodeBytes(scene->mRootNode) + animationKeyBytes();
+		for (uint i = 0; i < scene->mNumMeshes; i++)
+		{
+			const aiMesh* mesh = scene->mMeshes[i];
+			bytes += sizeof(aiMesh) + mesh->mNumVertices * sizeof(aiVector3D) * 4 + mesh->mNumFaces * (sizeof(aiFace) + 3 * sizeof(unsigned int));
+		}
+		return bytes;
+	}
+
+	size_t nodeBytes(const aiNode* node) const
+	{
+		size_t bytes = sizeof(aiNode) + node->mNumMeshes * sizeof(unsigned int) + node->mNumChildren * sizeof(aiNode*);
+		for (uint i = 0; i < node->mNumChildren; i++)
+			bytes += nodeBytes(node->mChildren[i]);
+		return bytes;
+	}
 
     /*  Functions   */
     // loads a model with supported ASSIMP extensions from file and stores the resulting meshes in the meshes vector.
     void loadModel(string const &path)
     {
+		// glTF skins and animations are read natively, ASSIMP stays as the fallback
+		if (isGltfFile(path))
+		{
+			if (loadGltf(path))
+			{
+				gltfSource = true;
+				if (residency == RESIDENCY_KEEP_CPU && acquireCpuData())
+					cpuDataUsers--;
+				applyResidency();
+				return;
+			}
+			cout << "WARNING::GLTF:: native loader failed for " << path << ", falling back to ASSIMP" << endl;
+			// what the glTF loader created before failing, so the fallback starts from an empty model
+			for (unsigned int i = 0; i < meshes.size(); i++)
+				meshes[i].releaseGpuData();
+			meshes.clear();
+			releaseTextures();
+			for (map<int, unsigned int>::iterator it = gltfBuffers.views.begin(); it != gltfBuffers.views.end(); ++it)
+				glDeleteBuffers(1, &it->second);
+			gltfBuffers.views.clear();
+			gltfBuffers.bytes = 0;
+			gltfScene.reset();
+			m_bone_mapping.clear();
+			m_bone_matrices.clear();
+			m_num_bones = 0;
+		}
+
         // read file via ASSIMP
         scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
         // check for errors
@@ -124,8 +535,12 @@ private:
 		cout << "		name bones : " << endl;
 		//processNode(scene->mRootNode, scene);
 		// process ASSIMP's root node recursively
+		meshes.reserve(scene->mNumMeshes);
 		processNode(scene->mRootNode, scene);
 
+		writeCache();
+		applyResidency();
+
 		cout << "		name nodes animation : " << endl;
 		for (uint i = 0; i < scene->mAnimations[0]->mNumChannels; i++)
 		{
@@ -134,6 +549,216 @@ private:
 		cout << endl;
     }
 
+	// builds the node tree, bones and first animation of a glTF file in the same structures ASSIMP fills,
+	// so boneTransform works unchanged. Bones are numbered in the order of the joints of the first skin,
+	// which lets its primitives send their JOINTS_0 stream to the GPU as it is.
+	bool loadGltf(string const &path)
+	{
+		GltfFile file;
+		vector<GltfPrimitive> primitives;
+		if (!file.open(path) || !gltfCollectPrimitives(file, primitives))
+			return false;
+		directory = path.substr(0, path.find_last_of('/'));
+
+		vector<string> names = gltfNodeNames(file);
+		gltfScene.reset(new aiScene());
+		gltfScene->mRootNode = gltfBuildSceneRoot(file, names);
+		gltfScene->mNumAnimations = 1;
+		gltfScene->mAnimations = new aiAnimation*[1];
+		gltfScene->mAnimations[0] = gltfBuildAnimation(file, 0, names);
+		scene = gltfScene.get();
+
+		m_global_inverse_transform = scene->mRootNode->mTransformation;
+		m_global_inverse_transform.Inverse();
+		ticks_per_second = 1.0f;    // glTF keys are in seconds
+
+		const JsonValue &skins = file.json["skins"];
+		gltfSkinBones.assign(skins.size(), vector<unsigned int>());
+		for (unsigned int s = 0; s < skins.size(); s++)
+		{
+			vector<aiMatrix4x4> inverseBindMatrices;
+			if (!gltfInverseBindMatrices(file, s, inverseBindMatrices))
+				return false;
+			const JsonValue &joints = skins[s]["joints"];
+			for (unsigned int j = 0; j < joints.size(); j++)
+			{
+				int node = joints[j].asInt(-1);
+				if (node < 0 || node >= (int)names.size())
+					return false;
+				map<string, uint>::iterator it = m_bone_mapping.find(names[node]);
+				if (it == m_bone_mapping.end())
+				{
+					BoneMatrix bi;
+					bi.offset_matrix = inverseBindMatrices[j];
+					m_bone_matrices.push_back(bi);
+					it = m_bone_mapping.insert(make_pair(names[node], m_num_bones++)).first;
+				}
+				gltfSkinBones[s].push_back(it->second);
+			}
+		}
+		meshes.reserve(primitives.size());
+		for (unsigned int i = 0; i < primitives.size(); i++)
+		{
+			const GltfPrimitive &primitive = primitives[i];
+			vector<GltfTexture> references;
+			vector<Texture> textures;
+			gltfMaterialTextures(file, primitive.material, references);
+			for (unsigned int t = 0; t < references.size(); t++)
+				textures.push_back(loadGltfTexture(textures_loaded, file, references[t], directory, textureQuality().tier(textureCategory)));
+
+			// joint indices only match our bone indices for the first skin
+			bool skinned = primitive.skin >= 0 && primitive.skin < (int)gltfSkinBones.size();
+			GpuGeometry geometry;
+			if (skinned && primitive.skin == 0 && gltfUploadPrimitive(file, primitive, gltfBuffers, true, geometry))
+			{
+				meshes.emplace_back(geometry, std::move(textures));
+				continue;
+			}
+			vector<Vertex> vertices;
+			vector<unsigned int> indices;
+			vector<VertexBoneData> bones;
+			if (!gltfConvertPrimitive(file, primitive, vertices, indices, &bones, skinned ? &gltfSkinBones[primitive.skin] : nullptr))
+				return false;
+			meshes.emplace_back(std::move(vertices), std::move(indices), std::move(textures), std::move(bones));
+		}
+		return true;
+	}
+
+	// flattens the node tree of the scene. A node takes the first channel with its name, as the animation
+	// did when it looked channels up by name every frame
+	void buildSkeleton()
+	{
+		skeleton.clear();
+		if (!scene || !scene->mRootNode || scene->mNumAnimations == 0)
+			return;
+		const aiAnimation* animation = scene->mAnimations[0];
+		map<string, int> channels;
+		for (uint c = 0; c < animation->mNumChannels; c++)
+			channels.insert(make_pair(string(animation->mChannels[c]->mNodeName.data), (int)c));
+
+		// for the reduced skeleton: the nearest bone at or above each node, and the bone detail nodes move with
+		vector<int> boneAbove, collapseInto;
+		vector<bool> detail;
+		vector<pair<const aiNode*, int> > pending(1, make_pair((const aiNode*)scene->mRootNode, -1));
+		while (!pending.empty())
+		{
+			const aiNode* node = pending.back().first;
+			SkeletonNode flat;
+			flat.parent = pending.back().second;
+			pending.pop_back();
+			string name(node->mName.data);
+			map<string, int>::const_iterator channel = channels.find(name);
+			map<string, uint>::const_iterator bone = m_bone_mapping.find(name);
+			flat.channel = channel != channels.end() ? channel->second : -1;
+			flat.bone = bone != m_bone_mapping.end() ? (int)bone->second : -1;
+			flat.transformation = node->mTransformation;
+			flat.rest = aiToGlm(node->mTransformation);
+			flat.track = -1;
+			int index = (int)skeleton.size();
+			skeleton.push_back(flat);
+			int parent = flat.parent;
+			bool isDetail = parent >= 0 && (detail[parent] || (boneAbove[parent] >= 0 && AnimationLod::detailBone(name)));
+			detail.push_back(isDetail);
+			boneAbove.push_back(flat.bone >= 0 ? flat.bone : parent >= 0 ? boneAbove[parent] : -1);
+			collapseInto.push_back(!isDetail ? -1 : detail[parent] ? collapseInto[parent] : boneAbove[parent]);
+			// pushed in reverse so the first child comes out next
+			for (uint i = node->mNumChildren; i-- > 0;)
+				pending.push_back(make_pair((const aiNode*)node->mChildren[i], index));
+		}
+		skeletonGlobals.resize(skeleton.size());
+		KeyCursors start = { 0, 0, 0 };
+		keyCursors.assign(animation->mNumChannels, start);
+
+		// tracks of the reduced skeleton first, then the detail nodes, then channels no node uses
+		reducedNodes.clear();
+		collapsedBones.clear();
+		trackChannels.clear();
+		vector<int> channelTracks(animation->mNumChannels, -1);
+		for (int pass = 0; pass < 2; pass++)
+		{
+			for (size_t i = 0; i < skeleton.size(); i++)
+			{
+				SkeletonNode& node = skeleton[i];
+				if (detail[i] != (pass == 1))
+					continue;
+				if (pass == 0)
+					reducedNodes.push_back((int)i);
+				else if (node.bone >= 0)
+					collapsedBones.push_back(make_pair(node.bone, collapseInto[i]));
+				if (node.channel >= 0 && channelTracks[node.channel] < 0)
+				{
+					channelTracks[node.channel] = (int)trackChannels.size();
+					trackChannels.push_back(node.channel);
+				}
+				node.track = node.channel >= 0 ? channelTracks[node.channel] : -1;
+			}
+			if (pass == 0)
+				reducedTracks = (unsigned int)trackChannels.size();
+		}
+		for (uint c = 0; c < animation->mNumChannels; c++)
+			if (channelTracks[c] < 0)
+				trackChannels.push_back((int)c);
+
+		poseGlobals.resize(skeleton.size());
+		boneOffsets.resize(m_num_bones);
+		for (uint b = 0; b < m_num_bones; b++)
+			boneOffsets[b] = aiToGlm(m_bone_matrices[b].offset_matrix);
+		bonePalette.assign(m_num_bones, glm::mat4(1.0f));
+		globalInverse = aiToGlm(m_global_inverse_transform);
+		loadClip();
+	}
+
+	// the clip written next to the file by an earlier load, or the animation baked and compressed now
+	void loadClip()
+	{
+		animationDuration = scene->mAnimations[0]->mDuration;
+		trackLocals.resize(trackChannels.size());
+		if (clip.load(path, trackChannels))
+			return;
+		AnimationTracks tracks;
+		bakeTracks(tracks);
+		clip.compress(tracks, trackChannels);
+		cout << "ANIMATION::CLIP:: " << path << "  keys: " << clip.keys() << " of " << (size_t)tracks.frames() * tracks.tracks() * 3
+			<< "  baked: " << tracks.bytes() / 1024 << " KB  keys imported: " << animationKeyBytes() / 1024 << " KB  clip: "
+			<< clip.bytes() / 1024 << " KB" << endl;
+		if (!clip.save(path))
+			cout << "WARNING::MODEL_ANIM:: could not write animation clip for " << path << endl;
+	}
+
+	// resamples every channel of the first animation at a fixed rate. The frames go forward in time, so the
+	// channel cursors read the keys in a single pass
+	void bakeTracks(AnimationTracks& tracks)
+	{
+		const aiAnimation* animation = scene->mAnimations[0];
+		float seconds = (float)(animation->mDuration / ticks_per_second);
+		float densest = 0.0f;
+		for (uint c = 0; c < animation->mNumChannels && seconds > 0.0f; c++)
+		{
+			const aiNodeAnim* channel = animation->mChannels[c];
+			uint keys = (std::max)(channel->mNumPositionKeys, (std::max)(channel->mNumRotationKeys, channel->mNumScalingKeys));
+			densest = (std::max)(densest, (keys - 1) / seconds);
+		}
+		float rate = (std::min)((std::max)(densest, ANIMATION_TRACKS_MIN_RATE), ANIMATION_TRACKS_MAX_RATE);
+		uint frames = (uint)std::ceil(seconds * rate - 1e-3f) + 1;
+		tracks.resize(animation->mNumChannels, frames, rate);
+		for (uint f = 0; f < frames; f++)
+		{
+			float time = (std::min)(f / rate, seconds) * ticks_per_second;
+			for (uint t = 0; t < trackChannels.size(); t++)
+			{
+				int c = trackChannels[t];
+				const aiNodeAnim* channel = animation->mChannels[c];
+				aiVector3D position = calcInterpolatedPosition(time, channel, keyCursors[c].position);
+				aiQuaternion rotation = calcInterpolatedRotation(time, channel, keyCursors[c].rotation);
+				aiVector3D scaling = calcInterpolatedScaling(time, channel, keyCursors[c].scaling);
+				tracks.setFrame(f, t, glm::vec3(position.x, position.y, position.z), glm::quat(rotation.w, rotation.x, rotation.y, rotation.z),
+					glm::vec3(scaling.x, scaling.y, scaling.z));
+			}
+		}
+		KeyCursors start = { 0, 0, 0 };
+		keyCursors.assign(animation->mNumChannels, start);
+	}
+
 	void showNodeName(aiNode* node)
 	{
 		cout << node->mName.data << endl;
@@ -152,7 +777,7 @@ private:
             // the node object only contains indices to index the actual objects in the scene. 
             // the scene contains all the data, node is just to keep stuff organized (like relations between nodes).
             aiMesh* mesh = scene->mMeshes[node->mMeshes[i]];
-            meshes.push_back(processMesh(mesh, scene));
+            processMesh(mesh, scene);
         }
         // after we've processed all of the meshes (if any) we then recursively process each of the children nodes
         for(unsigned int i = 0; i < node->mNumChildren; i++)
@@ -162,7 +787,8 @@ private:
 
     }
 
-    MeshAnim processMesh(aiMesh *mesh, const aiScene *scene)
+    // converts an aiMesh and constructs the resulting MeshAnim in place at the end of the meshes vector.
+    void processMesh(aiMesh *mesh, const aiScene *scene)
     {
 		std::cout << "bones: " << mesh->mNumBones << " vertices: " << mesh->mNumVertices << std::endl;
         // data to fill
@@ -173,54 +799,16 @@ private:
 
 		
 		//Tal vez haya que hacer resize de los vectores
-		vertices.reserve(mesh->mNumVertices);
-		indices.reserve(mesh->mNumVertices);
+		indices.reserve((size_t)mesh->mNumFaces * 3);
 		bones_id_weights_for_each_vertex.resize(mesh->mNumVertices);
 		
 
-        // Walk through each of the mesh's vertices
-        for(unsigned int i = 0; i < mesh->mNumVertices; i++)
-        {
-            Vertex vertex;
-            glm::vec3 vector; // we declare a placeholder vector since assimp uses its own vector class that doesn't directly convert to glm's vec3 class so we transfer the data to this placeholder glm::vec3 first.
-            // positions
-            vector.x = mesh->mVertices[i].x;
-            vector.y = mesh->mVertices[i].y;
-            vector.z = mesh->mVertices[i].z;
-            vertex.Position = vector;
-            // normals
-            vector.x = mesh->mNormals[i].x;
-            vector.y = mesh->mNormals[i].y;
-            vector.z = mesh->mNormals[i].z;
-            vertex.Normal = vector;
-            // texture coordinates
-            if(mesh->mTextureCoords[0]) // does the mesh contain texture coordinates?
-            {
-                glm::vec2 vec;
-                // a vertex can contain up to 8 different texture coordinates. We thus make the assumption that we won't 
-                // use models where a vertex can have multiple texture coordinates so we always take the first set (0).
-                vec.x = mesh->mTextureCoords[0][i].x; 
-                vec.y = mesh->mTextureCoords[0][i].y;
-                vertex.TexCoords = vec;
-            }
-            else
-                vertex.TexCoords = glm::vec2(0.0f, 0.0f);
-            // tangent
-            vector.x = mesh->mTangents[i].x;
-            vector.y = mesh->mTangents[i].y;
-            vector.z = mesh->mTangents[i].z;
-            vertex.Tangent = vector;
-            // bitangent
-            vector.x = mesh->mBitangents[i].x;
-            vector.y = mesh->mBitangents[i].y;
-            vector.z = mesh->mBitangents[i].z;
-            vertex.Bitangent = vector;
-            vertices.push_back(vertex);
-        }
+        // convert the mesh's attribute streams into our interleaved vertices (batched, and threaded for big meshes)
+        convertVertices(mesh, vertices);
         // now wak through each of the mesh's faces (a face is a mesh its triangle) and retrieve the corresponding vertex indices.
         for(unsigned int i = 0; i < mesh->mNumFaces; i++)
         {
-            aiFace face = mesh->mFaces[i];
+            const aiFace &face = mesh->mFaces[i];
             // retrieve all indices of the face and store them in the indices vector
             for(unsigned int j = 0; j < face.mNumIndices; j++)
                 indices.push_back(face.mIndices[j]);
@@ -229,23 +817,11 @@ private:
         aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];    
         // we assume a convention for sampler names in the shaders. Each diffuse texture should be named
         // as 'texture_diffuseN' where N is a sequential number ranging from 1 to MAX_SAMPLER_NUMBER. 
-        // Same applies to other texture as the following list summarizes:
-        // diffuse: texture_diffuseN
-        // specular: texture_specularN
-        // normal: texture_normalN
+        // The animation shader only samples texture_diffuse1, so the specular, normal and height maps
+        // of the material are not loaded at all.
 
         // 1. diffuse maps
-        vector<Texture> diffuseMaps = loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse");
-        textures.insert(textures.end(), diffuseMaps.begin(), diffuseMaps.end());
-        // 2. specular maps
-        vector<Texture> specularMaps = loadMaterialTextures(material, aiTextureType_SPECULAR, "texture_specular");
-        textures.insert(textures.end(), specularMaps.begin(), specularMaps.end());
-        // 3. normal maps
-        std::vector<Texture> normalMaps = loadMaterialTextures(material, aiTextureType_HEIGHT, "texture_normal");
-        textures.insert(textures.end(), normalMaps.begin(), normalMaps.end());
-        // 4. height maps
-        std::vector<Texture> heightMaps = loadMaterialTextures(material, aiTextureType_AMBIENT, "texture_height");
-        textures.insert(textures.end(), heightMaps.begin(), heightMaps.end());
+        loadMaterialTextures(material, aiTextureType_DIFFUSE, "texture_diffuse", textures);
 
 		// load bones
 		for (uint i = 0; i < mesh->mNumBones; i++)
@@ -285,15 +861,14 @@ private:
 			}
 		}
         
-        // return a mesh object created from the extracted mesh data
-        return MeshAnim(vertices, indices, textures, bones_id_weights_for_each_vertex);
+        // create the mesh in place from the extracted mesh data, handing over the buffers
+        meshes.emplace_back(std::move(vertices), std::move(indices), std::move(textures), std::move(bones_id_weights_for_each_vertex));
     }
 
     // checks all material textures of a given type and loads the textures if they're not loaded yet.
-    // the required info is returned as a Texture struct.
-    vector<Texture> loadMaterialTextures(aiMaterial *mat, aiTextureType type, string typeName)
+    // the required info is appended to textures as Texture structs.
+    void loadMaterialTextures(aiMaterial *mat, aiTextureType type, const string &typeName, vector<Texture> &textures)
     {
-        vector<Texture> textures;
         for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
         {
             aiString str;
@@ -312,76 +887,68 @@ private:
             if(!skip)
             {   // if texture hasn't been loaded already, load it
                 Texture texture;
-				texture.id = TextureFromFile(str.C_Str(), this->directory);
+				texture.id = TextureFromFile(str.C_Str(), this->directory, gammaCorrection, typeName == "texture_normal" ? TEXTURE_USAGE_NORMAL : TEXTURE_USAGE_COLOR,
+					textureQuality().tier(textureCategory));
                 texture.type = typeName;
                 texture.path = str.C_Str();
                 textures.push_back(texture);
-                textures_loaded.push_back(texture);  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
+                textures_loaded.push_back(std::move(texture));  // store it as texture loaded for entire model, to ensure we won't unnecesery load duplicate textures.
             }
         }
-        return textures;
     }
 
-	uint findPosition(float p_animation_time, const aiNodeAnim* p_node_anim)
+	// index of the key that starts the interval holding p_animation_time (the last interval past the end).
+	// Playback moves forward a little every frame, so the search starts at the cursor the previous sample
+	// left and steps ahead; going back (a loop) or far ahead falls back to a binary search
+	template <typename Key>
+	static uint findKey(float p_animation_time, const Key* keys, uint count, uint& cursor)
 	{
-		// ����� ���� ������� ����� ����� ����� ������� ���������� ����� ������ ��������
-		for (uint i = 0; i < p_node_anim->mNumPositionKeys - 1; i++) // �������� ����� ��������
+		uint last = count - 2;
+		uint index = (std::min)(cursor, last);
+		if (p_animation_time >= (float)keys[index].mTime)
 		{
-			if (p_animation_time < (float)p_node_anim->mPositionKeys[i + 1].mTime) // �������� �� �������� ��������� !!!
-			{
-				return i; // �� ������� ������ �������� !!!!!!!!!!!!!!!!!! ����������������������������
-			}
+			for (uint step = 0; step < KEY_CURSOR_STEPS && index < last && p_animation_time >= (float)keys[index + 1].mTime; step++)
+				index++;
+			if (index < last && p_animation_time >= (float)keys[index + 1].mTime)
+				index = searchKey(p_animation_time, keys, index + 1, last);
 		}
-
-		assert(0);
-		return 0;
-	}
-
-	uint findRotation(float p_animation_time, const aiNodeAnim* p_node_anim)
-	{
-		// ����� ���� ������� ����� ����� ����� ������� ���������� ����� ������ ��������
-		for (uint i = 0; i < p_node_anim->mNumRotationKeys - 1; i++) // �������� ����� ��������
-		{
-			if (p_animation_time < (float)p_node_anim->mRotationKeys[i + 1].mTime) // �������� �� �������� ��������� !!!
-			{
-				return i; // �� ������� ������ �������� !!!!!!!!!!!!!!!!!! ����������������������������
-			}
-		}
-
-		assert(0);
-		return 0;
+		else
+			index = searchKey(p_animation_time, keys, 0, index);
+		cursor = index;
+		return index;
 	}
 
-	uint findScaling(float p_animation_time, const aiNodeAnim* p_node_anim)
+	// last key in [first, last] that starts at or before p_animation_time, first if none does
+	template <typename Key>
+	static uint searchKey(float p_animation_time, const Key* keys, uint first, uint last)
 	{
-		// ����� ���� ������� ����� ����� ����� ������� ���������� ����� ������ ��������
-		for (uint i = 0; i < p_node_anim->mNumScalingKeys - 1; i++) // �������� ����� ��������
+		while (first < last)
 		{
-			if (p_animation_time < (float)p_node_anim->mScalingKeys[i + 1].mTime) // �������� �� �������� ��������� !!!
-			{
-				return i; // �� ������� ������ �������� !!!!!!!!!!!!!!!!!! ����������������������������
-			}
+			uint middle = first + (last - first + 1) / 2;
+			if (p_animation_time >= (float)keys[middle].mTime)
+				first = middle;
+			else
+				last = middle - 1;
 		}
-
-		assert(0);
-		return 0;
+		return first;
 	}
 
-	aiVector3D calcInterpolatedPosition(float p_animation_time, const aiNodeAnim* p_node_anim)
+	aiVector3D calcInterpolatedPosition(float p_animation_time, const aiNodeAnim* p_node_anim, uint& cursor)
 	{
 		if (p_node_anim->mNumPositionKeys == 1) // Keys ��� ������� �����
 		{
 			return p_node_anim->mPositionKeys[0].mValue;
 		}
 
-		uint position_index = findPosition(p_animation_time, p_node_anim); // ������ ������ �������� ����� ������� ������
+		uint position_index = findKey(p_animation_time, p_node_anim->mPositionKeys, p_node_anim->mNumPositionKeys, cursor); // ������ ������ �������� ����� ������� ������
 		uint next_position_index = position_index + 1; // ������ ��������� �������� �����
 		assert(next_position_index < p_node_anim->mNumPositionKeys);
 		// ���� ����� �������
 		float delta_time = (float)(p_node_anim->mPositionKeys[next_position_index].mTime - p_node_anim->mPositionKeys[position_index].mTime);
 		// ������ = (���� ������� ������ �� ������ �������� ��������� �����) / �� ���� ����� �������
 		float factor = (p_animation_time - (float)p_node_anim->mPositionKeys[position_index].mTime) / delta_time;
-		assert(factor >= 0.0f && factor <= 1.0f);
+		// before the first key or past the last one the pose holds
+		factor = (std::min)((std::max)(factor, 0.0f), 1.0f);
 		aiVector3D start = p_node_anim->mPositionKeys[position_index].mValue;
 		aiVector3D end = p_node_anim->mPositionKeys[next_position_index].mValue;
 		aiVector3D delta = end - start;
@@ -389,14 +956,14 @@ private:
 		return start + factor * delta;
 	}
 
-	aiQuaternion calcInterpolatedRotation(float p_animation_time, const aiNodeAnim* p_node_anim)
+	aiQuaternion calcInterpolatedRotation(float p_animation_time, const aiNodeAnim* p_node_anim, uint& cursor)
 	{
 		if (p_node_anim->mNumRotationKeys == 1) // Keys ��� ������� �����
 		{
 			return p_node_anim->mRotationKeys[0].mValue;
 		}
 
-		uint rotation_index = findRotation(p_animation_time, p_node_anim); // ������ ������ �������� ����� ������� ������
+		uint rotation_index = findKey(p_animation_time, p_node_anim->mRotationKeys, p_node_anim->mNumRotationKeys, cursor); // ������ ������ �������� ����� ������� ������
 		uint next_rotation_index = rotation_index + 1; // ������ ��������� �������� �����
 		assert(next_rotation_index < p_node_anim->mNumRotationKeys);
 		// ���� ����� �������
@@ -411,21 +978,22 @@ private:
 		//cout << "animation_time - mRotationKeys[rotation_index].mTime: " << (p_animation_time - (float)p_node_anim->mRotationKeys[rotation_index].mTime) << endl;
 		//cout << "factor: " << factor << endl << endl << endl;
 
-		assert(factor >= 0.0f && factor <= 1.0f);
+		// before the first key or past the last one the pose holds
+		factor = (std::min)((std::max)(factor, 0.0f), 1.0f);
 		aiQuaternion start_quat = p_node_anim->mRotationKeys[rotation_index].mValue;
 		aiQuaternion end_quat = p_node_anim->mRotationKeys[next_rotation_index].mValue;
 
 		return nlerp(start_quat, end_quat, factor);
 	}
 
-	aiVector3D calcInterpolatedScaling(float p_animation_time, const aiNodeAnim* p_node_anim)
+	aiVector3D calcInterpolatedScaling(float p_animation_time, const aiNodeAnim* p_node_anim, uint& cursor)
 	{
 		if (p_node_anim->mNumScalingKeys == 1) // Keys ��� ������� �����
 		{
 			return p_node_anim->mScalingKeys[0].mValue;
 		}
 
-		uint scaling_index = findScaling(p_animation_time, p_node_anim); // ������ ������ �������� ����� ������� ������
+		uint scaling_index = findKey(p_animation_time, p_node_anim->mScalingKeys, p_node_anim->mNumScalingKeys, cursor); // ������ ������ �������� ����� ������� ������
 		uint next_scaling_index = scaling_index + 1; // ������ ��������� �������� �����
 		assert(next_scaling_index < p_node_anim->mNumScalingKeys);
 		// ���� ����� �������
@@ -433,7 +1001,8 @@ private:
 		// ������ = (���� ������� ������ �� ������ �������� ��������� �����) / �� ���� ����� �������
 		float  factor = (p_animation_time - (float)p_node_anim->mScalingKeys[scaling_index].mTime) / delta_time;
 		//cout << "p_animation_time: " << p_animation_time << " " << "mTime: " << (float)p_node_anim->mScalingKeys[scaling_index].mTime << endl << endl << endl;
-		assert(factor >= 0.0f && factor <= 1.0f);
+		// before the first key or past the last one the pose holds
+		factor = (std::min)((std::max)(factor, 0.0f), 1.0f);
 		aiVector3D start = p_node_anim->mScalingKeys[scaling_index].mValue;
 		aiVector3D end = p_node_anim->mScalingKeys[next_scaling_index].mValue;
 		aiVector3D delta = end - start;
@@ -441,92 +1010,69 @@ private:
 		return start + factor * delta;
 	}
 
-	const aiNodeAnim * findNodeAnim(const aiAnimation * p_animation, const string p_node_name)
+	// the clip gives every local transform at once, the hierarchy is composed in glm. The reduced skeleton
+	// samples and walks fewer nodes and copies the palette of the collapsed bones
+	void evaluatePose(float p_animation_time, bool reduced = false)
 	{
-		// channel in animation contains aiNodeAnim (aiNodeAnim its transformation for bones)
-		// numChannels == numBones
-		for (uint i = 0; i < p_animation->mNumChannels; i++)
+		clip.sample(p_animation_time / ticks_per_second, trackLocals.data(), reduced ? reducedTracks : clip.tracks());
+		size_t count = reduced ? reducedNodes.size() : skeleton.size();
+		for (size_t n = 0; n < count; n++)
 		{
-			const aiNodeAnim* node_anim = p_animation->mChannels[i]; // ��������� ������� ������ node
-			if (string(node_anim->mNodeName.data) == p_node_name)
-			{
-				return node_anim;// ���� ����� �������� �� ������� ����� (� ������� ����������� node) ������������ ���� node_anim
-			}
+			size_t i = reduced ? reducedNodes[n] : n;
+			const SkeletonNode& node = skeleton[i];
+			const glm::mat4& local = node.track >= 0 ? trackLocals[node.track] : node.rest;
+			// the root starts from the inverse of the scene transform, every bone needs it
+			multiplyTransforms(node.parent >= 0 ? poseGlobals[node.parent] : globalInverse, local, poseGlobals[i]);
+			if (node.bone >= 0)
+				multiplyTransforms(poseGlobals[i], boneOffsets[node.bone], bonePalette[node.bone]);
 		}
-
-		return nullptr;
+		if (reduced)
+			for (size_t b = 0; b < collapsedBones.size(); b++)
+				bonePalette[collapsedBones[b].first] = bonePalette[collapsedBones[b].second];
 	}
 
-	// start from RootNode
-	void readNodeHierarchy(float p_animation_time, const aiNode* p_node, const aiMatrix4x4 parent_transform)
+	// sphere around the bind pose of every mesh
+	void computeBounds()
 	{
-
-		string node_name(p_node->mName.data);
-
-		//������� node, �� ������� ������������ �������, ������������� �������� ���� ������(aiNodeAnim).
-		const aiAnimation* animation = scene->mAnimations[0];
-		aiMatrix4x4 node_transform = p_node->mTransformation; // AQUI AHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHHH
-
-		const aiNodeAnim* node_anim = findNodeAnim(animation, node_name); // ����� ������� �� ����� ����
-
-		if (node_anim)
+		boundsRadius = 0.0f;
+		glm::vec3 low(0.0f), high(0.0f);
+		bool any = false;
+		for (size_t i = 0; i < meshes.size(); i++)
 		{
-
-			//scaling
-			//aiVector3D scaling_vector = node_anim->mScalingKeys[2].mValue;
-			aiVector3D scaling_vector = calcInterpolatedScaling(p_animation_time, node_anim);
-			aiMatrix4x4 scaling_matr;
-			aiMatrix4x4::Scaling(scaling_vector, scaling_matr);
-
-			//rotation
-			//aiQuaternion rotate_quat = node_anim->mRotationKeys[2].mValue;
-			aiQuaternion rotate_quat = calcInterpolatedRotation(p_animation_time, node_anim);
-			aiMatrix4x4 rotate_matr = aiMatrix4x4(rotate_quat.GetMatrix());
-
-			//translation
-			//aiVector3D translate_vector = node_anim->mPositionKeys[2].mValue;
-			aiVector3D translate_vector = calcInterpolatedPosition(p_animation_time, node_anim);
-			aiMatrix4x4 translate_matr;
-			aiMatrix4x4::Translation(translate_vector, translate_matr);
-
-			//if (p_node->mName == scene->mRootNode->mName) {
-			//	node_transform = translate_matr * (rotate_matr * aiMatrix4x4 (aiQuaternion(-90.0f, 0.0f, 0.0f).GetMatrix())) * scaling_matr;
-			//}
-
-			node_transform = translate_matr * rotate_matr * scaling_matr;
+			if (meshes[i].boundsRadius <= 0.0f)
+				continue;
+			glm::vec3 extent(meshes[i].boundsRadius);
+			low = any ? glm::min(low, meshes[i].boundsCenter - extent) : meshes[i].boundsCenter - extent;
+			high = any ? glm::max(high, meshes[i].boundsCenter + extent) : meshes[i].boundsCenter + extent;
+			any = true;
 		}
-
-		aiMatrix4x4 global_transform = parent_transform * node_transform;
-
-		// ���� � node �� �������� ����������� bone, �� �� node ������ ��������� � ������ bone !!!
-		if (m_bone_mapping.find(node_name) != m_bone_mapping.end()) // true if node_name exist in bone_mapping
-		{
-			uint bone_index = m_bone_mapping[node_name];
-			m_bone_matrices[bone_index].final_world_transform = m_global_inverse_transform * global_transform * m_bone_matrices[bone_index].offset_matrix;
-		}
-
-		for (uint i = 0; i < p_node->mNumChildren; i++)
-		{
-			readNodeHierarchy(p_animation_time, p_node->mChildren[i], global_transform);
-		}
-
+		boundsCenter = (low + high) * 0.5f;
+		boundsRadius = any ? glm::length(high - low) * 0.5f : 0.0f;
 	}
 
-	void boneTransform(double time_in_sec, vector<aiMatrix4x4>& transforms)
+	// local transform of an animated node at p_animation_time
+	aiMatrix4x4 channelTransform(float p_animation_time, const aiNodeAnim* node_anim, KeyCursors& cursors)
 	{
-		aiMatrix4x4 identity_matrix; // = mat4(1.0f);
-
-		double time_in_ticks = time_in_sec * ticks_per_second;
-		float animation_time = fmod(time_in_ticks, scene->mAnimations[0]->mDuration); //������� �� ����� (������� �� ������)
-		// animation_time - ���� ������� ������ � ���� ������ �� ������ �������� (�� ������� �������� ����� � �������� )
-
-		readNodeHierarchy(animation_time, scene->mRootNode, identity_matrix);
-
-		transforms.resize(m_num_bones);
+		aiMatrix4x4 scaling_matr;
+		aiMatrix4x4::Scaling(calcInterpolatedScaling(p_animation_time, node_anim, cursors.scaling), scaling_matr);
+		aiMatrix4x4 rotate_matr = aiMatrix4x4(calcInterpolatedRotation(p_animation_time, node_anim, cursors.rotation).GetMatrix());
+		aiMatrix4x4 translate_matr;
+		aiMatrix4x4::Translation(calcInterpolatedPosition(p_animation_time, node_anim, cursors.position), translate_matr);
+		return translate_matr * rotate_matr * scaling_matr;
+	}
 
-		for (uint i = 0; i < m_num_bones; i++)
+	// walks the flattened skeleton once: parents come first, so their global transform is ready
+	void evaluatePoseFromKeys(float p_animation_time)
+	{
+		const aiAnimation* animation = scene->mAnimations[0];
+		for (size_t i = 0; i < skeleton.size(); i++)
 		{
-			transforms[i] = m_bone_matrices[i].final_world_transform;
+			const SkeletonNode& node = skeleton[i];
+			aiMatrix4x4 node_transform = node.channel >= 0 ?
+				channelTransform(p_animation_time, animation->mChannels[node.channel], keyCursors[node.channel]) : node.transformation;
+			skeletonGlobals[i] = node.parent >= 0 ? skeletonGlobals[node.parent] * node_transform : node_transform;
+			if (node.bone >= 0)
+				m_bone_matrices[node.bone].final_world_transform = m_global_inverse_transform * skeletonGlobals[i] * m_bone_matrices[node.bone].offset_matrix;
 		}
 	}
 
@@ -582,4 +1128,50 @@ private:
 		return result.Normalize();
 	}
 };
+
+// times the pose from the compressed clip (whole and reduced skeleton) against the key by key evaluation over
+// a loop of the animation and compares the palettes; needs the scene, the model is loaded with keepScene
+inline bool benchmarkBoneEvaluation(ModelAnim &model, const string &name, int iterations = 1000)
+{
+	if (!model.scene)
+	{
+		cout << "WARNING::BENCHMARK:: " << name << " was loaded without its scene" << endl;
+		return false;
+	}
+	typedef std::chrono::high_resolution_clock Clock;
+	vector<aiMatrix4x4> keys;
+	double seconds[3] = { 0.0, 0.0, 0.0 };
+	float difference = 0.0f;
+	double length = model.animationDuration / model.ticks_per_second;
+	for (int it = 0; it < iterations; it++)
+	{
+		double time = length * it / iterations;
+		Clock::time_point start = Clock::now();
+		model.boneTransformFromKeys(time, keys);
+		seconds[0] += std::chrono::duration<double>(Clock::now() - start).count();
+		start = Clock::now();
+		const vector<glm::mat4>& palette = model.boneTransform(time);
+		seconds[1] += std::chrono::duration<double>(Clock::now() - start).count();
+		for (size_t b = 0; b < palette.size(); b++)
+			for (int c = 0; c < 4; c++)
+				for (int r = 0; r < 4; r++)
+					difference = (std::max)(difference, std::fabs(palette[b][c][r] - keys[b][r][c]));
+		start = Clock::now();
+		model.boneTransform(time, true);
+		seconds[2] += std::chrono::duration<double>(Clock::now() - start).count();
+	}
+
+	size_t bones = model.bonePalette.size();
+	const char *names[3] = { "keys", "compressed clip", "reduced skeleton" };
+	cout << "BENCHMARK::BONES:: " << name << "  bones: " << bones << "  nodes: " << model.skeleton.size() << " (reduced "
+		<< model.reducedNodes.size() << ")  poses: " << iterations << "  rate: " << model.clip.frameRate() << " fps" << endl;
+	for (int variant = 0; variant < 3; variant++)
+	{
+		double us = seconds[variant] * 1000000.0 / iterations;
+		cout << "    " << names[variant] << ": " << us << " us/pose  (" << bones / us << " bones/us, x" << seconds[0] / seconds[variant] << ")" << endl;
+	}
+	cout << "    max difference: " << difference << "  keys: " << model.animationKeyBytes() / 1024 << " KB  clip: "
+		<< model.clip.bytes() / 1024 << " KB (" << model.clip.keys() << " keys)" << endl;
+	return true;
+}
 #endif
\ No newline at end of file
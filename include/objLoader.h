@@ -0,0 +1,647 @@
+#ifndef OBJ_LOADER_H
+#define OBJ_LOADER_H
+
+#include <glm/glm.hpp>
+
+#include <mesh.h>
+#include <materialPacker.h>
+#include <meshCache.h>
+#include <mappedFile.h>
+#include <vertexConvert.h>
+
+#include <cctype>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Native Wavefront OBJ/MTL loader for the static models. It produces the same meshes Model used
+// to get from Assimp with aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace
+// (one mesh per material, fan triangulated faces, flipped V, per-vertex tangents) but:
+//  - the file is memory mapped and split into line-aligned chunks that are parsed in parallel,
+//  - numbers go through a small dedicated parser instead of the C locale machinery,
+//  - face corners with the same v/vt/vn triple are welded into one Vertex, built directly in the
+//    final layout, so there is no intermediate scene to walk afterwards.
+// Anything the loader does not understand makes it fail, and Model falls back to Assimp.
+
+#define OBJ_NO_INDEX INT_MIN
+#define OBJ_CHUNK_MIN_BYTES (256 * 1024)   // smaller files are parsed on the calling thread
+
+// what one chunk of the file contributes. Face corners hold 0-based indices (v, vt, vn); the ones written
+// with negative (relative) indices can't be resolved until the previous chunks are counted, see relativeCorners.
+struct ObjChunk {
+    vector<float> positions;                        // xyz
+    vector<float> texCoords;                        // uv
+    vector<float> normals;                          // xyz
+    vector<int> corners;                            // v, vt, vn per face corner, OBJ_NO_INDEX when missing
+    vector<size_t> relativeCorners;                 // entries of corners that are still relative to the chunk start
+    vector<unsigned int> faceSizes;                 // corners of each face
+    vector<pair<size_t, string> > materialSwitches; // (first face, material) for each usemtl
+    vector<string> materialLibraries;
+};
+
+// texture maps of a material, already translated to the sampler names Model uses
+// (only the maps the shaders sample, see materialPacker.h)
+struct ObjMaterial {
+    string diffuse;     // map_Kd -> texture_diffuse
+    MaterialPack pack;  // map_Ks, map_Ns/map_Pr, map_Pm/map_refl and the AO found next to them -> texture_material
+};
+
+inline bool objIsSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+inline bool objIsDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+inline const char *objSkipSpaces(const char *p, const char *end)
+{
+    while (p < end && objIsSpace(*p))
+        p++;
+    return p;
+}
+
+// parses a decimal number ("-1.25e-3"). Returns p unchanged if there is no number at p.
+inline const char *objParseFloat(const char *p, const char *end, float &value)
+{
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                     1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+
+    uint64_t mantissa = 0;
+    int exponent = 0, digits = 0;
+    bool any = false;
+    for (; p < end && objIsDigit(*p); p++, any = true)
+    {
+        if (digits < 19)
+        {
+            mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+            digits += mantissa != 0;
+        }
+        else
+            exponent++;
+    }
+    if (p < end && *p == '.')
+    {
+        for (p++; p < end && objIsDigit(*p); p++, any = true)
+        {
+            if (digits < 19)
+            {
+                mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any)
+        return start;
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        const char *e = p + 1;
+        bool negativeExponent = false;
+        if (e < end && (*e == '-' || *e == '+'))
+            negativeExponent = *e++ == '-';
+        if (e < end && objIsDigit(*e))
+        {
+            int power = 0;
+            for (; e < end && objIsDigit(*e); e++)
+                power = power < 10000 ? power * 10 + (*e - '0') : power;
+            exponent += negativeExponent ? -power : power;
+            p = e;
+        }
+    }
+
+    double result = (double)mantissa;
+    if (exponent < 0)
+        result = exponent >= -22 ? result / powers[-exponent] : result * pow(10.0, exponent);
+    else if (exponent > 0)
+        result = exponent <= 22 ? result * powers[exponent] : result * pow(10.0, exponent);
+    value = (float)(negative ? -result : result);
+    return p;
+}
+
+inline const char *objParseInt(const char *p, const char *end, int &value)
+{
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+'))
+        negative = *p++ == '-';
+    if (p >= end || !objIsDigit(*p))
+        return start;
+    int result = 0;
+    for (; p < end && objIsDigit(*p); p++)
+        result = result * 10 + (*p - '0');
+    value = negative ? -result : result;
+    return p;
+}
+
+// rest of the line without surrounding blanks (names may contain spaces)
+inline string objRestOfLine(const char *p, const char *end)
+{
+    p = objSkipSpaces(p, end);
+    while (end > p && objIsSpace(end[-1]))
+        end--;
+    return string(p, end);
+}
+
+inline bool objKeyword(const char *line, const char *end, const char *keyword, size_t length)
+{
+    return (size_t)(end - line) > length && memcmp(line, keyword, length) == 0 && objIsSpace(line[length]);
+}
+
+// reads up to count floats of a "v"/"vt"/"vn" line, missing ones are 0
+inline void objParseFloats(const char *p, const char *end, vector<float> &out, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        float value = 0.0f;
+        p = objSkipSpaces(p, end);
+        p = objParseFloat(p, end, value);
+        out.push_back(value);
+    }
+}
+
+// parses one "f" line. Faces with less than 3 corners are dropped.
+inline void objParseFace(const char *p, const char *end, ObjChunk &chunk)
+{
+    const int localCounts[3] = { (int)(chunk.positions.size() / 3), (int)(chunk.texCoords.size() / 2),
+                                 (int)(chunk.normals.size() / 3) };
+    size_t firstCorner = chunk.corners.size();
+    size_t firstRelative = chunk.relativeCorners.size();
+    unsigned int count = 0;
+    for (;;)
+    {
+        p = objSkipSpaces(p, end);
+        if (p >= end)
+            break;
+        int corner[3] = { OBJ_NO_INDEX, OBJ_NO_INDEX, OBJ_NO_INDEX };
+        size_t cornerRelative = chunk.relativeCorners.size();
+        for (int k = 0; k < 3; k++)
+        {
+            int value;
+            const char *next = objParseInt(p, end, value);
+            if (next != p)
+            {
+                p = next;
+                if (value > 0)
+                    corner[k] = value - 1;
+                else if (value < 0)
+                {
+                    // relative to the vertices read so far: local for now, the chunk offset is added later
+                    corner[k] = localCounts[k] + value;
+                    chunk.relativeCorners.push_back(chunk.corners.size() + k);
+                }
+            }
+            if (p < end && *p == '/')
+                p++;
+            else
+                break;
+        }
+        // skip whatever is left of a malformed corner
+        while (p < end && !objIsSpace(*p))
+            p++;
+        if (corner[0] == OBJ_NO_INDEX)
+        {
+            chunk.relativeCorners.resize(cornerRelative);
+            continue;
+        }
+        chunk.corners.insert(chunk.corners.end(), corner, corner + 3);
+        count++;
+    }
+    if (count >= 3)
+        chunk.faceSizes.push_back(count);
+    else
+    {
+        chunk.corners.resize(firstCorner);
+        chunk.relativeCorners.resize(firstRelative);
+    }
+}
+
+inline void parseObjChunk(const char *begin, const char *end, ObjChunk *chunk)
+{
+    const char *p = begin;
+    while (p < end)
+    {
+        const char *line = objSkipSpaces(p, end);
+        const char *lineEnd = (const char*)memchr(line, '\n', end - line);
+        if (!lineEnd)
+            lineEnd = end;
+        p = lineEnd < end ? lineEnd + 1 : end;
+        if (lineEnd > line && lineEnd[-1] == '\r')
+            lineEnd--;
+        if (lineEnd - line < 2)
+            continue;
+
+        if (line[0] == 'v')
+        {
+            if (objIsSpace(line[1]))
+                objParseFloats(line + 2, lineEnd, chunk->positions, 3);
+            else if (line[1] == 't' && lineEnd - line > 2 && objIsSpace(line[2]))
+                objParseFloats(line + 3, lineEnd, chunk->texCoords, 2);
+            else if (line[1] == 'n' && lineEnd - line > 2 && objIsSpace(line[2]))
+                objParseFloats(line + 3, lineEnd, chunk->normals, 3);
+        }
+        else if (line[0] == 'f' && objIsSpace(line[1]))
+            objParseFace(line + 2, lineEnd, *chunk);
+        else if (objKeyword(line, lineEnd, "usemtl", 6))
+            chunk->materialSwitches.push_back(make_pair((size_t)chunk->faceSizes.size(), objRestOfLine(line + 7, lineEnd)));
+        else if (objKeyword(line, lineEnd, "mtllib", 6))
+            chunk->materialLibraries.push_back(objRestOfLine(line + 7, lineEnd));
+        // o, g, s, comments and the rest don't change the geometry we build
+    }
+}
+
+// skips the options in front of the file name of a map_* statement ("-bm 1.0 -o 0 0 0 file name.png")
+inline string objTextureFile(const string &arguments)
+{
+    static const struct { const char *name; int count; bool numeric; } options[] = {
+        { "-blendu", 1, false }, { "-blendv", 1, false }, { "-boost", 1, true }, { "-mm", 2, true },
+        { "-o", 3, true }, { "-s", 3, true }, { "-t", 3, true }, { "-texres", 1, false }, { "-clamp", 1, false },
+        { "-bm", 1, true }, { "-imfchan", 1, false }, { "-type", 1, false }, { "-cc", 1, false }
+    };
+    const char *p = arguments.c_str();
+    const char *end = p + arguments.size();
+    for (;;)
+    {
+        p = objSkipSpaces(p, end);
+        if (p >= end || *p != '-')
+            break;
+        const char *tokenEnd = p;
+        while (tokenEnd < end && !objIsSpace(*tokenEnd))
+            tokenEnd++;
+        int option = -1;
+        for (int i = 0; i < (int)(sizeof(options) / sizeof(options[0])); i++)
+            if (strlen(options[i].name) == (size_t)(tokenEnd - p) && memcmp(options[i].name, p, tokenEnd - p) == 0)
+                option = i;
+        if (option < 0)
+            break;   // a file name that starts with '-'
+        p = tokenEnd;
+        for (int a = 0; a < options[option].count; a++)
+        {
+            const char *value = objSkipSpaces(p, end);
+            float number;
+            if (value >= end || (options[option].numeric && objParseFloat(value, end, number) == value))
+                break;
+            p = value;
+            while (p < end && !objIsSpace(*p))
+                p++;
+        }
+    }
+    return objRestOfLine(p, end);
+}
+
+inline bool objEqualsNoCase(const string &a, const char *b)
+{
+    size_t length = strlen(b);
+    if (a.size() != length)
+        return false;
+    for (size_t i = 0; i < length; i++)
+        if (tolower((unsigned char)a[i]) != tolower((unsigned char)b[i]))
+            return false;
+    return true;
+}
+
+inline bool parseMtl(const string &path, map<string, ObjMaterial> &materials)
+{
+    ifstream file(path.c_str());
+    if (!file)
+        return false;
+    string line;
+    ObjMaterial *material = nullptr;
+    while (getline(file, line))
+    {
+        if (!line.empty() && line[line.size() - 1] == '\r')
+            line.resize(line.size() - 1);
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string::npos || line[start] == '#')
+            continue;
+        size_t keyEnd = line.find_first_of(" \t", start);
+        if (keyEnd == string::npos)
+            continue;
+        string key = line.substr(start, keyEnd - start);
+        string arguments = line.substr(keyEnd + 1);
+        if (key == "newmtl")
+            material = &materials[objRestOfLine(arguments.c_str(), arguments.c_str() + arguments.size())];
+        else if (!material)
+            continue;
+        else if (key == "map_Kd")
+            material->diffuse = objTextureFile(arguments);
+        else if (key == "map_Ks")
+            material->pack.specular = objTextureFile(arguments);
+        else if (key == "map_Ns" || key == "map_Pr")   // the exporters used here put the roughness map in map_Ns
+            material->pack.roughness = objTextureFile(arguments);
+        else if (key == "map_Pm" || key == "map_refl")
+            material->pack.metalness = objTextureFile(arguments);
+    }
+    return true;
+}
+
+// vertices and indices of one material, welding corners that share the same v/vt/vn triple
+struct ObjMeshBuilder {
+    string material;
+    vector<Vertex> vertices;
+    vector<unsigned int> indices;
+    vector<int> keys;               // v, vt, vn of every vertex
+    vector<unsigned int> table;     // open addressing: vertex index + 1, 0 when empty
+
+    static size_t hashKey(const int *key)
+    {
+        uint64_t h = (uint64_t)(uint32_t)key[0] * 0x9E3779B97F4A7C15ull;
+        h ^= (uint64_t)(uint32_t)key[1] * 0xC2B2AE3D27D4EB4Full + (h >> 29);
+        h ^= (uint64_t)(uint32_t)key[2] * 0x165667B19E3779F9ull + (h >> 32);
+        return (size_t)(h ^ (h >> 31));
+    }
+
+    void grow()
+    {
+        vector<unsigned int> bigger(table.empty() ? 1024 : table.size() * 2, 0u);
+        size_t mask = bigger.size() - 1;
+        for (unsigned int v = 0; v < vertices.size(); v++)
+        {
+            size_t slot = hashKey(&keys[v * 3]) & mask;
+            while (bigger[slot])
+                slot = (slot + 1) & mask;
+            bigger[slot] = v + 1;
+        }
+        table.swap(bigger);
+    }
+
+    unsigned int weld(const int *key, const vector<float> &positions, const vector<float> &texCoords, const vector<float> &normals)
+    {
+        if ((vertices.size() + 1) * 2 > table.size())
+            grow();
+        size_t mask = table.size() - 1;
+        size_t slot = hashKey(key) & mask;
+        while (table[slot])
+        {
+            unsigned int v = table[slot] - 1;
+            if (keys[v * 3] == key[0] && keys[v * 3 + 1] == key[1] && keys[v * 3 + 2] == key[2])
+                return v;
+            slot = (slot + 1) & mask;
+        }
+        Vertex vertex;
+        vertex.Position = glm::vec3(positions[key[0] * 3], positions[key[0] * 3 + 1], positions[key[0] * 3 + 2]);
+        vertex.Normal = key[2] == OBJ_NO_INDEX ? glm::vec3(0.0f) :
+            glm::vec3(normals[key[2] * 3], normals[key[2] * 3 + 1], normals[key[2] * 3 + 2]);
+        // same as aiProcess_FlipUVs
+        vertex.TexCoords = key[1] == OBJ_NO_INDEX ? glm::vec2(0.0f) :
+            glm::vec2(texCoords[key[1] * 2], 1.0f - texCoords[key[1] * 2 + 1]);
+        vertex.Tangent = glm::vec3(0.0f);
+        vertex.Bitangent = glm::vec3(0.0f);
+        unsigned int index = (unsigned int)vertices.size();
+        vertices.push_back(vertex);
+        keys.insert(keys.end(), key, key + 3);
+        table[slot] = index + 1;
+        return index;
+    }
+};
+
+// loads an OBJ file (and its MTL libraries) into one cache entry per material. chunkCount forces the number
+// of parse chunks, 0 picks one per core (fewer for small files). The result doesn't depend on it.
+// Returns false if the file can't be read or references data it doesn't contain.
+inline bool loadObj(const string &path, vector<MeshCacheEntry> &entries, size_t chunkCount = 0)
+{
+    MappedFile file;
+    if (!file.open(path))
+        return false;
+    const char *data = file.data();
+    size_t size = file.size();
+
+    // 1. split the file at line boundaries and parse the chunks in parallel
+    if (chunkCount == 0)
+    {
+        unsigned int threads = std::thread::hardware_concurrency();
+        chunkCount = size / OBJ_CHUNK_MIN_BYTES;
+        if (chunkCount > threads)
+            chunkCount = threads;
+        if (chunkCount < 1)
+            chunkCount = 1;
+    }
+    vector<size_t> bounds(chunkCount + 1, size);
+    bounds[0] = 0;
+    for (size_t i = 1; i < chunkCount; i++)
+    {
+        size_t at = size / chunkCount * i;
+        if (at < bounds[i - 1])
+            at = bounds[i - 1];
+        const char *newline = (const char*)memchr(data + at, '\n', size - at);
+        bounds[i] = newline ? (size_t)(newline - data) + 1 : size;
+    }
+    vector<ObjChunk> chunks(chunkCount);
+    vector<std::thread> workers;
+    workers.reserve(chunkCount - 1);
+    for (size_t i = 1; i < chunkCount; i++)
+        workers.emplace_back(parseObjChunk, data + bounds[i], data + bounds[i + 1], &chunks[i]);
+    parseObjChunk(data + bounds[0], data + bounds[1], &chunks[0]);
+    for (size_t i = 0; i < workers.size(); i++)
+        workers[i].join();
+    file.close();
+
+    // 2. join the attribute arrays and turn relative indices into absolute ones
+    size_t totals[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        totals[0] += chunks[i].positions.size();
+        totals[1] += chunks[i].texCoords.size();
+        totals[2] += chunks[i].normals.size();
+    }
+    vector<float> positions, texCoords, normals;
+    positions.reserve(totals[0]);
+    texCoords.reserve(totals[1]);
+    normals.reserve(totals[2]);
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        ObjChunk &chunk = chunks[i];
+        const int offsets[3] = { (int)(positions.size() / 3), (int)(texCoords.size() / 2), (int)(normals.size() / 3) };
+        for (size_t r = 0; r < chunk.relativeCorners.size(); r++)
+            chunk.corners[chunk.relativeCorners[r]] += offsets[chunk.relativeCorners[r] % 3];
+        positions.insert(positions.end(), chunk.positions.begin(), chunk.positions.end());
+        texCoords.insert(texCoords.end(), chunk.texCoords.begin(), chunk.texCoords.end());
+        normals.insert(normals.end(), chunk.normals.begin(), chunk.normals.end());
+        vector<float>().swap(chunk.positions);
+        vector<float>().swap(chunk.texCoords);
+        vector<float>().swap(chunk.normals);
+    }
+    const int counts[3] = { (int)(positions.size() / 3), (int)(texCoords.size() / 2), (int)(normals.size() / 3) };
+
+    // 3. materials. Like Assimp, a library that can't be found is replaced by the .mtl next to the .obj
+    string directory = path.substr(0, path.find_last_of('/'));
+    map<string, ObjMaterial> materials;
+    set<string> libraries;
+    bool missingLibrary = false;
+    for (size_t i = 0; i < chunkCount; i++)
+        for (size_t l = 0; l < chunks[i].materialLibraries.size(); l++)
+            if (libraries.insert(chunks[i].materialLibraries[l]).second &&
+                !parseMtl(directory + '/' + chunks[i].materialLibraries[l], materials))
+                missingLibrary = true;
+    if (missingLibrary && !parseMtl(path.substr(0, path.size() - 3) + "mtl", materials))
+        cout << "WARNING::OBJ:: could not read the material library of " << path << endl;
+    for (map<string, ObjMaterial>::iterator it = materials.begin(); it != materials.end(); ++it)
+    {
+        MaterialPack &pack = it->second.pack;
+        completeMaterialPack(pack, it->second.diffuse.empty() ? pack.specular : it->second.diffuse, directory);
+    }
+
+    // 4. triangulate (fan) and weld the faces into one builder per material, in order of appearance
+    vector<ObjMeshBuilder> builders;
+    map<string, size_t> builderOf;
+    size_t current = (size_t)-1;
+    string currentMaterial;
+    for (size_t i = 0; i < chunkCount; i++)
+    {
+        const ObjChunk &chunk = chunks[i];
+        const int *corner = chunk.corners.data();
+        size_t nextSwitch = 0;
+        for (size_t f = 0; f < chunk.faceSizes.size(); f++)
+        {
+            while (nextSwitch < chunk.materialSwitches.size() && chunk.materialSwitches[nextSwitch].first == f)
+            {
+                currentMaterial = chunk.materialSwitches[nextSwitch++].second;
+                current = (size_t)-1;
+            }
+            if (current == (size_t)-1)
+            {
+                map<string, size_t>::iterator it = builderOf.find(currentMaterial);
+                if (it == builderOf.end())
+                {
+                    it = builderOf.insert(make_pair(currentMaterial, builders.size())).first;
+                    builders.push_back(ObjMeshBuilder());
+                    builders.back().material = currentMaterial;
+                }
+                current = it->second;
+            }
+            ObjMeshBuilder &builder = builders[current];
+
+            unsigned int faceSize = chunk.faceSizes[f];
+            for (unsigned int c = 0; c < faceSize; c++)
+                for (int k = 0; k < 3; k++)
+                {
+                    int index = corner[c * 3 + k];
+                    if ((index < 0 || index >= counts[k]) && (k == 0 || index != OBJ_NO_INDEX))
+                    {
+                        cout << "ERROR::OBJ:: index out of range in " << path << endl;
+                        return false;
+                    }
+                }
+            unsigned int first = builder.weld(corner, positions, texCoords, normals);
+            unsigned int previous = builder.weld(corner + 3, positions, texCoords, normals);
+            for (unsigned int c = 2; c < faceSize; c++)
+            {
+                unsigned int next = builder.weld(corner + c * 3, positions, texCoords, normals);
+                builder.indices.push_back(first);
+                builder.indices.push_back(previous);
+                builder.indices.push_back(next);
+                previous = next;
+            }
+            corner += faceSize * 3;
+        }
+        // a usemtl after the last face of the chunk applies to the faces of the next ones
+        while (nextSwitch < chunk.materialSwitches.size())
+        {
+            currentMaterial = chunk.materialSwitches[nextSwitch++].second;
+            current = (size_t)-1;
+        }
+    }
+
+    // 5. tangents and textures, in the order processMesh loads them
+    entries.clear();
+    entries.reserve(builders.size());
+    for (size_t b = 0; b < builders.size(); b++)
+    {
+        ObjMeshBuilder &builder = builders[b];
+        if (builder.indices.empty())
+            continue;
+        computeTangentSpace(builder.vertices, builder.indices);
+        entries.push_back(MeshCacheEntry());
+        MeshCacheEntry &entry = entries.back();
+        entry.vertices.swap(builder.vertices);
+        entry.indices.swap(builder.indices);
+        map<string, ObjMaterial>::const_iterator it = materials.find(builder.material);
+        if (it == materials.end())
+            continue;
+        const ObjMaterial &material = it->second;
+        if (!material.diffuse.empty())
+        {
+            MeshCacheTexture texture = { "texture_diffuse", material.diffuse };
+            entry.textures.push_back(std::move(texture));
+        }
+        if (!material.pack.empty())
+        {
+            MeshCacheTexture texture = { "texture_material", materialPackPath(material.pack) };
+            entry.textures.push_back(std::move(texture));
+        }
+    }
+    return !entries.empty();
+}
+
+inline bool sameObjEntries(const vector<MeshCacheEntry> &a, const vector<MeshCacheEntry> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++)
+    {
+        if (a[i].vertices.size() != b[i].vertices.size() || a[i].indices != b[i].indices ||
+            a[i].textures.size() != b[i].textures.size())
+            return false;
+        if (!a[i].vertices.empty() && memcmp(a[i].vertices.data(), b[i].vertices.data(), a[i].vertices.size() * sizeof(Vertex)) != 0)
+            return false;
+        for (size_t t = 0; t < a[i].textures.size(); t++)
+            if (a[i].textures[t].type != b[i].textures[t].type || a[i].textures[t].path != b[i].textures[t].path)
+                return false;
+    }
+    return true;
+}
+
+// parses a file on one chunk and on 2..maxChunks chunks, then times one chunk against one per core.
+// Returns false if any chunk count gives different meshes or the file can't be loaded.
+inline bool benchmarkObjLoader(const string &path, int iterations = 10, size_t maxChunks = 16)
+{
+    vector<MeshCacheEntry> reference, entries;
+    if (!loadObj(path, reference, 1))
+    {
+        cout << "ERROR::OBJ:: could not load " << path << endl;
+        return false;
+    }
+    bool identical = true;
+    for (size_t chunks = 2; chunks <= maxChunks; chunks++)
+    {
+        if (!loadObj(path, entries, chunks) || !sameObjEntries(reference, entries))
+        {
+            cout << "ERROR::OBJ:: " << chunks << " chunks give different meshes than one" << endl;
+            identical = false;
+        }
+    }
+
+    typedef std::chrono::high_resolution_clock Clock;
+    double seconds[2] = { 0.0, 0.0 };
+    for (int it = 0; it < iterations; it++)
+        for (int variant = 0; variant < 2; variant++)
+        {
+            Clock::time_point start = Clock::now();
+            loadObj(path, entries, variant == 0 ? 1 : 0);
+            seconds[variant] += std::chrono::duration<double>(Clock::now() - start).count();
+        }
+
+    const char *names[2] = { "one chunk", "one chunk per core" };
+    cout << "BENCHMARK::OBJ_LOADER:: " << path << "  meshes: " << reference.size() << "  iterations: " << iterations << endl;
+    for (int variant = 0; variant < 2; variant++)
+        cout << "    " << names[variant] << ": " << seconds[variant] * 1000.0 / iterations << " ms  (x"
+             << seconds[0] / seconds[variant] << ")" << endl;
+    return identical;
+}
+#endif
@@ -0,0 +1,145 @@
+#ifndef POSE_CACHE_H
+#define POSE_CACHE_H
+
+#include <glm/glm.hpp>
+
+#include <memoryLedger.h>
+
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Bone palettes already evaluated, shared by every character.
+// A palette is keyed by its skeleton (the file it was loaded from), clip, whether the reduced skeleton was
+// used (animationLod.h) and its time in the clip quantized to POSE_CACHE_RATE steps a second: characters
+// loaded from the same file and playing in sync, or a character animated twice in a frame, evaluate their
+// pose once. The POSE_CACHE_ENTRIES palettes used last are kept, so a loop that comes back to the same step
+// finds it too.
+// The characters are animated in parallel (jobSystem.h): palettes are copied in and out under a lock, one
+// that another character evicts is never read.
+
+#define POSE_CACHE_RATE     120.0
+#define POSE_CACHE_ENTRIES  256
+
+class PoseCache {
+public:
+    PoseCache() : tick(0), hitCount(0), missCount(0), evictionCount(0), ledgerHandle(0) {}
+
+    // the same id for every model loaded from path
+    unsigned int skeletonId(const string &path)
+    {
+        lock_guard<mutex> lock(guard);
+        if (ledgerHandle == 0)
+            ledgerHandle = memoryLedger().addSource("pose cache", MEMORY_CPU_ANIMATION, [this]() { return bytes(); });
+        map<string, unsigned int>::iterator it = skeletons.find(path);
+        if (it != skeletons.end())
+            return it->second;
+        unsigned int id = (unsigned int)skeletons.size();
+        skeletons[path] = id;
+        return id;
+    }
+
+    // the quantized step of seconds into the clip
+    static int64_t step(double seconds)
+    {
+        return (int64_t)(seconds * POSE_CACHE_RATE + 0.5);
+    }
+
+    static double stepSeconds(int64_t step)
+    {
+        return step / POSE_CACHE_RATE;
+    }
+
+    static uint64_t key(unsigned int skeleton, unsigned int clip, bool reduced, int64_t step)
+    {
+        return ((uint64_t)(skeleton & 0xFFFF) << 48) | ((uint64_t)(clip & 0x7FFF) << 33) | ((uint64_t)reduced << 32) | (uint32_t)step;
+    }
+
+    // copies the palette stored under key to palette, false if there is none
+    bool find(uint64_t key, vector<glm::mat4> &palette)
+    {
+        lock_guard<mutex> lock(guard);
+        map<uint64_t, Entry>::iterator it = entries.find(key);
+        if (it == entries.end())
+        {
+            missCount++;
+            return false;
+        }
+        hitCount++;
+        it->second.lastUse = ++tick;
+        palette = it->second.palette;
+        return true;
+    }
+
+    // keeps a copy of palette under key, dropping the palette used longest ago when full
+    void store(uint64_t key, const vector<glm::mat4> &palette)
+    {
+        lock_guard<mutex> lock(guard);
+        if (entries.size() >= POSE_CACHE_ENTRIES && entries.find(key) == entries.end())
+        {
+            map<uint64_t, Entry>::iterator oldest = entries.begin();
+            for (map<uint64_t, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+                if (it->second.lastUse < oldest->second.lastUse)
+                    oldest = it;
+            entries.erase(oldest);
+            evictionCount++;
+        }
+        Entry &entry = entries[key];
+        entry.palette = palette;
+        entry.lastUse = ++tick;
+    }
+
+    size_t hits() const { return hitCount; }
+    size_t misses() const { return missCount; }
+
+    size_t bytes() const
+    {
+        size_t total = 0;
+        for (map<uint64_t, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+            total += sizeof(Entry) + it->second.palette.capacity() * sizeof(glm::mat4);
+        return total;
+    }
+
+    void printReport() const
+    {
+        size_t lookups = hitCount + missCount;
+        cout << "ANIMATION::POSE_CACHE:: skeletons: " << skeletons.size() << "  palettes: " << entries.size() << " (" << bytes() / 1024
+             << " KB)  hits: " << hitCount << "  misses: " << missCount << "  hit rate: " << (lookups ? 100.0 * hitCount / lookups : 0.0)
+             << "%  evictions: " << evictionCount << endl;
+    }
+
+    // drops every palette, at shutdown
+    void clear()
+    {
+        entries.clear();
+        if (ledgerHandle)
+            memoryLedger().removeSource(ledgerHandle);
+        ledgerHandle = 0;
+    }
+
+private:
+    struct Entry {
+        vector<glm::mat4> palette;
+        unsigned long long lastUse;
+    };
+
+    mutex guard;
+    map<string, unsigned int> skeletons;
+    map<uint64_t, Entry> entries;
+    unsigned long long tick;
+    size_t hitCount;
+    size_t missCount;
+    size_t evictionCount;
+    unsigned int ledgerHandle;
+};
+
+inline PoseCache& poseCache()
+{
+    static PoseCache cache;
+    return cache;
+}
+#endif
@@ -0,0 +1,164 @@
+#ifndef PRE_SKINNING_H
+#define PRE_SKINNING_H
+
+#include <glad/glad.h>
+
+#include <boneBuffer.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+using namespace std;
+
+// Optional pre-skinning pass. Without it every draw of a character skins its vertices in anim.vs, so each
+// extra pass over the characters (depth prepass, shadows, picking, reflections) skins them again. With it,
+// once a frame and only for the characters whose pose changed, shaders/skin.vs writes the skinned position,
+// normal and texture coordinates of every vertex to a buffer of the mesh with transform feedback (model
+// space, rasterizer off), and every pass draws that buffer as static geometry (preskinned in anim.vs).
+// It pays off from the second pass on, so it is off by default: MUSEO_PRESKINNING=1 in the environment turns
+// it on. Crowds (crowd.h) keep skinning in anim.vs, their instances would need a buffer each.
+
+#define PRE_SKINNING_SHADER     "shaders/skin.vs"
+#define PRE_SKINNING_STRIDE     8       // floats per skinned vertex: position, normal, texture coordinates
+
+class PreSkinning {
+public:
+    PreSkinning() : program(0), failed(false), enabled(false), paletteLocation(-1), baseLocation(-1), influencesLocation(-1),
+                    previousProgram(0)
+    {
+        const char *preskinning = getenv("MUSEO_PRESKINNING");
+        if (preskinning && strcmp(preskinning, "1") == 0)
+            enabled = true;
+        resetCounts();
+    }
+
+    void setEnabled(bool on)
+    {
+        enabled = on;
+    }
+
+    // on, and its program built (the first call compiles it); when it fails the characters keep skinning in anim.vs
+    bool ready()
+    {
+        if (enabled && program == 0 && !failed)
+            build();
+        return enabled && program != 0;
+    }
+
+    // before the meshes of one character write their vertices; the bone buffer is uploaded and bound
+    void begin(unsigned int paletteBase, int influences)
+    {
+        glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+        glUseProgram(program);
+        glUniform1i(paletteLocation, BONE_BUFFER_UNIT);
+        glUniform1i(baseLocation, (GLint)paletteBase);
+        glUniform1i(influencesLocation, influences);
+        glEnable(GL_RASTERIZER_DISCARD);
+    }
+
+    void end(unsigned int vertices)
+    {
+        glDisable(GL_RASTERIZER_DISCARD);
+        glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, 0);
+        glBindVertexArray(0);
+        glUseProgram((GLuint)previousProgram);
+        skinned++;
+        skinnedVertices += vertices;
+    }
+
+    // a character drew the vertices skinned on an earlier frame, its pose didn't change
+    void reused()
+    {
+        reuses++;
+    }
+
+    // characters skinned and reused since the last report
+    void printReport()
+    {
+        cout << "ANIMATION::PRE_SKINNING:: skinned: " << skinned << " (" << skinnedVertices << " vertices)  reused: " << reuses
+             << (enabled ? "" : "  (off)") << endl;
+        resetCounts();
+    }
+
+    void release()
+    {
+        glDeleteProgram(program);
+        program = 0;
+        failed = false;
+    }
+
+private:
+    GLuint program;
+    bool failed;
+    bool enabled;
+    GLint paletteLocation;
+    GLint baseLocation;
+    GLint influencesLocation;
+    GLint previousProgram;
+    size_t skinned;
+    size_t skinnedVertices;
+    size_t reuses;
+
+    void resetCounts()
+    {
+        skinned = skinnedVertices = reuses = 0;
+    }
+
+    // the varyings have to be named before the program is linked, so it isn't built with Shader
+    void build()
+    {
+        failed = true;
+        ifstream file(PRE_SKINNING_SHADER);
+        if (!file)
+        {
+            cout << "ERROR::PRE_SKINNING:: could not read " << PRE_SKINNING_SHADER << endl;
+            return;
+        }
+        stringstream stream;
+        stream << file.rdbuf();
+        string code = stream.str();
+        const char *source = code.c_str();
+        GLuint shader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(shader, 1, &source, NULL);
+        glCompileShader(shader);
+        GLint success = 0;
+        char log[1024];
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success)
+        {
+            glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+            cout << "ERROR::PRE_SKINNING:: " << PRE_SKINNING_SHADER << "\n" << log << endl;
+            glDeleteShader(shader);
+            return;
+        }
+        program = glCreateProgram();
+        glAttachShader(program, shader);
+        const char *varyings[] = { "skinnedPosition", "skinnedNormal", "skinnedTexCoords" };
+        glTransformFeedbackVaryings(program, 3, varyings, GL_INTERLEAVED_ATTRIBS);
+        glLinkProgram(program);
+        glDeleteShader(shader);
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success)
+        {
+            glGetProgramInfoLog(program, sizeof(log), NULL, log);
+            cout << "ERROR::PRE_SKINNING:: " << log << endl;
+            glDeleteProgram(program);
+            program = 0;
+            return;
+        }
+        paletteLocation = glGetUniformLocation(program, "bone_palette");
+        baseLocation = glGetUniformLocation(program, "bone_base");
+        influencesLocation = glGetUniformLocation(program, "bone_influences");
+        failed = false;
+    }
+};
+
+inline PreSkinning& preSkinning()
+{
+    static PreSkinning skinning;
+    return skinning;
+}
+#endif
@@ -0,0 +1,1001 @@
+#ifndef TEXTURE_COOKER_H
+#define TEXTURE_COOKER_H
+
+#include <glad/glad.h>
+
+#include <mappedFile.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTURE_COOK_SSE2
+#endif
+
+// Texture cooker: turns a decoded RGBA8 image into a block-compressed texture with its whole mip chain
+// and stores it as a KTX2 file, so later runs upload it with glCompressedTexImage2D and skip the JPEG/PNG
+// decode and glGenerateMipmap altogether.
+//   BC1  opaque color (8 bytes per 4x4 block, 1/8 of RGBA8)
+//   BC3  color with alpha (16 bytes per block)
+//   BC5  normal maps, X and Y in two BC4 channels (Z is rebuilt in the shader)
+//   BC7  color with or without alpha when S3TC isn't available (mode 6 only), if BPTC is
+//   RGBA8 for whatever the GPU can't sample compressed
+// Cooked files live in TEXTURE_COOK_DIRECTORY and are named after the hash of the source file, so a
+// copy of an image in another folder reuses the same file and an edited image gets a new one.
+// The encoders are plain CPU code (no GL) and split the blocks of big levels among threads.
+
+#ifndef TEXTURE_COOK_DIRECTORY
+#define TEXTURE_COOK_DIRECTORY "resources/cache/textures"
+#endif
+
+// below this many blocks a level is encoded on the calling thread
+#define TEXTURE_COOK_PARALLEL_BLOCKS 4096
+
+// S3TC is an extension, glad only loads the core profile
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT  0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+enum CookedFormat {
+    COOKED_RGBA8,
+    COOKED_BC1,
+    COOKED_BC3,
+    COOKED_BC5,
+    COOKED_BC7
+};
+
+// what a texture is sampled as, it decides the compressed format
+enum TextureUsage {
+    TEXTURE_USAGE_COLOR,
+    TEXTURE_USAGE_NORMAL
+};
+
+struct CookedTexture {
+    CookedFormat format;
+    unsigned int width;
+    unsigned int height;
+    vector<unsigned char> data;         // every level, level 0 first
+    vector<size_t> levelOffsets;
+    vector<size_t> levelSizes;
+
+    CookedTexture() : format(COOKED_RGBA8), width(0), height(0) {}
+
+    size_t levels() const { return levelSizes.size(); }
+};
+
+inline size_t cookedBlockBytes(CookedFormat format)
+{
+    switch (format)
+    {
+    case COOKED_BC1: return 8;
+    case COOKED_BC3: case COOKED_BC5: case COOKED_BC7: return 16;
+    default: return 4;      // one RGBA8 texel
+    }
+}
+
+inline size_t cookedLevelSize(CookedFormat format, unsigned int width, unsigned int height)
+{
+    if (format == COOKED_RGBA8)
+        return (size_t)width * height * 4;
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * cookedBlockBytes(format);
+}
+
+inline const char *cookedFormatName(CookedFormat format)
+{
+    switch (format)
+    {
+    case COOKED_BC1: return "BC1";
+    case COOKED_BC3: return "BC3";
+    case COOKED_BC5: return "BC5";
+    case COOKED_BC7: return "BC7";
+    default: return "RGBA8";
+    }
+}
+
+/*  Block encoders. Each takes the 16 RGBA texels of a 4x4 block, row by row.  */
+
+inline uint16_t cookPack565(const float *color)
+{
+    int r = (int)(std::max)(0.0f, (std::min)(31.0f, color[0] * 31.0f / 255.0f + 0.5f));
+    int g = (int)(std::max)(0.0f, (std::min)(63.0f, color[1] * 63.0f / 255.0f + 0.5f));
+    int b = (int)(std::max)(0.0f, (std::min)(31.0f, color[2] * 31.0f / 255.0f + 0.5f));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+inline void cookUnpack565(uint16_t packed, int *color)
+{
+    int r = (packed >> 11) & 31, g = (packed >> 5) & 63, b = packed & 31;
+    color[0] = (r << 3) | (r >> 2);
+    color[1] = (g << 2) | (g >> 4);
+    color[2] = (b << 3) | (b >> 2);
+}
+
+// principal axis of the block colors (channels components) by power iteration on their covariance
+inline void cookPrincipalAxis(const unsigned char *texels, int channels, float *mean, float *axis)
+{
+    float covariance[4][4] = {};
+    for (int c = 0; c < channels; c++)
+    {
+        mean[c] = 0.0f;
+        for (int i = 0; i < 16; i++)
+            mean[c] += texels[i * 4 + c];
+        mean[c] /= 16.0f;
+    }
+    for (int i = 0; i < 16; i++)
+        for (int a = 0; a < channels; a++)
+            for (int b = 0; b < channels; b++)
+                covariance[a][b] += (texels[i * 4 + a] - mean[a]) * (texels[i * 4 + b] - mean[b]);
+
+    // start from the channel with the biggest spread
+    int widest = 0;
+    for (int c = 1; c < channels; c++)
+        if (covariance[c][c] > covariance[widest][widest])
+            widest = c;
+    for (int c = 0; c < channels; c++)
+        axis[c] = c == widest ? 1.0f : 0.0f;
+    for (int iteration = 0; iteration < 8; iteration++)
+    {
+        float next[4] = {}, length = 0.0f;
+        for (int a = 0; a < channels; a++)
+        {
+            for (int b = 0; b < channels; b++)
+                next[a] += covariance[a][b] * axis[b];
+            length = (std::max)(length, fabsf(next[a]));
+        }
+        if (length < 1e-6f)
+            break;
+        for (int c = 0; c < channels; c++)
+            axis[c] = next[c] / length;
+    }
+    float length = 0.0f;
+    for (int c = 0; c < channels; c++)
+        length += axis[c] * axis[c];
+    length = sqrtf(length);
+    for (int c = 0; c < channels; c++)
+        axis[c] = length > 0.0f ? axis[c] / length : 0.0f;
+}
+
+// BC1 in four color mode: endpoints on the principal axis, one least squares refit, nearest palette entry
+inline void encodeBC1Block(const unsigned char *texels, unsigned char *out)
+{
+    float mean[4], axis[4];
+    cookPrincipalAxis(texels, 3, mean, axis);
+    float lowest = 1e9f, highest = -1e9f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < 3; c++)
+            t += (texels[i * 4 + c] - mean[c]) * axis[c];
+        lowest = (std::min)(lowest, t);
+        highest = (std::max)(highest, t);
+    }
+    // pull the endpoints in a little, the extremes are rarely hit exactly
+    float inset = (highest - lowest) / 16.0f;
+    float end0[3], end1[3];
+    for (int c = 0; c < 3; c++)
+    {
+        end0[c] = mean[c] + axis[c] * (highest - inset);
+        end1[c] = mean[c] + axis[c] * (lowest + inset);
+    }
+
+    // the refit of the second pass is kept only if it lowers the error: on nearly flat blocks the least squares
+    // endpoints can land far outside the colors of the block
+    uint16_t color0 = 0, color1 = 0, bestColor0 = 0, bestColor1 = 0;
+    unsigned char indices[16] = {}, bestIndices[16] = {};
+    int bestTotal = 1 << 30;
+    for (int pass = 0; pass < 2; pass++)
+    {
+        color0 = cookPack565(end0);
+        color1 = cookPack565(end1);
+        if (color0 < color1)
+            std::swap(color0, color1);
+        int palette[4][3];
+        cookUnpack565(color0, palette[0]);
+        cookUnpack565(color1, palette[1]);
+        for (int c = 0; c < 3; c++)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        int total = 0;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = 1 << 30;
+            for (int p = 0; p < 4; p++)
+            {
+                int error = 0;
+                for (int c = 0; c < 3; c++)
+                {
+                    int d = texels[i * 4 + c] - palette[p][c];
+                    error += d * d;
+                }
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = p;
+                }
+            }
+            indices[i] = (unsigned char)best;
+            total += bestError;
+        }
+        if (total < bestTotal)
+        {
+            bestTotal = total;
+            bestColor0 = color0;
+            bestColor1 = color1;
+            memcpy(bestIndices, indices, 16);
+        }
+        if (color0 == color1 || pass == 1)
+            break;
+
+        // least squares endpoints for the chosen indices: texel = w * end0 + (1 - w) * end1
+        static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+        float aa = 0.0f, bb = 0.0f, ab = 0.0f, ax[3] = {}, bx[3] = {};
+        for (int i = 0; i < 16; i++)
+        {
+            float w = weights[indices[i]];
+            aa += w * w;
+            bb += (1.0f - w) * (1.0f - w);
+            ab += w * (1.0f - w);
+            for (int c = 0; c < 3; c++)
+            {
+                ax[c] += w * texels[i * 4 + c];
+                bx[c] += (1.0f - w) * texels[i * 4 + c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if (fabsf(determinant) < 1e-6f)
+            break;
+        for (int c = 0; c < 3; c++)
+        {
+            end0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+            end1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+        }
+    }
+
+    color0 = bestColor0;
+    color1 = bestColor1;
+    uint32_t bits = 0;
+    if (color0 != color1)
+        for (int i = 0; i < 16; i++)
+            bits |= (uint32_t)bestIndices[i] << (2 * i);
+    out[0] = (unsigned char)(color0 & 0xFF);
+    out[1] = (unsigned char)(color0 >> 8);
+    out[2] = (unsigned char)(color1 & 0xFF);
+    out[3] = (unsigned char)(color1 >> 8);
+    memcpy(out + 4, &bits, 4);
+}
+
+// BC4 for one channel (stride bytes apart) in the eight value mode
+inline void encodeBC4Block(const unsigned char *values, int stride, unsigned char *out)
+{
+    int lowest = 255, highest = 0;
+    for (int i = 0; i < 16; i++)
+    {
+        lowest = (std::min)(lowest, (int)values[i * stride]);
+        highest = (std::max)(highest, (int)values[i * stride]);
+    }
+    out[0] = (unsigned char)highest;
+    out[1] = (unsigned char)lowest;
+    uint64_t bits = 0;
+    if (highest != lowest)
+    {
+        int palette[8];
+        palette[0] = highest;
+        palette[1] = lowest;
+        for (int k = 2; k < 8; k++)
+            palette[k] = ((8 - k) * highest + (k - 1) * lowest) / 7;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0, bestError = 1 << 30;
+            for (int k = 0; k < 8; k++)
+            {
+                int error = abs(values[i * stride] - palette[k]);
+                if (error < bestError)
+                {
+                    bestError = error;
+                    best = k;
+                }
+            }
+            bits |= (uint64_t)best << (3 * i);
+        }
+    }
+    for (int b = 0; b < 6; b++)
+        out[2 + b] = (unsigned char)(bits >> (8 * b));
+}
+
+inline void encodeBC3Block(const unsigned char *texels, unsigned char *out)
+{
+    encodeBC4Block(texels + 3, 4, out);
+    encodeBC1Block(texels, out + 8);
+}
+
+inline void encodeBC5Block(const unsigned char *texels, unsigned char *out)
+{
+    encodeBC4Block(texels, 4, out);
+    encodeBC4Block(texels + 1, 4, out + 8);
+}
+
+// appends count bits of value to a 128 bit block, least significant bit first
+inline void cookPutBits(unsigned char *block, int &position, uint32_t value, int count)
+{
+    for (int i = 0; i < count; i++, position++)
+        if (value & (1u << i))
+            block[position >> 3] |= (unsigned char)(1 << (position & 7));
+}
+
+// BC7 mode 6: one subset, RGBA endpoints of 7 bits plus a shared bit each, 4 bit indices
+inline void encodeBC7Block(const unsigned char *texels, unsigned char *out)
+{
+    static const int weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+    float mean[4], axis[4];
+    cookPrincipalAxis(texels, 4, mean, axis);
+    float lowest = 1e9f, highest = -1e9f;
+    for (int i = 0; i < 16; i++)
+    {
+        float t = 0.0f;
+        for (int c = 0; c < 4; c++)
+            t += (texels[i * 4 + c] - mean[c]) * axis[c];
+        lowest = (std::min)(lowest, t);
+        highest = (std::max)(highest, t);
+    }
+
+    // quantize each endpoint to 7 bits + the p bit that reproduces it best
+    int quantized[2][4], pbits[2], endpoints[2][4];
+    for (int e = 0; e < 2; e++)
+    {
+        float target[4];
+        for (int c = 0; c < 4; c++)
+            target[c] = (std::max)(0.0f, (std::min)(255.0f, mean[c] + axis[c] * (e == 0 ? lowest : highest)));
+        int bestError = 1 << 30;
+        for (int p = 0; p < 2; p++)
+        {
+            int q[4], error = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                q[c] = (int)((target[c] - p) / 2.0f + 0.5f);
+                q[c] = (std::max)(0, (std::min)(127, q[c]));
+                int d = (int)target[c] - ((q[c] << 1) | p);
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                pbits[e] = p;
+                memcpy(quantized[e], q, sizeof(q));
+            }
+        }
+        for (int c = 0; c < 4; c++)
+            endpoints[e][c] = (quantized[e][c] << 1) | pbits[e];
+    }
+
+    int palette[16][4];
+    for (int k = 0; k < 16; k++)
+        for (int c = 0; c < 4; c++)
+            palette[k][c] = ((64 - weights[k]) * endpoints[0][c] + weights[k] * endpoints[1][c] + 32) >> 6;
+    int indices[16];
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0, bestError = 1 << 30;
+        for (int k = 0; k < 16; k++)
+        {
+            int error = 0;
+            for (int c = 0; c < 4; c++)
+            {
+                int d = texels[i * 4 + c] - palette[k][c];
+                error += d * d;
+            }
+            if (error < bestError)
+            {
+                bestError = error;
+                best = k;
+            }
+        }
+        indices[i] = best;
+    }
+    // the first index is stored with 3 bits, its top bit has to be 0
+    if (indices[0] >= 8)
+    {
+        for (int c = 0; c < 4; c++)
+            std::swap(quantized[0][c], quantized[1][c]);
+        std::swap(pbits[0], pbits[1]);
+        for (int i = 0; i < 16; i++)
+            indices[i] = 15 - indices[i];
+    }
+
+    memset(out, 0, 16);
+    int position = 0;
+    cookPutBits(out, position, 1u << 6, 7);     // mode 6
+    for (int c = 0; c < 4; c++)
+    {
+        cookPutBits(out, position, (uint32_t)quantized[0][c], 7);
+        cookPutBits(out, position, (uint32_t)quantized[1][c], 7);
+    }
+    cookPutBits(out, position, (uint32_t)pbits[0], 1);
+    cookPutBits(out, position, (uint32_t)pbits[1], 1);
+    cookPutBits(out, position, (uint32_t)indices[0], 3);
+    for (int i = 1; i < 16; i++)
+        cookPutBits(out, position, (uint32_t)indices[i], 4);
+}
+
+// encodes one mip level. Blocks over the edge of the image repeat its last row/column.
+inline void cookEncodeLevel(CookedFormat format, const unsigned char *rgba, unsigned int width, unsigned int height, unsigned char *out)
+{
+    if (format == COOKED_RGBA8)
+    {
+        memcpy(out, rgba, (size_t)width * height * 4);
+        return;
+    }
+    unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+    size_t blockBytes = cookedBlockBytes(format);
+
+    auto encodeRows = [=](unsigned int firstRow, unsigned int lastRow)
+    {
+        unsigned char texels[64];
+        for (unsigned int by = firstRow; by < lastRow; by++)
+            for (unsigned int bx = 0; bx < blocksX; bx++)
+            {
+                for (unsigned int y = 0; y < 4; y++)
+                    for (unsigned int x = 0; x < 4; x++)
+                    {
+                        unsigned int sx = (std::min)(bx * 4 + x, width - 1), sy = (std::min)(by * 4 + y, height - 1);
+                        memcpy(texels + (y * 4 + x) * 4, rgba + ((size_t)sy * width + sx) * 4, 4);
+                    }
+                unsigned char *block = out + ((size_t)by * blocksX + bx) * blockBytes;
+                switch (format)
+                {
+                case COOKED_BC1: encodeBC1Block(texels, block); break;
+                case COOKED_BC3: encodeBC3Block(texels, block); break;
+                case COOKED_BC5: encodeBC5Block(texels, block); break;
+                default: encodeBC7Block(texels, block); break;
+                }
+            }
+    };
+
+    unsigned int threads = std::thread::hardware_concurrency();
+    if (threads < 1)
+        threads = 1;
+    if ((size_t)blocksX * blocksY < TEXTURE_COOK_PARALLEL_BLOCKS || threads == 1)
+    {
+        encodeRows(0, blocksY);
+        return;
+    }
+    threads = (std::min)(threads, blocksY);
+    unsigned int rowsPerThread = (blocksY + threads - 1) / threads;
+    vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned int t = 1; t < threads; t++)
+    {
+        unsigned int first = t * rowsPerThread, last = (std::min)(blocksY, first + rowsPerThread);
+        if (first < last)
+            workers.push_back(std::thread(encodeRows, first, last));
+    }
+    encodeRows(0, (std::min)(blocksY, rowsPerThread));
+    for (unsigned int t = 0; t < workers.size(); t++)
+        workers[t].join();
+}
+
+// box filtered half size level (a side of 1 stays 1). The SSE2 path averages four target texels (two 16 byte
+// loads per source row) at a time with the same rounding as the scalar one, which finishes each row
+inline void cookDownsample(const unsigned char *source, unsigned int width, unsigned int height, vector<unsigned char> &target)
+{
+    unsigned int w = (std::max)(1u, width / 2), h = (std::max)(1u, height / 2);
+    target.resize((size_t)w * h * 4);
+    for (unsigned int y = 0; y < h; y++)
+    {
+        unsigned int y0 = (std::min)(y * 2, height - 1), y1 = (std::min)(y * 2 + 1, height - 1);
+        unsigned int x = 0;
+#ifdef TEXTURE_COOK_SSE2
+        const unsigned char *row0 = source + (size_t)y0 * width * 4, *row1 = source + (size_t)y1 * width * 4;
+        unsigned char *out = &target[(size_t)y * w * 4];
+        const __m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2);
+        for (; x + 4 <= w && x * 2 + 8 <= width; x += 4)
+        {
+            __m128i sums[2];
+            for (int half = 0; half < 2; half++)
+            {
+                __m128i a = _mm_loadu_si128((const __m128i*)(row0 + (x * 2 + half * 4) * 4));
+                __m128i b = _mm_loadu_si128((const __m128i*)(row1 + (x * 2 + half * 4) * 4));
+                // texels 0,1 and 2,3 of both rows as 16 bit channels
+                __m128i low = _mm_add_epi16(_mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+                __m128i high = _mm_add_epi16(_mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+                low = _mm_add_epi16(low, _mm_srli_si128(low, 8));
+                high = _mm_add_epi16(high, _mm_srli_si128(high, 8));
+                sums[half] = _mm_srli_epi16(_mm_add_epi16(_mm_unpacklo_epi64(low, high), two), 2);
+            }
+            _mm_storeu_si128((__m128i*)(out + x * 4), _mm_packus_epi16(sums[0], sums[1]));
+        }
+#endif
+        for (; x < w; x++)
+        {
+            unsigned int x0 = (std::min)(x * 2, width - 1), x1 = (std::min)(x * 2 + 1, width - 1);
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = source[((size_t)y0 * width + x0) * 4 + c] + source[((size_t)y0 * width + x1) * 4 + c] +
+                          source[((size_t)y1 * width + x0) * 4 + c] + source[((size_t)y1 * width + x1) * 4 + c];
+                target[((size_t)y * w + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+inline void cookDownsample(const vector<unsigned char> &source, unsigned int width, unsigned int height, vector<unsigned char> &target)
+{
+    cookDownsample(source.data(), width, height, target);
+}
+
+// halves a decoded image up to halvings times, as long as its longer side stays at least minSize. The result is
+// in target, with its size in width and height; false (and target untouched) if it is kept as it is
+inline bool cookDownscale(const unsigned char *rgba, unsigned int &width, unsigned int &height, unsigned int halvings,
+                          unsigned int minSize, vector<unsigned char> &target)
+{
+    vector<unsigned char> next;
+    bool scaled = false;
+    for (; halvings > 0 && (std::max)(width, height) / 2 >= minSize; halvings--)
+    {
+        cookDownsample(scaled ? target.data() : rgba, width, height, next);
+        target.swap(next);
+        width = (std::max)(1u, width / 2);
+        height = (std::max)(1u, height / 2);
+        scaled = true;
+    }
+    return scaled;
+}
+
+// averaged normals get shorter, bring them back to unit length
+inline void cookRenormalize(vector<unsigned char> &rgba)
+{
+    for (size_t i = 0; i + 3 < rgba.size(); i += 4)
+    {
+        float n[3], length = 0.0f;
+        for (int c = 0; c < 3; c++)
+        {
+            n[c] = rgba[i + c] / 127.5f - 1.0f;
+            length += n[c] * n[c];
+        }
+        length = sqrtf(length);
+        if (length < 1e-4f)
+            continue;
+        for (int c = 0; c < 3; c++)
+            rgba[i + c] = (unsigned char)(std::max)(0.0f, (std::min)(255.0f, (n[c] / length + 1.0f) * 127.5f + 0.5f));
+    }
+}
+
+// bump maps are often plain height maps: only treat an image as a normal map if it is colored and mostly blue
+inline bool cookIsNormalMap(const unsigned char *rgba, size_t texels)
+{
+    size_t samples = 0, blue = 0;
+    bool gray = true;
+    for (size_t i = 0; i < texels; i += 97, samples++)
+    {
+        const unsigned char *t = rgba + i * 4;
+        gray = gray && t[0] == t[1] && t[1] == t[2];
+        blue += t[2];
+    }
+    return !gray && samples > 0 && blue / samples > 160;
+}
+
+// whether a GPU with (s3tc) or without S3TC and with (bptc) or without BPTC samples format. RGTC (BC5) is
+// core since 3.0
+inline bool cookedFormatUsable(CookedFormat format, bool s3tc, bool bptc)
+{
+    if (format == COOKED_BC1 || format == COOKED_BC3)
+        return s3tc;
+    return format != COOKED_BC7 || bptc;
+}
+
+// picks the format for an RGBA8 image: normal maps BC5, opaque color BC1, color with alpha BC3.
+// BC7 replaces BC1/BC3 when the GPU has no S3TC, RGBA8 when it has no BPTC either.
+inline CookedFormat chooseCookedFormat(const unsigned char *rgba, size_t texels, TextureUsage usage, bool s3tc, bool bptc)
+{
+    if (usage == TEXTURE_USAGE_NORMAL)
+        return COOKED_BC5;
+    bool alpha = false;
+    for (size_t i = 0; i < texels && !alpha; i++)
+        alpha = rgba[i * 4 + 3] != 255;
+    if (!s3tc)
+        return bptc ? COOKED_BC7 : COOKED_RGBA8;
+    return alpha ? COOKED_BC3 : COOKED_BC1;
+}
+
+// cooks an RGBA8 image and its whole mip chain (down to 1x1) in the given format
+inline void cookTexture(const unsigned char *rgba, unsigned int width, unsigned int height, CookedFormat format, TextureUsage usage, CookedTexture &cooked)
+{
+    cooked.format = format;
+    cooked.width = width;
+    cooked.height = height;
+    cooked.data.clear();
+    cooked.levelOffsets.clear();
+    cooked.levelSizes.clear();
+
+    size_t total = 0;
+    for (unsigned int w = width, h = height;; w = (std::max)(1u, w / 2), h = (std::max)(1u, h / 2))
+    {
+        cooked.levelOffsets.push_back(total);
+        cooked.levelSizes.push_back(cookedLevelSize(format, w, h));
+        total += cooked.levelSizes.back();
+        if (w == 1 && h == 1)
+            break;
+    }
+    cooked.data.resize(total);
+
+    vector<unsigned char> level(rgba, rgba + (size_t)width * height * 4), next;
+    if (usage == TEXTURE_USAGE_NORMAL)
+        cookRenormalize(level);
+    unsigned int w = width, h = height;
+    for (size_t l = 0; l < cooked.levels(); l++)
+    {
+        cookEncodeLevel(format, &level[0], w, h, &cooked.data[cooked.levelOffsets[l]]);
+        if (l + 1 == cooked.levels())
+            break;
+        cookDownsample(level, w, h, next);
+        if (usage == TEXTURE_USAGE_NORMAL)
+            cookRenormalize(next);
+        level.swap(next);
+        w = (std::max)(1u, w / 2);
+        h = (std::max)(1u, h / 2);
+    }
+}
+
+/*  KTX2 container  */
+
+static const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+
+// Vulkan formats of the cooked textures
+inline uint32_t cookedVkFormat(CookedFormat format)
+{
+    switch (format)
+    {
+    case COOKED_BC1: return 131;    // VK_FORMAT_BC1_RGB_UNORM_BLOCK
+    case COOKED_BC3: return 137;    // VK_FORMAT_BC3_UNORM_BLOCK
+    case COOKED_BC5: return 141;    // VK_FORMAT_BC5_UNORM_BLOCK
+    case COOKED_BC7: return 145;    // VK_FORMAT_BC7_UNORM_BLOCK
+    default: return 37;             // VK_FORMAT_R8G8B8A8_UNORM
+    }
+}
+
+inline bool cookedFormatFromVk(uint32_t vkFormat, CookedFormat &format)
+{
+    const CookedFormat formats[5] = { COOKED_RGBA8, COOKED_BC1, COOKED_BC3, COOKED_BC5, COOKED_BC7 };
+    for (int i = 0; i < 5; i++)
+        if (cookedVkFormat(formats[i]) == vkFormat)
+        {
+            format = formats[i];
+            return true;
+        }
+    return false;
+}
+
+inline void ktxPut32(vector<unsigned char> &out, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+        out.push_back((unsigned char)(value >> (8 * i)));
+}
+
+inline void ktxPut64(vector<unsigned char> &out, uint64_t value)
+{
+    ktxPut32(out, (uint32_t)value);
+    ktxPut32(out, (uint32_t)(value >> 32));
+}
+
+// basic data format descriptor: color model, block size and one sample per channel
+inline void ktxDataFormatDescriptor(CookedFormat format, vector<unsigned char> &dfd)
+{
+    struct Sample { uint16_t offset; uint8_t length; uint8_t channel; uint32_t upper; };
+    Sample samples[4];
+    int sampleCount = 0;
+    uint8_t model;
+    switch (format)
+    {
+    case COOKED_BC1:
+        model = 128;    // KHR_DF_MODEL_BC1A
+        samples[sampleCount++] = Sample{ 0, 63, 0, 0xFFFFFFFFu };
+        break;
+    case COOKED_BC3:
+        model = 130;    // KHR_DF_MODEL_BC3
+        samples[sampleCount++] = Sample{ 0, 63, 15, 0xFFFFFFFFu };
+        samples[sampleCount++] = Sample{ 64, 63, 0, 0xFFFFFFFFu };
+        break;
+    case COOKED_BC5:
+        model = 132;    // KHR_DF_MODEL_BC5
+        samples[sampleCount++] = Sample{ 0, 63, 0, 0xFFFFFFFFu };
+        samples[sampleCount++] = Sample{ 64, 63, 1, 0xFFFFFFFFu };
+        break;
+    case COOKED_BC7:
+        model = 134;    // KHR_DF_MODEL_BC7
+        samples[sampleCount++] = Sample{ 0, 127, 0, 0xFFFFFFFFu };
+        break;
+    default:
+        model = 1;      // KHR_DF_MODEL_RGBSDA
+        samples[sampleCount++] = Sample{ 0, 7, 0, 255 };
+        samples[sampleCount++] = Sample{ 8, 7, 1, 255 };
+        samples[sampleCount++] = Sample{ 16, 7, 2, 255 };
+        samples[sampleCount++] = Sample{ 24, 7, 15, 255 };
+        break;
+    }
+    bool block = format != COOKED_RGBA8;
+    uint32_t blockSize = 24 + 16 * sampleCount;
+
+    dfd.clear();
+    ktxPut32(dfd, 4 + blockSize);
+    ktxPut32(dfd, 0);                           // Khronos vendor, basic descriptor type
+    ktxPut32(dfd, 2 | (blockSize << 16));       // version 1.3, descriptor block size
+    dfd.push_back(model);
+    dfd.push_back(1);                           // BT.709 primaries
+    dfd.push_back(1);                           // linear transfer, the textures are sampled as UNORM
+    dfd.push_back(0);                           // straight alpha
+    dfd.push_back(block ? 3 : 0);               // block dimensions minus one
+    dfd.push_back(block ? 3 : 0);
+    dfd.push_back(0);
+    dfd.push_back(0);
+    ktxPut32(dfd, (uint32_t)cookedBlockBytes(format));  // bytes of plane 0
+    ktxPut32(dfd, 0);
+    for (int i = 0; i < sampleCount; i++)
+    {
+        dfd.push_back((unsigned char)(samples[i].offset & 0xFF));
+        dfd.push_back((unsigned char)(samples[i].offset >> 8));
+        dfd.push_back(samples[i].length);
+        dfd.push_back(samples[i].channel);
+        ktxPut32(dfd, 0);                       // sample position
+        ktxPut32(dfd, 0);                       // lower
+        ktxPut32(dfd, samples[i].upper);
+    }
+}
+
+inline bool writeKtx2(const string &path, const CookedTexture &cooked)
+{
+    size_t levels = cooked.levels();
+    size_t alignment = cookedBlockBytes(cooked.format) == 8 ? 8 : 16;   // lcm(block size, 4)
+    vector<unsigned char> dfd;
+    ktxDataFormatDescriptor(cooked.format, dfd);
+
+    size_t headerSize = 12 + 9 * 4 + 4 * 4 + 2 * 8 + levels * 24;
+    size_t dfdOffset = headerSize;
+    size_t offset = dfdOffset + dfd.size();
+
+    // levels are stored smallest first, the level index lists them from level 0
+    vector<size_t> fileOffsets(levels);
+    for (size_t l = levels; l-- > 0;)
+    {
+        offset = (offset + alignment - 1) / alignment * alignment;
+        fileOffsets[l] = offset;
+        offset += cooked.levelSizes[l];
+    }
+
+    vector<unsigned char> header(KTX2_IDENTIFIER, KTX2_IDENTIFIER + 12);
+    ktxPut32(header, cookedVkFormat(cooked.format));
+    ktxPut32(header, 1);                    // typeSize
+    ktxPut32(header, cooked.width);
+    ktxPut32(header, cooked.height);
+    ktxPut32(header, 0);                    // pixelDepth
+    ktxPut32(header, 0);                    // layerCount
+    ktxPut32(header, 1);                    // faceCount
+    ktxPut32(header, (uint32_t)levels);
+    ktxPut32(header, 0);                    // no supercompression
+    ktxPut32(header, (uint32_t)dfdOffset);
+    ktxPut32(header, (uint32_t)dfd.size());
+    ktxPut32(header, 0);                    // no key/value data
+    ktxPut32(header, 0);
+    ktxPut64(header, 0);                    // no supercompression global data
+    ktxPut64(header, 0);
+    for (size_t l = 0; l < levels; l++)
+    {
+        ktxPut64(header, fileOffsets[l]);
+        ktxPut64(header, cooked.levelSizes[l]);
+        ktxPut64(header, cooked.levelSizes[l]);
+    }
+
+    // written to a temporary name first so an interrupted run never leaves half a file behind
+    string temporary = path + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(&header[0], 1, header.size(), file) == header.size() &&
+              fwrite(&dfd[0], 1, dfd.size(), file) == dfd.size();
+    size_t written = header.size() + dfd.size();
+    static const unsigned char padding[16] = {};
+    for (size_t l = levels; ok && l-- > 0;)
+    {
+        ok = fwrite(padding, 1, fileOffsets[l] - written, file) == fileOffsets[l] - written &&
+             fwrite(&cooked.data[cooked.levelOffsets[l]], 1, cooked.levelSizes[l], file) == cooked.levelSizes[l];
+        written = fileOffsets[l] + cooked.levelSizes[l];
+    }
+    ok = fclose(file) == 0 && ok;
+    remove(path.c_str());
+    if (!ok || rename(temporary.c_str(), path.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+inline uint32_t ktxGet32(const unsigned char *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+inline uint64_t ktxGet64(const unsigned char *p)
+{
+    return (uint64_t)ktxGet32(p) | ((uint64_t)ktxGet32(p + 4) << 32);
+}
+
+// reads a KTX2 file written by writeKtx2 (single 2D image, no supercompression)
+inline bool readKtx2(const string &path, CookedTexture &cooked)
+{
+    MappedFile file;
+    if (!file.open(path) || file.size() < 80)
+        return false;
+    const unsigned char *data = (const unsigned char*)file.data();
+    if (memcmp(data, KTX2_IDENTIFIER, 12) != 0 || !cookedFormatFromVk(ktxGet32(data + 12), cooked.format))
+        return false;
+    cooked.width = ktxGet32(data + 20);
+    cooked.height = ktxGet32(data + 24);
+    uint32_t levels = ktxGet32(data + 40);
+    if (cooked.width == 0 || cooked.height == 0 || ktxGet32(data + 28) > 1 || ktxGet32(data + 32) > 1 || ktxGet32(data + 36) != 1 ||
+        ktxGet32(data + 44) != 0 || levels == 0 || levels > 32 || 80 + (size_t)levels * 24 > file.size())
+        return false;
+
+    cooked.levelOffsets.resize(levels);
+    cooked.levelSizes.resize(levels);
+    size_t total = 0;
+    unsigned int w = cooked.width, h = cooked.height;
+    for (uint32_t l = 0; l < levels; l++)
+    {
+        cooked.levelOffsets[l] = total;
+        cooked.levelSizes[l] = cookedLevelSize(cooked.format, w, h);
+        total += cooked.levelSizes[l];
+        w = (std::max)(1u, w / 2);
+        h = (std::max)(1u, h / 2);
+    }
+    cooked.data.resize(total);
+    for (uint32_t l = 0; l < levels; l++)
+    {
+        const unsigned char *entry = data + 80 + l * 24;
+        uint64_t offset = ktxGet64(entry), length = ktxGet64(entry + 8);
+        if (length != cooked.levelSizes[l] || offset > file.size() || length > file.size() - offset)
+            return false;
+        memcpy(&cooked.data[cooked.levelOffsets[l]], data + offset, length);
+    }
+    return true;
+}
+
+inline bool makeDirectories(const string &path)
+{
+    for (size_t slash = path.find('/'); ; slash = path.find('/', slash + 1))
+    {
+        string prefix = path.substr(0, slash);
+        if (!prefix.empty())
+        {
+#ifdef _WIN32
+            _mkdir(prefix.c_str());
+#else
+            mkdir(prefix.c_str(), 0755);
+#endif
+        }
+        if (slash == string::npos)
+            break;
+    }
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// cooked file for a source image; usage is part of the name since it changes the format, and so are the halvings
+// of the quality tier (textureQuality.h)
+inline string cookedTexturePath(uint64_t contentHash, size_t contentLength, TextureUsage usage, unsigned int halvings = 0)
+{
+    char name[64], tier[8] = "";
+    if (halvings > 0)
+        snprintf(tier, sizeof(tier), "_d%u", halvings);
+    snprintf(name, sizeof(name), "%016llx_%llx%s%s.ktx2", (unsigned long long)contentHash, (unsigned long long)contentLength,
+             usage == TEXTURE_USAGE_NORMAL ? "_n" : "", tier);
+    return string(TEXTURE_COOK_DIRECTORY) + '/' + name;
+}
+
+/*  GL side  */
+
+inline bool hasGLExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (extension && strcmp(extension, name) == 0)
+            return true;
+    }
+    return false;
+}
+
+inline bool s3tcSupported()
+{
+    static int supported = -1;
+    if (supported < 0)
+        supported = hasGLExtension("GL_EXT_texture_compression_s3tc") ? 1 : 0;
+    return supported == 1;
+}
+
+// BPTC (BC7) is core since 4.2, the context may be older
+inline bool bptcSupported()
+{
+    static int supported = -1;
+    if (supported < 0)
+        supported = GLAD_GL_VERSION_4_2 || hasGLExtension("GL_ARB_texture_compression_bptc") ||
+                    hasGLExtension("GL_EXT_texture_compression_bptc") ? 1 : 0;
+    return supported == 1;
+}
+
+inline bool cookedFormatSupported(CookedFormat format)
+{
+    return cookedFormatUsable(format, s3tcSupported(), bptcSupported());
+}
+
+inline GLenum cookedGLFormat(CookedFormat format)
+{
+    switch (format)
+    {
+    case COOKED_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case COOKED_BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    case COOKED_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case COOKED_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return GL_RGBA8;
+    }
+}
+
+// GPU bytes of every model texture (full mip chain), indexed by texture id
+inline map<unsigned int, size_t>& textureGpuBytes()
+{
+    static map<unsigned int, size_t> bytes;
+    return bytes;
+}
+
+// uploads every level of a cooked texture into a new texture object, returns 0 if GL rejected it
+inline unsigned int uploadCookedTexture(const CookedTexture &cooked, size_t *gpuBytes = nullptr)
+{
+    if (!cookedFormatSupported(cooked.format))
+        return 0;
+    for (int i = 0; i < 16 && glGetError() != GL_NO_ERROR; i++)
+        ;   // errors left by earlier calls
+    unsigned int textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    unsigned int w = cooked.width, h = cooked.height;
+    for (size_t l = 0; l < cooked.levels(); l++)
+    {
+        const unsigned char *level = &cooked.data[cooked.levelOffsets[l]];
+        if (cooked.format == COOKED_RGBA8)
+            glTexImage2D(GL_TEXTURE_2D, (GLint)l, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, level);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, (GLint)l, cookedGLFormat(cooked.format), w, h, 0, (GLsizei)cooked.levelSizes[l], level);
+        w = (std::max)(1u, w / 2);
+        h = (std::max)(1u, h / 2);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)cooked.levels() - 1);
+    if (glGetError() != GL_NO_ERROR)
+    {
+        glDeleteTextures(1, &textureID);
+        return 0;
+    }
+    if (gpuBytes)
+        *gpuBytes = cooked.data.size();
+    return textureID;
+}
+#endif
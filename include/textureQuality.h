@@ -0,0 +1,122 @@
+#ifndef TEXTURE_QUALITY_H
+#define TEXTURE_QUALITY_H
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+using namespace std;
+
+// Texture quality tiers, chosen once at startup.
+// A tier is the number of halvings applied to an image when it is decoded, before it is cooked (format and
+// mip chain, see textureCooker.h) and uploaded: full keeps it as it is, half drops to 1/4 of the memory and
+// quarter to 1/16. The cooked copy is stored per tier, so switching tiers doesn't decode the images again.
+// Every model texture belongs to a category taken from the folder of the model; the tier comes from
+// MUSEO_TEXTURE_QUALITY (full, half or quarter) and each category can override it with
+// MUSEO_TEXTURE_QUALITY_<CATEGORY>. Paintings stay at full unless asked otherwise: they are what visitors
+// walk up to. Images are never halved below TEXTURE_QUALITY_MIN_SIZE.
+
+#define TEXTURE_QUALITY_MIN_SIZE 256
+
+enum TextureQualityTier {
+    TEXTURE_QUALITY_FULL,
+    TEXTURE_QUALITY_HALF,
+    TEXTURE_QUALITY_QUARTER,
+    TEXTURE_QUALITY_TIERS
+};
+
+enum TextureCategory {
+    TEXTURE_CATEGORY_PAINTING,
+    TEXTURE_CATEGORY_ARCHITECTURE,
+    TEXTURE_CATEGORY_PROP,
+    TEXTURE_CATEGORY_FOLIAGE,
+    TEXTURE_CATEGORIES
+};
+
+inline const char *textureQualityName(unsigned int tier)
+{
+    static const char *names[TEXTURE_QUALITY_TIERS] = { "full", "half", "quarter" };
+    return tier < TEXTURE_QUALITY_TIERS ? names[tier] : "?";
+}
+
+inline const char *textureCategoryName(TextureCategory category)
+{
+    static const char *names[TEXTURE_CATEGORIES] = { "painting", "architecture", "prop", "foliage" };
+    return names[category];
+}
+
+// category of the textures of a model, from where its file lives under resources/objects
+inline TextureCategory textureCategoryOf(const string &modelPath)
+{
+    string path = modelPath;
+    for (size_t i = 0; i < path.size(); i++)
+        if (path[i] == '\\')
+            path[i] = '/';
+    if (path.find("/Arte/") != string::npos || path.find("/Caballete/pintura") != string::npos)
+        return TEXTURE_CATEGORY_PAINTING;
+    if (path.find("/Museo_Casa_Azul/") != string::npos)
+        return TEXTURE_CATEGORY_ARCHITECTURE;
+    if (path.find("/Plantas/") != string::npos)
+        return TEXTURE_CATEGORY_FOLIAGE;
+    return TEXTURE_CATEGORY_PROP;
+}
+
+class TextureQuality {
+public:
+    TextureQuality()
+    {
+        unsigned int tier = TEXTURE_QUALITY_FULL;
+        parseTier(getenv("MUSEO_TEXTURE_QUALITY"), tier);
+        for (int c = 0; c < TEXTURE_CATEGORIES; c++)
+            tiers[c] = tier;
+        tiers[TEXTURE_CATEGORY_PAINTING] = TEXTURE_QUALITY_FULL;
+
+        static const char *variables[TEXTURE_CATEGORIES] = { "MUSEO_TEXTURE_QUALITY_PAINTING", "MUSEO_TEXTURE_QUALITY_ARCHITECTURE",
+                                                             "MUSEO_TEXTURE_QUALITY_PROP", "MUSEO_TEXTURE_QUALITY_FOLIAGE" };
+        for (int c = 0; c < TEXTURE_CATEGORIES; c++)
+            parseTier(getenv(variables[c]), tiers[c]);
+    }
+
+    // halvings applied to the textures of the category
+    unsigned int tier(TextureCategory category) const
+    {
+        return tiers[category];
+    }
+
+    void setTier(TextureCategory category, TextureQualityTier tier)
+    {
+        tiers[category] = tier;
+    }
+
+    void printSettings() const
+    {
+        cout << "TEXTURE::QUALITY::";
+        for (int c = 0; c < TEXTURE_CATEGORIES; c++)
+            cout << " " << textureCategoryName((TextureCategory)c) << ": " << textureQualityName(tiers[c]);
+        cout << endl;
+    }
+
+private:
+    unsigned int tiers[TEXTURE_CATEGORIES];
+
+    // leaves tier as it is when value is missing or unknown
+    static void parseTier(const char *value, unsigned int &tier)
+    {
+        if (!value)
+            return;
+        for (unsigned int t = 0; t < TEXTURE_QUALITY_TIERS; t++)
+            if (strcmp(value, textureQualityName(t)) == 0)
+            {
+                tier = t;
+                return;
+            }
+        cout << "WARNING::TEXTURE::QUALITY:: unknown tier " << value << ", use full, half or quarter" << endl;
+    }
+};
+
+inline TextureQuality& textureQuality()
+{
+    static TextureQuality quality;
+    return quality;
+}
+#endif
@@ -0,0 +1,311 @@
+#ifndef TEXTURE_REGISTRY_H
+#define TEXTURE_REGISTRY_H
+
+#include <glad/glad.h>
+
+#include <mappedFile.h>
+#include <textureCooker.h>
+#include <materialPacker.h>
+#include <textureStreamer.h>
+#include <textureResidency.h>
+#include <textureQuality.h>
+
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+using namespace std;
+
+// Process-wide registry of the textures loaded from image files (or images embedded in a model, or material
+// packs built from several files).
+// Textures are keyed by a hash of the encoded file contents, so the same image copied into several
+// asset folders is decoded and uploaded only once and every model gets the same GL texture.
+// A path -> content memo lets a repeated path skip reading and hashing the file again.
+// The quality tier is part of the key: an image used at two tiers (a painting and a prop) gets two textures.
+// Each acquire adds a reference; the GL texture is deleted when the last one is released.
+// The maps are guarded by a mutex so the registry can be queried from loader threads, but the
+// upload itself has to happen on the thread that owns the GL context.
+
+// turns an encoded image (PNG, JPEG...) into a new GL texture, halved for the quality tier, 0 if it can't be decoded.
+// contentHash names its cooked copy. Defined in model.h
+unsigned int uploadEncodedTexture(const unsigned char *data, size_t length, uint64_t contentHash, TextureUsage usage, unsigned int halvings, const char *name);
+// same for the packed scalar maps of a material, read from directory. Defined in model.h
+unsigned int uploadMaterialPack(const MaterialPack &pack, const string &directory, uint64_t contentHash, unsigned int halvings, const char *name);
+
+// 64 bit hash of the file contents, 8 bytes at a time
+inline uint64_t textureContentHash(const unsigned char *data, size_t length)
+{
+    const uint64_t m1 = 0xff51afd7ed558ccdull, m2 = 0xc4ceb9fe1a85ec53ull;
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ (length * m1);
+    size_t i = 0;
+    for (; i + 8 <= length; i += 8)
+    {
+        uint64_t k;
+        memcpy(&k, data + i, 8);
+        k *= m1;
+        k ^= k >> 33;
+        h ^= k;
+        h = ((h << 27) | (h >> 37)) * m2;
+    }
+    uint64_t tail = 0;
+    for (size_t shift = 0; i < length; i++, shift += 8)
+        tail |= (uint64_t)data[i] << shift;
+    h ^= tail * m1;
+    h ^= h >> 33;
+    h *= m2;
+    h ^= h >> 29;
+    return h;
+}
+
+class TextureRegistry {
+public:
+    TextureRegistry() : requests(0), pathHits(0), contentHits(0), bytesSaved(0) {}
+
+    // texture with the contents of the image file at path, loading it only the first time those bytes are seen
+    unsigned int acquireFile(const string &path, TextureUsage usage = TEXTURE_USAGE_COLOR, unsigned int halvings = 0)
+    {
+        string key = normalizePath(path) + (usage == TEXTURE_USAGE_NORMAL ? "#normal" : "") + tierSuffix(halvings);
+        {
+            lock_guard<mutex> lock(guard);
+            requests++;
+            map<string, ContentKey>::iterator memo = pathMemo.find(key);
+            if (memo != pathMemo.end())
+            {
+                pathHits++;
+                return addReference(memo->second);
+            }
+        }
+
+        MappedFile file;
+        if (!file.open(path))
+            return 0;
+        const unsigned char *data = (const unsigned char*)file.data();
+        ContentKey content = { textureContentHash(data, file.size()), file.size(), usage, halvings };
+        unsigned int id = acquireContent(content, false, key, [&]() {
+            return uploadEncodedTexture(data, file.size(), content.hash, content.usage, content.halvings, key.c_str());
+        });
+        if (id != 0)
+        {
+            lock_guard<mutex> lock(guard);
+            pathMemo[key] = content;
+        }
+        return id;
+    }
+
+    // same for an encoded image that is already in memory (e.g. embedded in a GLB)
+    unsigned int acquireMemory(const unsigned char *data, size_t length, const char *name, TextureUsage usage = TEXTURE_USAGE_COLOR,
+                               unsigned int halvings = 0)
+    {
+        if (!data || length == 0)
+            return 0;
+        ContentKey content = { textureContentHash(data, length), length, usage, halvings };
+        return acquireContent(content, true, name ? name : "", [&]() {
+            return uploadEncodedTexture(data, length, content.hash, content.usage, content.halvings, name);
+        });
+    }
+
+    // texture packing the scalar maps of a material (materialPacker.h). It is keyed by the contents of all
+    // its maps, so materials of different models that use the same texture set share one pack
+    unsigned int acquireMaterialPack(const MaterialPack &pack, const string &directory, unsigned int halvings = 0)
+    {
+        string key = normalizePath(directory + '/' + materialPackPath(pack)) + tierSuffix(halvings);
+        {
+            lock_guard<mutex> lock(guard);
+            requests++;
+            map<string, ContentKey>::iterator memo = pathMemo.find(key);
+            if (memo != pathMemo.end())
+            {
+                pathHits++;
+                return addReference(memo->second);
+            }
+        }
+
+        const string *maps[5] = { &pack.occlusion, &pack.roughness, &pack.gloss, &pack.metalness, &pack.specular };
+        uint64_t hashes[5] = { 0, 0, 0, 0, 0 };
+        for (int m = 0; m < 5; m++)
+        {
+            MappedFile file;
+            if (!maps[m]->empty() && file.open(directory + '/' + *maps[m]))
+                hashes[m] = textureContentHash((const unsigned char*)file.data(), file.size());
+        }
+        // length 0 keeps packs apart from any encoded file
+        ContentKey content = { textureContentHash((const unsigned char*)hashes, sizeof(hashes)), 0, TEXTURE_USAGE_COLOR, halvings };
+        unsigned int id = acquireContent(content, false, key, [&]() {
+            return uploadMaterialPack(pack, directory, content.hash, content.halvings, key.c_str());
+        });
+        if (id != 0)
+        {
+            lock_guard<mutex> lock(guard);
+            pathMemo[key] = content;
+        }
+        return id;
+    }
+
+    // drops one reference, deleting the GL texture with the last one
+    void release(unsigned int id)
+    {
+        lock_guard<mutex> lock(guard);
+        map<unsigned int, ContentKey>::iterator owner = ids.find(id);
+        if (owner == ids.end())
+            return;
+        map<ContentKey, Entry>::iterator entry = entries.find(owner->second);
+        if (--entry->second.refs > 0)
+            return;
+        for (map<string, ContentKey>::iterator memo = pathMemo.begin(); memo != pathMemo.end();)
+        {
+            if (!(memo->second < owner->second) && !(owner->second < memo->second))
+                pathMemo.erase(memo++);
+            else
+                ++memo;
+        }
+        textureStreamer().cancel(id);
+        textureResidency().forget(id);
+        glDeleteTextures(1, &id);
+        textureGpuBytes().erase(id);
+        entries.erase(entry);
+        ids.erase(owner);
+    }
+
+    // what the texture was first loaded from, for the memory ledger; empty if the registry doesn't own it
+    string nameOf(unsigned int id)
+    {
+        lock_guard<mutex> lock(guard);
+        map<unsigned int, ContentKey>::const_iterator owner = ids.find(id);
+        return owner != ids.end() ? entries[owner->second].name : string();
+    }
+
+    void printReport()
+    {
+        lock_guard<mutex> lock(guard);
+        size_t bytes = 0, tierBytes[TEXTURE_QUALITY_TIERS] = {};
+        unsigned int tierTextures[TEXTURE_QUALITY_TIERS] = {};
+        for (map<ContentKey, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it)
+        {
+            size_t textureBytes = gpuBytes(it->second.id);
+            bytes += textureBytes;
+            unsigned int tier = (std::min)(it->first.halvings, (unsigned int)TEXTURE_QUALITY_TIERS - 1);
+            tierBytes[tier] += textureBytes;
+            tierTextures[tier]++;
+        }
+        cout << "MEMORY::TEXTURES:: unique: " << entries.size() << "  requests: " << requests
+             << "  same path: " << pathHits << "  same content: " << contentHits
+             << "  gpu: " << bytes / (1024 * 1024) << " MB  saved: " << bytesSaved / (1024 * 1024) << " MB" << endl;
+        cout << "MEMORY::TEXTURES:: quality";
+        for (unsigned int t = 0; t < TEXTURE_QUALITY_TIERS; t++)
+            cout << (t ? "  " : " ") << textureQualityName(t) << ": " << tierTextures[t] << " textures " << tierBytes[t] / 1024 << " KB";
+        cout << endl;
+    }
+
+private:
+    // hash and length of the encoded image; the usage is part of the key since it picks the cooked format, and the
+    // halvings of the quality tier since they change the texture
+    struct ContentKey {
+        uint64_t hash;
+        size_t length;
+        TextureUsage usage;
+        unsigned int halvings;
+
+        bool operator<(const ContentKey &other) const
+        {
+            if (hash != other.hash)
+                return hash < other.hash;
+            if (length != other.length)
+                return length < other.length;
+            if (usage != other.usage)
+                return usage < other.usage;
+            return halvings < other.halvings;
+        }
+    };
+
+    struct Entry {
+        unsigned int id;
+        int refs;
+        string name;
+    };
+
+    mutex guard;
+    map<ContentKey, Entry> entries;
+    map<unsigned int, ContentKey> ids;
+    map<string, ContentKey> pathMemo;
+    size_t requests;
+    size_t pathHits;        // requests answered by the path memo
+    size_t contentHits;     // different paths (or embedded images) that turned out to hold known contents
+    size_t bytesSaved;      // GPU bytes of every upload that was avoided
+
+    static string tierSuffix(unsigned int halvings)
+    {
+        return halvings > 0 ? "#" + string(textureQualityName(halvings)) : string();
+    }
+
+    static string normalizePath(const string &path)
+    {
+        string normalized = path;
+        for (size_t i = 0; i < normalized.size(); i++)
+            if (normalized[i] == '\\')
+                normalized[i] = '/';
+        return normalized;
+    }
+
+    // 0 while the texture is still streaming in
+    static size_t gpuBytes(unsigned int id)
+    {
+        map<unsigned int, size_t>::const_iterator bytes = textureGpuBytes().find(id);
+        return bytes != textureGpuBytes().end() ? bytes->second : 0;
+    }
+
+    // guard must be held
+    unsigned int addReference(const ContentKey &content)
+    {
+        map<ContentKey, Entry>::iterator entry = entries.find(content);
+        if (entry == entries.end())
+            return 0;
+        entry->second.refs++;
+        bytesSaved += gpuBytes(entry->second.id);
+        return entry->second.id;
+    }
+
+    // upload creates the texture when these contents haven't been seen before
+    unsigned int acquireContent(const ContentKey &content, bool countRequest, const string &name, const function<unsigned int()> &upload)
+    {
+        {
+            lock_guard<mutex> lock(guard);
+            if (countRequest)
+                requests++;
+            if (entries.count(content))
+            {
+                contentHits++;
+                return addReference(content);
+            }
+        }
+
+        // decode outside the lock, other lookups don't have to wait for it
+        unsigned int id = upload();
+        if (id == 0)
+            return 0;
+        lock_guard<mutex> lock(guard);
+        if (entries.count(content))
+        {
+            // someone else uploaded the same image meanwhile, keep theirs
+            textureStreamer().cancel(id);
+            textureResidency().forget(id);
+            glDeleteTextures(1, &id);
+            textureGpuBytes().erase(id);
+            contentHits++;
+            return addReference(content);
+        }
+        Entry entry = { id, 1, name };
+        entries[content] = entry;
+        ids[id] = content;
+        return id;
+    }
+};
+
+inline TextureRegistry& textureRegistry()
+{
+    static TextureRegistry registry;
+    return registry;
+}
+#endif
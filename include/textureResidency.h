@@ -0,0 +1,246 @@
+#ifndef TEXTURE_RESIDENCY_H
+#define TEXTURE_RESIDENCY_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <textureCooker.h>
+#include <textureStreamer.h>
+#include <gpuResources.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+using namespace std;
+
+// Mip residency of the streamed model textures.
+// Every texture starts with only its levels up to TEXTURE_RESIDENCY_START_SIZE in video memory. While drawing,
+// each mesh reports how many pixels it covers on screen (Model::Draw(shader, model) projects its bounding
+// sphere), which gives the finest level worth having for each of its textures. Once a frame, update() asks
+// the streamer for the missing finer levels -- read back from the cooked KTX2 file -- and frees the ones no
+// longer needed. Textures unused for TEXTURE_RESIDENCY_KEEP_FRAMES go back to the start size, and when the
+// wanted levels don't fit in the budget the least recently used, largest textures give up levels first.
+// The budget is TEXTURE_RESIDENCY_BUDGET_MB, or MUSEO_TEXTURE_BUDGET_MB from the environment, and never more
+// than what the VRAM ledger leaves for textures (gpuResources.h).
+
+#define TEXTURE_RESIDENCY_START_SIZE  64
+#define TEXTURE_RESIDENCY_BUDGET_MB   256
+#define TEXTURE_RESIDENCY_KEEP_FRAMES 300
+#define TEXTURE_RESIDENCY_MAX_LOADS   4     // level requests in flight at once
+
+class TextureResidency {
+public:
+    TextureResidency() : frame(0), pixelScale(0.0f), budget((size_t)TEXTURE_RESIDENCY_BUDGET_MB * 1024 * 1024), levelsEvicted(0)
+    {
+        const char *megabytes = getenv("MUSEO_TEXTURE_BUDGET_MB");
+        if (megabytes && atoi(megabytes) > 0)
+            budget = (size_t)atoi(megabytes) * 1024 * 1024;
+    }
+
+    // a streamed texture whose levels can be read back from cookedPath
+    void track(unsigned int textureID, const string &cookedPath)
+    {
+        Tracked tracked;
+        tracked.cookedPath = cookedPath;
+        tracked.wanted = 0;
+        tracked.lastUse = 0;
+        tracked.requested = false;
+        tracked.requestedLevel = 0;
+        tracked.unavailable = false;
+        textures[textureID] = tracked;
+    }
+
+    void forget(unsigned int textureID)
+    {
+        textures.erase(textureID);
+    }
+
+    // camera of the frame about to be drawn; viewportHeight in pixels
+    void beginFrame(const glm::mat4 &projection, const glm::mat4 &view, float viewportHeight)
+    {
+        this->view = view;
+        pixelScale = 0.5f * viewportHeight * projection[1][1];
+        frame++;
+    }
+
+    // on-screen diameter in pixels of a sphere given in world space, 0 when it is behind the camera
+    float screenSize(const glm::vec3 &center, float radius) const
+    {
+        glm::vec3 eye = glm::vec3(view * glm::vec4(center, 1.0f));
+        if (-eye.z + radius <= 0.0f || pixelScale <= 0.0f)
+            return 0.0f;
+        float distance = (std::max)(glm::length(eye) - radius, 0.1f);
+        return 2.0f * radius * pixelScale / distance;
+    }
+
+    // the texture is drawn this frame covering about pixels on screen (<= 0: full resolution)
+    void use(unsigned int textureID, float pixels)
+    {
+        map<unsigned int, Tracked>::iterator tracked = textures.find(textureID);
+        if (tracked == textures.end())
+            return;
+        TextureStreamer::ResidentLevels levels;
+        unsigned int level = 0;
+        if (pixels > 0.0f && textureStreamer().residentLevels(textureID, levels))
+        {
+            float texels = (float)(std::max)(levels.width, levels.height);
+            level = (unsigned int)(std::max)(0.0f, floorf(log2f(texels / pixels)));
+        }
+        Tracked &texture = tracked->second;
+        if (texture.lastUse != frame || level < texture.wanted)
+            texture.wanted = level;
+        texture.lastUse = frame;
+    }
+
+    // streams in or evicts levels against the budget; main thread, once per frame
+    void update()
+    {
+        if (!textureStreamer().running())
+            return;
+
+        // 1. the finest level each texture should have
+        vector<Target> targets;
+        targets.reserve(textures.size());
+        size_t total = 0;
+        for (map<unsigned int, Tracked>::iterator it = textures.begin(); it != textures.end(); ++it)
+        {
+            TextureStreamer::ResidentLevels levels;
+            if (!textureStreamer().residentLevels(it->first, levels))
+                continue;
+            Tracked &texture = it->second;
+            if (texture.requested && !textureStreamer().streaming(it->first))
+            {
+                // a request that ended without the levels means the cooked file can't be read back
+                texture.requested = false;
+                texture.unavailable = levels.base > texture.requestedLevel;
+            }
+            Target target;
+            target.id = it->first;
+            target.levels = levels;
+            target.start = startLevel(levels);
+            target.level = frame - texture.lastUse < TEXTURE_RESIDENCY_KEEP_FRAMES && texture.lastUse != 0 ?
+                (std::min)(texture.wanted, target.start) : target.start;
+            target.lastUse = texture.lastUse;
+            targets.push_back(target);
+            total += bytesFrom(levels, target.level);
+        }
+
+        // 2. over budget: drop a level of the least recently used texture with the finest level
+        size_t limit = (std::min)(budget, gpuResources().textureBudget());
+        bool overBudget = total > limit;
+        while (total > limit)
+        {
+            Target *victim = nullptr;
+            for (size_t i = 0; i < targets.size(); i++)
+            {
+                Target &candidate = targets[i];
+                if (candidate.level >= candidate.start)
+                    continue;
+                if (!victim || candidate.lastUse < victim->lastUse ||
+                    (candidate.lastUse == victim->lastUse && candidate.level < victim->level))
+                    victim = &candidate;
+            }
+            if (!victim)
+                break;
+            total -= bytesFrom(victim->levels, victim->level) - bytesFrom(victim->levels, victim->level + 1);
+            victim->level++;
+        }
+
+        // 3. apply: finer levels are streamed, coarser ones freed right away
+        unsigned int loads = 0;
+        for (map<unsigned int, Tracked>::const_iterator it = textures.begin(); it != textures.end(); ++it)
+            loads += it->second.requested ? 1 : 0;
+        for (size_t i = 0; i < targets.size(); i++)
+        {
+            Target &target = targets[i];
+            Tracked &texture = textures[target.id];
+            // a level of slack keeps textures at the edge of a mip from going back and forth
+            bool stale = frame - target.lastUse >= TEXTURE_RESIDENCY_KEEP_FRAMES;
+            if (target.level > target.levels.base && (overBudget || stale || target.level > target.levels.base + 1))
+            {
+                levelsEvicted += target.level - target.levels.base;
+                textureStreamer().evict(target.id, target.level);
+            }
+            else if (target.level < target.levels.base && !texture.requested && !texture.unavailable && loads < TEXTURE_RESIDENCY_MAX_LOADS)
+            {
+                string path = texture.cookedPath;
+                // the cooked file of the first request, unless it was cooked for a GPU with other formats
+                texture.requested = textureStreamer().requestLevels(target.id, [path](bool s3tc, bool bptc, CookedTexture &cooked) {
+                    return readKtx2(path, cooked) && cookedFormatUsable(cooked.format, s3tc, bptc);
+                }, path, target.level);
+                texture.requestedLevel = target.level;
+                loads += texture.requested ? 1 : 0;
+            }
+        }
+    }
+
+    void printReport()
+    {
+        size_t bytes = 0, fullBytes = 0;
+        unsigned int resident = 0;
+        for (map<unsigned int, Tracked>::const_iterator it = textures.begin(); it != textures.end(); ++it)
+        {
+            TextureStreamer::ResidentLevels levels;
+            if (!textureStreamer().residentLevels(it->first, levels))
+                continue;
+            resident++;
+            bytes += TextureStreamer::residentBytes(levels);
+            fullBytes += bytesFrom(levels, 0);
+        }
+        cout << "MEMORY::RESIDENCY:: textures: " << resident << "/" << textures.size() << "  resident: " << bytes / (1024 * 1024)
+             << " MB  full resolution: " << fullBytes / (1024 * 1024) << " MB  budget: " << (std::min)(budget, gpuResources().textureBudget()) / (1024 * 1024)
+             << " MB  levels evicted: " << levelsEvicted << endl;
+    }
+
+private:
+    struct Tracked {
+        string cookedPath;
+        unsigned int wanted;        // finest level asked for by the draws of lastUse
+        unsigned int lastUse;       // frame, 0 if never drawn
+        bool requested;             // finer levels on their way
+        unsigned int requestedLevel;
+        bool unavailable;           // they could not be read back, the texture stays as it is
+    };
+
+    struct Target {
+        unsigned int id;
+        TextureStreamer::ResidentLevels levels;
+        unsigned int start;
+        unsigned int level;
+        unsigned int lastUse;
+    };
+
+    map<unsigned int, Tracked> textures;
+    unsigned int frame;
+    glm::mat4 view;
+    float pixelScale;
+    size_t budget;
+    unsigned int levelsEvicted;
+
+    static unsigned int startLevel(const TextureStreamer::ResidentLevels &levels)
+    {
+        unsigned int level = 0;
+        while (level + 1 < levels.levels && (std::max)(levels.width >> level, levels.height >> level) > TEXTURE_RESIDENCY_START_SIZE)
+            level++;
+        return level;
+    }
+
+    static size_t bytesFrom(const TextureStreamer::ResidentLevels &levels, unsigned int base)
+    {
+        TextureStreamer::ResidentLevels from = levels;
+        from.base = base;
+        return TextureStreamer::residentBytes(from);
+    }
+};
+
+inline TextureResidency& textureResidency()
+{
+    static TextureResidency residency;
+    return residency;
+}
+#endif
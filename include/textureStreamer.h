@@ -0,0 +1,555 @@
+#ifndef TEXTURE_STREAMER_H
+#define TEXTURE_STREAMER_H
+
+#include <glad/glad.h>
+
+#include <textureCooker.h>
+#include <gpuResources.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Asynchronous texture uploads through a ring of pixel buffer objects.
+// request() hands back a texture right away (a 1x1 placeholder) and queues the CPU work -- reading the cooked
+// KTX2 or decoding and cooking the image -- on decode threads. They copy the cooked levels into a free slot
+// of one persistently mapped GL_PIXEL_UNPACK_BUFFER and mark it ready. update(), called by the main thread
+// once per frame, issues the glCompressedTex(Sub)Image2D calls from the ready slots up to a byte budget and
+// puts a fence behind each one; the slot is reused once its fence has signaled.
+// Levels are uploaded smallest first and GL_TEXTURE_BASE_LEVEL follows them down, so a texture is always
+// complete and sharpens while it streams in. A level larger than a slot is sent in bands of rows.
+// A request may stop at a maximum size; requestLevels() and evict() later move the finest resident level of
+// such a texture up and down (see textureResidency.h).
+
+#define TEXTURE_STREAM_SLOTS        4
+#define TEXTURE_STREAM_SLOT_BYTES   (8 * 1024 * 1024)
+#define TEXTURE_STREAM_FRAME_BYTES  (8 * 1024 * 1024)   // uploaded per update(); at least one slot always goes
+#define TEXTURE_STREAM_MAX_THREADS  4
+
+class TextureStreamer {
+public:
+    // CPU half of a texture, run on a decode thread. s3tc tells whether BC1/BC3 may be used, bptc BC7
+    typedef function<bool(bool s3tc, bool bptc, CookedTexture &cooked)> CookFunction;
+
+    // levels of a streamed texture currently in video memory: base .. levels - 1
+    struct ResidentLevels {
+        CookedFormat format;
+        unsigned int width;         // of level 0
+        unsigned int height;
+        unsigned int levels;
+        unsigned int base;
+    };
+
+    TextureStreamer() : buffer(0), mapped(nullptr), s3tc(false), bptc(false), stopping(false), nextSerial(1), pendingJobs(0) {}
+
+    bool running() const
+    {
+        return mapped != nullptr;
+    }
+
+    // creates the ring and the decode threads; main thread, with the GL context current
+    bool start(unsigned int threads = 0)
+    {
+        if (running())
+            return true;
+        // persistent mapping is GL 4.4, and glad only loads glBufferStorage for a 4.4 context
+        if (!GLAD_GL_VERSION_4_4 || !glBufferStorage)
+        {
+            cout << "WARNING::STREAM:: could not map the upload ring, textures are uploaded synchronously" << endl;
+            return false;
+        }
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)TEXTURE_STREAM_SLOTS * TEXTURE_STREAM_SLOT_BYTES, nullptr, flags);
+        gpuResources().allocate(GPU_RESOURCE_BUFFER, buffer, (size_t)TEXTURE_STREAM_SLOTS * TEXTURE_STREAM_SLOT_BYTES, "texture upload ring");
+        mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)TEXTURE_STREAM_SLOTS * TEXTURE_STREAM_SLOT_BYTES, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (!mapped)
+        {
+            cout << "WARNING::STREAM:: could not map the upload ring, textures are uploaded synchronously" << endl;
+            gpuResources().release(GPU_RESOURCE_BUFFER, buffer);
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+            return false;
+        }
+
+        s3tc = s3tcSupported();
+        bptc = bptcSupported();
+        slots.assign(TEXTURE_STREAM_SLOTS, Slot());
+        stopping = false;
+        if (threads == 0)
+        {
+            unsigned int cores = std::thread::hardware_concurrency();
+            threads = (std::min)((std::max)(cores, 2u) - 1, (unsigned int)TEXTURE_STREAM_MAX_THREADS);
+        }
+        for (unsigned int i = 0; i < threads; i++)
+            workers.emplace_back(&TextureStreamer::work, this);
+        return true;
+    }
+
+    // texture that will hold the image cook produces. Until then it is a 1x1 texture of the placeholder color.
+    // With maxSize only the levels up to that size are uploaded. The texture is left bound so the caller can
+    // set its sampling parameters
+    unsigned int request(const unsigned char placeholder[4], const CookFunction &cook, const string &name, unsigned int maxSize = 0)
+    {
+        unsigned int textureID;
+        glGenTextures(1, &textureID);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, placeholder);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+
+        Job job = { nextSerial++, textureID, cook, name, maxSize, 0, -1, COOKED_RGBA8, 0, 0, true };
+        queue(job);
+        return textureID;
+    }
+
+    // uploads the levels from firstLevel up to the current base of a texture whose first request is complete.
+    // cook has to produce the same image (e.g. by reading its cooked file back). False if nothing was queued
+    bool requestLevels(unsigned int textureID, const CookFunction &cook, const string &name, unsigned int firstLevel)
+    {
+        map<unsigned int, ResidentLevels>::const_iterator levels = resident.find(textureID);
+        if (levels == resident.end() || streaming(textureID) || firstLevel >= levels->second.base)
+            return false;
+        const ResidentLevels &current = levels->second;
+        Job job = { nextSerial++, textureID, cook, name, 0, (int)firstLevel, (int)current.base - 1, current.format, current.width, current.height, true };
+        queue(job);
+        return true;
+    }
+
+    // frees the levels finer than firstLevel; main thread
+    void evict(unsigned int textureID, unsigned int firstLevel)
+    {
+        map<unsigned int, ResidentLevels>::iterator levels = resident.find(textureID);
+        if (levels == resident.end() || streaming(textureID) || firstLevel <= levels->second.base)
+            return;
+        ResidentLevels &current = levels->second;
+        firstLevel = (std::min)(firstLevel, current.levels - 1);
+        glBindTexture(GL_TEXTURE_2D, textureID);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, firstLevel);
+        // a zero sized image releases the storage of a level
+        for (unsigned int level = current.base; level < firstLevel; level++)
+            glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, 0, 0, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        current.base = firstLevel;
+        textureGpuBytes()[textureID] = residentBytes(current);
+    }
+
+    // false while the first request of the texture is still streaming (or it isn't a streamed texture)
+    bool residentLevels(unsigned int textureID, ResidentLevels &levels) const
+    {
+        map<unsigned int, ResidentLevels>::const_iterator found = resident.find(textureID);
+        if (found == resident.end())
+            return false;
+        levels = found->second;
+        return true;
+    }
+
+    bool streaming(unsigned int textureID)
+    {
+        lock_guard<mutex> lock(guard);
+        return serials.count(textureID) != 0;
+    }
+
+    static size_t residentBytes(const ResidentLevels &levels)
+    {
+        size_t bytes = 0;
+        for (unsigned int level = levels.base; level < levels.levels; level++)
+            bytes += cookedLevelSize(levels.format, (std::max)(1u, levels.width >> level), (std::max)(1u, levels.height >> level));
+        return bytes;
+    }
+
+    // forgets the uploads still pending for a texture that is about to be deleted
+    void cancel(unsigned int textureID)
+    {
+        resident.erase(textureID);
+        lock_guard<mutex> lock(guard);
+        map<unsigned int, unsigned int>::iterator serial = serials.find(textureID);
+        if (serial == serials.end())
+            return;
+        cancelled.insert(serial->second);
+        serials.erase(serial);
+    }
+
+    // recycles the slots the GPU is done with and uploads ready slots worth up to budget bytes; main thread
+    void update(size_t budget = TEXTURE_STREAM_FRAME_BYTES)
+    {
+        if (!running())
+            return;
+        vector<int> batch;
+        vector<bool> live;
+        vector<Job> completed;
+        {
+            lock_guard<mutex> lock(guard);
+            bool freed = false;
+            for (size_t s = 0; s < slots.size(); s++)
+            {
+                if (slots[s].state != SLOT_IN_FLIGHT)
+                    continue;
+                GLenum status = glClientWaitSync(slots[s].fence, 0, 0);
+                if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+                    continue;
+                glDeleteSync(slots[s].fence);
+                slots[s].fence = 0;
+                slots[s].state = SLOT_FREE;
+                freed = true;
+            }
+            size_t spent = 0;
+            while (!ready.empty() && (batch.empty() || spent < budget))
+            {
+                int s = ready.front();
+                ready.pop_front();
+                for (size_t p = 0; p < slots[s].pieces.size(); p++)
+                    spent += slots[s].pieces[p].bytes;
+                batch.push_back(s);
+                live.push_back(cancelled.count(slots[s].serial) == 0);
+            }
+            completed.swap(finished);
+            if (freed)
+                slotFreed.notify_all();
+        }
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        for (size_t b = 0; b < batch.size(); b++)
+            if (live[b])
+                uploadSlot(batch[b]);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+        {
+            lock_guard<mutex> lock(guard);
+            bool freed = false;
+            for (size_t b = 0; b < batch.size(); b++)
+            {
+                Slot &slot = slots[batch[b]];
+                slot.state = slot.fence ? SLOT_IN_FLIGHT : SLOT_FREE;
+                freed = freed || !slot.fence;
+                if (slot.last && live[b])
+                {
+                    ResidentLevels levels = { slot.format, slot.width, slot.height, slot.levels, slot.firstLevel };
+                    resident[slot.texture] = levels;
+                    textureGpuBytes()[slot.texture] = residentBytes(levels);
+                }
+                if (slot.last)
+                    finishJob(slot.serial, slot.texture);
+            }
+            for (size_t f = 0; f < completed.size(); f++)
+            {
+                if (!completed[f].ok)
+                    cout << "Texture failed to load: " << completed[f].name << endl;
+                finishJob(completed[f].serial, completed[f].texture);
+            }
+            if (freed)
+                slotFreed.notify_all();
+        }
+    }
+
+    // textures requested but not completely uploaded yet
+    size_t pending()
+    {
+        lock_guard<mutex> lock(guard);
+        return pendingJobs;
+    }
+
+    // uploads everything requested so far, without a budget; main thread
+    void finish()
+    {
+        while (running() && pending() > 0)
+        {
+            update((size_t)-1);
+            std::this_thread::yield();
+        }
+    }
+
+    // joins the decode threads and releases the ring. Textures still streaming keep their placeholder
+    void stop()
+    {
+        if (!running())
+            return;
+        {
+            lock_guard<mutex> lock(guard);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        slotFreed.notify_all();
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+        workers.clear();
+        for (size_t s = 0; s < slots.size(); s++)
+            if (slots[s].fence)
+                glDeleteSync(slots[s].fence);
+        slots.clear();
+        jobs.clear();
+        ready.clear();
+        finished.clear();
+        resident.clear();
+        serials.clear();
+        cancelled.clear();
+        pendingJobs = 0;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        gpuResources().release(GPU_RESOURCE_BUFFER, buffer);
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        mapped = nullptr;
+    }
+
+private:
+    struct Job {
+        unsigned int serial;        // tells a texture apart from a later one that reuses its name
+        unsigned int texture;
+        CookFunction cook;
+        string name;
+        unsigned int maxSize;       // finest level uploaded, by size (0 for all of them)
+        int firstLevel;             // levels uploaded, -1 up to the smallest
+        int lastLevel;
+        CookedFormat format;        // what the resident levels are, for requestLevels
+        unsigned int width;
+        unsigned int height;
+        bool ok;                    // false when cook failed
+    };
+
+    // rows [y, y + rows) of one level, at offset in the slot
+    struct Piece {
+        unsigned int level;
+        unsigned int y;
+        unsigned int rows;
+        size_t offset;
+        size_t bytes;
+    };
+
+    enum SlotState { SLOT_FREE, SLOT_FILLING, SLOT_READY, SLOT_IN_FLIGHT };
+
+    struct Slot {
+        SlotState state;
+        GLsync fence;
+        unsigned int serial;
+        unsigned int texture;
+        CookedFormat format;
+        unsigned int width;         // of level 0
+        unsigned int height;
+        unsigned int levels;
+        unsigned int firstLevel;    // finest level of the job
+        bool last;                  // the job is complete once this slot is uploaded
+        vector<Piece> pieces;
+
+        Slot() : state(SLOT_FREE), fence(0), serial(0), texture(0), format(COOKED_RGBA8), width(0), height(0), levels(0), firstLevel(0), last(false) {}
+    };
+
+    GLuint buffer;
+    unsigned char *mapped;
+    bool s3tc;
+    bool bptc;
+    bool stopping;
+    unsigned int nextSerial;
+    size_t pendingJobs;
+
+    mutex guard;
+    condition_variable jobReady;
+    condition_variable slotFreed;
+    vector<thread> workers;
+    vector<Slot> slots;
+    deque<Job> jobs;
+    deque<int> ready;               // filled slots, in the order they have to be uploaded
+    vector<Job> finished;           // jobs that ended without a slot (failed, or nothing to upload)
+    map<unsigned int, unsigned int> serials;    // texture -> serial of its job, while it is streaming
+    set<unsigned int> cancelled;
+    map<unsigned int, ResidentLevels> resident; // main thread only
+
+    void queue(const Job &job)
+    {
+        {
+            lock_guard<mutex> lock(guard);
+            jobs.push_back(job);
+            serials[job.texture] = job.serial;
+            pendingJobs++;
+        }
+        jobReady.notify_one();
+    }
+
+    // guard must be held
+    void finishJob(unsigned int serial, unsigned int texture)
+    {
+        map<unsigned int, unsigned int>::iterator current = serials.find(texture);
+        if (current != serials.end() && current->second == serial)
+            serials.erase(current);
+        cancelled.erase(serial);
+        pendingJobs--;
+    }
+
+    void work()
+    {
+        for (;;)
+        {
+            Job job;
+            {
+                unique_lock<mutex> lock(guard);
+                jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+                if (stopping)
+                    return;
+                job = jobs.front();
+                jobs.pop_front();
+                if (cancelled.count(job.serial))
+                {
+                    finishJob(job.serial, job.texture);
+                    continue;
+                }
+            }
+
+            CookedTexture cooked;
+            job.ok = job.cook(s3tc, bptc, cooked) && cooked.levels() > 0;
+            if (job.ok && job.lastLevel >= 0)
+                job.ok = cooked.format == job.format && cooked.width == job.width && cooked.height == job.height;
+            if (!job.ok || !stream(job, cooked))
+            {
+                lock_guard<mutex> lock(guard);
+                finished.push_back(job);
+            }
+        }
+    }
+
+    // copies the levels of the job into ring slots, smallest level first. False if there was nothing to copy
+    bool stream(const Job &job, const CookedTexture &cooked)
+    {
+        int last = job.lastLevel >= 0 ? (std::min)(job.lastLevel, (int)cooked.levels() - 1) : (int)cooked.levels() - 1;
+        int first = (std::max)(job.firstLevel, 0);
+        while (job.maxSize > 0 && first < last && (std::max)(cooked.width >> first, cooked.height >> first) > job.maxSize)
+            first++;
+        if (first > last)
+            return false;
+
+        int slot = -1;
+        size_t used = 0;
+        for (int level = last; level >= first; level--)
+        {
+            unsigned int height = (std::max)(1u, cooked.height >> level);
+            // a row of blocks for the compressed formats
+            unsigned int rowPixels = cooked.format == COOKED_RGBA8 ? 1 : 4;
+            unsigned int rowCount = (height + rowPixels - 1) / rowPixels;
+            size_t rowBytes = cooked.levelSizes[level] / rowCount;
+            const unsigned char *data = &cooked.data[cooked.levelOffsets[level]];
+            for (unsigned int row = 0; row < rowCount;)
+            {
+                if (slot < 0 || used + rowBytes > TEXTURE_STREAM_SLOT_BYTES)
+                {
+                    if (slot >= 0)
+                        submit(slot, false);
+                    slot = acquireSlot(job, cooked, first);
+                    if (slot < 0)
+                        return true;
+                    used = 0;
+                }
+                unsigned int rows = (unsigned int)(std::min)((size_t)(rowCount - row), (TEXTURE_STREAM_SLOT_BYTES - used) / rowBytes);
+                Piece piece;
+                piece.level = (unsigned int)level;
+                piece.y = row * rowPixels;
+                piece.rows = (std::min)(height - piece.y, rows * rowPixels);
+                piece.offset = used;
+                piece.bytes = rows * rowBytes;
+                memcpy(mapped + (size_t)slot * TEXTURE_STREAM_SLOT_BYTES + used, data + row * rowBytes, piece.bytes);
+                slots[slot].pieces.push_back(piece);
+                used += piece.bytes;
+                row += rows;
+            }
+        }
+        submit(slot, true);
+        return true;
+    }
+
+    // waits for a free slot, -1 when the streamer is stopping
+    int acquireSlot(const Job &job, const CookedTexture &cooked, int firstLevel)
+    {
+        unique_lock<mutex> lock(guard);
+        int found = -1;
+        slotFreed.wait(lock, [&]() {
+            for (size_t s = 0; s < slots.size() && found < 0; s++)
+                if (slots[s].state == SLOT_FREE)
+                    found = (int)s;
+            return stopping || found >= 0;
+        });
+        if (stopping)
+            return -1;
+        Slot &slot = slots[found];
+        slot.state = SLOT_FILLING;
+        slot.serial = job.serial;
+        slot.texture = job.texture;
+        slot.format = cooked.format;
+        slot.width = cooked.width;
+        slot.height = cooked.height;
+        slot.levels = (unsigned int)cooked.levels();
+        slot.firstLevel = (unsigned int)firstLevel;
+        slot.last = false;
+        slot.pieces.clear();
+        return found;
+    }
+
+    void submit(int slot, bool last)
+    {
+        lock_guard<mutex> lock(guard);
+        slots[slot].last = last;
+        slots[slot].state = SLOT_READY;
+        ready.push_back(slot);
+    }
+
+    // GL calls for one ready slot, with the ring bound as GL_PIXEL_UNPACK_BUFFER
+    void uploadSlot(int s)
+    {
+        Slot &slot = slots[s];
+        GLenum format = cookedGLFormat(slot.format);
+        glBindTexture(GL_TEXTURE_2D, slot.texture);
+        for (size_t p = 0; p < slot.pieces.size(); p++)
+        {
+            const Piece &piece = slot.pieces[p];
+            GLsizei w = (GLsizei)(std::max)(1u, slot.width >> piece.level), h = (GLsizei)(std::max)(1u, slot.height >> piece.level);
+            const void *offset = (const void*)((size_t)s * TEXTURE_STREAM_SLOT_BYTES + piece.offset);
+            bool whole = piece.y == 0 && (GLsizei)piece.rows == h;
+            if (!whole && piece.y == 0)
+            {
+                // first band of a level: allocate it, with the ring unbound so that nullptr means no data
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                if (slot.format == COOKED_RGBA8)
+                    glTexImage2D(GL_TEXTURE_2D, piece.level, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+                else
+                    glCompressedTexImage2D(GL_TEXTURE_2D, piece.level, format, w, h, 0, (GLsizei)cookedLevelSize(slot.format, w, h), nullptr);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+            }
+            if (slot.format == COOKED_RGBA8)
+            {
+                if (whole)
+                    glTexImage2D(GL_TEXTURE_2D, piece.level, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+                else
+                    glTexSubImage2D(GL_TEXTURE_2D, piece.level, 0, piece.y, w, piece.rows, GL_RGBA, GL_UNSIGNED_BYTE, offset);
+            }
+            else
+            {
+                if (whole)
+                    glCompressedTexImage2D(GL_TEXTURE_2D, piece.level, format, w, h, 0, (GLsizei)piece.bytes, offset);
+                else
+                    glCompressedTexSubImage2D(GL_TEXTURE_2D, piece.level, 0, piece.y, w, piece.rows, format, (GLsizei)piece.bytes, offset);
+            }
+            if (piece.y + piece.rows == (unsigned int)h)
+            {
+                // the level is complete: sample from it down to the smallest one
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, piece.level);
+                glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, slot.levels - 1);
+            }
+        }
+        slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+};
+
+inline TextureStreamer& textureStreamer()
+{
+    static TextureStreamer streamer;
+    return streamer;
+}
+#endif
@@ -0,0 +1,308 @@
+#ifndef VERTEX_CONVERT_H
+#define VERTEX_CONVERT_H
+
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include <mesh.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define VERTEX_CONVERT_SSE2
+#endif
+
+// Converts the attribute streams of an aiMesh (one array per attribute) into our interleaved
+// Vertex array. The SSE2 path moves every attribute with one unaligned 4-float load and store:
+// the stores are issued in increasing offset order, so the extra lane each one writes is
+// overwritten by the next attribute (or, for the bitangent, by the position of the next vertex).
+// That is why the last vertex of a range always takes the scalar path: its bitangent store would
+// spill into a vertex that belongs to another range (and its loads would read past the streams).
+// Missing streams read from a zero block with stride 0, so there are no branches per vertex.
+// AVX is not worth it here: every attribute is 3 floats wide, so 8-wide registers only add
+// shuffles, and the loop is bound by memory bandwidth anyway.
+
+// below this many vertices a mesh is converted on the calling thread
+#define VERTEX_CONVERT_PARALLEL_THRESHOLD 65536
+
+static_assert(sizeof(Vertex) == 14 * sizeof(float), "vertexConvert assumes Vertex is 14 tightly packed floats");
+static_assert(offsetof(Vertex, Normal) == 3 * sizeof(float) && offsetof(Vertex, TexCoords) == 6 * sizeof(float) &&
+              offsetof(Vertex, Tangent) == 8 * sizeof(float) && offsetof(Vertex, Bitangent) == 11 * sizeof(float),
+              "vertexConvert assumes the Vertex member order of mesh.h");
+
+struct VertexStreams {
+    const float *positions;
+    const float *normals;
+    const float *texCoords;
+    const float *tangents;
+    const float *bitangents;
+    size_t normalStride;        // 3 when the stream exists, 0 when it points at the zero block
+    size_t texCoordStride;
+    size_t tangentStride;
+};
+
+inline const float *vertexConvertZeros()
+{
+    static const float zeros[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+    return zeros;
+}
+
+inline VertexStreams vertexStreamsOf(const aiMesh *mesh)
+{
+    VertexStreams streams;
+    const float *zeros = vertexConvertZeros();
+    bool hasNormals = mesh->HasNormals();
+    // a vertex can contain up to 8 different texture coordinates, we always take the first set (0)
+    bool hasTexCoords = mesh->mTextureCoords[0] != nullptr;
+    bool hasTangents = mesh->HasTangentsAndBitangents();
+    streams.positions = &mesh->mVertices[0].x;
+    streams.normals = hasNormals ? &mesh->mNormals[0].x : zeros;
+    streams.texCoords = hasTexCoords ? &mesh->mTextureCoords[0][0].x : zeros;
+    streams.tangents = hasTangents ? &mesh->mTangents[0].x : zeros;
+    streams.bitangents = hasTangents ? &mesh->mBitangents[0].x : zeros;
+    streams.normalStride = hasNormals ? 3 : 0;
+    streams.texCoordStride = hasTexCoords ? 3 : 0;
+    streams.tangentStride = hasTangents ? 3 : 0;
+    return streams;
+}
+
+inline void convertVertexScalar(const VertexStreams &s, size_t i, Vertex &vertex)
+{
+    const float *p = s.positions + i * 3;
+    const float *n = s.normals + i * s.normalStride;
+    const float *t = s.texCoords + i * s.texCoordStride;
+    const float *tg = s.tangents + i * s.tangentStride;
+    const float *bt = s.bitangents + i * s.tangentStride;
+    vertex.Position = glm::vec3(p[0], p[1], p[2]);
+    vertex.Normal = glm::vec3(n[0], n[1], n[2]);
+    vertex.TexCoords = glm::vec2(t[0], t[1]);
+    vertex.Tangent = glm::vec3(tg[0], tg[1], tg[2]);
+    vertex.Bitangent = glm::vec3(bt[0], bt[1], bt[2]);
+}
+
+// converts vertices [begin, end) into out[begin, end). Ranges may run concurrently as long as they don't overlap.
+inline void convertVertexRange(const VertexStreams &s, Vertex *out, size_t begin, size_t end)
+{
+    if (begin >= end)
+        return;
+#ifdef VERTEX_CONVERT_SSE2
+    float *dst = &out[begin].Position.x;
+    for (size_t i = begin; i + 1 < end; i++, dst += 14)
+    {
+        _mm_storeu_ps(dst + 0, _mm_loadu_ps(s.positions + i * 3));
+        _mm_storeu_ps(dst + 3, _mm_loadu_ps(s.normals + i * s.normalStride));
+        _mm_storeu_ps(dst + 6, _mm_loadu_ps(s.texCoords + i * s.texCoordStride));
+        _mm_storeu_ps(dst + 8, _mm_loadu_ps(s.tangents + i * s.tangentStride));
+        _mm_storeu_ps(dst + 11, _mm_loadu_ps(s.bitangents + i * s.tangentStride));
+    }
+    convertVertexScalar(s, end - 1, out[end - 1]);
+#else
+    for (size_t i = begin; i < end; i++)
+        convertVertexScalar(s, i, out[i]);
+#endif
+}
+
+// fills vertices with the converted mesh, splitting big meshes in chunks over several threads
+inline void convertVertices(const aiMesh *mesh, vector<Vertex> &vertices, unsigned int maxThreads = 0)
+{
+    size_t count = mesh->mNumVertices;
+    vertices.resize(count);
+    if (count == 0)
+        return;
+    VertexStreams streams = vertexStreamsOf(mesh);
+
+    unsigned int threads = maxThreads ? maxThreads : std::thread::hardware_concurrency();
+    if (threads < 1)
+        threads = 1;
+    if (count < VERTEX_CONVERT_PARALLEL_THRESHOLD || threads == 1)
+    {
+        convertVertexRange(streams, vertices.data(), 0, count);
+        return;
+    }
+    size_t maxChunks = count / (VERTEX_CONVERT_PARALLEL_THRESHOLD / 4);
+    if (threads > maxChunks)
+        threads = (unsigned int)maxChunks;
+
+    size_t chunk = (count + threads - 1) / threads;
+    vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned int t = 1; t < threads; t++)
+    {
+        size_t begin = t * chunk;
+        size_t end = (std::min)(count, begin + chunk);
+        workers.emplace_back(convertVertexRange, std::cref(streams), vertices.data(), begin, end);
+    }
+    convertVertexRange(streams, vertices.data(), 0, (std::min)(count, chunk));
+    for (size_t t = 0; t < workers.size(); t++)
+        workers[t].join();
+}
+
+// smooth per-vertex normals (area weighted) for geometry that comes without them
+inline void computeVertexNormals(vector<Vertex> &vertices, const vector<unsigned int> &indices)
+{
+    for (size_t v = 0; v < vertices.size(); v++)
+        vertices[v].Normal = glm::vec3(0.0f);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        Vertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+        glm::vec3 normal = glm::cross(b.Position - a.Position, c.Position - a.Position);
+        a.Normal += normal; b.Normal += normal; c.Normal += normal;
+    }
+    for (size_t v = 0; v < vertices.size(); v++)
+    {
+        float length = glm::length(vertices[v].Normal);
+        vertices[v].Normal = length > 1e-12f ? vertices[v].Normal / length : glm::vec3(0.0f, 1.0f, 0.0f);
+    }
+}
+
+// per-vertex tangent space like aiProcess_CalcTangentSpace: face tangents (from the unflipped UVs)
+// summed over the faces sharing a vertex, then made orthogonal to the normal.
+// Expects Tangent and Bitangent to start at zero.
+inline void computeTangentSpace(vector<Vertex> &vertices, const vector<unsigned int> &indices)
+{
+    for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    {
+        Vertex &a = vertices[indices[i]], &b = vertices[indices[i + 1]], &c = vertices[indices[i + 2]];
+        glm::vec3 e1 = b.Position - a.Position, e2 = c.Position - a.Position;
+        float s1 = b.TexCoords.x - a.TexCoords.x, t1 = a.TexCoords.y - b.TexCoords.y;
+        float s2 = c.TexCoords.x - a.TexCoords.x, t2 = a.TexCoords.y - c.TexCoords.y;
+        float direction = (t2 * s1 - s2 * t1) < 0.0f ? -1.0f : 1.0f;
+        glm::vec3 tangent = (e1 * t2 - e2 * t1) * direction;
+        glm::vec3 bitangent = (e2 * s1 - e1 * s2) * direction;
+        float tangentLength = glm::length(tangent), bitangentLength = glm::length(bitangent);
+        if (!(tangentLength > 1e-12f) || !(bitangentLength > 1e-12f))
+            continue;
+        tangent /= tangentLength;
+        bitangent /= bitangentLength;
+        a.Tangent += tangent; b.Tangent += tangent; c.Tangent += tangent;
+        a.Bitangent += bitangent; b.Bitangent += bitangent; c.Bitangent += bitangent;
+    }
+    for (size_t v = 0; v < vertices.size(); v++)
+    {
+        Vertex &vertex = vertices[v];
+        glm::vec3 tangent = vertex.Tangent - vertex.Normal * glm::dot(vertex.Normal, vertex.Tangent);
+        glm::vec3 bitangent = vertex.Bitangent - vertex.Normal * glm::dot(vertex.Normal, vertex.Bitangent);
+        float tangentLength = glm::length(tangent), bitangentLength = glm::length(bitangent);
+        vertex.Tangent = tangentLength > 1e-12f ? tangent / tangentLength : glm::vec3(0.0f);
+        vertex.Bitangent = bitangentLength > 1e-12f ? bitangent / bitangentLength : glm::vec3(0.0f);
+    }
+}
+
+// the per-vertex loop processMesh used before, kept as the baseline of the benchmark
+inline void convertVerticesReference(const aiMesh *mesh, vector<Vertex> &vertices)
+{
+    vertices.clear();
+    for (unsigned int i = 0; i < mesh->mNumVertices; i++)
+    {
+        Vertex vertex;
+        glm::vec3 vector;
+        vector.x = mesh->mVertices[i].x;
+        vector.y = mesh->mVertices[i].y;
+        vector.z = mesh->mVertices[i].z;
+        vertex.Position = vector;
+        if (mesh->HasNormals())
+        {
+            vector.x = mesh->mNormals[i].x;
+            vector.y = mesh->mNormals[i].y;
+            vector.z = mesh->mNormals[i].z;
+            vertex.Normal = vector;
+        }
+        else
+            vertex.Normal = glm::vec3(0.0f);
+        if (mesh->mTextureCoords[0])
+        {
+            glm::vec2 vec;
+            vec.x = mesh->mTextureCoords[0][i].x;
+            vec.y = mesh->mTextureCoords[0][i].y;
+            vertex.TexCoords = vec;
+        }
+        else
+            vertex.TexCoords = glm::vec2(0.0f, 0.0f);
+        if (mesh->HasTangentsAndBitangents())
+        {
+            vector.x = mesh->mTangents[i].x;
+            vector.y = mesh->mTangents[i].y;
+            vector.z = mesh->mTangents[i].z;
+            vertex.Tangent = vector;
+            vector.x = mesh->mBitangents[i].x;
+            vector.y = mesh->mBitangents[i].y;
+            vector.z = mesh->mBitangents[i].z;
+            vertex.Bitangent = vector;
+        }
+        else
+        {
+            vertex.Tangent = glm::vec3(0.0f);
+            vertex.Bitangent = glm::vec3(0.0f);
+        }
+        vertices.push_back(vertex);
+    }
+}
+
+// imports a model and times the reference loop against the batched kernel (single and multi-threaded)
+// over all its meshes. Returns false if the converted vertices differ or the model can't be read.
+inline bool benchmarkVertexConversion(const string &path, int iterations = 10)
+{
+    Assimp::Importer importer;
+    const aiScene *scene = importer.ReadFile(path, aiProcess_Triangulate | aiProcess_FlipUVs | aiProcess_CalcTangentSpace);
+    if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
+    {
+        cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+        return false;
+    }
+
+    size_t totalVertices = 0;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+        totalVertices += scene->mMeshes[m]->mNumVertices;
+
+    typedef std::chrono::high_resolution_clock Clock;
+    double seconds[3] = { 0.0, 0.0, 0.0 };
+    bool identical = true;
+    vector<Vertex> reference, converted;
+    for (int it = 0; it < iterations; it++)
+    {
+        for (unsigned int m = 0; m < scene->mNumMeshes; m++)
+        {
+            const aiMesh *mesh = scene->mMeshes[m];
+            for (int variant = 0; variant < 3; variant++)
+            {
+                // fresh vectors every time, so the reference pays for its reallocations like it did in processMesh
+                vector<Vertex> vertices;
+                Clock::time_point start = Clock::now();
+                if (variant == 0)
+                    convertVerticesReference(mesh, vertices);
+                else
+                    convertVertices(mesh, vertices, variant == 1 ? 1 : 0);
+                seconds[variant] += std::chrono::duration<double>(Clock::now() - start).count();
+                if (it == 0 && variant == 0)
+                    reference.swap(vertices);
+                else if (it == 0)
+                    identical = identical && vertices.size() == reference.size() &&
+                                (reference.empty() || memcmp(vertices.data(), reference.data(), reference.size() * sizeof(Vertex)) == 0);
+            }
+        }
+    }
+
+    const char *names[3] = { "reference loop", "batched (1 thread)", "batched (threads)" };
+    cout << "BENCHMARK::VERTEX_CONVERT:: " << path << "  vertices: " << totalVertices << "  iterations: " << iterations << endl;
+    for (int variant = 0; variant < 3; variant++)
+    {
+        double ms = seconds[variant] * 1000.0 / iterations;
+        cout << "    " << names[variant] << ": " << ms << " ms  (" << (totalVertices / 1000000.0) / (ms / 1000.0)
+             << " Mvertices/s, x" << seconds[0] / seconds[variant] << ")" << endl;
+    }
+    if (!identical)
+        cout << "ERROR::VERTEX_CONVERT:: batched output differs from the reference loop" << endl;
+    return identical;
+}
+#endif
@@ -0,0 +1,997 @@
+#ifndef VIRTUAL_TEXTURE_H
+#define VIRTUAL_TEXTURE_H
+
+#include <glad/glad.h>
+
+#include <glm/glm.hpp>
+
+#include <shader.h>
+#include <mappedFile.h>
+#include <textureCooker.h>
+#include <textureRegistry.h>
+#include <gpuResources.h>
+
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+using namespace std;
+
+// Sparse virtual textures for the painting scans visitors walk up to.
+// A scan is cut once into a mip pyramid of VIRTUAL_TEXTURE_PAGE^2 pages, each stored with a border of
+// VIRTUAL_TEXTURE_BORDER texels so bilinear filtering never reads the neighbor slot, and kept in
+// VIRTUAL_TEXTURE_DIRECTORY. Only the pages the camera sees are in video memory, in one atlas of
+// VIRTUAL_TEXTURE_ATLAS_PAGES^2 slots shared by every scan, so the memory used doesn't depend on how
+// large the scans are:
+//  - every scan has a page table (one R16UI texel per page of every level) holding, for each page, the
+//    atlas slot of the finest resident page that covers it. The lighting shader goes through it.
+//  - the meshes drawn with a scan are drawn again at 1/VIRTUAL_TEXTURE_FEEDBACK_SCALE of the screen,
+//    writing the page each pixel wants. The image is read back through pixel buffers a few frames later.
+//  - a loader thread reads the wanted pages, coarse levels first, and update() copies them into free
+//    slots, or into the ones seen least recently when the atlas is full. The coarsest page of a scan stays.
+// File layout (little endian): "MUSEOVT1", then format (CookedFormat), width, height, levels, page size,
+// border and bytes per page as uint32. The pages start at VIRTUAL_TEXTURE_HEADER_BYTES, level 0 first and
+// each level row by row. Scans too large to decode in memory can be tiled into it by an external tool.
+// The cut uses stb_image, whose implementation is compiled by the main translation unit.
+
+#define VIRTUAL_TEXTURE_DIRECTORY       "resources/cache/virtual"
+#define VIRTUAL_TEXTURE_PAGE            128
+#define VIRTUAL_TEXTURE_BORDER          4
+#define VIRTUAL_TEXTURE_STRIDE          (VIRTUAL_TEXTURE_PAGE + 2 * VIRTUAL_TEXTURE_BORDER)
+#define VIRTUAL_TEXTURE_HEADER_BYTES    64
+#define VIRTUAL_TEXTURE_MAX_LEVELS      12      // level 0 up to 256K texels wide; the shaders use the same
+#ifndef VIRTUAL_TEXTURE_ATLAS_PAGES
+#define VIRTUAL_TEXTURE_ATLAS_PAGES     32      // slots per side (at most 64, a page table entry has 12 bits for the slot)
+#endif
+#define VIRTUAL_TEXTURE_FEEDBACK_SCALE  8
+#define VIRTUAL_TEXTURE_FEEDBACK_FRAMES 3       // readbacks in flight
+#define VIRTUAL_TEXTURE_MAX_LOADS       64      // pages queued on the loader thread at once
+#define VIRTUAL_TEXTURE_FRAME_PAGES     16      // pages copied into the atlas per update()
+#define VIRTUAL_TEXTURE_TABLE_UNIT      14      // texture units of the page table and the atlas
+#define VIRTUAL_TEXTURE_ATLAS_UNIT      15
+
+static const char VIRTUAL_TEXTURE_MAGIC[8] = { 'M', 'U', 'S', 'E', 'O', 'V', 'T', '1' };
+
+// size of every level and where its pages are in the file
+struct VirtualTextureLayout {
+    CookedFormat format;
+    unsigned int width;
+    unsigned int height;
+    unsigned int levels;
+    size_t pageBytes;
+    unsigned int levelWidth[VIRTUAL_TEXTURE_MAX_LEVELS];
+    unsigned int levelHeight[VIRTUAL_TEXTURE_MAX_LEVELS];
+    unsigned int pagesX[VIRTUAL_TEXTURE_MAX_LEVELS];
+    unsigned int pagesY[VIRTUAL_TEXTURE_MAX_LEVELS];
+    size_t firstPage[VIRTUAL_TEXTURE_MAX_LEVELS + 1];   // the last one is the page count
+
+    // levels halve like a mip chain until one page holds the whole image. False if that takes too many
+    bool build(CookedFormat format, unsigned int width, unsigned int height)
+    {
+        this->format = format;
+        this->width = width;
+        this->height = height;
+        pageBytes = cookedLevelSize(format, VIRTUAL_TEXTURE_STRIDE, VIRTUAL_TEXTURE_STRIDE);
+        levels = 0;
+        firstPage[0] = 0;
+        unsigned int w = width, h = height;
+        while (levels < VIRTUAL_TEXTURE_MAX_LEVELS)
+        {
+            levelWidth[levels] = w;
+            levelHeight[levels] = h;
+            pagesX[levels] = (w + VIRTUAL_TEXTURE_PAGE - 1) / VIRTUAL_TEXTURE_PAGE;
+            pagesY[levels] = (h + VIRTUAL_TEXTURE_PAGE - 1) / VIRTUAL_TEXTURE_PAGE;
+            firstPage[levels + 1] = firstPage[levels] + (size_t)pagesX[levels] * pagesY[levels];
+            levels++;
+            if (w <= VIRTUAL_TEXTURE_PAGE && h <= VIRTUAL_TEXTURE_PAGE)
+                return width > 0 && height > 0;
+            w = (std::max)(1u, w / 2);
+            h = (std::max)(1u, h / 2);
+        }
+        return false;
+    }
+
+    size_t pageIndex(unsigned int level, unsigned int x, unsigned int y) const
+    {
+        return firstPage[level] + (size_t)y * pagesX[level] + x;
+    }
+
+    size_t fileOffset(size_t page) const
+    {
+        return VIRTUAL_TEXTURE_HEADER_BYTES + page * pageBytes;
+    }
+};
+
+// cuts the image at source into the pages of a virtual texture file. Each level is built from the one
+// before it with the cooker's box filter, so only two levels are in memory at a time
+inline bool tileVirtualTexture(const string &source, const string &target, CookedFormat format)
+{
+    int width, height, components;
+    unsigned char *pixels = stbi_load(source.c_str(), &width, &height, &components, 4);
+    if (!pixels)
+        return false;
+    VirtualTextureLayout layout;
+    if (!layout.build(format, (unsigned int)width, (unsigned int)height))
+    {
+        stbi_image_free(pixels);
+        return false;
+    }
+    vector<unsigned char> level(pixels, pixels + (size_t)width * height * 4), next;
+    stbi_image_free(pixels);
+
+    vector<unsigned char> header(VIRTUAL_TEXTURE_MAGIC, VIRTUAL_TEXTURE_MAGIC + 8);
+    ktxPut32(header, (uint32_t)format);
+    ktxPut32(header, layout.width);
+    ktxPut32(header, layout.height);
+    ktxPut32(header, layout.levels);
+    ktxPut32(header, VIRTUAL_TEXTURE_PAGE);
+    ktxPut32(header, VIRTUAL_TEXTURE_BORDER);
+    ktxPut32(header, (uint32_t)layout.pageBytes);
+    header.resize(VIRTUAL_TEXTURE_HEADER_BYTES, 0);
+
+    // written to a temporary name first, like the cooked textures
+    string temporary = target + ".tmp";
+    FILE *file = fopen(temporary.c_str(), "wb");
+    if (!file)
+        return false;
+    bool ok = fwrite(&header[0], 1, header.size(), file) == header.size();
+    vector<unsigned char> texels((size_t)VIRTUAL_TEXTURE_STRIDE * VIRTUAL_TEXTURE_STRIDE * 4), page(layout.pageBytes);
+    for (unsigned int l = 0; ok && l < layout.levels; l++)
+    {
+        int w = (int)layout.levelWidth[l], h = (int)layout.levelHeight[l];
+        for (unsigned int py = 0; ok && py < layout.pagesY[l]; py++)
+            for (unsigned int px = 0; ok && px < layout.pagesX[l]; px++)
+            {
+                // the border (and whatever lies past the edge of the image) repeats the nearest texel
+                for (int y = 0; y < VIRTUAL_TEXTURE_STRIDE; y++)
+                {
+                    int sy = (std::min)((std::max)((int)py * VIRTUAL_TEXTURE_PAGE - VIRTUAL_TEXTURE_BORDER + y, 0), h - 1);
+                    for (int x = 0; x < VIRTUAL_TEXTURE_STRIDE; x++)
+                    {
+                        int sx = (std::min)((std::max)((int)px * VIRTUAL_TEXTURE_PAGE - VIRTUAL_TEXTURE_BORDER + x, 0), w - 1);
+                        memcpy(&texels[((size_t)y * VIRTUAL_TEXTURE_STRIDE + x) * 4], &level[((size_t)sy * w + sx) * 4], 4);
+                    }
+                }
+                cookEncodeLevel(format, texels.data(), VIRTUAL_TEXTURE_STRIDE, VIRTUAL_TEXTURE_STRIDE, page.data());
+                ok = fwrite(page.data(), 1, page.size(), file) == page.size();
+            }
+        if (l + 1 < layout.levels)
+        {
+            cookDownsample(level, (unsigned int)w, (unsigned int)h, next);
+            level.swap(next);
+        }
+    }
+    ok = fclose(file) == 0 && ok;
+    remove(target.c_str());
+    if (!ok || rename(temporary.c_str(), target.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        return false;
+    }
+    return true;
+}
+
+// checks the header of a virtual texture file against its size
+inline bool readVirtualTextureHeader(const MappedFile &file, VirtualTextureLayout &layout)
+{
+    const unsigned char *data = (const unsigned char*)file.data();
+    if (!data || file.size() < VIRTUAL_TEXTURE_HEADER_BYTES || memcmp(data, VIRTUAL_TEXTURE_MAGIC, 8) != 0)
+        return false;
+    uint32_t format = ktxGet32(data + 8);
+    if (format > COOKED_BC7 || ktxGet32(data + 24) != VIRTUAL_TEXTURE_PAGE || ktxGet32(data + 28) != VIRTUAL_TEXTURE_BORDER)
+        return false;
+    if (!layout.build((CookedFormat)format, ktxGet32(data + 12), ktxGet32(data + 16)))
+        return false;
+    return layout.levels == ktxGet32(data + 20) && layout.pageBytes == ktxGet32(data + 32) &&
+           file.size() >= layout.fileOffset(layout.firstPage[layout.levels]);
+}
+
+class VirtualTextureCache {
+public:
+    VirtualTextureCache() : format(COOKED_RGBA8), atlas(0), framebuffer(0), feedbackColor(0), feedbackDepth(0),
+        feedbackWidth(0), feedbackHeight(0), viewportWidth(0), viewportHeight(0), frame(0), lastFeedback(0),
+        nextReadback(0), queuedLoads(0), stopping(false)
+    {
+    }
+
+    bool running() const
+    {
+        return atlas != 0;
+    }
+
+    // creates the atlas, the feedback pass and the loader thread; main thread, with the GL context current
+    bool start()
+    {
+        if (running())
+            return true;
+        format = s3tcSupported() ? COOKED_BC1 : bptcSupported() ? COOKED_BC7 : COOKED_RGBA8;
+        GLsizei size = VIRTUAL_TEXTURE_ATLAS_PAGES * VIRTUAL_TEXTURE_STRIDE;
+        glGenTextures(1, &atlas);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        // a single level allocated without data (glTexStorage2D would need GL 4.2)
+        if (format == COOKED_RGBA8)
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, size, size, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        else
+            glCompressedTexImage2D(GL_TEXTURE_2D, 0, cookedGLFormat(format), size, size, 0,
+                                   (GLsizei)cookedLevelSize(format, size, size), nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        if (glGetError() != GL_NO_ERROR)
+        {
+            cout << "WARNING::VIRTUAL:: could not create the page atlas, scans are drawn from their regular texture" << endl;
+            glDeleteTextures(1, &atlas);
+            atlas = 0;
+            return false;
+        }
+        gpuResources().allocate(GPU_RESOURCE_TEXTURE, atlas, cookedLevelSize(format, size, size), "virtual texture atlas");
+        slots.assign(VIRTUAL_TEXTURE_ATLAS_PAGES * VIRTUAL_TEXTURE_ATLAS_PAGES, Slot());
+        feedbackShader.reset(new Shader("shaders/shader_Lights.vs", "shaders/vt_feedback.fs"));
+        glGenBuffers(VIRTUAL_TEXTURE_FEEDBACK_FRAMES, readbackBuffers);
+        for (int r = 0; r < VIRTUAL_TEXTURE_FEEDBACK_FRAMES; r++)
+            readbacks[r] = Readback();
+        stopping = false;
+        loader = std::thread(&VirtualTextureCache::load, this);
+        return true;
+    }
+
+    // points the page table and atlas samplers of a shader that can draw scans at their texture units (leaves
+    // it in use). Has to happen before it draws anything: samplers of different types may not share a unit
+    void setupProgram(Shader &shader)
+    {
+        shader.use();
+        shader.setInt("vt_pageTable", VIRTUAL_TEXTURE_TABLE_UNIT);
+        shader.setInt("vt_atlas", VIRTUAL_TEXTURE_ATLAS_UNIT);
+        shader.setBool("virtualTexture", false);
+    }
+
+    // meshes textured with image are drawn from scan instead: an image file to cut into pages, or an
+    // already tiled file (.vt). Without a scan the image itself is tiled, at its own resolution
+    void addScan(const string &image, const string &scan = string())
+    {
+        string key = normalizePath(image);
+        if (handles.count(key))
+            return;
+        unique_ptr<Scan> added(new Scan());
+        added->source = scan.empty() ? image : scan;
+        lock_guard<mutex> lock(guard);
+        scans.push_back(std::move(added));
+        handles[key] = (unsigned int)scans.size();
+    }
+
+    // scan drawn instead of the texture at image (a path as the models have it), 0 if there is none.
+    // The first time, the scan's pages are opened, or cut on the loader thread if they don't exist yet
+    unsigned int acquire(const string &image)
+    {
+        if (!running())
+            return 0;
+        map<string, unsigned int>::const_iterator handle = handles.find(normalizePath(image));
+        if (handle == handles.end())
+            return 0;
+        Scan &scan = *scans[handle->second - 1];
+        if (scan.state != SCAN_IDLE)
+            return scan.state == SCAN_FAILED ? 0 : handle->second;
+
+        if (isTiledFile(scan.source))
+            scan.path = scan.source;
+        else
+        {
+            MappedFile source;
+            if (!source.open(scan.source))
+            {
+                cout << "WARNING::VIRTUAL:: could not read scan " << scan.source << endl;
+                scan.state = SCAN_FAILED;
+                return 0;
+            }
+            char name[64];
+            snprintf(name, sizeof(name), "%016llx_%llx_%s.vt", (unsigned long long)textureContentHash((const unsigned char*)source.data(), source.size()),
+                     (unsigned long long)source.size(), cookedFormatName(format));
+            scan.path = string(VIRTUAL_TEXTURE_DIRECTORY) + '/' + name;
+        }
+        if (open(handle->second))
+            return handle->second;
+        if (scan.path == scan.source || !makeDirectories(VIRTUAL_TEXTURE_DIRECTORY))
+        {
+            cout << "WARNING::VIRTUAL:: could not open " << scan.path << endl;
+            scan.state = SCAN_FAILED;
+            return 0;
+        }
+        scan.state = SCAN_TILING;
+        Job job = { handle->second, 0, true };
+        queue(job);
+        return handle->second;
+    }
+
+    // camera of the frame about to be drawn and the size of the window
+    void beginFrame(const glm::mat4 &projection, const glm::mat4 &view, unsigned int width, unsigned int height)
+    {
+        this->projection = projection;
+        this->view = view;
+        viewportWidth = width;
+        viewportHeight = height;
+        frame++;
+    }
+
+    // a mesh drawn with a scan this frame, drawn again by the next feedback pass
+    void record(unsigned int handle, unsigned int VAO, unsigned int indexCount, GLenum indexType, size_t indexOffset, const glm::mat4 &model)
+    {
+        if (!running() || handle == 0)
+            return;
+        FeedbackDraw draw = { handle, VAO, indexCount, indexType, indexOffset, model };
+        draws.push_back(draw);
+    }
+
+    // binds the page table and atlas of a scan and switches the program to them. False until the coarsest
+    // page of the scan is in; the mesh then draws with its regular texture
+    bool bind(unsigned int program, unsigned int handle)
+    {
+        if (!running() || handle == 0 || handle > scans.size() || !ready(*scans[handle - 1]))
+            return false;
+        Scan &scan = *scans[handle - 1];
+        glActiveTexture(GL_TEXTURE0 + VIRTUAL_TEXTURE_TABLE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, scan.table);
+        glActiveTexture(GL_TEXTURE0 + VIRTUAL_TEXTURE_ATLAS_UNIT);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        glActiveTexture(GL_TEXTURE0);
+        setLevelUniforms(program, scan);
+        glUniform1i(glGetUniformLocation(program, "virtualTexture"), 1);
+        programsOn.insert(program);
+        return true;
+    }
+
+    // back to the regular diffuse texture for the next draws of program
+    void unbind(unsigned int program)
+    {
+        if (programsOn.erase(program))
+            glUniform1i(glGetUniformLocation(program, "virtualTexture"), 0);
+    }
+
+    // reads the feedback of earlier frames, draws this one's, loads and evicts pages; main thread, once per frame
+    void update()
+    {
+        if (!running())
+            return;
+        openTiled();
+        readFeedback();
+        drawFeedback();
+        requestPages();
+        uploadPages();
+        flushTables();
+    }
+
+    void printReport()
+    {
+        size_t used = 0, tables = 0;
+        unsigned int open = 0;
+        for (size_t s = 0; s < slots.size(); s++)
+            used += slots[s].scan != 0 ? 1 : 0;
+        for (size_t s = 0; s < scans.size(); s++)
+            if (scans[s]->state == SCAN_OPEN)
+            {
+                open++;
+                tables += scans[s]->entries.size() * sizeof(uint16_t);
+            }
+        size_t atlasBytes = cookedLevelSize(format, VIRTUAL_TEXTURE_ATLAS_PAGES * VIRTUAL_TEXTURE_STRIDE, VIRTUAL_TEXTURE_ATLAS_PAGES * VIRTUAL_TEXTURE_STRIDE);
+        cout << "MEMORY::VIRTUAL:: scans: " << open << "/" << scans.size() << "  pages: " << used << "/" << slots.size()
+             << "  atlas: " << atlasBytes / (1024 * 1024) << " MB " << cookedFormatName(format)
+             << "  page tables: " << tables / 1024 << " KB" << endl;
+    }
+
+    // joins the loader thread and deletes the atlas, page tables and feedback pass
+    void stop()
+    {
+        if (!running())
+            return;
+        {
+            lock_guard<mutex> lock(guard);
+            stopping = true;
+        }
+        jobReady.notify_all();
+        loader.join();
+        jobs.clear();
+        loaded.clear();
+        tiled.clear();
+        for (int r = 0; r < VIRTUAL_TEXTURE_FEEDBACK_FRAMES; r++)
+            if (readbacks[r].fence)
+                glDeleteSync(readbacks[r].fence);
+        for (int r = 0; r < VIRTUAL_TEXTURE_FEEDBACK_FRAMES; r++)
+            gpuResources().release(GPU_RESOURCE_BUFFER, readbackBuffers[r]);
+        gpuResources().release(GPU_RESOURCE_TEXTURE, feedbackColor);
+        gpuResources().release(GPU_RESOURCE_RENDERBUFFER, feedbackDepth);
+        glDeleteBuffers(VIRTUAL_TEXTURE_FEEDBACK_FRAMES, readbackBuffers);
+        glDeleteFramebuffers(1, &framebuffer);
+        glDeleteTextures(1, &feedbackColor);
+        glDeleteRenderbuffers(1, &feedbackDepth);
+        framebuffer = feedbackColor = feedbackDepth = 0;
+        feedbackWidth = feedbackHeight = 0;
+        feedbackShader.reset();
+        for (size_t s = 0; s < scans.size(); s++)
+        {
+            Scan &scan = *scans[s];
+            if (scan.table)
+            {
+                gpuResources().release(GPU_RESOURCE_TEXTURE, scan.table);
+                glDeleteTextures(1, &scan.table);
+            }
+            scan.file.close();
+            scan.table = 0;
+            scan.state = SCAN_IDLE;
+        }
+        gpuResources().release(GPU_RESOURCE_TEXTURE, atlas);
+        glDeleteTextures(1, &atlas);
+        atlas = 0;
+        slots.clear();
+        draws.clear();
+        wanted.clear();
+        queuedLoads = 0;
+    }
+
+private:
+    enum ScanState { SCAN_IDLE, SCAN_TILING, SCAN_OPEN, SCAN_FAILED };
+
+    struct Scan {
+        string source;
+        string path;                    // tiled file
+        ScanState state;
+        MappedFile file;
+        VirtualTextureLayout layout;
+        unsigned int table;
+        unsigned int tableWidth;
+        unsigned int tableHeight;
+        int levelRects[VIRTUAL_TEXTURE_MAX_LEVELS][4];  // table x, y, level width, height (the shader's vt_level)
+        vector<uint16_t> entries;       // copy of the page table: (level << 12) | slot
+        vector<int> slots;              // atlas slot of every page, -1 when it isn't resident
+        vector<unsigned char> loading;
+        int dirty[VIRTUAL_TEXTURE_MAX_LEVELS][4];       // entries changed since the last upload, x0 y0 x1 y1
+
+        Scan() : state(SCAN_IDLE), table(0), tableWidth(0), tableHeight(0) {}
+    };
+
+    struct Slot {
+        unsigned int scan;              // 0 when free
+        unsigned int level;
+        unsigned int x;
+        unsigned int y;
+        unsigned int lastSeen;          // frame of the last feedback that asked for the page
+
+        Slot() : scan(0), level(0), x(0), y(0), lastSeen(0) {}
+    };
+
+    struct Job {
+        unsigned int scan;
+        size_t page;
+        bool tile;                      // cut the scan into pages instead of reading one
+    };
+
+    struct LoadedPage {
+        unsigned int scan;
+        size_t page;
+        vector<unsigned char> bytes;
+    };
+
+    struct FeedbackDraw {
+        unsigned int scan;
+        unsigned int VAO;
+        unsigned int indexCount;
+        GLenum indexType;
+        size_t indexOffset;
+        glm::mat4 model;
+    };
+
+    struct Readback {
+        GLsync fence;
+        unsigned int width;
+        unsigned int height;
+
+        Readback() : fence(0), width(0), height(0) {}
+    };
+
+    CookedFormat format;
+    unsigned int atlas;
+    vector<Slot> slots;
+    vector<unique_ptr<Scan> > scans;
+    map<string, unsigned int> handles;  // image path -> scan, from 1
+    set<unsigned int> programsOn;       // programs whose virtualTexture uniform is set
+
+    unique_ptr<Shader> feedbackShader;
+    unsigned int framebuffer, feedbackColor, feedbackDepth;
+    unsigned int feedbackWidth, feedbackHeight;
+    unsigned int readbackBuffers[VIRTUAL_TEXTURE_FEEDBACK_FRAMES];
+    Readback readbacks[VIRTUAL_TEXTURE_FEEDBACK_FRAMES];
+    vector<FeedbackDraw> draws;
+    glm::mat4 projection, view;
+    unsigned int viewportWidth, viewportHeight;
+    unsigned int frame;
+    unsigned int lastFeedback;          // frame whose update read the latest feedback
+    int nextReadback;
+    vector<uint64_t> wanted;            // missing pages, see requestPages
+
+    std::thread loader;
+    mutex guard;
+    condition_variable jobReady;
+    deque<Job> jobs;
+    deque<LoadedPage> loaded;
+    deque<pair<unsigned int, bool> > tiled;
+    unsigned int queuedLoads;           // page jobs not yet copied into the atlas
+    bool stopping;
+
+    static string normalizePath(const string &path)
+    {
+        string normalized = path;
+        for (size_t i = 0; i < normalized.size(); i++)
+            if (normalized[i] == '\\')
+                normalized[i] = '/';
+        return normalized;
+    }
+
+    static bool isTiledFile(const string &path)
+    {
+        return path.size() > 3 && path.compare(path.size() - 3, 3, ".vt") == 0;
+    }
+
+    static bool ready(const Scan &scan)
+    {
+        return scan.state == SCAN_OPEN && scan.slots[scan.layout.firstPage[scan.layout.levels - 1]] >= 0;
+    }
+
+    void queue(const Job &job)
+    {
+        {
+            lock_guard<mutex> lock(guard);
+            jobs.push_back(job);
+        }
+        jobReady.notify_one();
+    }
+
+    // loader thread: cuts scans and copies pages out of the mapped files
+    void load()
+    {
+        unique_lock<mutex> lock(guard);
+        while (true)
+        {
+            jobReady.wait(lock, [this]() { return stopping || !jobs.empty(); });
+            if (stopping)
+                return;
+            Job job = jobs.front();
+            jobs.pop_front();
+            Scan *scan = scans[job.scan - 1].get();
+            lock.unlock();
+
+            if (job.tile)
+            {
+                bool ok = tileVirtualTexture(scan->source, scan->path, format);
+                lock.lock();
+                tiled.push_back(make_pair(job.scan, ok));
+                continue;
+            }
+            LoadedPage page;
+            page.scan = job.scan;
+            page.page = job.page;
+            const char *bytes = scan->file.data() + scan->layout.fileOffset(job.page);
+            page.bytes.assign(bytes, bytes + scan->layout.pageBytes);
+            lock.lock();
+            loaded.push_back(std::move(page));
+        }
+    }
+
+    // maps the tiled file of a scan and creates its page table; the coarsest page is loaded right away
+    bool open(unsigned int handle)
+    {
+        Scan &scan = *scans[handle - 1];
+        if (!scan.file.open(scan.path) || !readVirtualTextureHeader(scan.file, scan.layout) || scan.layout.format != format)
+        {
+            scan.file.close();
+            return false;
+        }
+        const VirtualTextureLayout &layout = scan.layout;
+        // level 0 on the left, the rest stacked in a column to its right
+        scan.tableWidth = layout.pagesX[0] + (layout.levels > 1 ? layout.pagesX[1] : 0);
+        scan.tableHeight = layout.pagesY[0];
+        unsigned int column = 0;
+        for (unsigned int l = 0; l < layout.levels; l++)
+        {
+            int *rect = scan.levelRects[l];
+            rect[0] = l == 0 ? 0 : (int)layout.pagesX[0];
+            rect[1] = l == 0 ? 0 : (int)column;
+            rect[2] = (int)layout.levelWidth[l];
+            rect[3] = (int)layout.levelHeight[l];
+            if (l > 0)
+                column += layout.pagesY[l];
+            clearDirty(scan, l);
+        }
+        scan.tableHeight = (std::max)(scan.tableHeight, column);
+        scan.entries.assign((size_t)scan.tableWidth * scan.tableHeight, 0xFFFF);
+        scan.slots.assign(layout.firstPage[layout.levels], -1);
+        scan.loading.assign(layout.firstPage[layout.levels], 0);
+
+        glGenTextures(1, &scan.table);
+        glBindTexture(GL_TEXTURE_2D, scan.table);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, scan.tableWidth, scan.tableHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, scan.entries.data());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+        gpuResources().allocate(GPU_RESOURCE_TEXTURE, scan.table, scan.entries.size() * sizeof(uint16_t), "virtual texture page table of " + scan.source);
+        scan.state = SCAN_OPEN;
+
+        size_t top = layout.firstPage[layout.levels - 1];
+        scan.loading[top] = 1;
+        queuedLoads++;
+        Job job = { handle, top, false };
+        queue(job);
+        return true;
+    }
+
+    void openTiled()
+    {
+        deque<pair<unsigned int, bool> > done;
+        {
+            lock_guard<mutex> lock(guard);
+            done.swap(tiled);
+        }
+        for (size_t d = 0; d < done.size(); d++)
+        {
+            Scan &scan = *scans[done[d].first - 1];
+            if (!done[d].second || !open(done[d].first))
+            {
+                cout << "WARNING::VIRTUAL:: could not tile scan " << scan.source << endl;
+                scan.state = SCAN_FAILED;
+            }
+        }
+    }
+
+    void setLevelUniforms(unsigned int program, const Scan &scan)
+    {
+        glUniform4iv(glGetUniformLocation(program, "vt_level"), scan.layout.levels, &scan.levelRects[0][0]);
+        glUniform1i(glGetUniformLocation(program, "vt_levelCount"), scan.layout.levels);
+    }
+
+    // (re)creates the feedback target for the current window size
+    void resizeFeedback()
+    {
+        unsigned int width = (std::max)(1u, viewportWidth / VIRTUAL_TEXTURE_FEEDBACK_SCALE);
+        unsigned int height = (std::max)(1u, viewportHeight / VIRTUAL_TEXTURE_FEEDBACK_SCALE);
+        if (framebuffer && width == feedbackWidth && height == feedbackHeight)
+            return;
+        if (!framebuffer)
+        {
+            glGenFramebuffers(1, &framebuffer);
+            glGenTextures(1, &feedbackColor);
+            glGenRenderbuffers(1, &feedbackDepth);
+        }
+        feedbackWidth = width;
+        feedbackHeight = height;
+        glBindTexture(GL_TEXTURE_2D, feedbackColor);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16UI, width, height, 0, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindRenderbuffer(GL_RENDERBUFFER, feedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, feedbackColor, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, feedbackDepth);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        gpuResources().allocate(GPU_RESOURCE_TEXTURE, feedbackColor, (size_t)width * height * 4 * sizeof(uint16_t), "virtual texture feedback");
+        gpuResources().allocate(GPU_RESOURCE_RENDERBUFFER, feedbackDepth, (size_t)width * height * 4, "virtual texture feedback");
+    }
+
+    // draws the scans recorded last frame with the page each pixel needs and starts reading it back
+    void drawFeedback()
+    {
+        Readback &readback = readbacks[nextReadback];
+        if (draws.empty() || viewportWidth == 0 || readback.fence)
+        {
+            draws.clear();
+            return;
+        }
+        resizeFeedback();
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, feedbackWidth, feedbackHeight);
+        const GLuint nothing[4] = { 0, 0, 0, 0 };
+        glClearBufferuiv(GL_COLOR, 0, nothing);
+        glClear(GL_DEPTH_BUFFER_BIT);
+        glEnable(GL_DEPTH_TEST);
+
+        Shader &shader = *feedbackShader;
+        shader.use();
+        shader.setMat4("projection", projection);
+        shader.setMat4("view", view);
+        // the pass is smaller than the screen, its UV derivatives are that many times larger
+        shader.setFloat("vt_lodBias", -log2f((float)VIRTUAL_TEXTURE_FEEDBACK_SCALE));
+        for (size_t d = 0; d < draws.size(); d++)
+        {
+            const FeedbackDraw &draw = draws[d];
+            const Scan &scan = *scans[draw.scan - 1];
+            if (scan.state != SCAN_OPEN)
+                continue;
+            shader.setMat4("model", draw.model);
+            shader.setInt("vt_id", (int)draw.scan);
+            setLevelUniforms(shader.ID, scan);
+            glBindVertexArray(draw.VAO);
+            glDrawElements(GL_TRIANGLES, draw.indexCount, draw.indexType, (void*)draw.indexOffset);
+        }
+        glBindVertexArray(0);
+        draws.clear();
+
+        size_t bytes = (size_t)feedbackWidth * feedbackHeight * 4 * sizeof(uint16_t);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[nextReadback]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        gpuResources().allocate(GPU_RESOURCE_BUFFER, readbackBuffers[nextReadback], bytes, "virtual texture readback");
+        glReadPixels(0, 0, feedbackWidth, feedbackHeight, GL_RGBA_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        readback.width = feedbackWidth;
+        readback.height = feedbackHeight;
+        nextReadback = (nextReadback + 1) % VIRTUAL_TEXTURE_FEEDBACK_FRAMES;
+
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glViewport(0, 0, viewportWidth, viewportHeight);
+    }
+
+    // takes the oldest readback the GPU is done with: every page it names is marked as seen, together with
+    // the coarser pages that stand in for it, and the missing ones are remembered for requestPages
+    void readFeedback()
+    {
+        int oldest = -1;
+        for (int r = 0; r < VIRTUAL_TEXTURE_FEEDBACK_FRAMES && oldest < 0; r++)
+        {
+            int candidate = (nextReadback + r) % VIRTUAL_TEXTURE_FEEDBACK_FRAMES;
+            if (readbacks[candidate].fence)
+                oldest = candidate;
+        }
+        if (oldest < 0)
+            return;
+        Readback &readback = readbacks[oldest];
+        GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            return;
+        glDeleteSync(readback.fence);
+        readback.fence = 0;
+
+        size_t texels = (size_t)readback.width * readback.height;
+        vector<uint64_t> requests;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[oldest]);
+        const uint16_t *pixels = (const uint16_t*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, texels * 4 * sizeof(uint16_t), GL_MAP_READ_BIT);
+        if (pixels)
+        {
+            uint64_t previous = 0;
+            for (size_t t = 0; t < texels; t++)
+            {
+                const uint16_t *pixel = pixels + t * 4;
+                if (pixel[0] == 0)
+                    continue;
+                uint64_t key = ((uint64_t)pixel[0] << 48) | ((uint64_t)pixel[1] << 32) | ((uint64_t)pixel[2] << 16) | pixel[3];
+                if (key != previous)
+                    requests.push_back(key);
+                previous = key;
+            }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        sort(requests.begin(), requests.end());
+        requests.erase(unique(requests.begin(), requests.end()), requests.end());
+
+        lastFeedback = frame;
+        wanted.clear();
+        for (size_t r = 0; r < requests.size(); r++)
+        {
+            unsigned int handle = (unsigned int)(requests[r] >> 48);
+            if (handle == 0 || handle > scans.size() || scans[handle - 1]->state != SCAN_OPEN)
+                continue;
+            Scan &scan = *scans[handle - 1];
+            const VirtualTextureLayout &layout = scan.layout;
+            unsigned int level = (std::min)((unsigned int)(requests[r] >> 32) & 0xFFFF, layout.levels - 1);
+            unsigned int x = (unsigned int)(requests[r] >> 16) & 0xFFFF, y = (unsigned int)requests[r] & 0xFFFF;
+            for (unsigned int l = level; l < layout.levels; l++, x /= 2, y /= 2)
+            {
+                x = (std::min)(x, layout.pagesX[l] - 1);
+                y = (std::min)(y, layout.pagesY[l] - 1);
+                size_t page = layout.pageIndex(l, x, y);
+                if (scan.slots[page] >= 0)
+                    slots[scan.slots[page]].lastSeen = frame;
+                else if (!scan.loading[page])
+                    // coarse levels sort first: a closer look sharpens a level at a time
+                    wanted.push_back(((uint64_t)(VIRTUAL_TEXTURE_MAX_LEVELS - l) << 56) | ((uint64_t)handle << 40) | page);
+            }
+        }
+        sort(wanted.begin(), wanted.end());
+        wanted.erase(unique(wanted.begin(), wanted.end()), wanted.end());
+    }
+
+    // queues the missing pages on the loader thread, a bounded number at a time
+    void requestPages()
+    {
+        size_t next = 0;
+        while (next < wanted.size() && queuedLoads < VIRTUAL_TEXTURE_MAX_LOADS)
+        {
+            unsigned int handle = (unsigned int)(wanted[next] >> 40) & 0xFFFF;
+            size_t page = (size_t)(wanted[next] & 0xFFFFFFFFFFull);
+            next++;
+            Scan &scan = *scans[handle - 1];
+            if (scan.slots[page] >= 0 || scan.loading[page])
+                continue;
+            scan.loading[page] = 1;
+            queuedLoads++;
+            Job job = { handle, page, false };
+            queue(job);
+        }
+        wanted.erase(wanted.begin(), wanted.begin() + next);
+    }
+
+    // a free slot, or the one seen least recently that the latest feedback didn't ask for. -1 if every slot is in view
+    int allocateSlot()
+    {
+        int victim = -1;
+        for (size_t s = 0; s < slots.size(); s++)
+        {
+            const Slot &slot = slots[s];
+            if (slot.scan == 0)
+                return (int)s;
+            // the coarsest page of a scan is what everything else falls back to
+            if (slot.level == scans[slot.scan - 1]->layout.levels - 1 || slot.lastSeen >= lastFeedback)
+                continue;
+            if (victim < 0 || slot.lastSeen < slots[victim].lastSeen)
+                victim = (int)s;
+        }
+        return victim;
+    }
+
+    // copies the pages the loader has read into the atlas, up to VIRTUAL_TEXTURE_FRAME_PAGES
+    void uploadPages()
+    {
+        deque<LoadedPage> batch;
+        {
+            lock_guard<mutex> lock(guard);
+            while (!loaded.empty() && batch.size() < VIRTUAL_TEXTURE_FRAME_PAGES)
+            {
+                batch.push_back(std::move(loaded.front()));
+                loaded.pop_front();
+            }
+        }
+        if (batch.empty())
+            return;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glBindTexture(GL_TEXTURE_2D, atlas);
+        for (size_t b = 0; b < batch.size(); b++)
+        {
+            const LoadedPage &page = batch[b];
+            Scan &scan = *scans[page.scan - 1];
+            queuedLoads--;
+            scan.loading[page.page] = 0;
+            if (scan.state != SCAN_OPEN)
+                continue;
+            int s = allocateSlot();
+            if (s < 0)
+                continue;
+            if (slots[s].scan != 0)
+                unmapPage(s);
+
+            GLint x = (s % VIRTUAL_TEXTURE_ATLAS_PAGES) * VIRTUAL_TEXTURE_STRIDE, y = (s / VIRTUAL_TEXTURE_ATLAS_PAGES) * VIRTUAL_TEXTURE_STRIDE;
+            if (format == COOKED_RGBA8)
+                glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VIRTUAL_TEXTURE_STRIDE, VIRTUAL_TEXTURE_STRIDE, GL_RGBA, GL_UNSIGNED_BYTE, page.bytes.data());
+            else
+                glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, VIRTUAL_TEXTURE_STRIDE, VIRTUAL_TEXTURE_STRIDE, cookedGLFormat(format),
+                                          (GLsizei)page.bytes.size(), page.bytes.data());
+
+            const VirtualTextureLayout &layout = scan.layout;
+            unsigned int level = 0;
+            while (page.page >= layout.firstPage[level + 1])
+                level++;
+            size_t index = page.page - layout.firstPage[level];
+            Slot &slot = slots[s];
+            slot.scan = page.scan;
+            slot.level = level;
+            slot.x = (unsigned int)(index % layout.pagesX[level]);
+            slot.y = (unsigned int)(index / layout.pagesX[level]);
+            slot.lastSeen = frame;
+            scan.slots[page.page] = s;
+            refreshEntries(scan, level, slot.x, slot.y);
+        }
+    }
+
+    void unmapPage(int s)
+    {
+        Slot &slot = slots[s];
+        Scan &scan = *scans[slot.scan - 1];
+        scan.slots[scan.layout.pageIndex(slot.level, slot.x, slot.y)] = -1;
+        refreshEntries(scan, slot.level, slot.x, slot.y);
+        slot = Slot();
+    }
+
+    // rebuilds the entries covered by a page that came in or went away: each one points at its own page
+    // when it is resident, otherwise at whatever its parent points at
+    void refreshEntries(Scan &scan, unsigned int level, unsigned int x, unsigned int y)
+    {
+        const VirtualTextureLayout &layout = scan.layout;
+        bool lastX = x == layout.pagesX[level] - 1, lastY = y == layout.pagesY[level] - 1;
+        for (unsigned int l = level + 1; l-- > 0;)
+        {
+            unsigned int shift = level - l;
+            // pages past the end of a level hang from the last page of the next one
+            unsigned int x0 = x << shift, y0 = y << shift;
+            unsigned int x1 = lastX ? layout.pagesX[l] : (std::min)((x + 1) << shift, layout.pagesX[l]);
+            unsigned int y1 = lastY ? layout.pagesY[l] : (std::min)((y + 1) << shift, layout.pagesY[l]);
+            const int *rect = scan.levelRects[l];
+            for (unsigned int py = y0; py < y1; py++)
+                for (unsigned int px = x0; px < x1; px++)
+                {
+                    int s = scan.slots[layout.pageIndex(l, px, py)];
+                    uint16_t entry = 0xFFFF;
+                    if (s >= 0)
+                        entry = (uint16_t)((l << 12) | (unsigned int)s);
+                    else if (l + 1 < layout.levels)
+                    {
+                        const int *parent = scan.levelRects[l + 1];
+                        unsigned int qx = (std::min)(px / 2, layout.pagesX[l + 1] - 1), qy = (std::min)(py / 2, layout.pagesY[l + 1] - 1);
+                        entry = scan.entries[(size_t)(parent[1] + qy) * scan.tableWidth + parent[0] + qx];
+                    }
+                    scan.entries[(size_t)(rect[1] + py) * scan.tableWidth + rect[0] + px] = entry;
+                }
+            int *dirty = scan.dirty[l];
+            dirty[0] = (std::min)(dirty[0], (int)x0);
+            dirty[1] = (std::min)(dirty[1], (int)y0);
+            dirty[2] = (std::max)(dirty[2], (int)x1);
+            dirty[3] = (std::max)(dirty[3], (int)y1);
+        }
+    }
+
+    static void clearDirty(Scan &scan, unsigned int level)
+    {
+        scan.dirty[level][0] = scan.dirty[level][1] = INT_MAX;
+        scan.dirty[level][2] = scan.dirty[level][3] = 0;
+    }
+
+    // uploads the rectangles of the page tables that changed this frame
+    void flushTables()
+    {
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 2);
+        for (size_t s = 0; s < scans.size(); s++)
+        {
+            Scan &scan = *scans[s];
+            if (scan.state != SCAN_OPEN)
+                continue;
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, scan.tableWidth);
+            bool bound = false;
+            for (unsigned int l = 0; l < scan.layout.levels; l++)
+            {
+                const int *dirty = scan.dirty[l], *rect = scan.levelRects[l];
+                if (dirty[0] >= dirty[2] || dirty[1] >= dirty[3])
+                    continue;
+                if (!bound)
+                    glBindTexture(GL_TEXTURE_2D, scan.table);
+                bound = true;
+                glPixelStorei(GL_UNPACK_SKIP_PIXELS, rect[0] + dirty[0]);
+                glPixelStorei(GL_UNPACK_SKIP_ROWS, rect[1] + dirty[1]);
+                glTexSubImage2D(GL_TEXTURE_2D, 0, rect[0] + dirty[0], rect[1] + dirty[1], dirty[2] - dirty[0], dirty[3] - dirty[1],
+                                GL_RED_INTEGER, GL_UNSIGNED_SHORT, scan.entries.data());
+                clearDirty(scan, l);
+            }
+        }
+        glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+        glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    }
+};
+
+inline VirtualTextureCache& virtualTextures()
+{
+    static VirtualTextureCache cache;
+    return cache;
+}
+#endif
@@ -4,6 +4,8 @@ layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
 layout (location = 5) in ivec4 bone_ids;
 layout (location = 6) in vec4 weights;
+layout (location = 7) in mat4 aModel;       // visitantes de una multitud (ver crowd.h), en lugar de model
+layout (location = 11) in vec4 aClip;       // primera fila del clip, cuadros, desfase en segundos, cuadros por segundo
 
 out vec3 FragPos;
 out vec3 Normal;
@@ -13,22 +15,82 @@ uniform mat4 model;
 uniform mat4 view;
 uniform mat4 projection;
 
-const int MAX_BONES = 100;
-uniform mat4 bones[MAX_BONES];
+// Matrices de todos los personajes (ver boneBuffer.h): tres filas RGBA32F por hueso, desde bone_base
+uniform samplerBuffer bone_palette;
+uniform int bone_base;
+uniform int bone_influences;		// 2 en los personajes lejanos: solo las dos influencias más pesadas (ver animationLod.h)
+uniform bool preskinned;			// los vertices ya vienen deformados por skin.vs (ver preSkinning.h)
+
+mat4 bone(int id)
+{
+	int texel = (bone_base + id) * 3;
+	// las filas se leen como columnas y se transponen
+	return transpose(mat4(texelFetch(bone_palette, texel), texelFetch(bone_palette, texel + 1),
+		texelFetch(bone_palette, texel + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+// Multitudes: los clips horneados en una textura, un cuadro por fila con el mismo formato que el buffer de huesos
+uniform bool crowd;
+uniform sampler2D crowd_animation;
+uniform float crowd_time;
+
+mat4 crowdRows(int id, int row)
+{
+	return transpose(mat4(texelFetch(crowd_animation, ivec2(id * 3, row), 0), texelFetch(crowd_animation, ivec2(id * 3 + 1, row), 0),
+		texelFetch(crowd_animation, ivec2(id * 3 + 2, row), 0), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+mat4 crowdBone(int id)
+{
+	// el clip se repite: despues del ultimo cuadro se mezcla con el primero
+	float frame = mod((crowd_time + aClip.z) * aClip.w, aClip.y);
+	int first = int(frame);
+	int second = first + 1 < int(aClip.y) ? first + 1 : 0;
+	int row = int(aClip.x);
+	mat4 from = crowdRows(id, row + first);
+	return from + (crowdRows(id, row + second) - from) * fract(frame);
+}
 
 void main()
 {
-	mat4 bone_transform = bones[bone_ids[0]] * weights[0];
-		bone_transform += bones[bone_ids[1]] * weights[1];
-		bone_transform += bones[bone_ids[2]] * weights[2];
-		bone_transform += bones[bone_ids[3]] * weights[3];
+	mat4 bone_transform;
+	if (crowd)
+	{
+		bone_transform = crowdBone(bone_ids[0]) * weights[0];
+		bone_transform += crowdBone(bone_ids[1]) * weights[1];
+		bone_transform += crowdBone(bone_ids[2]) * weights[2];
+		bone_transform += crowdBone(bone_ids[3]) * weights[3];
+	}
+	else if (preskinned)
+		bone_transform = mat4(1.0);
+	else if (bone_influences < 4)
+	{
+		int first = 0;
+		for (int i = 1; i < 4; i++)
+			if (weights[i] > weights[first])
+				first = i;
+		int second = first == 0 ? 1 : 0;
+		for (int i = 0; i < 4; i++)
+			if (i != first && weights[i] > weights[second])
+				second = i;
+		float total = max(weights[first] + weights[second], 1e-6);
+		bone_transform = (bone(bone_ids[first]) * weights[first] + bone(bone_ids[second]) * weights[second]) / total;
+	}
+	else
+	{
+		bone_transform = bone(bone_ids[0]) * weights[0];
+		bone_transform += bone(bone_ids[1]) * weights[1];
+		bone_transform += bone(bone_ids[2]) * weights[2];
+		bone_transform += bone(bone_ids[3]) * weights[3];
+	}
+	mat4 world = crowd ? aModel : model;
 		
 	vec4 boned_position = bone_transform * vec4(aPos, 1.0); // transformed by bones
 
-    FragPos = vec3(model * bone_transform);
+    FragPos = vec3(world * bone_transform);
     //Normal = mat3(transpose(inverse(model))) * aNormal; // Calcular normales fuera del shader 
 	Normal = vec3 (bone_transform * vec4 (aNormal, 0.0)); // A lo mejor se cambia
     
-    gl_Position = projection * view * model * boned_position;
+    gl_Position = projection * view * world * boned_position;
 	TexCoords = aTexCoords;
 }
\ No newline at end of file
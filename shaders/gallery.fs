@@ -0,0 +1,242 @@
+#version 330 core
+// Paintings of the gallery (see gallery.h): the lighting of shader_Lights_mod.fs with the canvases and frame
+// finishes read from texture arrays
+out vec4 FragColor;
+
+#define NUMBER 2
+#define NUMBER_SPOT 1
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+in vec3 LayerCoords;
+flat in int OnFrame;
+
+struct DirLight
+{
+    vec3 direction;
+    
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct PointLight
+{
+    vec3 position;
+    
+    float constant;
+    float linear;
+    float quadratic;
+    
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+struct SpotLight
+{
+    vec3 position;
+    vec3 direction;
+    float cutOff;
+    float outerCutOff;
+    
+    float constant;
+    float linear;
+    float quadratic;
+    
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+};
+
+uniform vec3 viewPos;
+uniform DirLight dirLight;
+uniform PointLight pointLight[NUMBER];
+uniform SpotLight spotLight[NUMBER_SPOT];
+
+uniform sampler2DArray gallery_canvases;
+uniform sampler2DArray gallery_finishes;
+uniform float material_shininess;
+
+// painting scans are drawn from a virtual texture instead of texture_diffuse1 (see virtualTexture.h)
+#define VT_PAGE 128
+#define VT_BORDER 4
+#define VT_MAX_LEVELS 12
+uniform bool virtualTexture;
+uniform usampler2D vt_pageTable;    // per page: ( resident level << 12 ) | atlas slot
+uniform sampler2D vt_atlas;
+uniform ivec4 vt_level[VT_MAX_LEVELS];  // page table position and size in texels of every level
+uniform int vt_levelCount;
+
+// fetched once per fragment and shared by every light
+vec4 albedo;
+vec4 surface;
+vec3 specularColor;
+float shininess;
+
+// Function prototypes
+vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir );
+vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir );
+vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir );
+vec4 SampleVirtual( vec2 uv );
+
+void main()
+{    
+    //Properties needed to lighting
+    vec3 viewDir = normalize(viewPos - FragPos);
+    vec3 norm = normalize(Normal);
+
+    //Material
+    if( OnFrame == 1 )
+        albedo = texture( gallery_finishes, LayerCoords );
+    else
+        albedo = virtualTexture ? SampleVirtual( TexCoords ) : texture( gallery_canvases, LayerCoords );
+    // the defaults of materialPacker.h: no occlusion, smooth, dielectric, half specular
+    surface = vec4( 1.0, 0.0, 0.0, 0.5 );
+    specularColor = mix( vec3( surface.a ), albedo.rgb * surface.a, surface.b );
+    shininess = max( material_shininess * ( 1.0 - surface.g ), 1.0 );
+
+    //Directional lighting
+    vec3 result = CalcDirLight(dirLight, norm, viewDir);
+
+    //Point Light
+    for(int i = 0; i < NUMBER; i++)
+    {
+        result  += CalcPointLight(pointLight[i], norm, FragPos, viewDir);
+    }
+
+    // Spot light
+    for(int j = 0; j < NUMBER_SPOT; j++)
+    {
+        result += CalcSpotLight( spotLight[j], norm, FragPos, viewDir );
+    }
+    
+    vec4   texColor = vec4( result, albedo.a );
+    if(texColor.a < 0.1)
+        discard;
+    FragColor = texColor;
+}
+
+// Calculates the color when using a directional light.
+vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir )
+{
+    vec3 lightDir = normalize( -light.direction );
+    
+    // Diffuse shading
+    float diff = max( dot( normal, lightDir ), 0.0 );
+    
+    // Specular shading
+    vec3 reflectDir = reflect( -lightDir, normal );
+    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), shininess );
+    
+    // Combine results
+    vec3 ambient = light.ambient * albedo.rgb * surface.r;
+    vec3 diffuse = light.diffuse * diff * albedo.rgb;
+    vec3 specular = light.specular * spec * specularColor;
+   
+   vec3 result = ambient + diffuse + specular;
+
+    return (result);
+}
+
+// Calculates the color when using a point light.
+vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
+{
+    vec3 lightDir = normalize( light.position - fragPos );
+    
+    // Diffuse shading
+    float diff = max( dot( normal, lightDir ), 0.0 );
+    
+    // Specular shading
+    vec3 reflectDir = reflect( -lightDir, normal );
+    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), shininess );
+    
+    // Attenuation
+    float distance = length( light.position - fragPos );
+    float attenuation = 1.0f / ( light.constant + light.linear * distance + light.quadratic * ( distance * distance ) );
+    
+    // Combine results
+    vec3 ambient = light.ambient * albedo.rgb * surface.r;
+    vec3 diffuse = light.diffuse * diff * albedo.rgb;
+    vec3 specular = light.specular * spec * specularColor;
+    
+    ambient *= attenuation;
+    diffuse *= attenuation;
+    specular *= attenuation;
+
+    vec3 result=ambient + diffuse + specular;
+
+    return (result);
+    
+}
+
+// Calculates the color when using a spot light.
+vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
+{
+     vec3 lightDir = normalize( light.position - fragPos );
+    
+    // Diffuse shading
+    float diff = max( dot( normal, lightDir ), 0.0 );
+    
+    // Specular shading
+    vec3 reflectDir = reflect( -lightDir, normal );
+    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), shininess );
+    
+    // Attenuation
+    float distance = length( light.position - fragPos );
+    float attenuation = 1.0f / ( light.constant + light.linear * distance + light.quadratic * ( distance * distance ) );
+    
+    // Spotlight intensity
+    float theta = dot( lightDir, normalize( -light.direction ) );
+    float epsilon = light.cutOff - light.outerCutOff;
+    float intensity = clamp( ( theta - light.outerCutOff ) / epsilon, 0.0, 1.0 );
+    
+    // Combine results
+    vec3 ambient = light.ambient * albedo.rgb * surface.r;
+    vec3 diffuse = light.diffuse * diff * albedo.rgb;
+    vec3 specular = light.specular * spec * specularColor;
+    
+    ambient *= attenuation * intensity;
+    diffuse *= attenuation * intensity;
+    specular *= attenuation * intensity;
+    
+    return ( ambient + diffuse + specular );
+
+   
+}
+
+// Page of a level that holds uv
+ivec2 VirtualPage( vec2 uv, int level )
+{
+    ivec2 size = vt_level[level].zw;
+    return min( ivec2( uv * vec2( size ) ) / VT_PAGE, ( size - 1 ) / VT_PAGE );
+}
+
+// Samples the virtual texture: the level comes from the UV derivatives, the page table gives the atlas
+// slot of the finest resident page covering it (maybe of a coarser level while the finer one streams in)
+vec4 SampleVirtual( vec2 uv )
+{
+    vec2 texels = uv * vec2( vt_level[0].zw );
+    vec2 dx = dFdx( texels );
+    vec2 dy = dFdy( texels );
+    float lod = clamp( 0.5 * log2( max( dot( dx, dx ), dot( dy, dy ) ) ), 0.0, float( vt_levelCount - 1 ) );
+    uv = clamp( uv, 0.0, 1.0 );
+
+    int level = int( lod );
+    ivec2 page = VirtualPage( uv, level );
+    uint entry = texelFetch( vt_pageTable, vt_level[level].xy + page, 0 ).r;
+    int resident = int( entry >> 12u );
+    int slot = int( entry & 0xFFFu );
+
+    // the page of the coarser level is found like the table does it, halving the page index; levels of odd size
+    // make it differ a fraction of a texel from the one under uv, which the border covers
+    ivec2 residentSize = vt_level[resident].zw;
+    ivec2 residentPage = min( page >> ( resident - level ), ( residentSize - 1 ) / VT_PAGE );
+    vec2 inPage = clamp( uv * vec2( residentSize ) / float( VT_PAGE ) - vec2( residentPage ),
+                         -float( VT_BORDER ) / float( VT_PAGE ), 1.0 + float( VT_BORDER ) / float( VT_PAGE ) );
+    ivec2 atlasSize = textureSize( vt_atlas, 0 );
+    int slotsPerRow = atlasSize.x / ( VT_PAGE + 2 * VT_BORDER );
+    vec2 corner = vec2( slot % slotsPerRow, slot / slotsPerRow ) * float( VT_PAGE + 2 * VT_BORDER ) + float( VT_BORDER );
+    return textureLod( vt_atlas, ( corner + inPage * float( VT_PAGE ) ) / vec2( atlasSize ), 0.0 );
+}
\ No newline at end of file
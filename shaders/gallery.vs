@@ -0,0 +1,46 @@
+#version 330 core
+// Paintings of the gallery, one instance per work (see gallery.h)
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 3) in vec3 aFrame;       // how far the vertex moves out to the frame edge; z: 1 on the frame
+layout (location = 4) in mat4 aModel;
+layout (location = 8) in vec4 aSize;        // canvas half width, half height, frame half width, half height
+layout (location = 9) in vec4 aCanvas;      // UV scale of the image in its layer, layer, quarter turns
+layout (location = 10) in float aFinish;    // layer of the frame finish
+
+#define FRAME_TILING 0.15
+
+out vec3 FragPos;
+out vec3 Normal;
+out vec2 TexCoords;             // in the image as stored, what the scans use
+out vec3 LayerCoords;           // in the canvas or finish array
+flat out int OnFrame;
+
+uniform mat4 view;
+uniform mat4 projection;
+
+void main()
+{
+    vec3 local = vec3( aPos.x, aPos.y * aSize.y + aFrame.x * ( aSize.w - aSize.y ), aPos.z * aSize.x + aFrame.y * ( aSize.z - aSize.x ) );
+
+    // the image is stored turned a number of quarters clockwise
+    int turn = int( aCanvas.w );
+    vec2 st = aTexCoords;
+    TexCoords = turn == 1 ? vec2( 1.0 - st.y, st.x ) : turn == 2 ? 1.0 - st : turn == 3 ? vec2( st.y, 1.0 - st.x ) : st;
+
+    OnFrame = int( aFrame.z );
+    if( OnFrame == 1 )
+    {
+        // the wood runs along every face, at the same density whatever the size of the work
+        vec2 planar = abs( aNormal.x ) > 0.5 ? local.zy : abs( aNormal.y ) > 0.5 ? local.zx : local.xy;
+        LayerCoords = vec3( planar * FRAME_TILING, aFinish );
+    }
+    else
+        LayerCoords = vec3( TexCoords * aCanvas.xy, aCanvas.z );
+
+    FragPos = vec3( aModel * vec4( local, 1.0 ) );
+    // the works are scaled the same on every axis
+    Normal = mat3( aModel ) * aNormal;
+    gl_Position = projection * view * vec4( FragPos, 1.0 );
+}
@@ -60,14 +60,32 @@ uniform PointLight pointLight[NUMBER];
 uniform SpotLight spotLight[NUMBER_SPOT];
 //uniform Material material;
 
-uniform sampler2D material_diffuse;
-uniform sampler2D material_specular;
+uniform sampler2D texture_diffuse1;
+// packed material maps: R ambient occlusion, G roughness, B metalness, A specular intensity
+uniform sampler2D texture_material1;
 uniform float material_shininess;
 
+// painting scans are drawn from a virtual texture instead of texture_diffuse1 (see virtualTexture.h)
+#define VT_PAGE 128
+#define VT_BORDER 4
+#define VT_MAX_LEVELS 12
+uniform bool virtualTexture;
+uniform usampler2D vt_pageTable;    // per page: ( resident level << 12 ) | atlas slot
+uniform sampler2D vt_atlas;
+uniform ivec4 vt_level[VT_MAX_LEVELS];  // page table position and size in texels of every level
+uniform int vt_levelCount;
+
+// fetched once per fragment and shared by every light
+vec4 albedo;
+vec4 surface;
+vec3 specularColor;
+float shininess;
+
 // Function prototypes
 vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir );
 vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir );
 vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir );
+vec4 SampleVirtual( vec2 uv );
 
 void main()
 {    
@@ -75,6 +93,12 @@ void main()
     vec3 viewDir = normalize(viewPos - FragPos);
     vec3 norm = normalize(Normal);
 
+    //Material
+    albedo = virtualTexture ? SampleVirtual( TexCoords ) : texture( texture_diffuse1, TexCoords );
+    surface = texture( texture_material1, TexCoords );
+    specularColor = mix( vec3( surface.a ), albedo.rgb * surface.a, surface.b );
+    shininess = max( material_shininess * ( 1.0 - surface.g ), 1.0 );
+
     //Directional lighting
     vec3 result = CalcDirLight(dirLight, norm, viewDir);
 
@@ -90,7 +114,7 @@ void main()
         result += CalcSpotLight( spotLight[j], norm, FragPos, viewDir );
     }
     
-    vec4   texColor = vec4( result,texture( material_diffuse, TexCoords).a );
+    vec4   texColor = vec4( result, albedo.a );
     if(texColor.a < 0.1)
         discard;
     FragColor = texColor;
@@ -106,12 +130,12 @@ vec3 CalcDirLight( DirLight light, vec3 normal, vec3 viewDir )
     
     // Specular shading
     vec3 reflectDir = reflect( -lightDir, normal );
-    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), material_shininess );
+    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), shininess );
     
     // Combine results
-    vec3 ambient = light.ambient * vec3( texture( material_diffuse, TexCoords ).rgb );
-    vec3 diffuse = light.diffuse * diff * vec3( texture( material_diffuse, TexCoords ).rgb );
-    vec3 specular = light.specular * spec * vec3( texture( material_specular, TexCoords ).rgb );
+    vec3 ambient = light.ambient * albedo.rgb * surface.r;
+    vec3 diffuse = light.diffuse * diff * albedo.rgb;
+    vec3 specular = light.specular * spec * specularColor;
    
    vec3 result = ambient + diffuse + specular;
 
@@ -128,16 +152,16 @@ vec3 CalcPointLight( PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     
     // Specular shading
     vec3 reflectDir = reflect( -lightDir, normal );
-    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), material_shininess );
+    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), shininess );
     
     // Attenuation
     float distance = length( light.position - fragPos );
     float attenuation = 1.0f / ( light.constant + light.linear * distance + light.quadratic * ( distance * distance ) );
     
     // Combine results
-    vec3 ambient = light.ambient * vec3( texture( material_diffuse, TexCoords ).rgb );
-    vec3 diffuse = light.diffuse * diff * vec3( texture( material_diffuse, TexCoords ).rgb );
-    vec3 specular = light.specular * spec * vec3( texture( material_specular, TexCoords ).rgb );
+    vec3 ambient = light.ambient * albedo.rgb * surface.r;
+    vec3 diffuse = light.diffuse * diff * albedo.rgb;
+    vec3 specular = light.specular * spec * specularColor;
     
     ambient *= attenuation;
     diffuse *= attenuation;
@@ -159,7 +183,7 @@ vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     
     // Specular shading
     vec3 reflectDir = reflect( -lightDir, normal );
-    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), material_shininess );
+    float spec = pow( max( dot( viewDir, reflectDir ), 0.0 ), shininess );
     
     // Attenuation
     float distance = length( light.position - fragPos );
@@ -171,9 +195,9 @@ vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     float intensity = clamp( ( theta - light.outerCutOff ) / epsilon, 0.0, 1.0 );
     
     // Combine results
-    vec3 ambient = light.ambient * vec3( texture( material_diffuse, TexCoords ) );
-    vec3 diffuse = light.diffuse * diff * vec3( texture( material_diffuse, TexCoords ) );
-    vec3 specular = light.specular * spec * vec3( texture( material_specular, TexCoords ) );
+    vec3 ambient = light.ambient * albedo.rgb * surface.r;
+    vec3 diffuse = light.diffuse * diff * albedo.rgb;
+    vec3 specular = light.specular * spec * specularColor;
     
     ambient *= attenuation * intensity;
     diffuse *= attenuation * intensity;
@@ -182,4 +206,39 @@ vec3 CalcSpotLight( SpotLight light, vec3 normal, vec3 fragPos, vec3 viewDir )
     return ( ambient + diffuse + specular );
 
    
+}
+
+// Page of a level that holds uv
+ivec2 VirtualPage( vec2 uv, int level )
+{
+    ivec2 size = vt_level[level].zw;
+    return min( ivec2( uv * vec2( size ) ) / VT_PAGE, ( size - 1 ) / VT_PAGE );
+}
+
+// Samples the virtual texture: the level comes from the UV derivatives, the page table gives the atlas
+// slot of the finest resident page covering it (maybe of a coarser level while the finer one streams in)
+vec4 SampleVirtual( vec2 uv )
+{
+    vec2 texels = uv * vec2( vt_level[0].zw );
+    vec2 dx = dFdx( texels );
+    vec2 dy = dFdy( texels );
+    float lod = clamp( 0.5 * log2( max( dot( dx, dx ), dot( dy, dy ) ) ), 0.0, float( vt_levelCount - 1 ) );
+    uv = clamp( uv, 0.0, 1.0 );
+
+    int level = int( lod );
+    ivec2 page = VirtualPage( uv, level );
+    uint entry = texelFetch( vt_pageTable, vt_level[level].xy + page, 0 ).r;
+    int resident = int( entry >> 12u );
+    int slot = int( entry & 0xFFFu );
+
+    // the page of the coarser level is found like the table does it, halving the page index; levels of odd size
+    // make it differ a fraction of a texel from the one under uv, which the border covers
+    ivec2 residentSize = vt_level[resident].zw;
+    ivec2 residentPage = min( page >> ( resident - level ), ( residentSize - 1 ) / VT_PAGE );
+    vec2 inPage = clamp( uv * vec2( residentSize ) / float( VT_PAGE ) - vec2( residentPage ),
+                         -float( VT_BORDER ) / float( VT_PAGE ), 1.0 + float( VT_BORDER ) / float( VT_PAGE ) );
+    ivec2 atlasSize = textureSize( vt_atlas, 0 );
+    int slotsPerRow = atlasSize.x / ( VT_PAGE + 2 * VT_BORDER );
+    vec2 corner = vec2( slot % slotsPerRow, slot / slotsPerRow ) * float( VT_PAGE + 2 * VT_BORDER ) + float( VT_BORDER );
+    return textureLod( vt_atlas, ( corner + inPage * float( VT_PAGE ) ) / vec2( atlasSize ), 0.0 );
 }
\ No newline at end of file
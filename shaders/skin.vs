@@ -0,0 +1,52 @@
+#version 330 core
+// Pre-skinning (ver preSkinning.h): solo transform feedback, sin rasterizar. Escribe cada vertice de un
+// personaje ya deformado por sus huesos, en espacio del modelo, y las pasadas lo dibujan como geometria fija
+layout (location = 0) in vec3 aPos;
+layout (location = 1) in vec3 aNormal;
+layout (location = 2) in vec2 aTexCoords;
+layout (location = 5) in ivec4 bone_ids;
+layout (location = 6) in vec4 weights;
+
+out vec3 skinnedPosition;
+out vec3 skinnedNormal;
+out vec2 skinnedTexCoords;
+
+// Las mismas matrices y las mismas influencias que anim.vs
+uniform samplerBuffer bone_palette;
+uniform int bone_base;
+uniform int bone_influences;
+
+mat4 bone(int id)
+{
+	int texel = (bone_base + id) * 3;
+	return transpose(mat4(texelFetch(bone_palette, texel), texelFetch(bone_palette, texel + 1),
+		texelFetch(bone_palette, texel + 2), vec4(0.0, 0.0, 0.0, 1.0)));
+}
+
+void main()
+{
+	mat4 bone_transform;
+	if (bone_influences < 4)
+	{
+		int first = 0;
+		for (int i = 1; i < 4; i++)
+			if (weights[i] > weights[first])
+				first = i;
+		int second = first == 0 ? 1 : 0;
+		for (int i = 0; i < 4; i++)
+			if (i != first && weights[i] > weights[second])
+				second = i;
+		float total = max(weights[first] + weights[second], 1e-6);
+		bone_transform = (bone(bone_ids[first]) * weights[first] + bone(bone_ids[second]) * weights[second]) / total;
+	}
+	else
+	{
+		bone_transform = bone(bone_ids[0]) * weights[0];
+		bone_transform += bone(bone_ids[1]) * weights[1];
+		bone_transform += bone(bone_ids[2]) * weights[2];
+		bone_transform += bone(bone_ids[3]) * weights[3];
+	}
+	skinnedPosition = vec3(bone_transform * vec4(aPos, 1.0));
+	skinnedNormal = vec3(bone_transform * vec4(aNormal, 0.0));
+	skinnedTexCoords = aTexCoords;
+}
\ No newline at end of file
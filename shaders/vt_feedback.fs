@@ -0,0 +1,27 @@
+#version 330 core
+// Feedback pass of the virtual textures: which page each pixel of a painting scan needs (see virtualTexture.h)
+layout (location = 0) out uvec4 FragPage;
+
+in vec2 TexCoords;
+
+#define VT_PAGE 128
+#define VT_MAX_LEVELS 12
+uniform int vt_id;
+uniform ivec4 vt_level[VT_MAX_LEVELS];  // page table position and size in texels of every level
+uniform int vt_levelCount;
+uniform float vt_lodBias;               // the pass is smaller than the screen
+
+void main()
+{
+    // same level as SampleVirtual in shader_Lights_mod.fs
+    vec2 texels = TexCoords * vec2( vt_level[0].zw );
+    vec2 dx = dFdx( texels );
+    vec2 dy = dFdy( texels );
+    float lod = clamp( 0.5 * log2( max( dot( dx, dx ), dot( dy, dy ) ) ) + vt_lodBias, 0.0, float( vt_levelCount - 1 ) );
+    vec2 uv = clamp( TexCoords, 0.0, 1.0 );
+
+    int level = int( lod );
+    ivec2 size = vt_level[level].zw;
+    ivec2 page = min( ivec2( uv * vec2( size ) ) / VT_PAGE, ( size - 1 ) / VT_PAGE );
+    FragPage = uvec4( uint( vt_id ), uint( level ), uvec2( page ) );
+}